@@ -20,6 +20,8 @@ enum class ContentID : uint8_t {
   LIFTOFF_APOGEE = 0x03,   // 離床 or 頂点検知通知
   VOLTAGE = 0x04,          // 電圧送信
   QUATERNION = 0x05,       // クオータニオン送信
+  PIPELINE_STATUS = 0x06,  // ロギング経路の状態送信(開放基板)
+  SETTINGS_STATUS = 0x07,  // 設定の保存結果の送信(開放基板)
 };
 
 /**
@@ -58,4 +60,37 @@ enum class ServoCommand : uint8_t {
 enum class ParaStatus : uint8_t {
   APOGEE_DETECTED = 'y',  // 頂点検知通知
   LIFTOFF_DETECT = 'x',   // 離床検知通知
-};
\ No newline at end of file
+};
+
+// ロギング経路の状態送信(通信内容ID:0x06)
+// LOGGINGモード中に開放基板から定期的に送信する(8byte、リトルエンディアン)
+// 値が上限を超えた場合は上限値で止める
+struct PipelineStatusFrame {
+  // 取りこぼし数(uint16)
+  static constexpr uint8_t DROPPED_OFFSET = 0;
+  // 取得遅れ数(uint16)
+  static constexpr uint8_t LATE_OFFSET = 2;
+  // 取得できなかった周期の数(uint16)
+  static constexpr uint8_t OVERRUN_OFFSET = 4;
+  // リングバッファの最大使用率(%)
+  static constexpr uint8_t MAX_QUEUE_PERCENT_OFFSET = 6;
+  // ログバッファ待ちの回数(uint8)
+  static constexpr uint8_t BUFFER_STALL_OFFSET = 7;
+  static constexpr uint8_t LENGTH = 8;
+};
+
+// 設定の保存結果の送信(通信内容ID:0x07)
+// モード遷移やサーボ角度の変更で要求した設定の保存が終わった時に、開放基板から送信する
+// (8byte、リトルエンディアン)
+// モード遷移は設定の保存を待たずに完了し、保存済みになったことはこれで知らせる
+struct SettingsStatusFrame {
+  // 保存した要求の番号(uint32、起動からの通し番号)
+  static constexpr uint8_t GENERATION_OFFSET = 0;
+  // 1なら保存済み(durable)、0なら再試行しても保存できなかった
+  static constexpr uint8_t DURABLE_OFFSET = 4;
+  // 書き込みを試みた回数(uint8)
+  static constexpr uint8_t ATTEMPTS_OFFSET = 5;
+  // 要求から完了までの時間(ms、uint16)
+  static constexpr uint8_t ELAPSED_MS_OFFSET = 6;
+  static constexpr uint8_t LENGTH = 8;
+};
@@ -25,7 +25,9 @@ bool CommandHandler::init(CanComm* can_comm_ptr, SdController* logger_ptr,
                           SensorTaskHandler* sensor_handler_ptr,
                           LogTaskHandler* log_handler_ptr,
                           ServoController* servo_controller_ptr,
-                          LedController* led_controller_ptr) {
+                          LedController* led_controller_ptr,
+                          EventJournal* journal_ptr,
+                          SettingsWriter* settings_writer_ptr) {
   // UARTモードの場合はcan_commがnullptrでも許容する
   if (can_comm_ptr == nullptr) {
     ESP_LOGW(
@@ -64,6 +66,14 @@ bool CommandHandler::init(CanComm* can_comm_ptr, SdController* logger_ptr,
   log_handler = log_handler_ptr;
   servo_controller = servo_controller_ptr;
   led_controller = led_controller_ptr;
+  journal = journal_ptr;
+  settings_writer = settings_writer_ptr;
+
+  // 設定の保存が終わったら、イベントジャーナルへの記録と通知を行う
+  if (settings_writer != nullptr) {
+    settings_writer->setDoneCallback(
+        [this](const SettingsSaveResult& result) { onSettingsSaved(result); });
+  }
 
   // SDカードから通信モードを読み込む
   std::string comm_mode_str = logger->getStringSetting("comm_mode", "can");
@@ -89,6 +99,9 @@ void CommandHandler::setupModeManager() {
       ModeCommand::START,
       [this](ModeCommand previous_mode, ModeCommand next_mode) {
         ESP_LOGI(TAG, "Changing to START mode");
+        recordEvent(LogFormat::EventType::MODE_CHANGE,
+                    static_cast<uint8_t>(next_mode),
+                    static_cast<uint8_t>(previous_mode));
 
         // ログバッファをフラッシュして、ファイル操作の競合を減らす
         if (log_handler != nullptr && logger != nullptr) {
@@ -99,37 +112,8 @@ void CommandHandler::setupModeManager() {
         logger->setBoolSetting("is_logging_mode", false);
         ESP_LOGI(TAG, "is_logging_mode set to false");
 
-        // 設定の保存を試みる（改善版）
-        int retry_count = 0;
-        const int max_retries = 3;
-        bool save_success = false;
-
-        while (retry_count < max_retries && !save_success) {
-          // 少し待機してから再試行
-          if (retry_count > 0) {
-            ESP_LOGI(TAG, "Retrying settings save (attempt %d/%d)...",
-                     retry_count + 1, max_retries);
-            vTaskDelay(
-                pdMS_TO_TICKS(500 * retry_count));  // 待機時間を徐々に増やす
-          }
-
-          save_success = logger->saveSettings();
-
-          if (!save_success) {
-            ESP_LOGW(TAG, "Failed to save settings (attempt %d/%d)",
-                     retry_count + 1, max_retries);
-            retry_count++;
-          }
-        }
-
-        if (save_success) {
-          ESP_LOGI(TAG, "Settings saved to SD card successfully");
-        } else {
-          ESP_LOGE(
-              TAG,
-              "Failed to save settings after %d attempts, continuing anyway",
-              max_retries);
-        }
+        // 設定の保存は保存タスクに任せ、完了を待たずに進める
+        requestSettingsSave();
 
         // STARTモードのLED点滅パターンを設定
         if (led_controller->getBlinkTaskHandle() == nullptr) {
@@ -155,47 +139,35 @@ void CommandHandler::setupModeManager() {
       ModeCommand::LOGGING,
       [this](ModeCommand previous_mode, ModeCommand next_mode) {
         ESP_LOGI(TAG, "Changing to LOGGING mode");
+        recordEvent(LogFormat::EventType::MODE_CHANGE,
+                    static_cast<uint8_t>(next_mode),
+                    static_cast<uint8_t>(previous_mode));
 
         // ログバッファをフラッシュして、ファイル操作の競合を減らす
         if (log_handler != nullptr && logger != nullptr) {
           logger->flush();
         }
 
+        // ログファイルを開く（事前確保する場合はここで領域を確保する）
+        if (logger->openLogFile()) {
+          recordEvent(LogFormat::EventType::LOG_OPENED, 0,
+                      logger->getIntSetting("log_sequence", 0));
+        } else {
+          ESP_LOGE(TAG, "Failed to open log file");
+          recordEvent(LogFormat::EventType::ERROR,
+                      static_cast<uint8_t>(
+                          LogFormat::EventError::LOG_OPEN_FAILED));
+        }
+
         // LOGGINGモードに移行したらis_logging_modeをtrueに設定
         logger->setBoolSetting("is_logging_mode", true);
         ESP_LOGI(TAG, "is_logging_mode set to true");
 
-        // 設定の保存を試みる（改善版）
-        int retry_count = 0;
-        const int max_retries = 3;
-        bool save_success = false;
-
-        while (retry_count < max_retries && !save_success) {
-          // 少し待機してから再試行
-          if (retry_count > 0) {
-            ESP_LOGI(TAG, "Retrying settings save (attempt %d/%d)...",
-                     retry_count + 1, max_retries);
-            vTaskDelay(
-                pdMS_TO_TICKS(500 * retry_count));  // 待機時間を徐々に増やす
-          }
-
-          save_success = logger->saveSettings();
+        // 設定の保存は保存タスクに任せ、完了を待たずに進める
+        requestSettingsSave();
 
-          if (!save_success) {
-            ESP_LOGW(TAG, "Failed to save settings (attempt %d/%d)",
-                     retry_count + 1, max_retries);
-            retry_count++;
-          }
-        }
-
-        if (save_success) {
-          ESP_LOGI(TAG, "Settings saved to SD card successfully");
-        } else {
-          ESP_LOGE(
-              TAG,
-              "Failed to save settings after %d attempts, continuing anyway",
-              max_retries);
-        }
+        // 取りこぼし等の統計とサンプル番号をリセットする
+        sensor_handler->resetPipelineStats();
 
         // センサータスクとログタスクを開始
         if (sensor_handler->getTaskHandle() != nullptr) {
@@ -220,6 +192,8 @@ void CommandHandler::setupModeManager() {
         }
 
         log_handler->startTask();
+        // モード変更の時点（ファイルのヘッダ）までをSDカードへ同期させる
+        log_handler->requestSync();
 
         // LOGGINGモードのLED点滅パターンを設定
         if (led_controller->getBlinkTaskHandle() == nullptr) {
@@ -246,6 +220,23 @@ void CommandHandler::setupModeManager() {
           }
         }
         log_handler->stopTask();
+
+        // 今回のロギングの統計を残しておく
+        PipelineStats stats = sensor_handler->getPipelineStats();
+        ESP_LOGI(TAG,
+                 "Pipeline: samples=%lu, dropped=%lu, late=%lu, overrun=%lu, "
+                 "duplicate=%lu, skipped=%lu, watchdog=%lu, baro_stale=%lu",
+                 (unsigned long)stats.samples, (unsigned long)stats.dropped,
+                 (unsigned long)stats.late, (unsigned long)stats.overrun,
+                 (unsigned long)stats.duplicate, (unsigned long)stats.skipped,
+                 (unsigned long)stats.watchdog,
+                 (unsigned long)stats.baro_stale);
+
+        // ログファイルを閉じる（事前確保した領域は実際の長さに切り詰める）
+        logger->closeLogFile();
+        recordEvent(LogFormat::EventType::LOG_CLOSED, 0, stats.samples,
+                    stats.dropped);
+
         printf("Mode changed from %s\n",
                ModeManager::getModeString(previous_mode).c_str());
       });
@@ -360,8 +351,23 @@ void CommandHandler::processUartCommand(int cmd_uart) {
           esp_timer_get_time() / 1000;  // マイクロ秒からミリ秒に変換
       printf("Time since launch: %lld ms\n", current_time - launch_time);
     }
+  } else if (cmd_uart == 'B' || cmd_uart == 'b') {
+    // SDカードの書き込みベンチマーク（STARTモードの時のみ）
+    if (mode_manager->getMode() != ModeCommand::START) {
+      printf("Benchmark is only available in START mode\n");
+    } else {
+      logger->runWriteBenchmark();
+    }
+  } else if (cmd_uart == 'N') {
+    // ログファイル名を決める時間のベンチマーク（STARTモードの時のみ）
+    // ('n'はサーボの角度調整に使っている)
+    if (mode_manager->getMode() != ModeCommand::START) {
+      printf("Benchmark is only available in START mode\n");
+    } else {
+      logger->runNamingBenchmark();
+    }
   } else if (cmd_uart == 'S' || cmd_uart == 's') {
-    // センサー状態の概要表示
+    // センサー状態とロギング経路の状態の概要表示
     bool is_launched = sensor_handler->getIsLaunched();
     bool has_reached_apogee = sensor_handler->getHasReachedApogee();
     printf("Sensor status:\n");
@@ -376,6 +382,84 @@ void CommandHandler::processUartCommand(int cmd_uart) {
       printf("- Launch time: %lld ms (elapsed: %lld ms)\n", launch_time,
              current_time - launch_time);
     }
+    printPipelineStatus();
+  }
+}
+
+void CommandHandler::printPipelineStatus() {
+  PipelineStats stats = sensor_handler->getPipelineStats();
+  LogBufferStats buffer_stats = log_handler->getBufferStats();
+  printf("Logging pipeline (since LOGGING started):\n");
+  printf("- Samples: %lu (dropped: %lu, late: %lu, overrun: %lu)\n",
+         (unsigned long)stats.samples, (unsigned long)stats.dropped,
+         (unsigned long)stats.late, (unsigned long)stats.overrun);
+  printf("- Max sample interval: %lu us\n",
+         (unsigned long)stats.max_interval_us);
+  printf("- ICM samples: duplicate %lu, skipped %lu (%s, watchdog %lu)\n",
+         (unsigned long)stats.duplicate, (unsigned long)stats.skipped,
+         sensor_handler->isInterruptMode() ? "INT1" : "timer",
+         (unsigned long)stats.watchdog);
+  printf("- Baro stale reads: %lu\n", (unsigned long)stats.baro_stale);
+  if (log_handler->isPretriggerEnabled()) {
+    printf("- Pretrigger: %s\n", log_handler->isTriggered()
+                                      ? "TRIGGERED (recording)"
+                                      : "WAITING (not writing to SD)");
+  }
+  printf("- Ring: %u/%u now, max %u\n",
+         (unsigned)log_handler->getQueuedCount(),
+         (unsigned)log_handler->getQueueCapacity(),
+         (unsigned)log_handler->getMaxQueuedCount());
+  printf("- Buffers: written %lu, max full %lu, stalls %lu, "
+         "max write %lld us\n",
+         (unsigned long)buffer_stats.buffers_written,
+         (unsigned long)buffer_stats.max_full_buffers,
+         (unsigned long)buffer_stats.stall_count, buffer_stats.max_write_us);
+  FlushStats flush_stats = log_handler->getFlushStats();
+  printf("- Syncs (limit %u bytes / %lu ms): bytes %lu, age %lu, event %lu, "
+         "stop %lu\n",
+         (unsigned)log_handler->getFlushMaxPendingBytes(),
+         (unsigned long)log_handler->getFlushMaxAgeMs(),
+         (unsigned long)flush_stats.syncs[(int)FlushReason::BYTES],
+         (unsigned long)flush_stats.syncs[(int)FlushReason::AGE],
+         (unsigned long)flush_stats.syncs[(int)FlushReason::EVENT],
+         (unsigned long)flush_stats.syncs[(int)FlushReason::STOP]);
+  printf("- Max unsynced: %lld ms / %u bytes, max sync %lld us\n",
+         flush_stats.max_unsynced_us / 1000,
+         (unsigned)flush_stats.max_pending_bytes, flush_stats.max_sync_us);
+  printf("SD card I/O (since LOGGING started):\n");
+  logger->printIoStats(stdout);
+}
+
+void CommandHandler::sendPipelineStatus() {
+  PipelineStats stats = sensor_handler->getPipelineStats();
+  LogBufferStats buffer_stats = log_handler->getBufferStats();
+
+  // 上限を超えた値は上限値で止める
+  auto saturate16 = [](uint32_t value) -> uint16_t {
+    return value > UINT16_MAX ? UINT16_MAX : value;
+  };
+  auto put16 = [](uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+  };
+
+  uint8_t data[PipelineStatusFrame::LENGTH];
+  put16(&data[PipelineStatusFrame::DROPPED_OFFSET], saturate16(stats.dropped));
+  put16(&data[PipelineStatusFrame::LATE_OFFSET], saturate16(stats.late));
+  put16(&data[PipelineStatusFrame::OVERRUN_OFFSET], saturate16(stats.overrun));
+  size_t capacity = log_handler->getQueueCapacity();
+  data[PipelineStatusFrame::MAX_QUEUE_PERCENT_OFFSET] =
+      capacity > 0 ? log_handler->getMaxQueuedCount() * 100 / capacity : 0;
+  data[PipelineStatusFrame::BUFFER_STALL_OFFSET] =
+      buffer_stats.stall_count > UINT8_MAX ? UINT8_MAX
+                                           : buffer_stats.stall_count;
+  can_comm->send(ContentID::PIPELINE_STATUS, data, sizeof(data));
+}
+
+void CommandHandler::recordEvent(LogFormat::EventType type, uint8_t detail,
+                                 int32_t value0, int32_t value1) {
+  if (journal != nullptr) {
+    journal->record(type, detail, value0, value1);
   }
 }
 
@@ -396,11 +480,17 @@ void CommandHandler::processServoCommand(ServoCommand servo_command) {
       printf("OPEN_SERVO\n");
       // サーボを開く
       servo_controller->openServo(open_angle);
+      recordEvent(LogFormat::EventType::SERVO,
+                  static_cast<uint8_t>(LogFormat::ServoAction::OPEN),
+                  open_angle, 1);
       break;
     case ServoCommand::CLOSE_SERVO:
       printf("CLOSE_SERVO\n");
       // サーボを閉じる
       servo_controller->closeServo(close_angle);
+      recordEvent(LogFormat::EventType::SERVO,
+                  static_cast<uint8_t>(LogFormat::ServoAction::CLOSE),
+                  close_angle, 1);
       break;
     case ServoCommand::OPEN_ANGLE_MINUS_1:
       printf("OPEN_ANGLE_MINUS_1\n");
@@ -410,6 +500,9 @@ void CommandHandler::processServoCommand(ServoCommand servo_command) {
       settings_changed = true;
       // 現在のモードがSTARTの場合は、サーボの角度も更新する
       servo_controller->openServo(open_angle);
+      recordEvent(LogFormat::EventType::SERVO,
+                  static_cast<uint8_t>(LogFormat::ServoAction::OPEN),
+                  open_angle, 1);
       break;
     case ServoCommand::OPEN_ANGLE_PLUS_1:
       printf("OPEN_ANGLE_PLUS_1\n");
@@ -419,6 +512,9 @@ void CommandHandler::processServoCommand(ServoCommand servo_command) {
       settings_changed = true;
       // 現在のモードがSTARTの場合は、サーボの角度も更新する
       servo_controller->openServo(open_angle);
+      recordEvent(LogFormat::EventType::SERVO,
+                  static_cast<uint8_t>(LogFormat::ServoAction::OPEN),
+                  open_angle, 1);
       break;
     case ServoCommand::CLOSE_ANGLE_PLUS:
       printf("CLOSE_ANGLE_PLUS\n");
@@ -438,24 +534,62 @@ void CommandHandler::processServoCommand(ServoCommand servo_command) {
       break;
   }
 
-  // 設定が変更された場合、SDカードに保存する
+  // 設定が変更された場合、SDカードへの保存を要求する（完了は待たない）
   if (settings_changed) {
-    // 設定の保存を試みるが、失敗しても続行
+    ESP_LOGI(TAG, "Open angle: %d, Close angle: %d", open_angle, close_angle);
+    requestSettingsSave();
+  }
+}
+
+void CommandHandler::requestSettingsSave() {
+  if (settings_writer == nullptr) {
+    // 保存タスクがなければ、このタスクで保存する
     if (logger->saveSettings()) {
-      ESP_LOGI(TAG, "Servo settings saved to SD card");
-      // 変更後の値をログに出力
-      ESP_LOGI(TAG, "Open angle: %d, Close angle: %d",
-               logger->getIntSetting("open-angle"),
-               logger->getIntSetting("close-angle"));
+      ESP_LOGI(TAG, "Settings saved to SD card successfully");
     } else {
-      ESP_LOGW(TAG,
-               "Failed to save servo settings to SD card, but continuing with "
-               "updated values in memory");
-      // 変更後の値をログに出力（メモリ上の値）
-      ESP_LOGI(TAG, "Open angle (in memory): %d, Close angle (in memory): %d",
-               open_angle, close_angle);
+      ESP_LOGE(TAG, "Failed to save settings, continuing anyway");
+      recordEvent(
+          LogFormat::EventType::ERROR,
+          static_cast<uint8_t>(LogFormat::EventError::SETTINGS_SAVE_FAILED));
     }
+    return;
   }
+  uint32_t generation = settings_writer->requestSave();
+  ESP_LOGI(TAG, "Settings save requested (request %lu)",
+           (unsigned long)generation);
+}
+
+void CommandHandler::onSettingsSaved(const SettingsSaveResult& result) {
+  if (result.durable) {
+    recordEvent(LogFormat::EventType::SETTINGS_SAVED, 0, result.generation,
+                result.elapsed_ms);
+  } else {
+    recordEvent(
+        LogFormat::EventType::ERROR,
+        static_cast<uint8_t>(LogFormat::EventError::SETTINGS_SAVE_FAILED),
+        result.generation);
+  }
+
+  if (comm_mode == CommMode::UART || can_comm == nullptr) {
+    printf("Settings %s (request %lu, %u attempts, %lu ms)\n",
+           result.durable ? "durable" : "NOT saved",
+           (unsigned long)result.generation, (unsigned)result.attempts,
+           (unsigned long)result.elapsed_ms);
+    return;
+  }
+
+  uint8_t data[SettingsStatusFrame::LENGTH];
+  uint32_t generation = result.generation;
+  for (int i = 0; i < 4; i++) {
+    data[SettingsStatusFrame::GENERATION_OFFSET + i] = generation >> (8 * i);
+  }
+  data[SettingsStatusFrame::DURABLE_OFFSET] = result.durable ? 1 : 0;
+  data[SettingsStatusFrame::ATTEMPTS_OFFSET] = result.attempts;
+  uint16_t elapsed_ms =
+      result.elapsed_ms > UINT16_MAX ? UINT16_MAX : result.elapsed_ms;
+  data[SettingsStatusFrame::ELAPSED_MS_OFFSET] = elapsed_ms & 0xFF;
+  data[SettingsStatusFrame::ELAPSED_MS_OFFSET + 1] = elapsed_ms >> 8;
+  can_comm->send(ContentID::SETTINGS_STATUS, data, sizeof(data));
 }
 
 void CommandHandler::commandTask(void* pvParameters) {
@@ -475,6 +609,7 @@ void CommandHandler::commandTask(void* pvParameters) {
   }
 
   CanRxFrame receive_frame;
+  int64_t last_status_us = esp_timer_get_time();
 
   while (true) {
     if (self->comm_mode == CommMode::CAN) {
@@ -482,6 +617,15 @@ void CommandHandler::commandTask(void* pvParameters) {
       if (self->can_comm->readFrameNoWait(receive_frame) == ESP_OK) {
         self->processCanCommand(receive_frame);
       }
+
+      // LOGGINGモード中は定期的にロギング経路の状態を送信する
+      int64_t now_us = esp_timer_get_time();
+      if (now_us - last_status_us >= PIPELINE_STATUS_INTERVAL_US) {
+        last_status_us = now_us;
+        if (self->mode_manager->getMode() == ModeCommand::LOGGING) {
+          self->sendPipelineStatus();
+        }
+      }
     } else {
       // UARTからのコマンド受信
       int cmd_uart = getchar();
@@ -5,6 +5,7 @@
 #include "CanComm.hpp"
 #include "config.hpp"
 #include "esp_log.h"
+#include "event_journal.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "led_controller.hpp"
@@ -13,6 +14,7 @@
 #include "sd_controller.hpp"
 #include "sensor_task_handler.hpp"
 #include "servo_controller.hpp"
+#include "settings_writer.hpp"
 
 class CommandHandler {
  public:
@@ -27,11 +29,16 @@ class CommandHandler {
    * @param log_handler ログタスクハンドラへのポインタ
    * @param servo_controller サーボコントローラーへのポインタ
    * @param led_controller LEDコントローラーへのポインタ
+   * @param journal イベントジャーナルへのポインタ（nullptrなら記録しない）
+   * @param settings_writer 設定の保存タスクへのポインタ
+   * （nullptrならコマンドタスクで保存を待つ）
    * @return 初期化が成功したかどうか
    */
   bool init(CanComm* can_comm, SdController* logger,
             SensorTaskHandler* sensor_handler, LogTaskHandler* log_handler,
-            ServoController* servo_controller, LedController* led_controller);
+            ServoController* servo_controller, LedController* led_controller,
+            EventJournal* journal = nullptr,
+            SettingsWriter* settings_writer = nullptr);
 
   /**
    * @brief コマンド受信タスクを開始する
@@ -60,6 +67,8 @@ class CommandHandler {
   static constexpr int TASK_STACK_SIZE = 4096;
   static constexpr int TASK_PRIORITY = 5;
   static constexpr int UART_DELAY_MS = 10;
+  // LOGGINGモード中にロギング経路の状態をCANで送信する間隔
+  static constexpr int64_t PIPELINE_STATUS_INTERVAL_US = 1000 * 1000;
 
   // モードに応じたLEDの点滅パターン
   static constexpr uint32_t START_MODE_LED_ON_TIME_MS = 1500;
@@ -75,6 +84,8 @@ class CommandHandler {
   ServoController* servo_controller = nullptr;
   LedController* led_controller = nullptr;
   ModeManager* mode_manager = nullptr;
+  EventJournal* journal = nullptr;
+  SettingsWriter* settings_writer = nullptr;
 
   // 通信モードの列挙型
   enum class CommMode { CAN, UART };
@@ -104,6 +115,34 @@ class CommandHandler {
    */
   void processServoCommand(ServoCommand servo_command);
 
+  /**
+   * @brief 現在の設定の保存を要求する（保存タスクがあれば待たない）
+   */
+  void requestSettingsSave();
+
+  /**
+   * @brief 設定の保存が終わった時に、イベントジャーナルに記録し、CAN（またはUART）で知らせる
+   * 保存タスクから呼ばれる
+   * @param result 保存の結果
+   */
+  void onSettingsSaved(const SettingsSaveResult& result);
+
+  /**
+   * @brief イベントジャーナルに記録する（ジャーナルがなければ何もしない）
+   */
+  void recordEvent(LogFormat::EventType type, uint8_t detail = 0,
+                   int32_t value0 = 0, int32_t value1 = 0);
+
+  /**
+   * @brief ロギング経路の状態（取りこぼし・遅れ・バッファ使用状況）を表示する
+   */
+  void printPipelineStatus();
+
+  /**
+   * @brief ロギング経路の状態をCANで送信する
+   */
+  void sendPipelineStatus();
+
   /**
    * @brief コマンド受信タスク関数
    * @param pvParameters タスクパラメータ
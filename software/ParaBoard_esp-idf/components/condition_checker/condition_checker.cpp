@@ -8,6 +8,8 @@ ConditionChecker::ConditionChecker()
     : is_launched(false),
       has_reached_apogee(false),
       launch_time(0),
+      launch_info{},
+      apogee_info{},
       accel_data_count_for_check_launch(0),
       accel_increase_count_for_check_launch(0),
       pressure_decrease_count_for_check_launch(0),
@@ -17,7 +19,9 @@ ConditionChecker::ConditionChecker()
       pressure_increase_count_for_check_apogee(0),
       pressure_sum_for_check_apogee(0),
       pressure_data_count_for_check_apogee(0),
-      last_pressure_av_for_check_apogee(0) {
+      last_pressure_av_for_check_apogee(0),
+      pressure_detection(ConditionConfig::pressureDetectionFor(
+          ConditionConfig::PRESSURE_TUNED_ODR_MHZ)) {
   accel_sum_for_check_launch[0] = 0.0f;
   accel_sum_for_check_launch[1] = 0.0f;
   accel_sum_for_check_launch[2] = 0.0f;
@@ -29,6 +33,8 @@ void ConditionChecker::begin() {
   is_launched = false;
   has_reached_apogee = false;
   launch_time = 0;
+  launch_info = {};
+  apogee_info = {};
   pressure_decrease_count_for_check_launch = 0;
   pressure_increase_count_for_check_apogee = 0;
   accel_increase_count_for_check_launch = 0;
@@ -46,6 +52,30 @@ void ConditionChecker::begin() {
   ESP_LOGI(TAG, "ConditionChecker initialized");
 }
 
+void ConditionChecker::setPressureRate(uint32_t odr_mhz) {
+  pressure_detection = ConditionConfig::pressureDetectionFor(odr_mhz);
+
+  // 途中まで溜めた平均はデータの数が変わると使えないので、最初から取り直す
+  pressure_sum_for_check_launch = 0;
+  pressure_data_count_for_check_launch = 0;
+  last_pressure_av_for_check_launch = 0;
+  pressure_decrease_count_for_check_launch = 0;
+  pressure_sum_for_check_apogee = 0;
+  pressure_data_count_for_check_apogee = 0;
+  last_pressure_av_for_check_apogee = 0;
+  pressure_increase_count_for_check_apogee = 0;
+
+  ESP_LOGI(TAG,
+           "Pressure detection at %.1f Hz: %lu-sample mean (%lu ms), "
+           "launch %lu x %.2f, apogee %lu x %.2f",
+           odr_mhz / 1000.0f, (unsigned long)pressure_detection.data_count,
+           (unsigned long)pressure_detection.window_ms,
+           (unsigned long)pressure_detection.launch_count,
+           pressure_detection.launch_threshold,
+           (unsigned long)pressure_detection.apogee_count,
+           pressure_detection.apogee_threshold);
+}
+
 bool ConditionChecker::checkLaunchByAccel(float accel_x, float accel_y,
                                           float accel_z) {
   // すでに離床検知している場合
@@ -89,6 +119,7 @@ bool ConditionChecker::checkLaunchByAccel(float accel_x, float accel_y,
         ConditionConfig::ACCEL_INCREASE_COUNT_THRESHOLD_FOR_LAUNCH) {
       ESP_LOGI(TAG, "Launch detected by accel");
       is_launched = true;
+      launch_info = {LogFormat::EventSource::ACCEL, accel_av_square_sum, 0};
     }
 
     // データをリセット
@@ -108,10 +139,9 @@ bool ConditionChecker::checkLaunchByPressure(float pressure) {
   }
   pressure_sum_for_check_launch += pressure;
 
-  if (pressure_data_count_for_check_launch ==
-      ConditionConfig::NUMBER_OF_PRESSURE_DATA_FOR_LAUNCH) {
-    float pressure_av = pressure_sum_for_check_launch /
-                        ConditionConfig::NUMBER_OF_PRESSURE_DATA_FOR_LAUNCH;
+  if (pressure_data_count_for_check_launch == pressure_detection.data_count) {
+    float pressure_av =
+        pressure_sum_for_check_launch / pressure_detection.data_count;
 
     // 初回は前回の平均値がないので、現在の平均値を設定して終了
     if (last_pressure_av_for_check_launch == 0) {
@@ -129,7 +159,7 @@ bool ConditionChecker::checkLaunchByPressure(float pressure) {
         pressure_av, pressure_diff);
 
     if (pressure_diff > 0 &&
-        pressure_diff > ConditionConfig::PRESSURE_AV_THRESHOLD_FOR_LAUNCH) {
+        pressure_diff > pressure_detection.launch_threshold) {
       pressure_decrease_count_for_check_launch++;
     } else {
       pressure_decrease_count_for_check_launch = 0;
@@ -138,10 +168,12 @@ bool ConditionChecker::checkLaunchByPressure(float pressure) {
     last_pressure_av_for_check_launch = pressure_av;
 
     if (pressure_decrease_count_for_check_launch >=
-        ConditionConfig::PRESSURE_DECREASE_COUNT_THRESHOLD_FOR_LAUNCH) {
+        pressure_detection.launch_count) {
       ESP_LOGI(TAG, "Launch detected by pressure");
       is_launched = true;
       launch_time = esp_timer_get_time() / 1000;  // マイクロ秒からミリ秒に変換
+      launch_info = {LogFormat::EventSource::PRESSURE, pressure_av,
+                     pressure_diff};
     }
 
     pressure_sum_for_check_launch = 0;
@@ -163,10 +195,9 @@ bool ConditionChecker::checkApogeeByPressure(float pressure) {
 
   pressure_sum_for_check_apogee += pressure;
 
-  if (pressure_data_count_for_check_apogee ==
-      ConditionConfig::NUMBER_OF_PRESSURE_DATA_FOR_APOGEE) {
-    float pressure_av = pressure_sum_for_check_apogee /
-                        ConditionConfig::NUMBER_OF_PRESSURE_DATA_FOR_APOGEE;
+  if (pressure_data_count_for_check_apogee == pressure_detection.data_count) {
+    float pressure_av =
+        pressure_sum_for_check_apogee / pressure_detection.data_count;
 
     // 初回は前回の平均値がないので、現在の平均値を設定して終了
     if (last_pressure_av_for_check_apogee == 0) {
@@ -183,8 +214,7 @@ bool ConditionChecker::checkApogeeByPressure(float pressure) {
              pressure_av, pressure_diff);
 
     if (pressure_diff > 0 &&
-        pressure_diff >
-            ConditionConfig::PRESSURE_AV_DIFFERENCE_THRESHOLD_FOR_APOGEE) {
+        pressure_diff > pressure_detection.apogee_threshold) {
       pressure_increase_count_for_check_apogee++;
     } else {
       pressure_increase_count_for_check_apogee = 0;
@@ -193,9 +223,11 @@ bool ConditionChecker::checkApogeeByPressure(float pressure) {
     last_pressure_av_for_check_apogee = pressure_av;
 
     if (pressure_increase_count_for_check_apogee >=
-        ConditionConfig::PRESSURE_INCREASE_COUNT_THRESHOLD_FOR_APOGEE) {
+        pressure_detection.apogee_count) {
       ESP_LOGI(TAG, "Apogee detected by pressure");
       has_reached_apogee = true;
+      apogee_info = {LogFormat::EventSource::PRESSURE, pressure_av,
+                     pressure_diff};
     }
 
     pressure_sum_for_check_apogee = 0;
@@ -222,6 +254,8 @@ bool ConditionChecker::checkApogeeByTimer() {
       ConditionConfig::TIME_THRESHOLD_FOR_APOGEE_FROM_LAUNCH) {
     ESP_LOGI(TAG, "Apogee reached by timer");
     has_reached_apogee = true;
+    apogee_info = {LogFormat::EventSource::TIMER,
+                   (float)(current_time - launch_time), 0};
   }
 
   return has_reached_apogee;
@@ -4,6 +4,16 @@
 
 #include "config.hpp"
 #include "esp_log.h"
+#include "event_format.hpp"
+
+/**
+ * @brief 離床・頂点を検知した条件と、その時の値
+ */
+struct DetectionInfo {
+  LogFormat::EventSource source;  // 検知した条件（未検知ならNONE）
+  float value;  // 加速度: 平均の2乗和(g^2), 気圧: 平均(hPa), タイマー: 離床からの経過時間(ms)
+  float delta;  // 気圧: 前回の平均からの変化量(hPa)、それ以外は0
+};
 
 class ConditionChecker {
  public:
@@ -15,6 +25,20 @@ class ConditionChecker {
    */
   void begin();
 
+  /**
+   * @brief LPSの出力データレートに合わせて、気圧による判定のデータの数・回数・閾値を換算する
+   * 途中まで溜めた気圧の平均は捨てる（離床・頂点の検知の状態は変えない）
+   * @param odr_mhz LPSの出力データレート(mHz)
+   */
+  void setPressureRate(uint32_t odr_mhz);
+
+  /**
+   * @brief 判定に使っている気圧のデータの数・回数・閾値を取得する
+   */
+  ConditionConfig::PressureDetection getPressureDetection() const {
+    return pressure_detection;
+  }
+
   /**
    * @brief 加速度による離床検知
    * @param accel_x X軸加速度
@@ -29,7 +53,7 @@ class ConditionChecker {
    * @brief 気圧による離床検知
    * @param pressure 気圧値
    * @return 離床検知したかどうか
-   * @note 25Hzで呼び出すことを想定
+   * @note LPSの出力データレート（setPressureRate()）ごとに呼び出すことを想定
    */
   bool checkLaunchByPressure(float pressure);
 
@@ -38,7 +62,7 @@ class ConditionChecker {
    * @param pressure 気圧値
    * @return 頂点検知したかどうか
    * @note 離床検知をしていないときはfalseを返す
-   * @note 25Hzで呼び出すことを想定
+   * @note LPSの出力データレート（setPressureRate()）ごとに呼び出すことを想定
    */
   bool checkApogeeByPressure(float pressure);
 
@@ -68,6 +92,18 @@ class ConditionChecker {
    */
   int64_t getLaunchTime() const;
 
+  /**
+   * @brief 離床を検知した条件を取得
+   * @return 検知した条件と値（未検知ならsourceがNONE）
+   */
+  DetectionInfo getLaunchInfo() const { return launch_info; }
+
+  /**
+   * @brief 頂点を検知した条件を取得
+   * @return 検知した条件と値（未検知ならsourceがNONE）
+   */
+  DetectionInfo getApogeeInfo() const { return apogee_info; }
+
  private:
   static constexpr const char* TAG = "CONDITION_CHECKER";
 
@@ -80,6 +116,10 @@ class ConditionChecker {
   /** 離床検知時間 */
   int64_t launch_time;
 
+  /** 離床・頂点を検知した条件 */
+  DetectionInfo launch_info;
+  DetectionInfo apogee_info;
+
   // 離床検知条件I（加速度）用変数
   /** 各軸加速度の和 */
   float accel_sum_for_check_launch[3];
@@ -107,4 +147,7 @@ class ConditionChecker {
   uint32_t pressure_data_count_for_check_apogee;
   /** 前回の気圧の平均 */
   float last_pressure_av_for_check_apogee;
+
+  /** 気圧による判定のデータの数・回数・閾値（LPSの出力データレートで換算） */
+  ConditionConfig::PressureDetection pressure_detection;
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+
+// ESP-IDFに依存しないため、ホスト側ツールからもインクルードできる
+
+// 条件判定用の閾値設定
+namespace ConditionConfig {
+// 加速度による離床検知の設定
+/** 判定に必要な加速度データの数 */
+static constexpr int16_t NUMBER_OF_ACCEL_DATA_FOR_LAUNCH = 20;
+/** 判定に必要な加速度の二乗和の閾値(G^2) */
+static constexpr int16_t ACCEL_SQUARE_SUM_THRESHOLD = 4;
+/** 加速度が増加した回数の閾値 */
+static constexpr int8_t ACCEL_INCREASE_COUNT_THRESHOLD_FOR_LAUNCH = 50;
+
+// 気圧による離床検知の設定
+/** 判定に必要な気圧データの数 */
+static constexpr uint32_t NUMBER_OF_PRESSURE_DATA_FOR_LAUNCH = 5;
+/** 判定に必要な気圧の和の閾値(Pa) */
+static constexpr uint32_t PRESSURE_AV_THRESHOLD_FOR_LAUNCH = 10;
+/** 気圧が減少した回数の閾値 */
+static constexpr int8_t PRESSURE_DECREASE_COUNT_THRESHOLD_FOR_LAUNCH = 5;
+
+// 気圧による頂点検知の設定
+/** 判定に必要な気圧データの数 */
+static constexpr int8_t NUMBER_OF_PRESSURE_DATA_FOR_APOGEE = 5;
+/** 判定に必要な気圧の差の閾値(Pa) */
+static constexpr int16_t PRESSURE_AV_DIFFERENCE_THRESHOLD_FOR_APOGEE = 0;
+/** 気圧が増加した回数の閾値 */
+static constexpr int8_t PRESSURE_INCREASE_COUNT_THRESHOLD_FOR_APOGEE = 5;
+
+// 気圧による判定の上の値（データの数・回数・閾値）は、LPSの25Hzで調整したもの
+/** 上の値を調整したLPSの出力データレート(mHz) */
+static constexpr uint32_t PRESSURE_TUNED_ODR_MHZ = 25000;
+/** 他のレートに換算した時に、変化が続いた回数として最低限求める数 */
+static constexpr uint32_t MIN_PRESSURE_COUNT_THRESHOLD = 2;
+
+/**
+ * @brief LPSの出力データレートに合わせた、気圧による判定のデータの数・回数・閾値
+ */
+struct PressureDetection {
+  uint32_t data_count;         // 平均するデータの数
+  float launch_threshold;      // 離床: 平均の減少量の閾値
+  uint32_t launch_count;       // 離床: 減少が続いた回数の閾値
+  float apogee_threshold;      // 頂点: 平均の増加量の閾値
+  uint32_t apogee_count;       // 頂点: 増加が続いた回数の閾値
+  uint32_t window_ms;          // 平均する時間
+};
+
+/**
+ * @brief 25Hzで調整した値を、出力データレートに合わせて換算する
+ * 平均する時間（25Hzで5個=200ms）と、判定にかかる時間（平均する時間×回数=約1秒）が
+ * 25Hzの時に近くなるようにする。平均の差の閾値は、平均する時間の長さに比例させる
+ * @param odr_mhz LPSの出力データレート(mHz)
+ */
+inline PressureDetection pressureDetectionFor(uint32_t odr_mhz) {
+  if (odr_mhz == 0) odr_mhz = PRESSURE_TUNED_ODR_MHZ;
+  uint32_t data_count = (NUMBER_OF_PRESSURE_DATA_FOR_LAUNCH * odr_mhz +
+                         PRESSURE_TUNED_ODR_MHZ / 2) /
+                        PRESSURE_TUNED_ODR_MHZ;
+  if (data_count < 1) data_count = 1;
+  uint64_t window_us = (uint64_t)data_count * 1000000000ULL / odr_mhz;
+  uint64_t tuned_window_us = (uint64_t)NUMBER_OF_PRESSURE_DATA_FOR_LAUNCH *
+                             1000000000ULL / PRESSURE_TUNED_ODR_MHZ;
+  float scale = (float)window_us / tuned_window_us;
+
+  auto scale_count = [&](uint32_t tuned_count) {
+    uint32_t count =
+        (tuned_count * tuned_window_us + window_us / 2) / window_us;
+    return count < MIN_PRESSURE_COUNT_THRESHOLD ? MIN_PRESSURE_COUNT_THRESHOLD
+                                                : count;
+  };
+
+  PressureDetection detection;
+  detection.data_count = data_count;
+  detection.launch_threshold = PRESSURE_AV_THRESHOLD_FOR_LAUNCH * scale;
+  detection.launch_count =
+      scale_count(PRESSURE_DECREASE_COUNT_THRESHOLD_FOR_LAUNCH);
+  detection.apogee_threshold =
+      PRESSURE_AV_DIFFERENCE_THRESHOLD_FOR_APOGEE * scale;
+  detection.apogee_count =
+      scale_count(PRESSURE_INCREASE_COUNT_THRESHOLD_FOR_APOGEE);
+  detection.window_ms = window_us / 1000;
+  return detection;
+}
+
+// タイマーによる頂点検知の設定
+/** 離床検知から何秒立ったら頂点とするか(ms) */
+static constexpr uint32_t TIME_THRESHOLD_FOR_APOGEE_FROM_LAUNCH = 18000;
+
+// エンジン燃焼中の減速機構作動禁止時間
+static constexpr uint32_t TIME_THRESHOLD_FOR_ENGINE_FIRE_FOR_DECELERATION =
+    10000;
+}  // namespace ConditionConfig
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// センサーの生データ構造体
+// ESP-IDFに依存しないため、ホスト側ツールからもインクルードできる
+
+struct AccelData {
+  uint8_t u_x, d_x, u_y, d_y, u_z, d_z;
+};
+
+struct GyroData {
+  uint8_t u_x, d_x, u_y, d_y, u_z, d_z;
+};
+
+struct IcmTempData {
+  uint8_t u_t, d_t;
+};
+
+struct PressureData {
+  uint8_t xl_p, l_p, h_p;
+};
+
+struct TempData {
+  uint8_t l_t, h_t;
+};
+
+// SensorData::flags
+// 1kHzの加速度・角速度は毎回更新されるが、気圧とICMの温度は低いレートでしか更新されない
+// 更新されたサンプルにだけフラグを立て、ログには新しい値だけを記録する
+static constexpr uint8_t SENSOR_DATA_HAS_BARO = 1 << 0;      // 気圧・温度が新しい
+static constexpr uint8_t SENSOR_DATA_HAS_ICM_TEMP = 1 << 1;  // ICMの温度が新しい
+
+struct SensorData {
+  uint64_t timestamp_us;  // 加速度・角速度を取得した時刻
+  uint32_t seq;  // LOGGING開始からのサンプル番号（欠けていれば取りこぼし）
+  uint8_t flags;
+  AccelData accel;
+  GyroData gyro;
+  PressureData pressure;  // 最後に取得した値（離床/頂点検知用）
+  TempData temperature;
+  IcmTempData icm_temp;
+  uint64_t baro_timestamp_us;      // 気圧・温度を取得した時刻
+  uint64_t icm_temp_timestamp_us;  // ICMの温度を取得した時刻
+};
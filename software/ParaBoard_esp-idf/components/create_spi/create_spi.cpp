@@ -1,5 +1,9 @@
 #include "create_spi.hpp"
 
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
+
 const char *CreateSpi::TAG = "CREATE SPI";
 
 CreateSpi::CreateSpi() : host(SPI2_HOST), frequency(DEFAULT_SPI_FREQUENCY) {
@@ -26,6 +30,22 @@ bool CreateSpi::begin(spi_host_device_t host_id, int8_t sck, int8_t miso, int8_t
         return false;
     }
 
+    // Build the descriptors for queued reads once, so queueRead only fills in the command and length
+    async_buffers = (uint8_t *)heap_caps_malloc(ASYNC_SLOTS * ASYNC_BUFFER_SIZE, MALLOC_CAP_DMA);
+    if (async_buffers == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate DMA buffers for queued transactions");
+        return false;
+    }
+    for (int i = 0; i < ASYNC_SLOTS; i++) {
+        AsyncSlot &slot = async_slots[i];
+        slot = {};
+        slot.rx_buffer = async_buffers + i * ASYNC_BUFFER_SIZE;
+        slot.transaction.base.flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR;
+        slot.transaction.base.rx_buffer = slot.rx_buffer;
+        slot.transaction.base.user = &slot;
+        slot.transaction.command_bits = 8;
+    }
+
     return true;
 }
 
@@ -40,6 +60,8 @@ bool CreateSpi::end() {
         return false;
     }
 
+    heap_caps_free(async_buffers);
+    async_buffers = nullptr;
     return true;
 }
 
@@ -50,6 +72,9 @@ int CreateSpi::addDevice(spi_device_interface_config_t *device_if_cfg, gpio_num_
     }
 
     device_if_cfg->spics_io_num = cs;
+    if (device_if_cfg->post_cb == nullptr) {
+        device_if_cfg->post_cb = onTransactionDone;
+    }
 
     spi_device_handle_t device_handle;
     esp_err_t err = spi_bus_add_device(host, device_if_cfg, &device_handle);
@@ -132,3 +157,97 @@ bool CreateSpi::pollTransmit(spi_transaction_t *transaction, int device_handle_i
     }
     return true;
 }
+
+int CreateSpi::queueRead(uint8_t cmd, size_t length, int device_handle_id, spi_done_callback_t callback, void *arg) {
+    if (async_buffers == nullptr || device_handle_id < 0 || device_handle_id >= devices.size() || length == 0 || length > ASYNC_BUFFER_SIZE) {
+        ESP_LOGE(TAG, "Invalid queued read");
+        return -1;
+    }
+
+    AsyncSlot *slot = nullptr;
+    int index = 0;
+    for (; index < ASYNC_SLOTS; index++) {
+        if (!async_slots[index].in_use) {
+            slot = &async_slots[index];
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        ESP_LOGE(TAG, "No free descriptor for queued read");
+        return -1;
+    }
+
+    // The token carries a generation so that a stale token does not match a reused slot
+    async_generation = (async_generation + 1) & 0x7FFF;
+    slot->token = async_generation * ASYNC_SLOTS + index;
+    slot->device_handle_id = device_handle_id;
+    slot->callback = callback;
+    slot->callback_arg = arg;
+    slot->collected = false;
+    slot->done_us = 0;
+    slot->transaction.base.cmd = cmd;
+    slot->transaction.base.length = length * 8;
+    slot->transaction.base.rxlength = 0;
+    slot->in_use = true;
+
+    esp_err_t err = spi_device_queue_trans(devices[device_handle_id], &slot->transaction.base, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SPI device queue transaction failed: %d", err);
+        slot->in_use = false;
+        return -1;
+    }
+    return slot->token;
+}
+
+bool CreateSpi::waitTransaction(int token, uint8_t *rx_data, int64_t *done_us, TickType_t timeout) {
+    if (token < 0) {
+        return false;
+    }
+    AsyncSlot *slot = &async_slots[token % ASYNC_SLOTS];
+    if (!slot->in_use || slot->token != token) {
+        ESP_LOGE(TAG, "Invalid completion token: %d", token);
+        return false;
+    }
+    if (!collect(slot, timeout)) {
+        return false;
+    }
+
+    if (rx_data != nullptr) {
+        memcpy(rx_data, slot->rx_buffer, slot->transaction.base.length / 8);
+    }
+    if (done_us != nullptr) {
+        *done_us = slot->done_us;
+    }
+    slot->in_use = false;
+    return true;
+}
+
+bool CreateSpi::collect(AsyncSlot *slot, TickType_t timeout) {
+    // The driver returns the results of a device in queued order,
+    // so earlier reads of the same device are marked as collected on the way
+    while (!slot->collected) {
+        spi_transaction_t *finished = nullptr;
+        esp_err_t err = spi_device_get_trans_result(devices[slot->device_handle_id], &finished, timeout);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "SPI device get transaction result failed: %d", err);
+            return false;
+        }
+        static_cast<AsyncSlot *>(finished->user)->collected = true;
+    }
+    return true;
+}
+
+void IRAM_ATTR CreateSpi::onTransactionDone(spi_transaction_t *transaction) {
+    // Polled transactions keep the CS pin number in user, only queued reads point it at a slot
+    if (!esp_ptr_internal(transaction->user)) {
+        return;
+    }
+    AsyncSlot *slot = static_cast<AsyncSlot *>(transaction->user);
+    if (&slot->transaction.base != transaction) {
+        return;
+    }
+    slot->done_us = esp_timer_get_time();
+    if (slot->callback != nullptr) {
+        slot->callback(slot->token, slot->callback_arg);
+    }
+}
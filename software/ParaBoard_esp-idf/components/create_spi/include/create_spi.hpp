@@ -9,10 +9,25 @@
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
 
 #define MAX_TRANSFER_SIZE 4094
 #define DEFAULT_SPI_FREQUENCY SPI_MASTER_FREQ_8M
 #define MAX_CS_PINS 3
+// Number of pre-built descriptors for queued transactions (shared by all devices)
+#define ASYNC_SLOTS 4
+// Receive buffer size of each descriptor
+#define ASYNC_BUFFER_SIZE 32
+// queue_size to give addDevice() for devices that use queueRead()
+#define ASYNC_QUEUE_SIZE ASYNC_SLOTS
+
+/**
+ * @brief Called from the SPI ISR when a queued transaction is done
+ * Must be placed in IRAM and must not block
+ * @param token The completion token returned by queueRead
+ * @param arg The argument given to queueRead
+ */
+typedef void (*spi_done_callback_t)(int token, void *arg);
 
 class CreateSpi {
    public:
@@ -91,8 +106,65 @@ class CreateSpi {
      */
     bool pollTransmit(spi_transaction_t *transaction, int device_handle_id);
 
+    /**
+     * @brief Queue a read without waiting for it to finish
+     * The command byte is sent first, then length bytes are read by DMA into a pre-built descriptor.
+     * Every queued read must be finished with waitTransaction, which also frees the descriptor.
+     * Do not use pollTransmit on the same device until its queued reads are waited for.
+     * @param cmd The command (register address with the read bit)
+     * @param length The number of bytes to read (up to ASYNC_BUFFER_SIZE)
+     * @param device_handle_id The handle id for the device
+     * @param callback Called from the SPI ISR when the read is done (optional)
+     * @param arg The argument for the callback
+     * @return The completion token, -1 if failed (no free descriptor or queue error)
+     */
+    int queueRead(uint8_t cmd, size_t length, int device_handle_id, spi_done_callback_t callback = nullptr, void *arg = nullptr);
+
+    /**
+     * @brief Wait for a queued read and free its descriptor
+     * @param token The completion token returned by queueRead
+     * @param rx_data Buffer for the received bytes (length given to queueRead), nullptr to discard
+     * @param done_us esp_timer time when the transfer finished (nullptr if not needed)
+     * @param timeout Ticks to wait
+     * @return true if the read finished, false if the token is invalid or the wait timed out
+     */
+    bool waitTransaction(int token, uint8_t *rx_data, int64_t *done_us = nullptr, TickType_t timeout = portMAX_DELAY);
+
    private:
+    /**
+     * @brief A reusable descriptor for queued reads
+     */
+    struct AsyncSlot {
+        spi_transaction_ext_t transaction;  // built once in begin(), user points back to this slot
+        uint8_t *rx_buffer;                 // DMA-capable, ASYNC_BUFFER_SIZE bytes
+        int device_handle_id;
+        int token;
+        bool in_use;     // queued and not yet waited for
+        bool collected;  // result already taken from the driver
+        spi_done_callback_t callback;
+        void *callback_arg;
+        volatile int64_t done_us;  // written by the SPI ISR
+    };
+
     static const char *TAG;
+    AsyncSlot async_slots[ASYNC_SLOTS] = {};
+    uint8_t *async_buffers = nullptr;
+    uint16_t async_generation = 0;
+
+    /**
+     * @brief post_cb of every device, finishes queued reads (runs in the SPI ISR)
+     * @param transaction The finished transaction
+     */
+    static void onTransactionDone(spi_transaction_t *transaction);
+
+    /**
+     * @brief Take the results of finished transactions from the driver until the slot's one is found
+     * @param slot The slot to wait for
+     * @param timeout Ticks to wait
+     * @return true if the slot's transaction was collected
+     */
+    bool collect(AsyncSlot *slot, TickType_t timeout);
+
     spi_bus_config_t bus_cfg = {};
     spi_host_device_t host;
     int dma_chan;
@@ -0,0 +1,160 @@
+#include "event_journal.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+EventJournal::EventJournal() {}
+
+EventJournal::~EventJournal() {
+  if (task_handle != nullptr) {
+    vTaskDelete(task_handle);
+    task_handle = nullptr;
+  }
+  if (queue != nullptr) {
+    vQueueDelete(queue);
+    queue = nullptr;
+  }
+  if (file_pointer != nullptr) {
+    fclose(file_pointer);
+    file_pointer = nullptr;
+  }
+}
+
+bool EventJournal::init(SdController* sd_controller) {
+  if (sd_controller == nullptr) {
+    ESP_LOGE(TAG, "SD controller pointer is null");
+    return false;
+  }
+  if (file_pointer != nullptr) {
+    ESP_LOGW(TAG, "Event journal already opened");
+    return true;
+  }
+
+  // 起動ごとのディレクトリに作成する
+  std::string dir_path = sd_controller->getBootDirectoryPath();
+  if (dir_path.empty()) {
+    ESP_LOGE(TAG, "No log directory for event journal");
+    return false;
+  }
+  std::string file_path = dir_path + "/" + FILE_NAME;
+
+  // 追記のみ（同じ起動で開き直した場合もヘッダは最初の1回だけ）
+  struct stat st;
+  bool exists = (stat(file_path.c_str(), &st) == 0 && st.st_size > 0);
+  file_pointer = fopen(file_path.c_str(), "ab");
+  if (file_pointer == nullptr) {
+    ESP_LOGE(TAG, "Failed to open %s", file_path.c_str());
+    return false;
+  }
+  if (!exists) {
+    LogFormat::EventFileHeader header = LogFormat::makeEventFileHeader(
+        sd_controller->getIntSetting("boot_count", 0));
+    fwrite(&header, sizeof(header), 1, file_pointer);
+    sync();
+  }
+
+  queue = xQueueCreate(QUEUE_LENGTH, sizeof(LogFormat::EventRecord));
+  if (queue == nullptr) {
+    ESP_LOGE(TAG, "Failed to create event queue");
+    fclose(file_pointer);
+    file_pointer = nullptr;
+    return false;
+  }
+
+  BaseType_t result = xTaskCreate(journalTask, "event_journal_task",
+                                  TASK_STACK_SIZE, this, TASK_PRIORITY,
+                                  &task_handle);
+  if (result != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create event journal task");
+    task_handle = nullptr;
+    vQueueDelete(queue);
+    queue = nullptr;
+    fclose(file_pointer);
+    file_pointer = nullptr;
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Event journal: %s", file_path.c_str());
+  return true;
+}
+
+bool EventJournal::record(LogFormat::EventType type, uint8_t detail,
+                          int32_t value0, int32_t value1) {
+  if (queue == nullptr) {
+    return false;
+  }
+
+  LogFormat::EventRecord event = {};
+  event.timestamp_us = esp_timer_get_time();
+  event.seq = next_seq++;
+  event.type = static_cast<uint8_t>(type);
+  event.detail = detail;
+  event.value0 = value0;
+  event.value1 = value1;
+  LogFormat::sealEventRecord(&event);
+
+  // センサータスクからも呼ぶので待たない（満杯なら番号が飛ぶ）
+  if (xQueueSend(queue, &event, 0) != pdTRUE) {
+    dropped_count++;
+    return false;
+  }
+  return true;
+}
+
+void EventJournal::journalTask(void* pvParameters) {
+  EventJournal* self = static_cast<EventJournal*>(pvParameters);
+  bool dirty = false;
+  bool critical = false;
+
+  while (true) {
+    LogFormat::EventRecord event;
+    TickType_t timeout = dirty ? pdMS_TO_TICKS(SYNC_IDLE_MS) : portMAX_DELAY;
+    if (xQueueReceive(self->queue, &event, timeout) != pdTRUE) {
+      // しばらくイベントがないので、溜まっている分を同期する
+      self->sync();
+      dirty = false;
+      critical = false;
+      continue;
+    }
+
+    if (fwrite(&event, sizeof(event), 1, self->file_pointer) != 1) {
+      ESP_LOGE(TAG, "Failed to write event %s",
+               LogFormat::eventTypeName(event.type));
+      continue;
+    }
+    dirty = true;
+    critical = critical || isCritical(event.type);
+
+    ESP_LOGI(TAG, "Event #%u %s detail=%u values=%ld,%ld", event.seq,
+             LogFormat::eventTypeName(event.type), event.detail,
+             (long)event.value0, (long)event.value1);
+
+    // 重要なイベントは、続けて来ているものをまとめてからすぐに同期する
+    if (critical && uxQueueMessagesWaiting(self->queue) == 0) {
+      self->sync();
+      dirty = false;
+      critical = false;
+    }
+  }
+}
+
+bool EventJournal::isCritical(uint8_t type) {
+  switch (static_cast<LogFormat::EventType>(type)) {
+    case LogFormat::EventType::MODE_CHANGE:
+    case LogFormat::EventType::LAUNCH:
+    case LogFormat::EventType::APOGEE:
+    case LogFormat::EventType::SERVO:
+    case LogFormat::EventType::ERROR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void EventJournal::sync() {
+  fflush(file_pointer);
+  int fd = fileno(file_pointer);
+  if (fd >= 0) {
+    fsync(fd);
+  }
+}
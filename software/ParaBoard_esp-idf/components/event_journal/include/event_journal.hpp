@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "event_format.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "sd_controller.hpp"
+
+/**
+ * @brief 離床・頂点検知、サーボ、モード変更、エラー等のイベントを
+ * センサーログとは別のファイル（logs/boot-N/events.bin）に追記する
+ *
+ * record()はキューに積むだけなので、センサータスクからも呼べる。
+ * SDカードへの書き込みはジャーナルタスクが行い、離床・頂点・サーボ・
+ * モード変更・エラーはすぐに同期する。それ以外は次の同期か、
+ * キューが空になってからSYNC_IDLE_MS後に同期する
+ */
+class EventJournal {
+ public:
+  EventJournal();
+  ~EventJournal();
+
+  /**
+   * @brief ジャーナルファイルを開き、ジャーナルタスクを開始する
+   * @param sd_controller SDカードコントローラへのポインタ
+   * @return 初期化が成功したかどうか
+   */
+  bool init(SdController* sd_controller);
+
+  /**
+   * @brief イベントを記録する（どのタスクからも呼べる、待たない）
+   * 時刻は呼び出した時点のesp_timer_get_time()
+   * @param type イベントの種類
+   * @param detail 種類ごとの詳細（event_format.hpp）
+   * @param value0 種類ごとの値
+   * @param value1 種類ごとの値
+   * @return キューに積めたかどうか（未初期化・満杯ならfalse）
+   */
+  bool record(LogFormat::EventType type, uint8_t detail = 0,
+              int32_t value0 = 0, int32_t value1 = 0);
+
+  /**
+   * @brief キューが満杯で記録できなかったイベントの数を取得する
+   */
+  uint32_t getDroppedCount() const { return dropped_count; }
+
+ private:
+  static constexpr const char* TAG = "EVENT_JOURNAL";
+  static constexpr const char* FILE_NAME = "events.bin";
+  static constexpr int QUEUE_LENGTH = 32;
+  // 重要でないイベントは、キューが空になってからこの時間後に同期する
+  static constexpr int SYNC_IDLE_MS = 1000;
+  static constexpr int TASK_STACK_SIZE = 4096;
+  // ログの書き込みタスクより低くし、センサー・ログの処理を優先する
+  static constexpr int TASK_PRIORITY = 3;
+
+  FILE* file_pointer = nullptr;
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t task_handle = nullptr;
+  std::atomic<uint16_t> next_seq{0};
+  std::atomic<uint32_t> dropped_count{0};
+
+  /**
+   * @brief ジャーナルタスク関数（キューのイベントをファイルに書き込む）
+   * @param pvParameters タスクパラメータ
+   */
+  static void journalTask(void* pvParameters);
+
+  /**
+   * @brief すぐに同期するイベントかどうか
+   * @param type イベントの種類
+   */
+  static bool isCritical(uint8_t type);
+
+  /**
+   * @brief ファイルの内容を物理メディアまで反映させる
+   */
+  void sync();
+};
@@ -1,5 +1,9 @@
 #include "icm42688.hpp"
 
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+
 namespace Icm {
 
 const char *Icm42688::TAG = "Icm42688";
@@ -19,7 +23,8 @@ bool Icm42688::begin(CreateSpi *spi, gpio_num_t cs_pin, uint32_t frequency) {
   device_if_config.cs_ena_posttrans = 0;
   device_if_config.clock_speed_hz = frequency;
   device_if_config.mode = 3;
-  device_if_config.queue_size = 1;
+  // startAccelAndGyro()で完了を待たずに読み出せるようにする
+  device_if_config.queue_size = ASYNC_QUEUE_SIZE;
 
   device_handle_id = create_spi->addDevice(&device_if_config, cs_pin);
   if (device_handle_id < 0) {
@@ -213,4 +218,292 @@ bool Icm42688::getAccelAndGyro(AccelData *accel, GyroData *gyro) {
   return true;
 }
 
+bool Icm42688::getAccelAndGyro(AccelData *accel, GyroData *gyro,
+                               bool *data_ready) {
+  // ACCEL_DATAからINT_STATUSまで続けて読む（間のTMST_FSYNCは使わない）
+  spi_transaction_t transaction = {};
+  transaction.flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR;
+  transaction.length = ACCEL_STATUS_LENGTH * 8;
+
+  uint8_t rx_buffer[ACCEL_STATUS_LENGTH];
+  transaction.cmd =
+      Icm42688Config::READ_BIT | Icm42688Config::Registers::ACCEL_DATA;
+  transaction.tx_buffer = NULL;
+  transaction.rx_buffer = rx_buffer;
+  transaction.user = (void *)cs_pin;
+
+  spi_transaction_ext_t spi_transaction = {};
+  spi_transaction.base = transaction;
+  spi_transaction.command_bits = 8;
+  bool result = create_spi->pollTransmit((spi_transaction_t *)&spi_transaction,
+                                         device_handle_id);
+  if (!result) {
+    ESP_LOGE(TAG, "Failed to get accel and gyro");
+    return false;
+  }
+
+  parseAccelAndGyro(rx_buffer, accel, gyro);
+  *data_ready = rx_buffer[ACCEL_STATUS_LENGTH - 1] &
+                Icm42688Config::Interrupt::STATUS_DATA_READY;
+  return true;
+}
+
+bool Icm42688::startAccelAndGyro() {
+  if (pending_token >= 0) {
+    ESP_LOGE(TAG, "Accel and gyro read already in flight");
+    return false;
+  }
+  pending_token = create_spi->queueRead(
+      Icm42688Config::READ_BIT | Icm42688Config::Registers::ACCEL_DATA,
+      ACCEL_STATUS_LENGTH, device_handle_id);
+  return pending_token >= 0;
+}
+
+bool Icm42688::finishAccelAndGyro(AccelData *accel, GyroData *gyro,
+                                  bool *data_ready, int64_t *timestamp_us) {
+  if (pending_token < 0) {
+    ESP_LOGE(TAG, "No accel and gyro read in flight");
+    return false;
+  }
+  uint8_t rx_buffer[ACCEL_STATUS_LENGTH];
+  bool result = create_spi->waitTransaction(pending_token, rx_buffer,
+                                            timestamp_us);
+  pending_token = -1;
+  if (!result) {
+    ESP_LOGE(TAG, "Failed to get accel and gyro");
+    return false;
+  }
+
+  parseAccelAndGyro(rx_buffer, accel, gyro);
+  *data_ready = rx_buffer[ACCEL_STATUS_LENGTH - 1] &
+                Icm42688Config::Interrupt::STATUS_DATA_READY;
+  return true;
+}
+
+void Icm42688::parseAccelAndGyro(const uint8_t *rx_buffer, AccelData *accel,
+                                 GyroData *gyro) {
+  accel->u_x = rx_buffer[0];
+  accel->d_x = rx_buffer[1];
+  accel->u_y = rx_buffer[2];
+  accel->d_y = rx_buffer[3];
+  accel->u_z = rx_buffer[4];
+  accel->d_z = rx_buffer[5];
+
+  gyro->u_x = rx_buffer[6];
+  gyro->d_x = rx_buffer[7];
+  gyro->u_y = rx_buffer[8];
+  gyro->d_y = rx_buffer[9];
+  gyro->u_z = rx_buffer[10];
+  gyro->d_z = rx_buffer[11];
+}
+
+bool Icm42688::enableInterrupt(uint16_t fifo_watermark) {
+  uint8_t source = Icm42688Config::Interrupt::SOURCE_DATA_READY;
+  if (isFifoEnabled()) {
+    // 溜まった数がウォーターマークに達したら割り込む
+    if (!create_spi->setReg(Icm42688Config::Registers::FIFO_CONFIG2,
+                            fifo_watermark & 0xFF, device_handle_id) ||
+        !create_spi->setReg(Icm42688Config::Registers::FIFO_CONFIG3,
+                            (fifo_watermark >> 8) & 0x0F, device_handle_id) ||
+        !create_spi->setReg(Icm42688Config::Registers::FIFO_CONFIG1,
+                            Icm42688Config::Fifo::PACKET3 |
+                                Icm42688Config::Interrupt::FIFO_WM_GT_TH,
+                            device_handle_id)) {
+      ESP_LOGE(TAG, "Failed to set FIFO watermark");
+      return false;
+    }
+    source = Icm42688Config::Interrupt::SOURCE_FIFO_THS;
+  }
+
+  if (!create_spi->setReg(Icm42688Config::Registers::INT_CONFIG,
+                          Icm42688Config::Interrupt::INT1_PULSE_PUSH_PULL_HIGH,
+                          device_handle_id) ||
+      !create_spi->setReg(Icm42688Config::Registers::INT_CONFIG1,
+                          Icm42688Config::Interrupt::CONFIG1,
+                          device_handle_id) ||
+      !create_spi->setReg(Icm42688Config::Registers::INT_SOURCE0, source,
+                          device_handle_id)) {
+    ESP_LOGE(TAG, "Failed to configure INT1");
+    return false;
+  }
+  ESP_LOGI(TAG, "INT1 enabled (%s)",
+           isFifoEnabled() ? "FIFO watermark" : "data ready");
+  return true;
+}
+
+bool Icm42688::beginFifo() {
+  if (fifo_buffer == nullptr) {
+    fifo_buffer = (uint8_t *)heap_caps_malloc(
+        Icm42688Config::Fifo::SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (fifo_buffer == nullptr) {
+      ESP_LOGE(TAG, "Failed to allocate FIFO buffer");
+      return false;
+    }
+  }
+
+  // FIFO_COUNTをパケット数で返すようにし、パケット3を有効にしてからStreamモードにする
+  if (!create_spi->setReg(Icm42688Config::Registers::INTF_CONFIG0,
+                          Icm42688Config::Fifo::COUNT_IN_RECORDS,
+                          device_handle_id) ||
+      !create_spi->setReg(Icm42688Config::Registers::FIFO_CONFIG1,
+                          Icm42688Config::Fifo::PACKET3, device_handle_id) ||
+      !create_spi->setReg(Icm42688Config::Registers::FIFO_CONFIG,
+                          Icm42688Config::Fifo::MODE_STREAM,
+                          device_handle_id)) {
+    ESP_LOGE(TAG, "Failed to configure FIFO");
+    heap_caps_free(fifo_buffer);
+    fifo_buffer = nullptr;
+    return false;
+  }
+  if (!flushFifo()) {
+    heap_caps_free(fifo_buffer);
+    fifo_buffer = nullptr;
+    return false;
+  }
+  ESP_LOGI(TAG, "FIFO enabled");
+  return true;
+}
+
+bool Icm42688::flushFifo() {
+  if (!create_spi->setReg(Icm42688Config::Registers::SIGNAL_PATH_RESET,
+                          Icm42688Config::Fifo::FLUSH, device_handle_id)) {
+    ESP_LOGE(TAG, "Failed to flush FIFO");
+    return false;
+  }
+  fifo_started = false;
+  fifo_anchored = false;
+  fifo_sensor_time_us = 0;
+  return true;
+}
+
+int Icm42688::readFifo(SensorData *samples, int max_samples,
+                       FifoReadResult *result) {
+  *result = {};
+  if (fifo_buffer == nullptr) {
+    return -1;
+  }
+
+  // 1. 溜まっているパケットの数を読む
+  spi_transaction_t transaction = {};
+  transaction.flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR;
+  transaction.length = (2) * 8;
+
+  uint8_t count_buffer[2];
+  transaction.cmd =
+      Icm42688Config::READ_BIT | Icm42688Config::Registers::FIFO_COUNTH;
+  transaction.tx_buffer = NULL;
+  transaction.rx_buffer = count_buffer;
+  transaction.user = (void *)cs_pin;
+
+  spi_transaction_ext_t spi_transaction = {};
+  spi_transaction.base = transaction;
+  spi_transaction.command_bits = 8;
+  if (!create_spi->pollTransmit((spi_transaction_t *)&spi_transaction,
+                                device_handle_id)) {
+    ESP_LOGE(TAG, "Failed to get FIFO count");
+    return -1;
+  }
+  int64_t read_time_us = esp_timer_get_time();
+  int records = count_buffer[0] << 8 | count_buffer[1];
+  if (records == 0) {
+    return 0;
+  }
+  if (records >= (int)Icm42688Config::Fifo::MAX_PACKETS) {
+    // 満杯の間に来たサンプルは失われているので、時刻の対応付けをやり直す
+    result->overflowed = true;
+    fifo_anchored = false;
+  }
+  int count = std::min({records, max_samples,
+                        (int)Icm42688Config::Fifo::MAX_PACKETS});
+
+  // 2. パケットをまとめて1回のDMA転送で読み出す（転送中はタスクを待たせる）
+  spi_transaction = {};
+  spi_transaction.base.flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR;
+  spi_transaction.base.length = count * Icm42688Config::Fifo::PACKET_SIZE * 8;
+  spi_transaction.base.cmd =
+      Icm42688Config::READ_BIT | Icm42688Config::Registers::FIFO_DATA;
+  spi_transaction.base.rx_buffer = fifo_buffer;
+  spi_transaction.base.user = (void *)cs_pin;
+  spi_transaction.command_bits = 8;
+  if (!create_spi->transmit((spi_transaction_t *)&spi_transaction,
+                            device_handle_id)) {
+    ESP_LOGE(TAG, "Failed to read FIFO");
+    return -1;
+  }
+
+  // 3. パケットを変換する（時刻はいったんセンサーの時刻で入れる）
+  int parsed = 0;
+  for (int i = 0; i < count; i++) {
+    const uint8_t *packet = fifo_buffer + i * Icm42688Config::Fifo::PACKET_SIZE;
+    uint8_t header = packet[0];
+    if ((header & Icm42688Config::Fifo::HEADER_EMPTY) ||
+        (header & Icm42688Config::Fifo::HEADER_ACCEL_GYRO) !=
+            Icm42688Config::Fifo::HEADER_ACCEL_GYRO) {
+      break;
+    }
+
+    SensorData &data = samples[parsed];
+    data = {};
+    data.accel.u_x = packet[1];
+    data.accel.d_x = packet[2];
+    data.accel.u_y = packet[3];
+    data.accel.d_y = packet[4];
+    data.accel.u_z = packet[5];
+    data.accel.d_z = packet[6];
+    data.gyro.u_x = packet[7];
+    data.gyro.d_x = packet[8];
+    data.gyro.u_y = packet[9];
+    data.gyro.d_y = packet[10];
+    data.gyro.u_z = packet[11];
+    data.gyro.d_z = packet[12];
+    int16_t temp = (int8_t)packet[13] * Icm42688Config::Fifo::TEMP_SCALE;
+    data.icm_temp.u_t = (uint16_t)temp >> 8;
+    data.icm_temp.d_t = (uint16_t)temp & 0xFF;
+
+    // 16ビットの時刻は約65msで一周するので、前のパケットとの差を積算する
+    uint16_t timestamp = packet[14] << 8 | packet[15];
+    if (fifo_started) {
+      uint16_t delta_us = timestamp - last_fifo_timestamp;
+      fifo_sensor_time_us += delta_us;
+      // 同じサンプル・抜けたサンプルがないか、ODRの時刻の差で確かめる
+      // （溢れた直後の差は一周しているかもしれないので数えない）
+      if (!(result->overflowed && parsed == 0)) {
+        if (delta_us < Icm42688Config::ODR_PERIOD_US / 2) {
+          result->duplicate++;
+        } else if (delta_us > Icm42688Config::ODR_PERIOD_US * 3 / 2) {
+          result->skipped += (delta_us + Icm42688Config::ODR_PERIOD_US / 2) /
+                                 Icm42688Config::ODR_PERIOD_US -
+                             1;
+        }
+      }
+    }
+    fifo_started = true;
+    last_fifo_timestamp = timestamp;
+    data.timestamp_us = fifo_sensor_time_us;
+    parsed++;
+  }
+  if (parsed == 0) {
+    return 0;
+  }
+
+  // 4. 起動からの時刻に直す
+  // 読み出した時刻は最新のパケットより後なので、その差の最小値を時刻のずれとする
+  // センサーとESP32のクロックの差で離れていかないよう、経過時間の1%までは後ろへ動かす
+  if (parsed == records || !fifo_anchored) {
+    int64_t candidate = read_time_us - fifo_sensor_time_us;
+    if (!fifo_anchored || candidate < fifo_offset_us) {
+      fifo_offset_us = candidate;
+    } else {
+      fifo_offset_us = std::min(
+          candidate, fifo_offset_us + (read_time_us - last_fifo_read_us) / 100);
+    }
+    fifo_anchored = true;
+    last_fifo_read_us = read_time_us;
+  }
+  for (int i = 0; i < parsed; i++) {
+    samples[i].timestamp_us += fifo_offset_us;
+  }
+  return parsed;
+}
+
 }  // namespace Icm
@@ -2,6 +2,7 @@
 
 #include "create_spi.hpp"
 #include "driver/spi_master.h"
+#include "esp_timer.h"
 #include "math.h"
 
 namespace Icm {
@@ -19,6 +20,51 @@ struct Icm42688Config {
     static constexpr uint8_t GYRO_DATA = 0x25;
     static constexpr uint8_t GYRO_CONFIG0 = 0x4F;
     static constexpr uint8_t ACCEL_CONFIG0 = 0x50;
+    static constexpr uint8_t FIFO_CONFIG = 0x16;
+    static constexpr uint8_t FIFO_COUNTH = 0x2E;  // FIFO_COUNTLが続く
+    static constexpr uint8_t FIFO_DATA = 0x30;
+    static constexpr uint8_t SIGNAL_PATH_RESET = 0x4B;
+    static constexpr uint8_t INTF_CONFIG0 = 0x4C;
+    static constexpr uint8_t FIFO_CONFIG1 = 0x5F;
+    static constexpr uint8_t FIFO_CONFIG2 = 0x60;  // ウォーターマークの下位8ビット
+    static constexpr uint8_t FIFO_CONFIG3 = 0x61;  // ウォーターマークの上位4ビット
+    static constexpr uint8_t INT_CONFIG = 0x14;
+    static constexpr uint8_t INT_STATUS = 0x2D;
+    static constexpr uint8_t INT_CONFIG1 = 0x64;
+    static constexpr uint8_t INT_SOURCE0 = 0x65;
+  };
+
+  // INT1の設定
+  struct Interrupt {
+    // INT_CONFIG: INT1をパルス・プッシュプル・アクティブHighにする
+    static constexpr uint8_t INT1_PULSE_PUSH_PULL_HIGH = 0x03;
+    // INT_CONFIG1: INT_ASYNC_RESETを0にする（INT1を使う時に必要、パルス幅は100us）
+    static constexpr uint8_t CONFIG1 = 0x00;
+    static constexpr uint8_t SOURCE_DATA_READY = 0x08;  // INT_SOURCE0: UI_DRDY_INT1_EN
+    static constexpr uint8_t SOURCE_FIFO_THS = 0x04;    // INT_SOURCE0: FIFO_THS_INT1_EN
+    static constexpr uint8_t STATUS_DATA_READY = 0x08;  // INT_STATUS: DATA_RDY_INT
+    // FIFO_CONFIG1: 溜まった数がウォーターマーク以上の間、割り込みを出し続ける
+    static constexpr uint8_t FIFO_WM_GT_TH = 0x20;
+  };
+
+  // FIFOの設定とパケットの形式
+  // パケット3（16バイト）: ヘッダ, 加速度X/Y/Z, 角速度X/Y/Z（ビッグエンディアン）,
+  // 温度(8ビット), ODRの時刻(16ビット、1us単位)
+  struct Fifo {
+    static constexpr uint8_t MODE_BYPASS = 0x00;  // FIFO_CONFIG
+    static constexpr uint8_t MODE_STREAM = 0x40;  // FIFO_CONFIG: Stream-to-FIFO
+    // FIFO_CONFIG1: 時刻・温度・角速度・加速度をパケットに含める
+    static constexpr uint8_t PACKET3 = 0x0F;
+    // INTF_CONFIG0: FIFO_COUNTをパケット数で返す（エンディアンは既定値のビッグエンディアン）
+    static constexpr uint8_t COUNT_IN_RECORDS = 0x70;
+    static constexpr uint8_t FLUSH = 0x02;  // SIGNAL_PATH_RESET
+    static constexpr size_t SIZE = 2048;
+    static constexpr size_t PACKET_SIZE = 16;
+    static constexpr size_t MAX_PACKETS = SIZE / PACKET_SIZE;
+    static constexpr uint8_t HEADER_EMPTY = 0x80;  // FIFOが空（無効なパケット）
+    static constexpr uint8_t HEADER_ACCEL_GYRO = 0x60;
+    // FIFOの温度(1/2.07℃)をTEMP_DATAの単位(1/132.48℃)に直す倍率
+    static constexpr int TEMP_SCALE = 64;
   };
 
   struct GyroScale {
@@ -56,6 +102,19 @@ struct Icm42688Config {
     static constexpr uint8_t ODR1_5625 = 0b00001110;  // LP mode
     static constexpr uint8_t ODR500 = 0b00001111;     // LN or LP mode
   };
+
+  // 加速度・角速度のODRの周期(us)（begin()で1kHzに設定する）
+  static constexpr uint32_t ODR_PERIOD_US = 1000;
+};
+
+/**
+ * @brief readFifo()1回分の結果
+ * duplicate / skipped は、パケットのODRの時刻を前のパケットと比べて数える
+ */
+struct FifoReadResult {
+  bool overflowed;     // FIFOが満杯だった（古いサンプルが失われた）かどうか
+  uint32_t duplicate;  // 前のパケットとの時刻の差が半周期未満だった数
+  uint32_t skipped;    // 時刻の差から求めた、抜けていたサンプルの数
 };
 
 class Icm42688 {
@@ -65,6 +124,29 @@ class Icm42688 {
   CreateSpi *create_spi;
   static const char *TAG;
 
+  // FIFOモード
+  uint8_t *fifo_buffer = nullptr;  // DMAで読み出す先
+  bool fifo_started = false;       // センサーの時刻を積算し始めたかどうか
+  bool fifo_anchored = false;      // 起動からの時刻との対応が決まったかどうか
+  uint16_t last_fifo_timestamp = 0;
+  int64_t fifo_sensor_time_us = 0;  // センサーの時刻（16ビットの時刻の差を積算）
+  int64_t fifo_offset_us = 0;       // 起動からの時刻 - センサーの時刻
+  int64_t last_fifo_read_us = 0;
+
+  // 完了を待たずに開始した読み出しの完了トークン（なければ-1）
+  int pending_token = -1;
+
+  // ACCEL_DATAからINT_STATUSまでのバイト数
+  static constexpr int ACCEL_STATUS_LENGTH =
+      Icm42688Config::Registers::INT_STATUS -
+      Icm42688Config::Registers::ACCEL_DATA + 1;
+
+  /**
+   * @brief ACCEL_DATAから読んだバイト列を加速度・角速度に分ける
+   */
+  static void parseAccelAndGyro(const uint8_t *rx_buffer, AccelData *accel,
+                                GyroData *gyro);
+
  public:
   bool begin(CreateSpi *create_spi, gpio_num_t cs_pin,
              uint32_t frequency = Icm42688Config::DEFAULT_SPI_FREQ);
@@ -74,6 +156,70 @@ class Icm42688 {
   bool getTemp(IcmTempData *data);
   bool getAccelAndGyro(AccelData *accel, GyroData *gyro);
 
+  /**
+   * @brief 加速度・角速度と、前回から新しいサンプルになったかどうかを1回の転送で読む
+   * INT_STATUSのDATA_RDY_INTは読むと消えるので、同じサンプルを二重に読むとfalseになる
+   * @param accel 加速度
+   * @param gyro 角速度
+   * @param data_ready 新しいサンプルだったかどうか
+   * @return 成功したかどうか
+   */
+  bool getAccelAndGyro(AccelData *accel, GyroData *gyro, bool *data_ready);
+
+  /**
+   * @brief getAccelAndGyro()と同じ読み出しをキューに入れ、転送の完了を待たずに戻る
+   * 転送中は他の処理ができる。finishAccelAndGyro()を呼ぶまで、このICMに他の読み書きをしないこと
+   * @return キューに入れられたかどうか
+   */
+  bool startAccelAndGyro();
+
+  /**
+   * @brief startAccelAndGyro()で開始した読み出しの完了を待ち、結果を取り出す
+   * @param accel 加速度
+   * @param gyro 角速度
+   * @param data_ready 新しいサンプルだったかどうか
+   * @param timestamp_us 転送が終わった時刻（起動からのマイクロ秒）
+   * @return 成功したかどうか
+   */
+  bool finishAccelAndGyro(AccelData *accel, GyroData *gyro, bool *data_ready,
+                          int64_t *timestamp_us);
+
+  /**
+   * @brief INT1から割り込みを出すようにする
+   * FIFOが有効ならウォーターマーク、そうでなければデータ準備完了で割り込む
+   * @param fifo_watermark FIFOのウォーターマーク（パケット数、FIFOが無効なら使わない）
+   * @return 成功したかどうか
+   */
+  bool enableInterrupt(uint16_t fifo_watermark);
+
+  /**
+   * @brief FIFOを有効にする（Stream-to-FIFO、加速度・角速度・温度・時刻のパケット）
+   * 有効にした後は、readFifo()で溜まったサンプルをまとめて読み出す
+   * @return 成功したかどうか
+   */
+  bool beginFifo();
+
+  /**
+   * @brief FIFOを空にし、時刻の対応付けをやり直す（取得を再開する時に呼ぶ）
+   * @return 成功したかどうか
+   */
+  bool flushFifo();
+
+  /**
+   * @brief FIFOに溜まったパケットを1回のDMA転送で読み出し、SensorDataに変換する
+   * timestamp_usはパケットのODRの時刻から求めた起動からの時刻
+   * （最新のパケットを読み出した時刻に合わせ、パケットの間隔はセンサーの時刻のまま）
+   * icm_tempはFIFOの8ビットの温度をTEMP_DATAの単位に直した値（フラグは立てない）
+   * seqと気圧は設定しない
+   * @param samples 読み出し先
+   * @param max_samples 読み出す最大の数
+   * @param result FIFOが溢れたかどうかと、時刻の確認の結果
+   * @return 読み出したサンプルの数（失敗したら-1）
+   */
+  int readFifo(SensorData *samples, int max_samples, FifoReadResult *result);
+
+  bool isFifoEnabled() const { return fifo_buffer != nullptr; }
+
   // エラー状態の管理を追加
   bool isInitialized() const { return device_handle_id >= 0; }
 };
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, 多項式0xEDB88320)
+// ESP-IDFに依存しないため、ホスト側ツールからもインクルードできる
+
+namespace LogFormat {
+
+namespace detail {
+
+struct Crc32Table {
+  uint32_t entries[256];
+
+  constexpr Crc32Table() : entries() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+      }
+      entries[i] = crc;
+    }
+  }
+};
+
+static constexpr Crc32Table CRC32_TABLE;
+
+}  // namespace detail
+
+/**
+ * @brief CRC-32を計算する
+ * @param data データ
+ * @param size データのバイト数
+ * @param crc 途中までのCRC(続けて計算する場合)
+ * @return CRC-32
+ */
+inline uint32_t crc32(const void* data, size_t size, uint32_t crc = 0) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = detail::CRC32_TABLE.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+}  // namespace LogFormat
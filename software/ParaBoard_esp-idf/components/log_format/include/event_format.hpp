@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32.hpp"
+
+// イベントジャーナル(logs/boot-N/events.bin)のフォーマット定義
+// ファイルは EventFileHeader 1つと、固定長の EventRecord の並びで構成される
+// 離床・頂点検知、サーボの動作、モード変更、エラー等の低レートのイベントを
+// 1kHzのセンサーログとは別に追記していく
+// 時刻はセンサーログと同じ esp_timer_get_time() なので、同じ起動のログと時刻で突き合わせられる
+// マルチバイトの値はすべてリトルエンディアンで格納する
+// ESP-IDFに依存しないため、ホスト側ツールからもインクルードできる
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "event_format.hpp assumes a little-endian target"
+#endif
+
+namespace LogFormat {
+
+/** ファイル先頭のマジック "PBEV" */
+static constexpr char EVENT_MAGIC[4] = {'P', 'B', 'E', 'V'};
+/** スキーマバージョン(レコード構造を変えたら上げる) */
+static constexpr uint16_t EVENT_SCHEMA_VERSION = 1;
+/** 気圧の値の倍率（hPaをこの値倍した整数で格納する、1/100Pa単位） */
+static constexpr int32_t EVENT_PRESSURE_SCALE = 10000;
+/** 加速度の2乗和の倍率（g^2をこの値倍した整数で格納する） */
+static constexpr int32_t EVENT_ACCEL_SQUARE_SCALE = 1000;
+
+struct __attribute__((packed)) EventFileHeader {
+  char magic[4];
+  uint16_t schema_version;
+  uint16_t header_size;
+  uint16_t record_size;
+  uint16_t reserved0;
+  uint32_t boot_count;  // logs/boot-N のN
+  uint8_t reserved[16];
+};
+
+/**
+ * @brief イベントの種類
+ * 種類ごとの detail と value0/value1 の意味はコメントの通り
+ */
+enum class EventType : uint8_t {
+  // 起動した  value0: 起動番号, value1: 前回のリセット要因(esp_reset_reason_t)
+  BOOT = 1,
+  // モードが変わった  detail: 新しいモード(ModeCommand), value0: 前のモード
+  MODE_CHANGE = 2,
+  // 離床を検知した  detail: 検知した条件(EventSource)
+  //   ACCEL   : value0: 平均加速度の2乗和(×EVENT_ACCEL_SQUARE_SCALE)
+  //   PRESSURE: value0: 気圧の平均(×EVENT_PRESSURE_SCALE), value1: 前回の平均からの低下量
+  LAUNCH = 3,
+  // 頂点を検知した  detail: 検知した条件(EventSource)
+  //   PRESSURE: value0: 気圧の平均(×EVENT_PRESSURE_SCALE), value1: 前回の平均からの上昇量
+  //   TIMER   : value0: 離床からの経過時間(ms)
+  APOGEE = 4,
+  // サーボを動かした  detail: ServoAction, value0: 角度, value1: 1ならコマンドによる操作
+  SERVO = 5,
+  // ログファイルを開いた  value0: ログの通し番号(log-N のN)
+  LOG_OPENED = 6,
+  // ログファイルを閉じた  value0: サンプル数, value1: 取りこぼしたサンプル数
+  LOG_CLOSED = 7,
+  // エラー  detail: EventError, value0/value1: エラーごとの値
+  ERROR = 8,
+  // SDカードの速度を決めた  detail: SdSpeed, value0: クロック(kHz),
+  //   value1: 起動時に計測した書き込み速度(kB/s、確認に失敗したら0)
+  SD_CARD = 9,
+  // 設定の保存が完了した（同期まで済んだ）  value0: 要求の番号, value1: 要求から完了までの時間(ms)
+  //   保存できなかった場合は ERROR(SETTINGS_SAVE_FAILED) を記録する
+  SETTINGS_SAVED = 10,
+};
+
+/** 離床・頂点を検知した条件 */
+enum class EventSource : uint8_t {
+  NONE = 0,
+  ACCEL = 1,
+  PRESSURE = 2,
+  TIMER = 3,
+};
+
+/** サーボの動作 */
+enum class ServoAction : uint8_t {
+  OPEN = 1,
+  CLOSE = 2,
+};
+
+/** SDカードの速度 */
+enum class SdSpeed : uint8_t {
+  DEFAULT_SPEED = 0,  // 通常速度(20MHz)
+  HIGH_SPEED = 1,     // 高速(40MHz)
+  FALLBACK = 2,       // 高速で使えず通常速度に戻した
+};
+
+/** エラーの種類 */
+enum class EventError : uint8_t {
+  LOG_OPEN_FAILED = 1,       // ログファイルを開けなかった
+  SETTINGS_SAVE_FAILED = 2,  // 設定を保存できなかった
+  SAMPLES_DROPPED = 3,       // サンプルを取りこぼし始めた  value0: seq
+  SENSOR_INIT_FAILED = 4,    // センサーの初期化に失敗した  value0: 0=ICM, 1=LPS
+                             // SETTINGS_SAVE_FAILED の value0: 要求の番号
+  SENSOR_INTERRUPT_MISSING = 5,  // ICMの割り込みが来ずタイマーで取得した  value0: seq
+};
+
+struct __attribute__((packed)) EventRecord {
+  uint64_t timestamp_us;
+  uint16_t seq;  // 起動からのイベント番号（飛んでいればジャーナルに書けなかった）
+  uint8_t type;  // EventType
+  uint8_t detail;
+  int32_t value0;
+  int32_t value1;
+  uint32_t crc32;  // ここまでのCRC-32（書き込み途中で電源が切れたレコードを捨てる）
+};
+
+static_assert(sizeof(EventFileHeader) == 32, "EventFileHeader must be 32 bytes");
+static_assert(sizeof(EventRecord) == 24, "EventRecord must be 24 bytes");
+
+/**
+ * @brief イベントジャーナルのファイルヘッダを作成する
+ * @param boot_count 起動番号
+ * @return ファイルヘッダ
+ */
+inline EventFileHeader makeEventFileHeader(uint32_t boot_count) {
+  EventFileHeader header = {};
+  memcpy(header.magic, EVENT_MAGIC, sizeof(EVENT_MAGIC));
+  header.schema_version = EVENT_SCHEMA_VERSION;
+  header.header_size = sizeof(EventFileHeader);
+  header.record_size = sizeof(EventRecord);
+  header.boot_count = boot_count;
+  return header;
+}
+
+/**
+ * @brief イベントジャーナルのファイルヘッダが読み込み可能か確認する
+ * @param header ファイルヘッダ
+ * @return マジックが一致し、読み込めるバージョンならtrue
+ */
+inline bool isValidEventFileHeader(const EventFileHeader& header) {
+  return memcmp(header.magic, EVENT_MAGIC, sizeof(EVENT_MAGIC)) == 0 &&
+         header.schema_version == EVENT_SCHEMA_VERSION &&
+         header.header_size == sizeof(EventFileHeader) &&
+         header.record_size == sizeof(EventRecord);
+}
+
+/**
+ * @brief レコードのCRCを計算して格納する
+ * @param record レコード
+ */
+inline void sealEventRecord(EventRecord* record) {
+  record->crc32 = crc32(record, offsetof(EventRecord, crc32));
+}
+
+/**
+ * @brief レコードのCRCを確認する
+ * @param record レコード
+ * @return CRCが一致すればtrue
+ */
+inline bool isValidEventRecord(const EventRecord& record) {
+  return record.crc32 == crc32(&record, offsetof(EventRecord, crc32));
+}
+
+/**
+ * @brief イベントの種類の名前を取得する
+ * @param type イベントの種類
+ * @return 名前（不明なら"UNKNOWN"）
+ */
+inline const char* eventTypeName(uint8_t type) {
+  switch (static_cast<EventType>(type)) {
+    case EventType::BOOT:
+      return "BOOT";
+    case EventType::MODE_CHANGE:
+      return "MODE_CHANGE";
+    case EventType::LAUNCH:
+      return "LAUNCH";
+    case EventType::APOGEE:
+      return "APOGEE";
+    case EventType::SERVO:
+      return "SERVO";
+    case EventType::LOG_OPENED:
+      return "LOG_OPENED";
+    case EventType::LOG_CLOSED:
+      return "LOG_CLOSED";
+    case EventType::ERROR:
+      return "ERROR";
+    case EventType::SD_CARD:
+      return "SD_CARD";
+    case EventType::SETTINGS_SAVED:
+      return "SETTINGS_SAVED";
+  }
+  return "UNKNOWN";
+}
+
+}  // namespace LogFormat
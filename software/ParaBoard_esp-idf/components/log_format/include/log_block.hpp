@@ -0,0 +1,227 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crc32.hpp"
+
+// バイナリログ(log-N.bin)のブロック形式の定義（スキーマv5以降）
+// ファイルは BLOCK_SIZE バイトの固定長ブロックの並びで、各ブロックは
+// BlockHeader（ファイルID、通し番号、ペイロード長、CRC-32）とペイロードで構成される
+// ペイロードを先頭から順につなげると、従来どおり FileHeader とレコードの並びになる
+// （ブロック0のペイロードは FileHeader のみ。レコードはブロックをまたがない）
+// ペイロードの後ろは0で埋める
+//
+// 電源断の後は、ブロック0と同じファイルIDを持ち、通し番号がブロックの位置と一致し、
+// CRCが合うブロックを有効とみなす。書き込みは先頭から順に行うので、有効なブロックは
+// 先頭から連続して並び、その後ろは書きかけのブロックか、事前確保した領域に残っていた
+// 古いデータになる。findLastValidBlock() は二分探索でその境目を探す
+// ESP-IDFに依存しないため、ホスト側ツールからもインクルードできる
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "log_block.hpp assumes a little-endian target"
+#endif
+
+namespace LogFormat {
+
+/** ブロック先頭のマジック "PBBK" */
+static constexpr char BLOCK_MAGIC[4] = {'P', 'B', 'B', 'K'};
+/** ブロックのサイズ（ログタスクのバッファと同じ、セクタサイズの倍数） */
+static constexpr size_t BLOCK_SIZE = 4096;
+/**
+ * 二分探索の後、境目の手前を順に確認するブロック数
+ * 同期していない区間（flush_max_pending_bytesとログバッファの分）は、
+ * 電源断の時に順番どおりにカードへ反映されているとは限らないため
+ */
+static constexpr uint32_t BLOCK_VERIFY_WINDOW = 16;
+
+struct __attribute__((packed)) BlockHeader {
+  char magic[4];
+  uint32_t file_id;       // ファイルごとに一意なID（FileHeaderのboot_idと同じ）
+  uint32_t seq;           // ファイル内のブロックの通し番号（0から）
+  uint16_t payload_size;  // ペイロードのバイト数
+  uint16_t reserved;
+  uint32_t crc32;  // ここまでとペイロードのCRC-32
+};
+
+static_assert(sizeof(BlockHeader) == 20, "BlockHeader must be 20 bytes");
+
+/** 1ブロックに入るペイロードの最大のバイト数 */
+static constexpr size_t BLOCK_PAYLOAD_SIZE = BLOCK_SIZE - sizeof(BlockHeader);
+
+/**
+ * @brief ブロックのヘッダとCRCを書き込み、ペイロードの後ろを0で埋める
+ * @param block ブロックの先頭（BLOCK_SIZE、ペイロードは書き込み済み）
+ * @param file_id ファイルID
+ * @param seq ブロックの通し番号
+ * @param payload_size ペイロードのバイト数（BLOCK_PAYLOAD_SIZE以下）
+ */
+inline void sealBlock(uint8_t* block, uint32_t file_id, uint32_t seq,
+                      size_t payload_size) {
+  BlockHeader header = {};
+  memcpy(header.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+  header.file_id = file_id;
+  header.seq = seq;
+  header.payload_size = payload_size;
+  uint8_t* payload = block + sizeof(BlockHeader);
+  memset(payload + payload_size, 0, BLOCK_PAYLOAD_SIZE - payload_size);
+  header.crc32 = crc32(payload, payload_size,
+                       crc32(&header, offsetof(BlockHeader, crc32)));
+  memcpy(block, &header, sizeof(header));
+}
+
+/**
+ * @brief ブロックが有効か確認する
+ * @param block ブロックの先頭（BLOCK_SIZE）
+ * @param header 読み出したヘッダ
+ * @return マジックが一致し、ペイロード長が範囲内で、CRCが合えばtrue
+ */
+inline bool readBlockHeader(const uint8_t* block, BlockHeader* header) {
+  memcpy(header, block, sizeof(*header));
+  if (memcmp(header->magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) != 0 ||
+      header->payload_size > BLOCK_PAYLOAD_SIZE) {
+    return false;
+  }
+  return header->crc32 == crc32(block + sizeof(BlockHeader),
+                                header->payload_size,
+                                crc32(header, offsetof(BlockHeader, crc32)));
+}
+
+/**
+ * @brief ブロックの先頭かどうかを確認する（形式の判別用）
+ * @param data ファイルの先頭
+ * @param size バイト数
+ */
+inline bool isBlockFile(const uint8_t* data, size_t size) {
+  return size >= sizeof(BLOCK_MAGIC) &&
+         memcmp(data, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) == 0;
+}
+
+/**
+ * @brief findLastValidBlock()の結果
+ */
+struct BlockScanResult {
+  uint32_t valid_blocks;  // 先頭から連続する有効なブロックの数
+  uint32_t file_id;       // ブロック0のファイルID
+  uint32_t reads;         // 読み込んだブロックの数
+};
+
+/**
+ * @brief 先頭から連続する有効なブロックの数を、二分探索で求める
+ *
+ * ブロック0のファイルIDを基準に、i番目のブロックが「同じファイルIDで、
+ * 通し番号がiで、CRCが合う」かを判定する。有効なブロックは先頭から
+ * 連続しているので、二分探索で最後の有効なブロックを探し、最後に
+ * その手前のverify_window個を順に確認する（同期前の区間の順序の乱れ対策）
+ * 読み込むブロックはおよそ log2(block_count) + verify_window 個
+ *
+ * @param read_block ブロックを読み込む関数 bool(uint32_t index, uint8_t* buffer)
+ * @param block_count 確保した領域のブロック数
+ * @param buffer 読み込み用のバッファ（BLOCK_SIZE）
+ * @param verify_window 境目の手前を順に確認するブロック数
+ * @return 結果
+ */
+template <typename ReadBlock>
+inline BlockScanResult findLastValidBlock(
+    ReadBlock read_block, uint32_t block_count, uint8_t* buffer,
+    uint32_t verify_window = BLOCK_VERIFY_WINDOW) {
+  BlockScanResult result = {};
+  BlockHeader header;
+
+  auto is_valid = [&](uint32_t index) {
+    result.reads++;
+    return read_block(index, buffer) && readBlockHeader(buffer, &header) &&
+           header.file_id == result.file_id && header.seq == index;
+  };
+
+  // ブロック0が壊れていればファイルIDが分からないので、有効なブロックはない
+  if (block_count == 0) return result;
+  result.reads++;
+  if (!read_block(0, buffer) || !readBlockHeader(buffer, &header) ||
+      header.seq != 0) {
+    return result;
+  }
+  result.file_id = header.file_id;
+
+  // lastは有効、endは無効（確保した領域の終わり）として境目を探す
+  uint32_t last = 0;
+  uint32_t end = block_count;
+  while (end - last > 1) {
+    uint32_t mid = last + (end - last) / 2;
+    if (is_valid(mid)) {
+      last = mid;
+    } else {
+      end = mid;
+    }
+  }
+
+  // 境目の手前に無効なブロックが紛れていないか順に確認する
+  uint32_t first = last > verify_window ? last - verify_window : 1;
+  for (uint32_t index = first; index <= last; index++) {
+    if (!is_valid(index)) {
+      result.valid_blocks = index;
+      return result;
+    }
+  }
+  result.valid_blocks = last + 1;
+  return result;
+}
+
+/**
+ * @brief ブロック形式のファイルから、ペイロードを順につなげて書き出す（ホスト側ツール用）
+ * 最初の無効なブロックで止める
+ * @param in ブロック形式のファイル（先頭から読む）
+ * @param out 書き出し先
+ * @param block_count 書き出したブロックの数
+ * @return 最後まで有効なブロックだったかどうか（途中で止まればfalse）
+ */
+inline bool copyBlockPayloads(FILE* in, FILE* out, uint32_t* block_count) {
+  static uint8_t block[BLOCK_SIZE];
+  BlockHeader header;
+  uint32_t file_id = 0;
+  uint32_t index = 0;
+  bool complete = true;
+  size_t read_size;
+  while ((read_size = fread(block, 1, BLOCK_SIZE, in)) > 0) {
+    if (read_size != BLOCK_SIZE || !readBlockHeader(block, &header) ||
+        header.seq != index || (index > 0 && header.file_id != file_id)) {
+      complete = false;
+      break;
+    }
+    if (index == 0) file_id = header.file_id;
+    fwrite(block + sizeof(BlockHeader), 1, header.payload_size, out);
+    index++;
+  }
+  *block_count = index;
+  return complete;
+}
+
+/**
+ * @brief ブロック形式のファイルなら、ペイロードをつなげた一時ファイルに置き換える（ホスト側ツール用）
+ * ブロック形式でなければ（スキーマv4以前）、先頭に戻してそのまま返す
+ * @param in 入力ファイル（置き換えた場合は閉じる）
+ * @param block_count ブロック形式なら有効なブロックの数、そうでなければ0
+ * @param complete 最後まで有効なブロックだったかどうか
+ * @return 読み込むファイル（一時ファイルを作れなければnullptr）
+ */
+inline FILE* unwrapBlockFile(FILE* in, uint32_t* block_count, bool* complete) {
+  uint8_t magic[sizeof(BLOCK_MAGIC)] = {};
+  size_t size = fread(magic, 1, sizeof(magic), in);
+  rewind(in);
+  *block_count = 0;
+  *complete = true;
+  if (!isBlockFile(magic, size)) {
+    return in;
+  }
+  FILE* payload = tmpfile();
+  if (payload) {
+    *complete = copyBlockPayloads(in, payload, block_count);
+    rewind(payload);
+  }
+  fclose(in);
+  return payload;
+}
+
+}  // namespace LogFormat
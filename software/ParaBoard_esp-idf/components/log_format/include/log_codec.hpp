@@ -0,0 +1,315 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log_format.hpp"
+
+// IMUレコードの差分圧縮と、タグ付きレコードの読み込み
+//
+// 連続するICM-42688のサンプルは少しずつしか変化しないので、直前のIMUレコード
+// からの差分をzigzag/varintで詰めた'D'レコードとして書く
+//   'D'レコード : タグ + 時刻間隔の変化量 + 6軸(加速度xyz、角速度xyz)の差分
+//   時刻間隔の変化量 : (今回の間隔 - 前回の間隔)、キーフレームの直後は前回を0とする
+//   各軸の差分 : 上位/下位バイトを合わせたint16の差分（オーバーフローは折り返す）
+//   サンプル番号 : 直前+1として扱う（取りこぼしがあった時はキーフレームを書く）
+// 'D'レコードは前のレコードがないと復元できないので、一定の件数ごとに
+// 通常のIMUレコード('I')をキーフレームとして書く
+// 差分の方が大きくなる時もキーフレームを書くので、1サンプルがImuRecordより
+// 大きくなることはない（LogFormat::MAX_SAMPLE_SIZEはそのまま使える）
+// ESP-IDFに依存しないため、ホスト側のデコーダからもインクルードできる
+
+namespace LogFormat {
+
+/** 32bitのvarintの最大バイト数 */
+static constexpr size_t MAX_VARINT_SIZE = 5;
+
+/** 符号付き整数を、絶対値が小さいほど小さい符号なし整数に変換する */
+inline uint32_t zigzagEncode(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/** zigzagEncode()の逆変換 */
+inline int32_t zigzagDecode(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief 7bitずつ、続きがあれば最上位bitを立てて書き込む
+ * @param value 書き込む値
+ * @param buffer 書き込み先（MAX_VARINT_SIZE以上）
+ * @return 書き込んだバイト数
+ */
+inline size_t putVarint(uint32_t value, uint8_t* buffer) {
+  size_t used = 0;
+  while (value >= 0x80) {
+    buffer[used++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buffer[used++] = (uint8_t)value;
+  return used;
+}
+
+/**
+ * @brief varintを1つ読み込む
+ * @param fp 入力ファイル
+ * @param value 読み込んだ値
+ * @param size 読み込んだバイト数に加算する
+ * @return 読み込めたかどうか（ファイル末尾、またはMAX_VARINT_SIZEを超えたらfalse）
+ */
+inline bool readVarint(FILE* fp, uint32_t* value, size_t* size) {
+  uint32_t result = 0;
+  for (size_t i = 0; i < MAX_VARINT_SIZE; i++) {
+    int c = fgetc(fp);
+    if (c == EOF) return false;
+    (*size)++;
+    result |= (uint32_t)(c & 0x7f) << (7 * i);
+    if ((c & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** 差分の基準にする直前のIMUサンプル */
+struct ImuDeltaState {
+  bool valid = false;        // キーフレームを書いた（読んだ）後ならtrue
+  uint64_t timestamp_us = 0;
+  uint32_t interval_us = 0;  // 直前の時刻間隔（キーフレームの直後は0）
+  uint32_t seq = 0;
+  uint16_t axes[6] = {};     // 加速度xyz、角速度xyz
+
+  /** 加速度・角速度を軸ごとのint16(上位/下位バイトを合わせた値)にする */
+  static void toAxes(const AccelData& accel, const GyroData& gyro,
+                     uint16_t* axes) {
+    axes[0] = accel.u_x << 8 | accel.d_x;
+    axes[1] = accel.u_y << 8 | accel.d_y;
+    axes[2] = accel.u_z << 8 | accel.d_z;
+    axes[3] = gyro.u_x << 8 | gyro.d_x;
+    axes[4] = gyro.u_y << 8 | gyro.d_y;
+    axes[5] = gyro.u_z << 8 | gyro.d_z;
+  }
+
+  /** toAxes()の逆変換 */
+  static void fromAxes(const uint16_t* axes, AccelData* accel,
+                       GyroData* gyro) {
+    accel->u_x = axes[0] >> 8;
+    accel->d_x = axes[0] & 0xff;
+    accel->u_y = axes[1] >> 8;
+    accel->d_y = axes[1] & 0xff;
+    accel->u_z = axes[2] >> 8;
+    accel->d_z = axes[2] & 0xff;
+    gyro->u_x = axes[3] >> 8;
+    gyro->d_x = axes[3] & 0xff;
+    gyro->u_y = axes[4] >> 8;
+    gyro->d_y = axes[4] & 0xff;
+    gyro->u_z = axes[5] >> 8;
+    gyro->d_z = axes[5] & 0xff;
+  }
+};
+
+/**
+ * @brief センサーデータをレコードに変換する（IMUは差分圧縮する）
+ * 1つのファイルには1つのエンコーダで、書き込む順に変換すること
+ */
+class RecordEncoder {
+ public:
+  /**
+   * @brief 新しいファイル用に状態を初期化する
+   * @param keyframe_interval キーフレーム間隔（レコード数、0なら圧縮しない）
+   */
+  void reset(uint32_t keyframe_interval) {
+    this->keyframe_interval = keyframe_interval;
+    state = ImuDeltaState();
+    since_keyframe = 0;
+    sample_count = 0;
+    keyframe_count = 0;
+    byte_count = 0;
+  }
+
+  /**
+   * @brief センサーデータをレコードに変換する
+   * 入りきらなかった場合は状態を変えないので、次のバッファで同じデータから続けられる
+   * @param data センサーデータ
+   * @param buffer 書き込み先
+   * @param size 書き込み先のサイズ
+   * @return 書き込んだバイト数（入りきらない場合は0）
+   */
+  size_t encode(const SensorData& data, uint8_t* buffer, size_t size) {
+    uint16_t axes[6];
+    ImuDeltaState::toAxes(data.accel, data.gyro, axes);
+
+    // 差分で書けるなら'D'レコードを作る
+    uint8_t imu[sizeof(ImuRecord)];
+    size_t imu_size = 0;
+    uint32_t interval_us = 0;
+    if (keyframe_interval > 0 && state.valid &&
+        since_keyframe < keyframe_interval && data.seq == state.seq + 1 &&
+        data.timestamp_us >= state.timestamp_us &&
+        data.timestamp_us - state.timestamp_us <= INT32_MAX) {
+      interval_us = data.timestamp_us - state.timestamp_us;
+      uint8_t delta[1 + MAX_VARINT_SIZE * 7];
+      size_t used = 0;
+      delta[used++] = static_cast<uint8_t>(RecordTag::IMU_DELTA);
+      used += putVarint(
+          zigzagEncode((int32_t)interval_us - (int32_t)state.interval_us),
+          delta + used);
+      for (int i = 0; i < 6; i++) {
+        used += putVarint(zigzagEncode((int16_t)(axes[i] - state.axes[i])),
+                          delta + used);
+      }
+      // 差分の方が大きい場合はキーフレームにする
+      if (used < sizeof(ImuRecord)) {
+        memcpy(imu, delta, used);
+        imu_size = used;
+      }
+    }
+    bool keyframe = (imu_size == 0);
+    if (keyframe) {
+      imu_size = encodeImuRecord(data, imu);
+      interval_us = 0;
+    }
+
+    size_t needed = imu_size + auxRecordsSize(data);
+    if (size < needed) return 0;
+    memcpy(buffer, imu, imu_size);
+    encodeAuxRecords(data, buffer + imu_size);
+
+    state.valid = true;
+    state.timestamp_us = data.timestamp_us;
+    state.interval_us = interval_us;
+    state.seq = data.seq;
+    memcpy(state.axes, axes, sizeof(axes));
+    since_keyframe = keyframe ? 1 : since_keyframe + 1;
+    sample_count++;
+    if (keyframe) keyframe_count++;
+    byte_count += needed;
+    return needed;
+  }
+
+  /** reset()してから変換したサンプル数 */
+  uint32_t getSampleCount() const { return sample_count; }
+  /** reset()してから書いたキーフレームの数 */
+  uint32_t getKeyframeCount() const { return keyframe_count; }
+  /** reset()してから書き込んだバイト数 */
+  uint64_t getByteCount() const { return byte_count; }
+
+ private:
+  uint32_t keyframe_interval = 0;
+  ImuDeltaState state;
+  uint32_t since_keyframe = 0;  // 直前のキーフレームから数えたIMUレコード数
+  uint32_t sample_count = 0;
+  uint32_t keyframe_count = 0;
+  uint64_t byte_count = 0;
+};
+
+/** 読み込んだ1レコード分のデータ */
+struct Record {
+  RecordTag tag;  // 'D'レコードは復元してIMUとして返す
+  size_t size;    // ファイル上のバイト数
+  uint64_t timestamp_us;
+  uint32_t seq;  // IMUのみ
+  AccelData accel;
+  GyroData gyro;
+  PressureData pressure;
+  TempData temperature;
+  IcmTempData icm_temp;
+};
+
+/**
+ * @brief タグ付きレコードを先頭から順に読み込む（'D'レコードも復元する）
+ */
+class RecordReader {
+ public:
+  /** ファイルの先頭（ヘッダの直後）から読み直す時に呼ぶ */
+  void reset() { state = ImuDeltaState(); }
+
+  /**
+   * @brief レコードを1つ読み込む
+   * @param fp 入力ファイル（ヘッダの直後、またはレコードの境界を指していること）
+   * @param record 読み込んだレコード
+   * @return 読み込めたかどうか（ファイル末尾、または壊れたレコードならfalse）
+   */
+  bool read(FILE* fp, Record* record) {
+    int tag = fgetc(fp);
+    if (tag == EOF) return false;
+    memset(record, 0, sizeof(*record));
+    record->tag = static_cast<RecordTag>(tag);
+
+    switch (record->tag) {
+      case RecordTag::IMU: {
+        ImuRecord imu;
+        if (!readRest(fp, tag, &imu, sizeof(imu))) return false;
+        record->size = sizeof(imu);
+        record->timestamp_us = imu.timestamp_us;
+        record->seq = imu.seq;
+        memcpy(&record->accel, imu.accel, sizeof(imu.accel));
+        memcpy(&record->gyro, imu.gyro, sizeof(imu.gyro));
+        state.valid = true;
+        state.timestamp_us = imu.timestamp_us;
+        state.interval_us = 0;
+        state.seq = imu.seq;
+        ImuDeltaState::toAxes(record->accel, record->gyro, state.axes);
+        return true;
+      }
+      case RecordTag::IMU_DELTA: {
+        // キーフレームを読む前の差分は復元できない
+        if (!state.valid) return false;
+        size_t size = 1;
+        uint32_t value;
+        if (!readVarint(fp, &value, &size)) return false;
+        int64_t interval_us = (int64_t)state.interval_us + zigzagDecode(value);
+        if (interval_us < 0 || interval_us > INT32_MAX) return false;
+        uint16_t axes[6];
+        for (int i = 0; i < 6; i++) {
+          if (!readVarint(fp, &value, &size)) return false;
+          axes[i] = state.axes[i] + (uint16_t)zigzagDecode(value);
+        }
+        state.timestamp_us += interval_us;
+        state.interval_us = interval_us;
+        state.seq++;
+        memcpy(state.axes, axes, sizeof(axes));
+
+        record->tag = RecordTag::IMU;
+        record->size = size;
+        record->timestamp_us = state.timestamp_us;
+        record->seq = state.seq;
+        ImuDeltaState::fromAxes(axes, &record->accel, &record->gyro);
+        return true;
+      }
+      case RecordTag::BARO: {
+        BaroRecord baro;
+        if (!readRest(fp, tag, &baro, sizeof(baro))) return false;
+        record->size = sizeof(baro);
+        record->timestamp_us = baro.timestamp_us;
+        memcpy(&record->pressure, baro.pressure, sizeof(baro.pressure));
+        memcpy(&record->temperature, baro.temp, sizeof(baro.temp));
+        return true;
+      }
+      case RecordTag::ICM_TEMP: {
+        IcmTempRecord icm_temp;
+        if (!readRest(fp, tag, &icm_temp, sizeof(icm_temp))) return false;
+        record->size = sizeof(icm_temp);
+        record->timestamp_us = icm_temp.timestamp_us;
+        memcpy(&record->icm_temp, icm_temp.temp, sizeof(icm_temp.temp));
+        return true;
+      }
+    }
+    // 不明なタグ
+    return false;
+  }
+
+ private:
+  ImuDeltaState state;
+
+  /** 固定長レコードのタグ以降を読み込む */
+  static bool readRest(FILE* fp, int tag, void* record, size_t size) {
+    uint8_t* bytes = static_cast<uint8_t*>(record);
+    bytes[0] = tag;
+    return fread(bytes + 1, size - 1, 1, fp) == 1;
+  }
+};
+
+}  // namespace LogFormat
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sensor_data.hpp"
+
+// バイナリログ(log-N.bin)のフォーマット定義
+// ファイルは FileHeader 1つと、タグ付きのレコードの並びで構成される
+// （スキーマv5以降は、これを固定長のブロックに分けて格納する。log_block.hpp）
+// レコードは先頭1バイトのタグで種類を表し、種類ごとに長さが決まっている
+//   ImuRecord     : 加速度・角速度（1kHz、毎サンプル）
+//   BaroRecord    : 気圧・温度（LPS25HBから新しい値を読んだ時のみ）
+//   IcmTempRecord : ICM-42688の温度（低レート）
+//   'D'レコード   : 直前のIMUレコードからの差分（差分圧縮時のみ、log_codec.hpp）
+// 各レコードはそれぞれ取得した時刻を持ち、ファイル内では時刻順に並ぶ
+// マルチバイトの値はすべてリトルエンディアンで格納する
+// センサーの生データ(加速度・角速度・気圧・温度)はレジスタから読んだ順のまま格納する
+// ESP-IDFに依存しないため、ホスト側のデコーダからもインクルードできる
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "log_format.hpp assumes a little-endian target"
+#endif
+
+namespace LogFormat {
+
+/** ファイル先頭のマジック "PBLG" */
+static constexpr char MAGIC[4] = {'P', 'B', 'L', 'G'};
+/** スキーマバージョン(レコード構造を変えたら上げる) */
+// v2: レコードにサンプル番号(seq)を追加
+// v3: タグ付きの可変長レコード（気圧・ICMの温度を別レコードに分離）
+// v4: IMUの差分レコード('D')を追加、ヘッダにキーフレーム間隔を追加
+// v5: ファイル全体をCRC付きの固定長ブロックで包む（log_block.hpp）
+//     ブロックのペイロードをつなげたものはv4と同じ
+// v6: ヘッダにSDカードのクロックと起動時に計測した書き込み速度を追加
+static constexpr uint16_t SCHEMA_VERSION = 6;
+/** 読み込み可能な最も古いスキーマバージョン(v4以降はv3の上位互換) */
+static constexpr uint16_t MIN_SCHEMA_VERSION = 3;
+
+/** 加速度レンジ(±g) */
+static constexpr uint16_t ACCEL_RANGE_G = 16;
+/** 角速度レンジ(±dps) */
+static constexpr uint16_t GYRO_RANGE_DPS = 2000;
+/** 気圧の分解能(LSB/hPa) */
+static constexpr uint16_t PRESSURE_LSB_PER_HPA = 4096;
+/** 温度の分解能(LSB/℃) */
+static constexpr uint16_t TEMP_LSB_PER_DEGC = 480;
+/** 温度のオフセット(0.1℃単位、42.5℃) */
+static constexpr int16_t TEMP_OFFSET_DECI_DEGC = 425;
+
+struct __attribute__((packed)) FileHeader {
+  char magic[4];
+  uint16_t schema_version;
+  uint16_t header_size;
+  uint16_t record_size;
+  uint16_t sample_rate_hz;
+  uint32_t boot_id;
+  uint16_t accel_range_g;
+  uint16_t gyro_range_dps;
+  uint16_t pressure_lsb_per_hpa;
+  uint16_t temp_lsb_per_degc;
+  int16_t temp_offset_deci_degc;
+  uint16_t keyframe_interval;  // 差分圧縮のキーフレーム間隔（0なら圧縮なし）
+  uint32_t sd_freq_khz;        // SDカードのクロック（v5以前は0）
+  uint32_t sd_write_kbps;      // 起動時に計測した書き込み速度（kB/s、v5以前は0）
+  uint8_t reserved[28];
+};
+
+/** レコードの種類 */
+enum class RecordTag : uint8_t {
+  IMU = 'I',
+  BARO = 'B',
+  ICM_TEMP = 'T',
+  IMU_DELTA = 'D',  // 可変長（log_codec.hpp）
+};
+
+struct __attribute__((packed)) ImuRecord {
+  uint8_t tag;  // RecordTag::IMU
+  uint64_t timestamp_us;
+  uint32_t seq;      // サンプル番号
+  uint8_t accel[6];  // u_x, d_x, u_y, d_y, u_z, d_z
+  uint8_t gyro[6];   // u_x, d_x, u_y, d_y, u_z, d_z
+};
+
+struct __attribute__((packed)) BaroRecord {
+  uint8_t tag;  // RecordTag::BARO
+  uint64_t timestamp_us;
+  uint8_t pressure[3];  // xl_p, l_p, h_p
+  uint8_t temp[2];      // l_t, h_t
+};
+
+struct __attribute__((packed)) IcmTempRecord {
+  uint8_t tag;  // RecordTag::ICM_TEMP
+  uint64_t timestamp_us;
+  uint8_t temp[2];  // u_t, d_t
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader must be 64 bytes");
+static_assert(sizeof(ImuRecord) == 25, "ImuRecord must be 25 bytes");
+static_assert(sizeof(BaroRecord) == 14, "BaroRecord must be 14 bytes");
+static_assert(sizeof(IcmTempRecord) == 11, "IcmTempRecord must be 11 bytes");
+
+/** 1サンプル(SensorData)から作られるレコードの最大の合計サイズ */
+static constexpr size_t MAX_SAMPLE_SIZE =
+    sizeof(ImuRecord) + sizeof(BaroRecord) + sizeof(IcmTempRecord);
+
+/**
+ * @brief タグからレコードの長さを取得する
+ * @param tag レコードの先頭1バイト
+ * @return レコードの長さ（不明なタグなら0）
+ */
+inline size_t recordSize(uint8_t tag) {
+  switch (static_cast<RecordTag>(tag)) {
+    case RecordTag::IMU:
+      return sizeof(ImuRecord);
+    case RecordTag::BARO:
+      return sizeof(BaroRecord);
+    case RecordTag::ICM_TEMP:
+      return sizeof(IcmTempRecord);
+    case RecordTag::IMU_DELTA:
+      return 0;  // 可変長なので中身を読まないと分からない
+  }
+  return 0;
+}
+
+/**
+ * @brief レコードの時刻を取得する（全てのレコードで同じ位置にある）
+ * @param record レコードの先頭
+ * @return 時刻(us)
+ */
+inline uint64_t recordTimestamp(const uint8_t* record) {
+  uint64_t timestamp_us;
+  memcpy(&timestamp_us, record + 1, sizeof(timestamp_us));
+  return timestamp_us;
+}
+
+/**
+ * @brief ファイルヘッダを作成する
+ * @param boot_id 起動ごとに一意なID
+ * @param sample_rate_hz サンプリング周波数
+ * @param keyframe_interval 差分圧縮のキーフレーム間隔（0なら圧縮なし）
+ * @return ファイルヘッダ
+ */
+inline FileHeader makeFileHeader(uint32_t boot_id, uint16_t sample_rate_hz,
+                                 uint16_t keyframe_interval = 0) {
+  FileHeader header = {};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.schema_version = SCHEMA_VERSION;
+  header.header_size = sizeof(FileHeader);
+  header.record_size = 0;  // v3以降は可変長（タグで判別する）
+  header.sample_rate_hz = sample_rate_hz;
+  header.boot_id = boot_id;
+  header.accel_range_g = ACCEL_RANGE_G;
+  header.gyro_range_dps = GYRO_RANGE_DPS;
+  header.pressure_lsb_per_hpa = PRESSURE_LSB_PER_HPA;
+  header.temp_lsb_per_degc = TEMP_LSB_PER_DEGC;
+  header.temp_offset_deci_degc = TEMP_OFFSET_DECI_DEGC;
+  header.keyframe_interval = keyframe_interval;
+  return header;
+}
+
+/**
+ * @brief ファイルヘッダが読み込み可能か確認する
+ * @param header ファイルヘッダ
+ * @return マジックが一致し、読み込めるバージョンならtrue
+ */
+inline bool isValidFileHeader(const FileHeader& header) {
+  return memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+         header.schema_version >= MIN_SCHEMA_VERSION &&
+         header.schema_version <= SCHEMA_VERSION &&
+         header.header_size == sizeof(FileHeader) && header.record_size == 0;
+}
+
+/**
+ * @brief IMUレコードを書き込む
+ * @param data センサーデータ
+ * @param buffer 書き込み先（sizeof(ImuRecord)以上）
+ * @return 書き込んだバイト数
+ */
+inline size_t encodeImuRecord(const SensorData& data, uint8_t* buffer) {
+  ImuRecord imu;
+  imu.tag = static_cast<uint8_t>(RecordTag::IMU);
+  imu.timestamp_us = data.timestamp_us;
+  imu.seq = data.seq;
+  memcpy(imu.accel, &data.accel, sizeof(imu.accel));
+  memcpy(imu.gyro, &data.gyro, sizeof(imu.gyro));
+  memcpy(buffer, &imu, sizeof(imu));
+  return sizeof(imu);
+}
+
+/**
+ * @brief 気圧とICMの温度のレコードの合計サイズを取得する
+ * @param data センサーデータ
+ * @return 新しい値がある分のレコードの合計サイズ
+ */
+inline size_t auxRecordsSize(const SensorData& data) {
+  size_t size = 0;
+  if (data.flags & SENSOR_DATA_HAS_BARO) size += sizeof(BaroRecord);
+  if (data.flags & SENSOR_DATA_HAS_ICM_TEMP) size += sizeof(IcmTempRecord);
+  return size;
+}
+
+/**
+ * @brief 気圧とICMの温度のレコードを、新しい値がある時だけ書き込む
+ * @param data センサーデータ
+ * @param buffer 書き込み先（auxRecordsSize()以上）
+ * @return 書き込んだバイト数
+ */
+inline size_t encodeAuxRecords(const SensorData& data, uint8_t* buffer) {
+  size_t used = 0;
+  // 気圧・温度はIMUの後に読むので、時刻順はIMU→気圧→ICMの温度になる
+  if (data.flags & SENSOR_DATA_HAS_BARO) {
+    BaroRecord baro;
+    baro.tag = static_cast<uint8_t>(RecordTag::BARO);
+    baro.timestamp_us = data.baro_timestamp_us;
+    memcpy(baro.pressure, &data.pressure, sizeof(baro.pressure));
+    memcpy(baro.temp, &data.temperature, sizeof(baro.temp));
+    memcpy(buffer + used, &baro, sizeof(baro));
+    used += sizeof(baro);
+  }
+  if (data.flags & SENSOR_DATA_HAS_ICM_TEMP) {
+    IcmTempRecord icm_temp;
+    icm_temp.tag = static_cast<uint8_t>(RecordTag::ICM_TEMP);
+    icm_temp.timestamp_us = data.icm_temp_timestamp_us;
+    memcpy(icm_temp.temp, &data.icm_temp, sizeof(icm_temp.temp));
+    memcpy(buffer + used, &icm_temp, sizeof(icm_temp));
+    used += sizeof(icm_temp);
+  }
+  return used;
+}
+
+/**
+ * @brief センサーデータをレコードに変換する
+ * IMUレコードは必ず、気圧とICMの温度は新しい値がある時だけ書き込む
+ * @param data センサーデータ
+ * @param buffer 書き込み先
+ * @param size 書き込み先のサイズ
+ * @return 書き込んだバイト数（入りきらない場合は0）
+ */
+inline size_t encodeRecords(const SensorData& data, uint8_t* buffer,
+                            size_t size) {
+  if (size < sizeof(ImuRecord) + auxRecordsSize(data)) return 0;
+  size_t used = encodeImuRecord(data, buffer);
+  return used + encodeAuxRecords(data, buffer + used);
+}
+
+}  // namespace LogFormat
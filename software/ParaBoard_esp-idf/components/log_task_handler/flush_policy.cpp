@@ -0,0 +1,62 @@
+#include "flush_policy.hpp"
+
+void FlushPolicy::configure(size_t max_pending_bytes, uint32_t max_age_ms) {
+  this->max_pending_bytes = max_pending_bytes;
+  max_age_us = (int64_t)max_age_ms * 1000;
+}
+
+void FlushPolicy::reset() {
+  pending_bytes = 0;
+  oldest_us = 0;
+  stats = {};
+}
+
+void FlushPolicy::onWritten(size_t bytes, int64_t written_oldest_us) {
+  if (bytes == 0) {
+    return;
+  }
+  if (pending_bytes == 0 || written_oldest_us < oldest_us) {
+    oldest_us = written_oldest_us;
+  }
+  pending_bytes += bytes;
+}
+
+bool FlushPolicy::shouldSync(int64_t now_us, FlushReason* reason) const {
+  if (pending_bytes == 0) {
+    return false;
+  }
+  if (pending_bytes >= max_pending_bytes) {
+    *reason = FlushReason::BYTES;
+    return true;
+  }
+  if (now_us - oldest_us >= max_age_us) {
+    *reason = FlushReason::AGE;
+    return true;
+  }
+  return false;
+}
+
+int64_t FlushPolicy::getTimeUntilDeadlineUs(int64_t now_us) const {
+  if (pending_bytes == 0) {
+    return -1;
+  }
+  int64_t remaining_us = oldest_us + max_age_us - now_us;
+  return remaining_us > 0 ? remaining_us : 0;
+}
+
+void FlushPolicy::onSynced(FlushReason reason, int64_t now_us,
+                           int64_t sync_us) {
+  stats.syncs[static_cast<uint8_t>(reason)]++;
+  stats.synced_bytes += pending_bytes;
+  if (sync_us > stats.max_sync_us) {
+    stats.max_sync_us = sync_us;
+  }
+  if (pending_bytes > 0 && now_us - oldest_us > stats.max_unsynced_us) {
+    stats.max_unsynced_us = now_us - oldest_us;
+  }
+  if (pending_bytes > stats.max_pending_bytes) {
+    stats.max_pending_bytes = pending_bytes;
+  }
+  pending_bytes = 0;
+  oldest_us = 0;
+}
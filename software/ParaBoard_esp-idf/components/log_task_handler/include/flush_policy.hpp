@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief SDカードへの同期(fflush+fsync)を行った理由
+ */
+enum class FlushReason : uint8_t {
+  BYTES,  // 同期していないデータがflush_max_pending_bytesに達した
+  AGE,    // 同期していない最も古いデータがflush_max_age_msに達した
+  EVENT,  // 離床・頂点・モード変更
+  STOP,   // ログタスクの停止
+};
+
+/**
+ * @brief 同期の統計
+ */
+struct FlushStats {
+  uint32_t syncs[4];          // 理由(FlushReason)ごとの同期回数
+  uint64_t synced_bytes;      // 同期したデータの合計
+  int64_t max_sync_us;        // 1回の同期にかかった最大時間
+  int64_t max_unsynced_us;    // 同期した時点で最も古かったデータの最大の経過時間
+  size_t max_pending_bytes;   // 同期した時点で溜まっていたデータの最大
+};
+
+/**
+ * @brief いつSDカードへ同期するかを決める
+ *
+ * 書き込んだが同期していないデータの量と、その中で最も古いデータの経過時間を
+ * 管理し、どちらかが上限に達した時だけ同期が必要と判定する。
+ * 書き込みタスクだけが使う（時刻は呼び出し側から渡す）
+ */
+class FlushPolicy {
+ public:
+  /**
+   * @brief 上限を設定する
+   * @param max_pending_bytes 同期していないデータの上限（0なら書き込むたびに同期する）
+   * @param max_age_ms 同期していないデータの経過時間の上限（0なら書き込むたびに同期する）
+   */
+  void configure(size_t max_pending_bytes, uint32_t max_age_ms);
+
+  size_t getMaxPendingBytes() const { return max_pending_bytes; }
+  uint32_t getMaxAgeMs() const { return max_age_us / 1000; }
+
+  /**
+   * @brief 同期していないデータと統計をリセットする（ログタスクの開始時に呼ぶ）
+   */
+  void reset();
+
+  /**
+   * @brief 書き込んだ（まだ同期していない）データを記録する
+   * @param bytes 書き込んだバイト数
+   * @param oldest_us 書き込んだデータのうち最も古いものを変換した時刻
+   */
+  void onWritten(size_t bytes, int64_t oldest_us);
+
+  /**
+   * @brief 同期していないデータがあるかどうか
+   */
+  bool hasPending() const { return pending_bytes > 0; }
+
+  /**
+   * @brief 上限に達していて同期が必要かどうかを判定する
+   * @param now_us 現在時刻
+   * @param reason 同期が必要な理由（BYTESまたはAGE）
+   * @return 同期が必要ならtrue
+   */
+  bool shouldSync(int64_t now_us, FlushReason* reason) const;
+
+  /**
+   * @brief 経過時間の上限に達するまでの時間を取得する
+   * @param now_us 現在時刻
+   * @return 残り時間（同期していないデータがなければ-1）
+   */
+  int64_t getTimeUntilDeadlineUs(int64_t now_us) const;
+
+  /**
+   * @brief 同期したことを記録する
+   * @param reason 同期した理由
+   * @param now_us 同期を始めた時刻
+   * @param sync_us 同期にかかった時間
+   */
+  void onSynced(FlushReason reason, int64_t now_us, int64_t sync_us);
+
+  FlushStats getStats() const { return stats; }
+
+ private:
+  size_t max_pending_bytes = 0;
+  int64_t max_age_us = 0;
+
+  size_t pending_bytes = 0;  // 書き込んだが同期していないバイト数
+  int64_t oldest_us = 0;     // 同期していないデータのうち最も古いものの時刻
+  FlushStats stats = {};
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/**
+ * @brief ログバッファの使用状況
+ */
+struct LogBufferStats {
+  uint32_t buffers_written;   // 書き込んだバッファの数
+  uint32_t max_full_buffers;  // 書き込み待ちになったバッファの最大数
+  uint32_t stall_count;       // 空きバッファがなく待たされた回数
+  int64_t max_stall_us;       // 空きバッファを待った最大時間
+  int64_t max_write_us;       // 1バッファの書き込みにかかった最大時間
+};
+
+/**
+ * @brief DMA対応領域に確保したログバッファのプール
+ *
+ * 書き込む側は空きバッファを取得して埋め、書き込み待ちとして渡す。
+ * SDカードへ書き込む側は書き込み待ちのバッファを受け取り、書き終わったら返す。
+ * タスク間ではバッファの番号だけを受け渡すので、データのコピーは発生しない
+ */
+class LogBufferPool {
+ public:
+  /** バッファの境界とサイズを揃える単位（SDカードのセクタサイズ） */
+  static constexpr size_t SECTOR_SIZE = 512;
+  static constexpr size_t MAX_BUFFER_COUNT = 8;
+
+  LogBufferPool();
+  ~LogBufferPool();
+
+  /**
+   * @brief バッファを確保する
+   * @param buffer_count バッファの数（2以上）
+   * @param buffer_size 1つあたりのサイズ（SECTOR_SIZEの倍数）
+   * @return 確保に成功したかどうか
+   */
+  bool init(size_t buffer_count, size_t buffer_size);
+
+  /**
+   * @brief 空きバッファを取得する（空きがなければ待つ）
+   * @param index 取得したバッファの番号
+   * @param timeout 最大待ち時間
+   * @return 取得できたかどうか
+   */
+  bool acquire(uint8_t* index, TickType_t timeout);
+
+  /**
+   * @brief 埋めたバッファを書き込み待ちとして渡す
+   * @param index バッファの番号
+   * @param length 書き込むバイト数（0なら同期の要求だけを渡す）
+   * @param oldest_us バッファ内の最も古いデータを変換した時刻
+   * @param sync 書き込んだ後すぐにSDカードへ同期させるかどうか
+   */
+  void submit(uint8_t index, size_t length, int64_t oldest_us = 0,
+              bool sync = false);
+
+  /**
+   * @brief 書き込み待ちのバッファを受け取る
+   * @param index 受け取ったバッファの番号
+   * @param timeout 最大待ち時間
+   * @return 受け取れたかどうか
+   */
+  bool receive(uint8_t* index, TickType_t timeout);
+
+  /**
+   * @brief 書き込みが終わったバッファを空きに戻す
+   * @param index バッファの番号
+   * @param write_us 書き込みにかかった時間
+   */
+  void release(uint8_t index, int64_t write_us);
+
+  uint8_t* getData(uint8_t index) const { return buffers[index]; }
+  size_t getLength(uint8_t index) const { return lengths[index]; }
+  int64_t getOldestUs(uint8_t index) const { return oldest_us[index]; }
+  bool isSyncRequested(uint8_t index) const { return sync_flags[index]; }
+  size_t getBufferSize() const { return buffer_size; }
+  size_t getBufferCount() const { return buffer_count; }
+
+  /**
+   * @brief 空きバッファの数を取得する
+   */
+  size_t getFreeCount() const;
+
+  /**
+   * @brief 使用状況を取得する
+   */
+  LogBufferStats getStats() const { return stats; }
+
+  /**
+   * @brief 使用状況をリセットする
+   */
+  void resetStats();
+
+ private:
+  static constexpr const char* TAG = "LOG_BUFFER_POOL";
+
+  uint8_t* buffers[MAX_BUFFER_COUNT] = {};
+  size_t lengths[MAX_BUFFER_COUNT] = {};
+  int64_t oldest_us[MAX_BUFFER_COUNT] = {};
+  bool sync_flags[MAX_BUFFER_COUNT] = {};
+  size_t buffer_count = 0;
+  size_t buffer_size = 0;
+
+  QueueHandle_t free_queue = nullptr;  // 空きバッファの番号
+  QueueHandle_t full_queue = nullptr;  // 書き込み待ちのバッファの番号
+
+  LogBufferStats stats = {};
+};
@@ -2,12 +2,28 @@
 
 #include <stdio.h>
 
+#include <atomic>
+
 #include "config.hpp"
 #include "esp_log.h"
+#include "flush_policy.hpp"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/task.h"
+#include "log_block.hpp"
+#include "log_buffer_pool.hpp"
 #include "sd_controller.hpp"
+#include "spsc_ring.hpp"
+
+/**
+ * @brief ログタスクがまとめて取り出した単位（バッチ）の統計
+ */
+struct LogBatchStats {
+  uint32_t batches;       // バッチの数
+  uint64_t samples;       // 取り出したサンプルの合計
+  uint32_t max_batch;     // 1バッチの最大サンプル数
+  int64_t total_batch_us; // 変換と受け渡しにかかった時間の合計
+  int64_t max_batch_us;   // 1バッチの最大時間
+};
 
 class LogTaskHandler {
  public:
@@ -28,13 +44,15 @@ class LogTaskHandler {
 
   /**
    * @brief ログタスクを停止する
+   * 書きかけのバッファを含め、全てのバッファを書き終えてから書き込みタスクを止める
    */
   void stopTask();
 
   /**
-   * @brief ログキューにデータを送信する
+   * @brief リングバッファにデータを追加する（センサータスクから呼ぶ）
+   * 一定数溜まったらログタスクに通知する
    * @param data センサーデータ
-   * @return 送信が成功したかどうか
+   * @return 追加が成功したかどうか（満杯ならfalse）
    */
   bool sendToQueue(const SensorData& data);
 
@@ -45,26 +63,207 @@ class LogTaskHandler {
   TaskHandle_t getTaskHandle() const { return log_task_handle; }
 
   /**
-   * @brief ログキューを取得する
-   * @return ログキュー
+   * @brief リングバッファに溜まっているデータ数を取得する
+   * @return データ数
+   */
+  size_t getQueuedCount() const { return log_ring.size(); }
+
+  /**
+   * @brief リングバッファの容量を取得する
+   * @return 容量（データ数）
+   */
+  size_t getQueueCapacity() const { return log_ring.capacity(); }
+
+  /**
+   * @brief LOGGING開始からのリングバッファの最大使用数を取得する
+   * @return 最大使用数（データ数）
+   */
+  size_t getMaxQueuedCount() const { return max_queued; }
+
+  /**
+   * @brief ログバッファの使用状況を取得する
+   * @return ログバッファの使用状況
+   */
+  LogBufferStats getBufferStats() const { return buffer_pool.getStats(); }
+
+  /**
+   * @brief バッチの統計を取得する
+   * @return バッチの統計
+   */
+  LogBatchStats getBatchStats() const { return batch_stats; }
+
+  /**
+   * @brief SDカードへの同期の統計を取得する
+   * @return 同期の統計
+   */
+  FlushStats getFlushStats() const { return flush_policy.getStats(); }
+
+  /**
+   * @brief 同期の上限（flush_max_pending_bytes）を取得する
+   */
+  size_t getFlushMaxPendingBytes() const {
+    return flush_policy.getMaxPendingBytes();
+  }
+
+  /**
+   * @brief 同期の上限（flush_max_age_ms）を取得する
+   */
+  uint32_t getFlushMaxAgeMs() const { return flush_policy.getMaxAgeMs(); }
+
+  /**
+   * @brief 書きかけのデータも含めて、すぐにSDカードへ同期させる
+   * 頂点検知やモード変更の時に呼ぶ（flush_on_eventがfalseなら何もしない）
+   */
+  void requestSync();
+
+  /**
+   * @brief 離床を検知したことを通知する（センサータスクから呼ぶ）
+   * プリトリガモードでは、溜めておいた離床前のデータを書き込んでから記録を始める
+   */
+  void trigger();
+
+  /**
+   * @brief プリトリガモードかどうかを取得する
+   * @return pretrigger_secondsが正で、履歴バッファを確保できていればtrue
    */
-  QueueHandle_t getQueue() const { return log_queue; }
+  bool isPretriggerEnabled() const { return history.capacity() > 0; }
+
+  /**
+   * @brief 離床の通知を受けたかどうかを取得する
+   * @return 通知を受けていればtrue
+   */
+  bool isTriggered() const { return triggered; }
 
  private:
   static constexpr const char* TAG = "LOG_TASK_HANDLER";
-  static constexpr int QUEUE_SIZE = 10;
+  static constexpr int DEFAULT_RING_CAPACITY = 2048;
+  // log_batch_size: この数だけ溜まったらログタスクに通知し、1回に取り出す
+  static constexpr int DEFAULT_BATCH_SIZE = 16;
+  static constexpr int MAX_BATCH_SIZE = 256;
+  // log_batch_wait_ms: 通知がなくてもこの時間ごとにリングバッファを確認する
+  static constexpr int DEFAULT_BATCH_WAIT_MS = 20;
+  // pretrigger_seconds: 離床前のデータを溜めておく秒数の上限
+  static constexpr int MAX_PRETRIGGER_SECONDS = 60;
+  static constexpr int SAMPLE_RATE_HZ = 1000;
+  // 停止を要求した後、ログタスクの書き残しがこの時間減らなければ止まっているとみなす
+  static constexpr int STOP_TIMEOUT_MS = 1000;
+  // 停止を待つ間に、書き残しの数を表示する間隔
+  static constexpr int STOP_REPORT_INTERVAL_MS = 1000;
   static constexpr int TASK_STACK_SIZE = 4096;
   static constexpr int TASK_PRIORITY = 5;
-  static constexpr int DEFAULT_FLUSH_COUNT = 40;
+  // SDカードへの書き込みはログタスクより優先度を下げ、変換を先に進める
+  static constexpr int WRITER_TASK_STACK_SIZE = 4096;
+  static constexpr int WRITER_TASK_PRIORITY = TASK_PRIORITY - 1;
+  static constexpr size_t BUFFER_COUNT = 4;
+  // バイナリ形式では1つのバッファがそのまま1つのブロックになる
+  static constexpr size_t BUFFER_SIZE = 4 * 1024;
+  static_assert(BUFFER_SIZE == LogFormat::BLOCK_SIZE,
+                "log buffer must hold exactly one log block");
+  // 停止時に書き込みタスクが全てのバッファを書き終えるのを待つ最大時間
+  static constexpr int DRAIN_TIMEOUT_MS = 2000;
+  // flush_max_pending_bytes: 同期していないデータがこの量に達したら同期する
+  static constexpr int DEFAULT_FLUSH_MAX_PENDING_BYTES = 32 * 1024;
+  // 同期していない区間（この量とバッファの分）が、復旧時に順に確認する
+  // ブロック数（BLOCK_VERIFY_WINDOW）に収まる上限
+  static constexpr int MAX_FLUSH_PENDING_BYTES =
+      (LogFormat::BLOCK_VERIFY_WINDOW - BUFFER_COUNT) * BUFFER_SIZE;
+  static_assert(DEFAULT_FLUSH_MAX_PENDING_BYTES <= MAX_FLUSH_PENDING_BYTES,
+                "default flush limit must fit in the recovery window");
+  // flush_max_age_ms: 同期していない最も古いデータがこの時間経ったら同期する
+  static constexpr int DEFAULT_FLUSH_MAX_AGE_MS = 500;
 
   TaskHandle_t log_task_handle = nullptr;
-  QueueHandle_t log_queue = nullptr;
+  TaskHandle_t writer_task_handle = nullptr;
+  SpscRing<SensorData> log_ring;
+  SensorData* batch = nullptr;  // リングバッファから取り出したデータ
+  size_t batch_size = DEFAULT_BATCH_SIZE;
+  TickType_t batch_wait_ticks = pdMS_TO_TICKS(DEFAULT_BATCH_WAIT_MS);
+  int64_t batch_wait_us = DEFAULT_BATCH_WAIT_MS * 1000;
+  LogBatchStats batch_stats = {};
   SdController* logger = nullptr;
-  int flush_count = DEFAULT_FLUSH_COUNT;
+  std::atomic<size_t> max_queued{0};
+  // プリトリガモードで離床前のデータを溜めておく履歴バッファ（ログタスクのみが使う）
+  // 離床後は書き終わるまで、リングバッファから取り出したデータを後ろに並べる
+  SpscRing<SensorData> history;
+  // 離床前のデータを書き込んでいる間の計測（ログタスクのみが使う）
+  int64_t commit_start_us = 0;   // 書き込みを始めた時刻（書いていなければ0）
+  size_t commit_samples = 0;     // 書き込んだサンプル数
+  size_t commit_max_queued = 0;  // その間にリングバッファに溜まっていた最大数
+  uint32_t commit_dropped = 0;   // 履歴バッファが満杯で捨てた古いサンプル数
+  std::atomic<bool> triggered{false};
+  std::atomic<bool> stop_requested{false};
+  // 同期の判定（書き込みタスクのみが使う）と、イベントによる同期の要求
+  FlushPolicy flush_policy;
+  bool sync_on_event = true;
+  std::atomic<bool> sync_requested{false};
+  std::atomic<bool> task_finished{false};
+
+  LogBufferPool buffer_pool;
+  int active_buffer = -1;      // ログタスクが埋めているバッファの番号
+  size_t active_length = 0;    // 埋めたバイト数（先頭のブロックヘッダの分を含む）
+  size_t block_header_size = 0;  // バッファの先頭に空けておくバイト数
+  int64_t active_oldest_us = 0;  // 埋め始めた時刻
 
   /**
-   * @brief ログタスク関数
+   * @brief ログタスク関数（センサーデータを変換してバッファに詰める）
    * @param pvParameters タスクパラメータ
    */
   static void logTask(void* pvParameters);
+
+  /**
+   * @brief 書き込みタスク関数（埋まったバッファをSDカードへ書き込む）
+   * @param pvParameters タスクパラメータ
+   */
+  static void writerTask(void* pvParameters);
+
+  /**
+   * @brief リングバッファのデータをバッチ単位で取り出し、ログバッファに変換する
+   */
+  void drainRing();
+
+  /**
+   * @brief 履歴バッファにデータを追加する（満杯なら古いものから捨てる）
+   * @param samples センサーデータ
+   * @param count データ数
+   */
+  void storeHistory(const SensorData* samples, size_t count);
+
+  /**
+   * @brief 履歴バッファのデータを古い順にログバッファに変換する
+   * @param wait trueなら全て変換する（空きバッファを待つ）
+   *        falseなら空きバッファがある間だけ変換し、残りは次に呼ばれた時に続ける
+   *        （書き込みを待つ間もリングバッファを読み出せるようにする）
+   */
+  void commitHistory(bool wait);
+
+  /**
+   * @brief センサーデータをログバッファに変換し、埋まったら書き込みタスクへ渡す
+   * @param samples センサーデータ
+   * @param count データ数
+   */
+  void encodeSamples(const SensorData* samples, size_t count);
+
+  /**
+   * @brief 空きバッファを取得して埋め始める
+   * @return 取得できたかどうか
+   */
+  bool acquireActiveBuffer();
+
+  /**
+   * @brief 埋めているバッファを書き込みタスクへ渡す
+   * @param sync 書き込んだ後すぐに同期させるかどうか
+   *             （trueなら、書きかけのデータがなくても同期の要求だけを渡す）
+   */
+  void submitActiveBuffer(bool sync = false);
+
+  /**
+   * @brief 書きかけのバッファが同期の期限に間に合わなくなる前に渡す
+   */
+  void submitAgedBuffer();
+
+  /**
+   * @brief SDカードへ同期し、統計を記録する（書き込みタスクから呼ぶ）
+   * @param reason 同期する理由
+   */
+  void syncLog(FlushReason reason);
 };
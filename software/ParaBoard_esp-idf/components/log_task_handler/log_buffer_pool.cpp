@@ -0,0 +1,110 @@
+#include "log_buffer_pool.hpp"
+
+LogBufferPool::LogBufferPool() {}
+
+LogBufferPool::~LogBufferPool() {
+  for (size_t i = 0; i < buffer_count; i++) {
+    heap_caps_free(buffers[i]);
+    buffers[i] = nullptr;
+  }
+  if (free_queue != nullptr) {
+    vQueueDelete(free_queue);
+    free_queue = nullptr;
+  }
+  if (full_queue != nullptr) {
+    vQueueDelete(full_queue);
+    full_queue = nullptr;
+  }
+}
+
+bool LogBufferPool::init(size_t count, size_t size) {
+  if (buffer_count > 0) {
+    ESP_LOGW(TAG, "Buffer pool already initialized");
+    return true;
+  }
+  if (count < 2 || count > MAX_BUFFER_COUNT || size == 0 ||
+      size % SECTOR_SIZE != 0) {
+    ESP_LOGE(TAG, "Invalid buffer pool size (%u x %u)", (unsigned)count,
+             (unsigned)size);
+    return false;
+  }
+
+  free_queue = xQueueCreate(count, sizeof(uint8_t));
+  full_queue = xQueueCreate(count, sizeof(uint8_t));
+  if (free_queue == nullptr || full_queue == nullptr) {
+    ESP_LOGE(TAG, "Failed to create buffer queues");
+    return false;
+  }
+
+  // SDMMCのDMAでそのまま転送できるよう、セクタ境界に揃えて確保する
+  for (size_t i = 0; i < count; i++) {
+    buffers[i] = (uint8_t*)heap_caps_aligned_alloc(SECTOR_SIZE, size,
+                                                   MALLOC_CAP_DMA);
+    if (buffers[i] == nullptr) {
+      ESP_LOGE(TAG, "Failed to allocate log buffer %u", (unsigned)i);
+      for (size_t j = 0; j < i; j++) {
+        heap_caps_free(buffers[j]);
+        buffers[j] = nullptr;
+      }
+      return false;
+    }
+    uint8_t index = i;
+    xQueueSend(free_queue, &index, 0);
+  }
+  buffer_count = count;
+  buffer_size = size;
+
+  ESP_LOGI(TAG, "Allocated %u log buffers (%u bytes each)", (unsigned)count,
+           (unsigned)size);
+  return true;
+}
+
+bool LogBufferPool::acquire(uint8_t* index, TickType_t timeout) {
+  if (xQueueReceive(free_queue, index, 0) == pdPASS) {
+    return true;
+  }
+
+  // 空きがない = 書き込みが追いついていない
+  stats.stall_count++;
+  int64_t start_us = esp_timer_get_time();
+  bool acquired = xQueueReceive(free_queue, index, timeout) == pdPASS;
+  int64_t stall_us = esp_timer_get_time() - start_us;
+  if (stall_us > stats.max_stall_us) {
+    stats.max_stall_us = stall_us;
+  }
+  return acquired;
+}
+
+void LogBufferPool::submit(uint8_t index, size_t length, int64_t oldest,
+                           bool sync) {
+  lengths[index] = length;
+  oldest_us[index] = oldest;
+  sync_flags[index] = sync;
+  xQueueSend(full_queue, &index, portMAX_DELAY);
+
+  uint32_t full_buffers = uxQueueMessagesWaiting(full_queue);
+  if (full_buffers > stats.max_full_buffers) {
+    stats.max_full_buffers = full_buffers;
+  }
+}
+
+bool LogBufferPool::receive(uint8_t* index, TickType_t timeout) {
+  return xQueueReceive(full_queue, index, timeout) == pdPASS;
+}
+
+void LogBufferPool::release(uint8_t index, int64_t write_us) {
+  lengths[index] = 0;
+  sync_flags[index] = false;
+  stats.buffers_written++;
+  if (write_us > stats.max_write_us) {
+    stats.max_write_us = write_us;
+  }
+  xQueueSend(free_queue, &index, portMAX_DELAY);
+}
+
+size_t LogBufferPool::getFreeCount() const {
+  if (free_queue == nullptr) return 0;
+  return uxQueueMessagesWaiting(free_queue);
+}
+
+void LogBufferPool::resetStats() { stats = {}; }
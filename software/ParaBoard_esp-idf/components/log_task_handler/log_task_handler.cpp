@@ -1,22 +1,13 @@
 #include "log_task_handler.hpp"
 
-LogTaskHandler::LogTaskHandler() {
-  // キューの作成
-  log_queue = xQueueCreate(QUEUE_SIZE, sizeof(SensorData));
-  if (log_queue == nullptr) {
-    ESP_LOGE(TAG, "Failed to create log queue");
-  }
-}
+LogTaskHandler::LogTaskHandler() {}
 
 LogTaskHandler::~LogTaskHandler() {
   // タスクの停止
   stopTask();
 
-  // キューの削除
-  if (log_queue != nullptr) {
-    vQueueDelete(log_queue);
-    log_queue = nullptr;
-  }
+  delete[] batch;
+  batch = nullptr;
 }
 
 bool LogTaskHandler::init(SdController* logger_ptr) {
@@ -26,6 +17,98 @@ bool LogTaskHandler::init(SdController* logger_ptr) {
   }
 
   logger = logger_ptr;
+
+  // センサーデータ用のリングバッファを確保する（PSRAMがあればPSRAMに置く）
+  int ring_capacity =
+      logger->getIntSetting("log_ring_capacity", DEFAULT_RING_CAPACITY);
+  if (ring_capacity <= 0) {
+    ring_capacity = DEFAULT_RING_CAPACITY;
+  }
+  while (!log_ring.init(ring_capacity)) {
+    // 確保できなければ半分にして再試行する
+    ESP_LOGW(TAG, "Failed to allocate log ring (%d entries)", ring_capacity);
+    ring_capacity /= 2;
+    if (ring_capacity < MAX_BATCH_SIZE) {
+      ESP_LOGE(TAG, "Failed to create log ring");
+      return false;
+    }
+  }
+  ESP_LOGI(TAG, "Log ring: %u entries (%u bytes) in %s",
+           (unsigned)log_ring.capacity(),
+           (unsigned)(log_ring.capacity() * sizeof(SensorData)),
+           log_ring.isPsram() ? "PSRAM" : "internal RAM");
+
+  // 1回に取り出す数と待ち時間を設定から読み込む
+  int batch_setting =
+      logger->getIntSetting("log_batch_size", DEFAULT_BATCH_SIZE);
+  if (batch_setting < 1 || batch_setting > MAX_BATCH_SIZE) {
+    ESP_LOGW(TAG, "log_batch_size %d is out of range (1-%d), using %d",
+             batch_setting, MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE);
+    batch_setting = DEFAULT_BATCH_SIZE;
+  }
+  int wait_ms =
+      logger->getIntSetting("log_batch_wait_ms", DEFAULT_BATCH_WAIT_MS);
+  if (wait_ms < 1) {
+    wait_ms = DEFAULT_BATCH_WAIT_MS;
+  }
+  delete[] batch;
+  batch_size = batch_setting;
+  batch = new SensorData[batch_size];
+  batch_wait_ticks = pdMS_TO_TICKS(wait_ms);
+  batch_wait_us = (int64_t)wait_ms * 1000;
+  if (batch_wait_ticks == 0) {
+    batch_wait_ticks = 1;
+  }
+  ESP_LOGI(TAG, "Log batch: up to %u samples, wait %d ms",
+           (unsigned)batch_size, wait_ms);
+
+  // プリトリガモードの場合は履歴バッファを確保する（PSRAMがあればPSRAMに置く）
+  int pretrigger_seconds = logger->getIntSetting("pretrigger_seconds", 0);
+  if (pretrigger_seconds > MAX_PRETRIGGER_SECONDS) {
+    ESP_LOGW(TAG, "pretrigger_seconds %d is too large, using %d",
+             pretrigger_seconds, MAX_PRETRIGGER_SECONDS);
+    pretrigger_seconds = MAX_PRETRIGGER_SECONDS;
+  }
+  if (pretrigger_seconds > 0) {
+    if (history.init(pretrigger_seconds * SAMPLE_RATE_HZ)) {
+      ESP_LOGI(TAG, "Pretrigger history: %u entries (%u bytes) in %s",
+               (unsigned)history.capacity(),
+               (unsigned)(history.capacity() * sizeof(SensorData)),
+               history.isPsram() ? "PSRAM" : "internal RAM");
+    } else {
+      // 確保できなければ常に記録する
+      ESP_LOGE(TAG, "Failed to allocate %d s of pretrigger history",
+               pretrigger_seconds);
+    }
+  }
+
+  // SDカードへ同期する条件を設定から読み込む
+  int max_pending_bytes = logger->getIntSetting(
+      "flush_max_pending_bytes", DEFAULT_FLUSH_MAX_PENDING_BYTES);
+  int max_age_ms =
+      logger->getIntSetting("flush_max_age_ms", DEFAULT_FLUSH_MAX_AGE_MS);
+  if (max_pending_bytes < 0) {
+    max_pending_bytes = DEFAULT_FLUSH_MAX_PENDING_BYTES;
+  }
+  if (max_pending_bytes > MAX_FLUSH_PENDING_BYTES) {
+    // 超えると、電源断の後の復旧で同期前の区間を確認しきれず、有効なデータを切り捨てる
+    ESP_LOGW(TAG, "flush_max_pending_bytes %d exceeds recovery window, using %d",
+             max_pending_bytes, MAX_FLUSH_PENDING_BYTES);
+    max_pending_bytes = MAX_FLUSH_PENDING_BYTES;
+  }
+  if (max_age_ms < 0) {
+    max_age_ms = DEFAULT_FLUSH_MAX_AGE_MS;
+  }
+  flush_policy.configure(max_pending_bytes, max_age_ms);
+  sync_on_event = logger->getBoolSetting("flush_on_event", true);
+  ESP_LOGI(TAG, "Flush policy: %d bytes or %d ms pending, on event: %s",
+           max_pending_bytes, max_age_ms, sync_on_event ? "yes" : "no");
+
+  // ログバッファを確保する
+  if (!buffer_pool.init(BUFFER_COUNT, BUFFER_SIZE)) {
+    ESP_LOGE(TAG, "Failed to initialize log buffers");
+    return false;
+  }
   return true;
 }
 
@@ -35,14 +118,43 @@ void LogTaskHandler::startTask() {
     return;
   }
 
-  // タスクの作成
+  buffer_pool.resetStats();
+  flush_policy.reset();
+  sync_requested = false;
+  batch_stats = {};
+  max_queued = 0;
+  triggered = false;
+  history.clear();
+  commit_start_us = 0;
+  active_buffer = -1;
+  active_length = 0;
+  block_header_size = logger->getLogBlockHeaderSize();
+  stop_requested = false;
+  task_finished = false;
+
+  // 前回の停止後に溜まったデータは捨てる
+  log_ring.clear();
+
+  // 書き込みタスクの作成
   BaseType_t result =
-      xTaskCreate(logTask, "log_task", TASK_STACK_SIZE,
-                  this,  // 自身のインスタンスをパラメータとして渡す
-                  TASK_PRIORITY, &log_task_handle);
+      xTaskCreate(writerTask, "log_writer_task", WRITER_TASK_STACK_SIZE, this,
+                  WRITER_TASK_PRIORITY, &writer_task_handle);
+  if (result != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create log writer task");
+    writer_task_handle = nullptr;
+    return;
+  }
+
+  // タスクの作成
+  result = xTaskCreate(logTask, "log_task", TASK_STACK_SIZE,
+                       this,  // 自身のインスタンスをパラメータとして渡す
+                       TASK_PRIORITY, &log_task_handle);
 
   if (result != pdPASS) {
     ESP_LOGE(TAG, "Failed to create log task");
+    log_task_handle = nullptr;
+    vTaskDelete(writer_task_handle);
+    writer_task_handle = nullptr;
     return;
   }
 
@@ -54,87 +166,373 @@ void LogTaskHandler::stopTask() {
     return;
   }
 
-  // タスクの削除
-  vTaskDelete(log_task_handle);
+  // 停止を要求し、リングバッファと履歴バッファを書き切ってタスクが終了するのを待つ
+  // 履歴バッファ（最大60秒分）は1秒では書き切れないので、残りが減っている間は待ち続け、
+  // STOP_TIMEOUT_MSの間減らなかった時だけ止まっているとみなす
+  stop_requested = true;
+  xTaskNotifyGive(log_task_handle);
+  size_t last_remaining = history.size() + log_ring.size();
+  int idle_ms = 0;
+  int report_ms = 0;
+  while (!task_finished && idle_ms < STOP_TIMEOUT_MS) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+    size_t remaining = history.size() + log_ring.size();
+    if (remaining < last_remaining) {
+      last_remaining = remaining;
+      idle_ms = 0;
+    } else {
+      idle_ms += 10;
+    }
+    report_ms += 10;
+    if (report_ms >= STOP_REPORT_INTERVAL_MS && !task_finished) {
+      ESP_LOGI(TAG, "Writing remaining samples before stop: %u left",
+               (unsigned)remaining);
+      report_ms = 0;
+    }
+  }
+  if (!task_finished) {
+    // 空きバッファ待ちなどで止まっている場合は強制的に削除する
+    ESP_LOGW(TAG,
+             "Log task made no progress for %d ms, %u history and %u queued "
+             "samples lost",
+             STOP_TIMEOUT_MS, (unsigned)history.size(),
+             (unsigned)log_ring.size());
+    vTaskDelete(log_task_handle);
+  }
   log_task_handle = nullptr;
+
+  // 書きかけのバッファを同期の要求と一緒に渡し、全て書き終わるまで待つ
+  submitActiveBuffer(true);
+  int waited_ms = 0;
+  while (buffer_pool.getFreeCount() < buffer_pool.getBufferCount() &&
+         waited_ms < DRAIN_TIMEOUT_MS) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+    waited_ms += 10;
+  }
+  if (buffer_pool.getFreeCount() < buffer_pool.getBufferCount()) {
+    ESP_LOGW(TAG, "Log buffers were not drained within %d ms",
+             DRAIN_TIMEOUT_MS);
+  }
+
+  if (writer_task_handle != nullptr) {
+    vTaskDelete(writer_task_handle);
+    writer_task_handle = nullptr;
+  }
   ESP_LOGI(TAG, "Log task stopped");
+
+  LogBufferStats stats = buffer_pool.getStats();
+  ESP_LOGI(TAG,
+           "Log buffers: written=%lu, max full=%lu/%u, stalls=%lu "
+           "(max %lld us), max write=%lld us",
+           (unsigned long)stats.buffers_written,
+           (unsigned long)stats.max_full_buffers, (unsigned)BUFFER_COUNT,
+           (unsigned long)stats.stall_count, stats.max_stall_us,
+           stats.max_write_us);
+  FlushStats flush_stats = flush_policy.getStats();
+  ESP_LOGI(TAG,
+           "Log syncs: bytes=%lu, age=%lu, event=%lu, stop=%lu, "
+           "max unsynced %lld ms / %u bytes, max sync %lld us",
+           (unsigned long)flush_stats.syncs[(int)FlushReason::BYTES],
+           (unsigned long)flush_stats.syncs[(int)FlushReason::AGE],
+           (unsigned long)flush_stats.syncs[(int)FlushReason::EVENT],
+           (unsigned long)flush_stats.syncs[(int)FlushReason::STOP],
+           flush_stats.max_unsynced_us / 1000,
+           (unsigned)flush_stats.max_pending_bytes, flush_stats.max_sync_us);
+  if (batch_stats.batches > 0) {
+    ESP_LOGI(TAG,
+             "Log batches: %lu, average %.1f samples (max %lu), "
+             "average %lld us (max %lld us)",
+             (unsigned long)batch_stats.batches,
+             (float)batch_stats.samples / batch_stats.batches,
+             (unsigned long)batch_stats.max_batch,
+             batch_stats.total_batch_us / batch_stats.batches,
+             batch_stats.max_batch_us);
+  }
+}
+
+bool LogTaskHandler::acquireActiveBuffer() {
+  // 書き込みが追いついていなければここで待つ
+  uint8_t index;
+  if (!buffer_pool.acquire(&index, portMAX_DELAY)) {
+    return false;
+  }
+  active_buffer = index;
+  active_length = block_header_size;
+  active_oldest_us = esp_timer_get_time();
+  return true;
+}
+
+void LogTaskHandler::submitActiveBuffer(bool sync) {
+  if (active_buffer < 0 && (!sync || !acquireActiveBuffer())) {
+    return;
+  }
+  size_t payload_size = active_length - block_header_size;
+  if (payload_size > 0 || sync) {
+    // 中身があればブロックとして封をする（同期の要求だけなら何も書かない）
+    size_t length = 0;
+    if (payload_size > 0) {
+      length = logger->sealLogBlock(buffer_pool.getData(active_buffer),
+                                    payload_size);
+    }
+    buffer_pool.submit(active_buffer, length, active_oldest_us, sync);
+  } else {
+    buffer_pool.release(active_buffer, 0);
+  }
+  active_buffer = -1;
+  active_length = 0;
+}
+
+void LogTaskHandler::submitAgedBuffer() {
+  if (active_buffer < 0 || active_length == block_header_size) {
+    return;
+  }
+  // 次にログタスクが起きる時には経過時間の上限を過ぎてしまうなら、今渡す
+  int64_t age_us = esp_timer_get_time() - active_oldest_us;
+  if (age_us + batch_wait_us >= (int64_t)flush_policy.getMaxAgeMs() * 1000) {
+    submitActiveBuffer();
+  }
+}
+
+void LogTaskHandler::requestSync() {
+  if (!sync_on_event) {
+    return;
+  }
+  sync_requested = true;
+  TaskHandle_t task = log_task_handle;
+  if (task != nullptr) {
+    xTaskNotifyGive(task);
+  }
 }
 
 bool LogTaskHandler::sendToQueue(const SensorData& data) {
-  if (log_queue == nullptr) {
-    ESP_LOGE(TAG, "Log queue is null");
+  if (!log_ring.push(data)) {
     return false;
   }
 
-  // キューにデータを送信
-  BaseType_t result = xQueueSend(log_queue, &data, 0);
-  return (result == pdPASS);
+  size_t queued = log_ring.size();
+  if (queued > max_queued) {
+    max_queued = queued;
+  }
+
+  // 1件ごとではなく、一定数溜まった時だけログタスクを起こす
+  TaskHandle_t task = log_task_handle;
+  if (task != nullptr && queued >= batch_size) {
+    xTaskNotifyGive(task);
+  }
+  return true;
 }
 
 void LogTaskHandler::logTask(void* pvParameters) {
   LogTaskHandler* self = static_cast<LogTaskHandler*>(pvParameters);
 
   if (self == nullptr || self->logger == nullptr ||
-      self->log_queue == nullptr) {
+      self->log_ring.capacity() == 0 || self->batch == nullptr) {
     ESP_LOGE("LOG_TASK", "Invalid parameters");
     vTaskDelete(nullptr);
     return;
   }
 
-  int16_t count = 0;
+  while (!self->stop_requested) {
+    // 通知が来るか、一定時間が経つまで待つ
+    ulTaskNotifyTake(pdTRUE, self->batch_wait_ticks);
+
+    // 溜まっているデータをまとめて変換する
+    self->drainRing();
+
+    // 同期の要求があれば書きかけのバッファもすぐに渡す
+    // なければ、同期の期限に間に合うように書きかけのバッファを渡す
+    if (self->sync_requested.exchange(false)) {
+      self->submitActiveBuffer(true);
+    } else {
+      self->submitAgedBuffer();
+    }
+  }
+
+  // 停止要求の後に残っているデータも書き込む
+  self->drainRing();
+
+  // 離床を検知しないまま終了した場合も、直近のデータは残しておく
+  self->commitHistory(true);
+  self->task_finished = true;
+  vTaskDelete(nullptr);
+}
+
+void LogTaskHandler::trigger() {
+  if (triggered) {
+    return;
+  }
+  triggered = true;
+
+  // 溜めておいたデータをすぐに書き込めるよう、ログタスクを起こす
+  // 離床までのデータは同期させておく
+  if (sync_on_event) {
+    sync_requested = true;
+  }
+  TaskHandle_t task = log_task_handle;
+  if (task != nullptr) {
+    xTaskNotifyGive(task);
+  }
+}
+
+void LogTaskHandler::drainRing() {
+  // 離床前のデータを書いている間に、リングバッファにどこまで溜まったかを計測する
+  if (commit_start_us != 0 && log_ring.size() > commit_max_queued) {
+    commit_max_queued = log_ring.size();
+  }
+
+  size_t count;
+  while ((count = log_ring.popBatch(batch, batch_size)) > 0) {
+    int64_t start_us = esp_timer_get_time();
+
+    if (isPretriggerEnabled() && (!triggered || history.size() > 0)) {
+      // 離床前はSDカードに書かず、直近のデータだけを残しておく
+      // 離床後も離床前のデータを書き終わるまでは、順番を保つために後ろに並べる
+      storeHistory(batch, count);
+    } else {
+      encodeSamples(batch, count);
+    }
+
+    int64_t batch_us = esp_timer_get_time() - start_us;
+    batch_stats.batches++;
+    batch_stats.samples += count;
+    batch_stats.total_batch_us += batch_us;
+    if (count > batch_stats.max_batch) {
+      batch_stats.max_batch = count;
+    }
+    if (batch_us > batch_stats.max_batch_us) {
+      batch_stats.max_batch_us = batch_us;
+    }
+  }
+
+  // 離床後は、先に溜めておいた離床前のデータを書き込めるだけ書き込む
+  // (60秒分を一度に書くとリングバッファが溢れるので、空きバッファがある分ずつ進める)
+  if (triggered) {
+    commitHistory(false);
+  }
+}
+
+void LogTaskHandler::storeHistory(const SensorData* samples, size_t count) {
+  SensorData oldest;
+  for (size_t i = 0; i < count; i++) {
+    // ログタスクだけが読み書きするので、満杯なら自分で古いものを捨てる
+    if (!history.push(samples[i])) {
+      history.pop(&oldest);
+      history.push(samples[i]);
+      // 離床後に捨てるのは、書き込みが追いついていない離床前のデータ
+      if (triggered) {
+        commit_dropped++;
+      }
+    }
+  }
+}
+
+void LogTaskHandler::commitHistory(bool wait) {
+  if (history.size() == 0) {
+    return;
+  }
+  if (commit_start_us == 0) {
+    commit_start_us = esp_timer_get_time();
+    commit_samples = 0;
+    commit_max_queued = 0;
+    commit_dropped = 0;
+  }
+
+  // 待たない場合は、空きバッファがなくなったら（書き込みが追いつくまで）止める
+  size_t count;
+  while ((wait || buffer_pool.getFreeCount() > 0) &&
+         (count = history.popBatch(batch, batch_size)) > 0) {
+    encodeSamples(batch, count);
+    commit_samples += count;
+  }
+  if (history.size() > 0) {
+    return;
+  }
+
+  // 書き込みにかかった時間と、その間のリングバッファの余裕を表示する
+  ESP_LOGI(TAG,
+           "Committed pretrigger history: %u samples in %lld ms "
+           "(ring max %u/%u, %lu dropped)",
+           (unsigned)commit_samples,
+           (esp_timer_get_time() - commit_start_us) / 1000,
+           (unsigned)commit_max_queued, (unsigned)log_ring.capacity(),
+           (unsigned long)commit_dropped);
+  if (commit_dropped > 0) {
+    ESP_LOGW(TAG, "Dropped %lu oldest pretrigger samples while committing",
+             (unsigned long)commit_dropped);
+  }
+  commit_start_us = 0;
+}
+
+void LogTaskHandler::encodeSamples(const SensorData* samples, size_t count) {
+  // 空きバッファへ連続して変換する
+  size_t done = 0;
+  while (done < count) {
+    if (active_buffer < 0 && !acquireActiveBuffer()) {
+      break;
+    }
+    uint8_t* buffer = buffer_pool.getData(active_buffer);
+    size_t size = buffer_pool.getBufferSize();
+    size_t encoded = 0;
+    active_length += logger->encodeLogBatch(
+        samples + done, count - done, buffer + active_length,
+        size - active_length, &encoded);
+    done += encoded;
+
+    // 入りきらなかった場合とちょうど埋まった場合は書き込みタスクへ渡す
+    if (done < count || active_length == size) {
+      submitActiveBuffer();
+    }
+  }
+}
+
+void LogTaskHandler::writerTask(void* pvParameters) {
+  LogTaskHandler* self = static_cast<LogTaskHandler*>(pvParameters);
 
   while (true) {
-    // log_queueからデータを取得する
-    SensorData data;
-    if (xQueueReceive(self->log_queue, &data, portMAX_DELAY) != pdPASS) {
-      ESP_LOGE("LOG_TASK", "Failed to receive data from queue");
+    // 同期していないデータがあれば、経過時間の上限までだけ次のバッファを待つ
+    TickType_t timeout = portMAX_DELAY;
+    int64_t remaining_us =
+        self->flush_policy.getTimeUntilDeadlineUs(esp_timer_get_time());
+    if (remaining_us >= 0) {
+      timeout = (remaining_us * configTICK_RATE_HZ + 999999) / 1000000;
+    }
+
+    // 埋まったバッファを受け取る
+    uint8_t index;
+    FlushReason reason;
+    if (!self->buffer_pool.receive(&index, timeout)) {
+      // 待っている間に上限に達した
+      if (self->flush_policy.shouldSync(esp_timer_get_time(), &reason)) {
+        self->syncLog(reason);
+      }
       continue;
     }
 
-    // ログを書き込む
-    self->logger->writeLog(data);
-
-    // 一定回数ごとにフラッシュする
-    count++;
-    if (count % self->flush_count == 0) {
-      self->logger->flush();
-      count = 0;
-    }
-
-    // // 一定回数でログを出力
-    // if (count % 100 == 0) {
-    //   // 加速度・角速度・気圧をログに変換してから表示
-    //   float accel_x =
-    //       ((int16_t)(data.accel.u_x << 8 | data.accel.d_x)) / 32768.0f
-    //       * 16.0f;
-    //   float accel_y =
-    //       ((int16_t)(data.accel.u_y << 8 | data.accel.d_y)) / 32768.0f
-    //       * 16.0f;
-    //   float accel_z =
-    //       ((int16_t)(data.accel.u_z << 8 | data.accel.d_z)) / 32768.0f
-    //       * 16.0f;
-    //
-    //   float gyro_x =
-    //       ((int16_t)(data.gyro.u_x << 8 | data.gyro.d_x)) / 32768.0f *
-    //       2000.0f;
-    //   float gyro_y =
-    //       ((int16_t)(data.gyro.u_y << 8 | data.gyro.d_y)) / 32768.0f *
-    //       2000.0f;
-    //   float gyro_z =
-    //       ((int16_t)(data.gyro.u_z << 8 | data.gyro.d_z)) / 32768.0f *
-    //       2000.0f;
-    //
-    //   uint32_t pressure_value = (data.pressure.h_p << 16 |
-    //                              data.pressure.l_p << 8 | data.pressure.xl_p)
-    //                              /
-    //                             4096.0f;
-    //
-    //   ESP_LOGI("LOG_TASK",
-    //            "Time: %lld us, Accel: [%.2f, %.2f, %.2f] m/s^2, Gyro: [%.2f,
-    //            "
-    //            "%.2f, %.2f] dps, Pressure: %lu hPa",
-    //            data.timestamp_us, accel_x, accel_y, accel_z, gyro_x, gyro_y,
-    //            gyro_z, pressure_value);
-    // }
+    // SDカードへ書き込む（同期するかどうかはFlushPolicyで決める）
+    int64_t start_us = esp_timer_get_time();
+    size_t length = self->buffer_pool.getLength(index);
+    if (length > 0) {
+      self->logger->writeLogBytes(self->buffer_pool.getData(index), length);
+      self->flush_policy.onWritten(length,
+                                   self->buffer_pool.getOldestUs(index));
+    }
+    int64_t write_us = esp_timer_get_time() - start_us;
+
+    if (self->buffer_pool.isSyncRequested(index)) {
+      self->syncLog(self->stop_requested ? FlushReason::STOP
+                                         : FlushReason::EVENT);
+    } else if (self->flush_policy.shouldSync(esp_timer_get_time(), &reason)) {
+      self->syncLog(reason);
+    }
+
+    // 書き終わったバッファを空きに戻す
+    // (停止時に同期が終わる前にタスクを削除しないよう、同期の後で戻す)
+    self->buffer_pool.release(index, write_us);
   }
 }
+
+void LogTaskHandler::syncLog(FlushReason reason) {
+  int64_t start_us = esp_timer_get_time();
+  logger->flush();
+  flush_policy.onSynced(reason, start_us, esp_timer_get_time() - start_us);
+}
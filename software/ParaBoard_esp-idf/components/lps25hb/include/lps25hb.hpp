@@ -9,31 +9,80 @@ struct Lps25hbConfig {
   static constexpr uint8_t WHO_AM_I_VALUE = 0xBD;        // 期待される値
   static constexpr uint32_t DEFAULT_SPI_FREQ = 8000000;  // 8MHz
   static constexpr uint8_t READ_BIT = 0x80;  // 読み取り時の最上位ビット
+  static constexpr uint8_t AUTO_INCREMENT_BIT =
+      0x40;  // 連続読み出しでアドレスを進める（SPIのMSビット）
 
   struct Registers {
     static constexpr uint8_t WHO_AM_I = 0x0F;
+    static constexpr uint8_t RES_CONF = 0x10;
     static constexpr uint8_t CTRL_REG1 = 0x20;
     static constexpr uint8_t CTRL_REG2 = 0x21;
+    static constexpr uint8_t STATUS_REG = 0x27;
     static constexpr uint8_t PRESS_OUT_XL = 0x28;
     static constexpr uint8_t PRESS_OUT_L = 0x29;
     static constexpr uint8_t PRESS_OUT_H = 0x2A;
     static constexpr uint8_t TEMP_OUT_L = 0x2B;
     static constexpr uint8_t TEMP_OUT_H = 0x2C;
+    static constexpr uint8_t FIFO_CTRL = 0x2E;
   };
 
   struct Settings {
     static constexpr uint8_t POWER_UP = 0b10000000;     // Power up
+    static constexpr uint8_t ODR_1 = 0b00010000;        // ODR=1Hz
+    static constexpr uint8_t ODR_7 = 0b00100000;        // ODR=7Hz
+    static constexpr uint8_t ODR_12_5 = 0b00110000;     // ODR=12.5Hz
     static constexpr uint8_t ODR_25 = 0b01000000;       // ODR=25Hz
+    static constexpr uint8_t FIFO_EN = 0b01000000;      // CTRL_REG2: FIFO enable
     static constexpr uint8_t I2C_DISABLE = 0b00001000;  // I2C disable
+    static constexpr uint8_t BDU = 0b00000100;  // 上位バイトを読むまで出力を更新しない
+  };
+
+  // RES_CONF: 1回の出力に使う内部平均の回数（2ビットずつ、0〜3の順）
+  struct ResConf {
+    static constexpr uint16_t PRESSURE_AVG[4] = {8, 32, 128, 512};
+    static constexpr uint8_t TEMP_AVG[4] = {8, 16, 32, 64};
+    static constexpr int AVGT_SHIFT = 2;
+  };
+
+  // FIFO_CTRL: FIFOの移動平均（出力は直近のWTM_POINT+1個の平均になる）
+  struct FifoCtrl {
+    static constexpr uint8_t MODE_BYPASS = 0b00000000;
+    static constexpr uint8_t MODE_MEAN = 0b11000000;
+    static constexpr uint8_t MAX_MEAN_SAMPLES = 32;
+  };
+
+  struct Status {
+    static constexpr uint8_t P_DA = 0b00000010;  // 新しい気圧がある
+    static constexpr uint8_t T_DA = 0b00000001;  // 新しい温度がある
   };
 };
 
+/**
+ * @brief 出力データレートと平均の設定（既定値は電源投入時と同じ）
+ */
+struct Lps25hbSettings {
+  uint32_t odr_mhz = 25000;    // 出力データレート(mHz): 1000, 7000, 12500, 25000
+  uint16_t pressure_avg = 32;  // 気圧の内部平均の回数: 8, 32, 128, 512
+  uint8_t temp_avg = 16;       // 温度の内部平均の回数: 8, 16, 32, 64
+  uint8_t fifo_mean = 0;       // FIFOの移動平均の数: 0（使わない）, 2, 4, 8, 16, 32
+};
+
 class Lps25hb {
  private:
   int cs_pin;
   int device_handle_id;
   CreateSpi *create_spi;
   static const char *TAG;
+  Lps25hbSettings settings;
+
+  /**
+   * @brief 連続したレジスタを1回の転送で読む（アドレスを自動で進める）
+   * @param addr 先頭のレジスタ
+   * @param data 読んだ値
+   * @param length バイト数
+   * @return 成功したかどうか
+   */
+  bool readRegisters(uint8_t addr, uint8_t *data, size_t length);
 
  public:
   bool begin(CreateSpi *create_spi, gpio_num_t cs_pin,
@@ -43,6 +92,30 @@ class Lps25hb {
   bool getTemp(TempData *temp);
   bool getPressureAndTemp(PressureData *pressure, TempData *temp);
 
+  /**
+   * @brief STATUS_REGと気圧・温度を1回の転送で読む
+   * 出力は上位バイトを読むまで更新されない（BDU）ので、気圧と温度は同じ変換のものになる
+   * @param pressure 気圧
+   * @param temp 温度
+   * @param fresh 前回読んだ後に気圧・温度とも新しく変換されていたかどうか
+   *              （falseなら前回と同じ値）
+   * @return 成功したかどうか
+   */
+  bool getPressureAndTemp(PressureData *pressure, TempData *temp, bool *fresh);
+
+  /**
+   * @brief 出力データレート・内部平均・FIFOの移動平均を設定する
+   * いったんパワーダウンしてから設定し、再び変換を始める
+   * @param new_settings 設定
+   * @return 成功したかどうか（値が範囲外なら何も変えない）
+   */
+  bool configure(const Lps25hbSettings &new_settings);
+
+  /**
+   * @brief 現在の設定を取得する
+   */
+  const Lps25hbSettings &getSettings() const { return settings; }
+
   bool isInitialized() const { return device_handle_id >= 0; }
 };
 
@@ -32,7 +32,7 @@ bool Lps25hb::begin(CreateSpi *spi, gpio_num_t cs_pin, uint32_t frequency) {
         ESP_LOGE(TAG, "Failed to set CTRL_REG2");
         return false;
     }
-    if (!create_spi->setReg(Lps25hbConfig::Registers::CTRL_REG1, Lps25hbConfig::Settings::POWER_UP | Lps25hbConfig::Settings::ODR_25, device_handle_id)) {
+    if (!create_spi->setReg(Lps25hbConfig::Registers::CTRL_REG1, Lps25hbConfig::Settings::POWER_UP | Lps25hbConfig::Settings::ODR_25 | Lps25hbConfig::Settings::BDU, device_handle_id)) {
         ESP_LOGE(TAG, "Failed to set CTRL_REG1");
         return false;
     }
@@ -52,6 +52,61 @@ bool Lps25hb::begin(CreateSpi *spi, gpio_num_t cs_pin, uint32_t frequency) {
     return true;
 }
 
+bool Lps25hb::configure(const Lps25hbSettings &new_settings) {
+    uint8_t odr;
+    switch (new_settings.odr_mhz) {
+        case 1000:
+            odr = Lps25hbConfig::Settings::ODR_1;
+            break;
+        case 7000:
+            odr = Lps25hbConfig::Settings::ODR_7;
+            break;
+        case 12500:
+            odr = Lps25hbConfig::Settings::ODR_12_5;
+            break;
+        case 25000:
+            odr = Lps25hbConfig::Settings::ODR_25;
+            break;
+        default:
+            ESP_LOGE(TAG, "Invalid ODR: %lu mHz", (unsigned long)new_settings.odr_mhz);
+            return false;
+    }
+
+    int avgp = -1;
+    int avgt = -1;
+    for (int i = 0; i < 4; i++) {
+        if (Lps25hbConfig::ResConf::PRESSURE_AVG[i] == new_settings.pressure_avg) avgp = i;
+        if (Lps25hbConfig::ResConf::TEMP_AVG[i] == new_settings.temp_avg) avgt = i;
+    }
+    if (avgp < 0 || avgt < 0) {
+        ESP_LOGE(TAG, "Invalid averaging: pressure %u, temperature %u", new_settings.pressure_avg, new_settings.temp_avg);
+        return false;
+    }
+
+    // 移動平均の数は2のべき乗（WTM_POINTに数-1を書く）
+    uint8_t fifo_mean = new_settings.fifo_mean;
+    if (fifo_mean != 0 && (fifo_mean < 2 || fifo_mean > Lps25hbConfig::FifoCtrl::MAX_MEAN_SAMPLES || (fifo_mean & (fifo_mean - 1)) != 0)) {
+        ESP_LOGE(TAG, "Invalid FIFO mean: %u", fifo_mean);
+        return false;
+    }
+    uint8_t fifo_ctrl = fifo_mean ? (Lps25hbConfig::FifoCtrl::MODE_MEAN | (fifo_mean - 1)) : Lps25hbConfig::FifoCtrl::MODE_BYPASS;
+    uint8_t ctrl_reg2 = Lps25hbConfig::Settings::I2C_DISABLE | (fifo_mean ? Lps25hbConfig::Settings::FIFO_EN : 0);
+
+    // 変換を止めてから設定する
+    if (!create_spi->setReg(Lps25hbConfig::Registers::CTRL_REG1, 0, device_handle_id) ||
+        !create_spi->setReg(Lps25hbConfig::Registers::RES_CONF, avgt << Lps25hbConfig::ResConf::AVGT_SHIFT | avgp, device_handle_id) ||
+        !create_spi->setReg(Lps25hbConfig::Registers::FIFO_CTRL, fifo_ctrl, device_handle_id) ||
+        !create_spi->setReg(Lps25hbConfig::Registers::CTRL_REG2, ctrl_reg2, device_handle_id) ||
+        !create_spi->setReg(Lps25hbConfig::Registers::CTRL_REG1, Lps25hbConfig::Settings::POWER_UP | odr | Lps25hbConfig::Settings::BDU, device_handle_id)) {
+        ESP_LOGE(TAG, "Failed to configure");
+        return false;
+    }
+
+    settings = new_settings;
+    ESP_LOGI(TAG, "ODR %.1f Hz, averaging pressure %u / temperature %u, FIFO mean %u", new_settings.odr_mhz / 1000.0f, new_settings.pressure_avg, new_settings.temp_avg, fifo_mean);
+    return true;
+}
+
 bool Lps25hb::whoAmI(uint8_t *data) {
     if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::WHO_AM_I, device_handle_id, data)) {
         ESP_LOGE(TAG, "Failed to read WHO_AM_I");
@@ -60,20 +115,27 @@ bool Lps25hb::whoAmI(uint8_t *data) {
     return true;
 }
 
+bool Lps25hb::readRegisters(uint8_t addr, uint8_t *data, size_t length) {
+    spi_transaction_t transaction = {};
+    transaction.flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR;
+    transaction.length = length * 8;
+    transaction.cmd = Lps25hbConfig::READ_BIT | Lps25hbConfig::AUTO_INCREMENT_BIT | addr;
+    transaction.tx_buffer = NULL;
+    transaction.rx_buffer = data;
+    transaction.user = (void *)cs_pin;
+
+    spi_transaction_ext_t spi_transaction = {};
+    spi_transaction.base = transaction;
+    spi_transaction.command_bits = 8;
+    return create_spi->pollTransmit((spi_transaction_t *)&spi_transaction, device_handle_id);
+}
+
 bool Lps25hb::getPressure(PressureData *data) {
     uint8_t pressure_bytes[3];
 
-    // 3バイトの気圧データを読み取り
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::PRESS_OUT_XL, device_handle_id, &pressure_bytes[0])) {
-        ESP_LOGE(TAG, "Failed to read PRESS_OUT_XL");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::PRESS_OUT_L, device_handle_id, &pressure_bytes[1])) {
-        ESP_LOGE(TAG, "Failed to read PRESS_OUT_L");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::PRESS_OUT_H, device_handle_id, &pressure_bytes[2])) {
-        ESP_LOGE(TAG, "Failed to read PRESS_OUT_H");
+    // 3バイトの気圧データを1回で読み取り
+    if (!readRegisters(Lps25hbConfig::Registers::PRESS_OUT_XL, pressure_bytes, sizeof(pressure_bytes))) {
+        ESP_LOGE(TAG, "Failed to read PRESS_OUT");
         return false;
     }
 
@@ -88,12 +150,8 @@ bool Lps25hb::getPressure(PressureData *data) {
 bool Lps25hb::getTemp(TempData *data) {
     uint8_t temp_bytes[2];
 
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::TEMP_OUT_L, device_handle_id, &temp_bytes[0])) {
-        ESP_LOGE(TAG, "Failed to read TEMP_OUT_L");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::TEMP_OUT_H, device_handle_id, &temp_bytes[1])) {
-        ESP_LOGE(TAG, "Failed to read TEMP_OUT_H");
+    if (!readRegisters(Lps25hbConfig::Registers::TEMP_OUT_L, temp_bytes, sizeof(temp_bytes))) {
+        ESP_LOGE(TAG, "Failed to read TEMP_OUT");
         return false;
     }
 
@@ -104,36 +162,27 @@ bool Lps25hb::getTemp(TempData *data) {
 }
 
 bool Lps25hb::getPressureAndTemp(PressureData *pressure, TempData *temp) {
-    uint8_t pressure_bytes[3];
-    uint8_t temp_bytes[2];
+    bool fresh;
+    return getPressureAndTemp(pressure, temp, &fresh);
+}
 
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::PRESS_OUT_XL, device_handle_id, &pressure_bytes[0])) {
-        ESP_LOGE(TAG, "Failed to read PRESS_OUT_XL");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::PRESS_OUT_L, device_handle_id, &pressure_bytes[1])) {
-        ESP_LOGE(TAG, "Failed to read PRESS_OUT_L");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::PRESS_OUT_H, device_handle_id, &pressure_bytes[2])) {
-        ESP_LOGE(TAG, "Failed to read PRESS_OUT_H");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::TEMP_OUT_L, device_handle_id, &temp_bytes[0])) {
-        ESP_LOGE(TAG, "Failed to read TEMP_OUT_L");
-        return false;
-    }
-    if (!create_spi->readByte(Lps25hbConfig::READ_BIT | Lps25hbConfig::Registers::TEMP_OUT_H, device_handle_id, &temp_bytes[1])) {
-        ESP_LOGE(TAG, "Failed to read TEMP_OUT_H");
+bool Lps25hb::getPressureAndTemp(PressureData *pressure, TempData *temp, bool *fresh) {
+    // STATUS_REG(0x27)の直後にPRESS_OUT_XL〜TEMP_OUT_H(0x28〜0x2C)が並んでいる
+    uint8_t rx_buffer[6];
+    if (!readRegisters(Lps25hbConfig::Registers::STATUS_REG, rx_buffer, sizeof(rx_buffer))) {
+        ESP_LOGE(TAG, "Failed to read pressure and temperature");
         return false;
     }
 
-    pressure->xl_p = pressure_bytes[0];
-    pressure->l_p = pressure_bytes[1];
-    pressure->h_p = pressure_bytes[2];
+    uint8_t status = rx_buffer[0];
+    *fresh = (status & Lps25hbConfig::Status::P_DA) && (status & Lps25hbConfig::Status::T_DA);
+
+    pressure->xl_p = rx_buffer[1];
+    pressure->l_p = rx_buffer[2];
+    pressure->h_p = rx_buffer[3];
 
-    temp->l_t = temp_bytes[0];
-    temp->h_t = temp_bytes[1];
+    temp->l_t = rx_buffer[4];
+    temp->h_t = rx_buffer[5];
 
     return true;
 }
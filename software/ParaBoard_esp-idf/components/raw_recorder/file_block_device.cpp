@@ -0,0 +1,28 @@
+#include "file_block_device.hpp"
+
+FileBlockDevice::FileBlockDevice(FILE* file, uint64_t sector_count,
+                                 uint32_t sector_size)
+    : file(file), sector_count(sector_count), sector_size(sector_size) {}
+
+bool FileBlockDevice::readSectors(uint64_t sector, uint32_t count,
+                                  void* buffer) {
+  if (sector + count > sector_count || !seekToSector(sector)) {
+    return false;
+  }
+  return fread(buffer, sector_size, count, file) == count;
+}
+
+bool FileBlockDevice::writeSectors(uint64_t sector, uint32_t count,
+                                   const void* buffer) {
+  if (sector + count > sector_count || !seekToSector(sector)) {
+    return false;
+  }
+  if (fwrite(buffer, sector_size, count, file) != count) {
+    return false;
+  }
+  return fflush(file) == 0;
+}
+
+bool FileBlockDevice::seekToSector(uint64_t sector) {
+  return fseeko(file, (off_t)(sector * sector_size), SEEK_SET) == 0;
+}
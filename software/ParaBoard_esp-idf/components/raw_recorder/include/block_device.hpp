@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief セクタ単位で読み書きするブロックデバイスのインターフェース
+ *
+ * RawRecorderはこのインターフェースだけを通してデータを読み書きする
+ * 実機ではSdmmcBlockDevice、ホストではFileBlockDeviceを使う
+ */
+class BlockDevice {
+ public:
+  virtual ~BlockDevice() = default;
+
+  /**
+   * @brief セクタサイズを取得する
+   * @return セクタサイズ（バイト）
+   */
+  virtual uint32_t getSectorSize() const = 0;
+
+  /**
+   * @brief セクタ数を取得する
+   * @return 使用できるセクタ数
+   */
+  virtual uint64_t getSectorCount() const = 0;
+
+  /**
+   * @brief セクタを読み込む
+   * @param sector 先頭セクタ番号（デバイス先頭からの相対値）
+   * @param count セクタ数
+   * @param buffer 読み込み先（count * セクタサイズ以上）
+   * @return 成功したかどうか
+   */
+  virtual bool readSectors(uint64_t sector, uint32_t count, void* buffer) = 0;
+
+  /**
+   * @brief セクタを書き込む
+   * @param sector 先頭セクタ番号（デバイス先頭からの相対値）
+   * @param count セクタ数
+   * @param buffer 書き込むデータ（count * セクタサイズ以上）
+   * @return 成功したかどうか
+   */
+  virtual bool writeSectors(uint64_t sector, uint32_t count,
+                            const void* buffer) = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "block_device.hpp"
+
+/**
+ * @brief 通常のファイルをブロックデバイスとして扱う
+ *
+ * ホスト(Linux)でのRawRecorderの検証や、カードイメージからの取り出しに使う
+ */
+class FileBlockDevice : public BlockDevice {
+ public:
+  static constexpr uint32_t DEFAULT_SECTOR_SIZE = 512;
+
+  /**
+   * @param file 読み書き可能なファイル（所有権は移さない）
+   * @param sector_count セクタ数
+   * @param sector_size セクタサイズ
+   */
+  FileBlockDevice(FILE* file, uint64_t sector_count,
+                  uint32_t sector_size = DEFAULT_SECTOR_SIZE);
+
+  uint32_t getSectorSize() const override { return sector_size; }
+  uint64_t getSectorCount() const override { return sector_count; }
+  bool readSectors(uint64_t sector, uint32_t count, void* buffer) override;
+  bool writeSectors(uint64_t sector, uint32_t count,
+                    const void* buffer) override;
+
+ private:
+  FILE* file;
+  uint64_t sector_count;
+  uint32_t sector_size;
+
+  bool seekToSector(uint64_t sector);
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block_device.hpp"
+
+/**
+ * @brief ブロックデバイスへ直接ログを書き込むフライトレコーダ
+ *
+ * 領域の先頭2セクタをスーパーブロック(A/B)とし、3セクタ目以降にデータを
+ * 追記していく。スーパーブロックには書き込み済みのバイト数を記録するため、
+ * 電源断の後でも最後にsync()した位置までのデータを取り出せる。
+ * ESP-IDFに依存しないため、ホストでFileBlockDeviceと組み合わせて検証できる
+ */
+class RawRecorder {
+ public:
+  /** 記録しているデータの形式 */
+  enum class DataFormat : uint8_t { CSV = 0, BINARY = 1 };
+
+  struct __attribute__((packed)) Superblock {
+    char magic[4];
+    uint16_t version;
+    uint16_t sector_size;
+    uint32_t generation;    // 書き込むたびに増える（新しい方を採用する）
+    uint32_t recording_id;  // 記録ごとに一意なID
+    uint64_t data_sectors;  // データ領域のセクタ数
+    uint64_t data_bytes;    // sync済みのデータのバイト数
+    uint8_t data_format;    // DataFormat
+    uint8_t exported;       // 通常のファイルへ書き出し済みなら1
+    uint8_t reserved[26];
+    uint32_t crc32;  // ここまでのCRC-32
+  };
+  static_assert(sizeof(Superblock) == 64, "Superblock must be 64 bytes");
+
+  static constexpr char MAGIC[4] = {'P', 'B', 'R', 'W'};
+  static constexpr uint16_t VERSION = 1;
+  static constexpr uint64_t SUPERBLOCK_SECTORS = 2;
+
+  /**
+   * @param device 書き込み先のブロックデバイス
+   * @param staging_buffer セクタ境界に揃えるためのバッファ
+   *        (セクタサイズの倍数、実機ではDMA対応領域を渡す)
+   * @param staging_size バッファのサイズ
+   */
+  RawRecorder(BlockDevice* device, uint8_t* staging_buffer,
+              size_t staging_size);
+
+  /**
+   * @brief 新しい記録を開始する（既存のデータは破棄される）
+   * 世代は領域に残っているスーパーブロックの続きから数える
+   * @param recording_id 記録ごとに一意なID
+   * @param format 記録するデータの形式
+   * @return 成功したかどうか
+   */
+  bool create(uint32_t recording_id, DataFormat format);
+
+  /**
+   * @brief スーパーブロックを読み込む
+   * @return 有効なスーパーブロックがあればtrue
+   */
+  bool load();
+
+  /**
+   * @brief データを追記する
+   * バッファがいっぱいになった分だけセクタ単位で書き込む
+   * バッファが空でセクタ単位のデータが渡された場合は、コピーせずに直接書き込む
+   * (実機ではdataもDMA対応領域にあることが望ましい)
+   * @return 成功したかどうか（領域が足りない場合もfalse）
+   */
+  bool append(const void* data, size_t size);
+
+  /**
+   * @brief バッファに残っているデータを書き込み、スーパーブロックを更新する
+   * @return 成功したかどうか
+   */
+  bool sync();
+
+  /**
+   * @brief 書き出し済みとして記録する
+   * @return 成功したかどうか
+   */
+  bool markExported();
+
+  /**
+   * @brief 記録済みのデータを読み込む（書き出し用）
+   * @param offset データ先頭からのオフセット（セクタサイズの倍数）
+   * @param buffer 読み込み先
+   * @param size 読み込むバイト数（セクタサイズの倍数）
+   * @return 成功したかどうか
+   */
+  bool readData(uint64_t offset, void* buffer, size_t size);
+
+  uint64_t getDataBytes() const { return superblock.data_bytes; }
+  uint64_t getCapacityBytes() const;
+  uint32_t getRecordingId() const { return superblock.recording_id; }
+  DataFormat getDataFormat() const {
+    return static_cast<DataFormat>(superblock.data_format);
+  }
+  bool isExported() const { return superblock.exported != 0; }
+
+ private:
+  BlockDevice* device;
+  uint8_t* staging_buffer;
+  size_t staging_size;
+  uint32_t sector_size;
+
+  Superblock superblock = {};
+  uint64_t flushed_sectors = 0;  // データ領域に確定済みのセクタ数
+  size_t staged_bytes = 0;       // バッファに溜まっているバイト数
+
+  bool writeSuperblock();
+  bool writeStaged(size_t sectors);
+};
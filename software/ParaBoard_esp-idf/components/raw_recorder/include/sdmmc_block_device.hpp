@@ -0,0 +1,33 @@
+#pragma once
+
+#include "block_device.hpp"
+#include "sdmmc_cmd.h"
+
+/**
+ * @brief SDカードの連続したセクタ範囲をブロックデバイスとして扱う
+ *
+ * sdmmc_read_sectors/sdmmc_write_sectorsで直接読み書きするため、
+ * newlib・VFS・FATFSを経由しない
+ */
+class SdmmcBlockDevice : public BlockDevice {
+ public:
+  /**
+   * @param card SDカード
+   * @param first_sector 範囲の先頭セクタ（カード先頭からの絶対値）
+   * @param sector_count 範囲のセクタ数
+   */
+  SdmmcBlockDevice(sdmmc_card_t* card, uint64_t first_sector,
+                   uint64_t sector_count);
+
+  uint32_t getSectorSize() const override;
+  uint64_t getSectorCount() const override { return sector_count; }
+  bool readSectors(uint64_t sector, uint32_t count, void* buffer) override;
+  bool writeSectors(uint64_t sector, uint32_t count,
+                    const void* buffer) override;
+
+ private:
+  static constexpr const char* TAG = "SDMMC_BLOCK";
+  sdmmc_card_t* card;
+  uint64_t first_sector;
+  uint64_t sector_count;
+};
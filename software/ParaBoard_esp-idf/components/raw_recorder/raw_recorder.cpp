@@ -0,0 +1,183 @@
+#include "raw_recorder.hpp"
+
+#include <string.h>
+
+#include "crc32.hpp"
+
+RawRecorder::RawRecorder(BlockDevice* device, uint8_t* staging_buffer,
+                         size_t staging_size)
+    : device(device),
+      staging_buffer(staging_buffer),
+      staging_size(staging_size),
+      sector_size(device->getSectorSize()) {
+  // バッファはセクタサイズの倍数に切り捨てて使う
+  this->staging_size = staging_size - staging_size % sector_size;
+}
+
+bool RawRecorder::create(uint32_t recording_id, DataFormat format) {
+  if (device->getSectorCount() <= SUPERBLOCK_SECTORS || staging_size == 0) {
+    return false;
+  }
+
+  // 領域に残っているスーパーブロックより新しい世代から始める
+  // （0から始めると、次のload()で残っている古い記録の方が採用されてしまう）
+  load();
+  uint32_t generation = superblock.generation;
+  memset(&superblock, 0, sizeof(superblock));
+  memcpy(superblock.magic, MAGIC, sizeof(MAGIC));
+  superblock.version = VERSION;
+  superblock.sector_size = sector_size;
+  superblock.generation = generation;
+  superblock.recording_id = recording_id;
+  superblock.data_sectors = device->getSectorCount() - SUPERBLOCK_SECTORS;
+  superblock.data_bytes = 0;
+  superblock.data_format = static_cast<uint8_t>(format);
+  superblock.exported = 0;
+
+  flushed_sectors = 0;
+  staged_bytes = 0;
+  return writeSuperblock();
+}
+
+bool RawRecorder::load() {
+  // A/Bのうち、CRCが正しく世代の新しい方を採用する
+  bool found = false;
+  for (uint64_t i = 0; i < SUPERBLOCK_SECTORS; i++) {
+    if (!device->readSectors(i, 1, staging_buffer)) {
+      continue;
+    }
+    Superblock candidate;
+    memcpy(&candidate, staging_buffer, sizeof(candidate));
+    if (memcmp(candidate.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        candidate.version != VERSION || candidate.sector_size != sector_size ||
+        candidate.crc32 != LogFormat::crc32(&candidate,
+                                            offsetof(Superblock, crc32))) {
+      continue;
+    }
+    if (!found || (int32_t)(candidate.generation - superblock.generation) > 0) {
+      superblock = candidate;
+      found = true;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  // 追記を再開できるように、確定済みの位置を復元する
+  flushed_sectors = superblock.data_bytes / sector_size;
+  staged_bytes = superblock.data_bytes % sector_size;
+  if (staged_bytes > 0 &&
+      !device->readSectors(SUPERBLOCK_SECTORS + flushed_sectors, 1,
+                           staging_buffer)) {
+    return false;
+  }
+  return true;
+}
+
+bool RawRecorder::append(const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  if (flushed_sectors * sector_size + staged_bytes + size >
+      getCapacityBytes()) {
+    return false;
+  }
+
+  while (size > 0) {
+    // セクタ境界に揃っていれば、バッファを経由せずにそのまま書き込む
+    if (staged_bytes == 0 && size >= sector_size) {
+      size_t sectors = size / sector_size;
+      if (!device->writeSectors(SUPERBLOCK_SECTORS + flushed_sectors,
+                                (uint32_t)sectors, bytes)) {
+        return false;
+      }
+      flushed_sectors += sectors;
+      bytes += sectors * sector_size;
+      size -= sectors * sector_size;
+      continue;
+    }
+
+    size_t chunk = staging_size - staged_bytes;
+    if (chunk > size) chunk = size;
+    memcpy(staging_buffer + staged_bytes, bytes, chunk);
+    staged_bytes += chunk;
+    bytes += chunk;
+    size -= chunk;
+
+    // バッファがいっぱいになったらまとめて書き込む
+    if (staged_bytes == staging_size) {
+      if (!writeStaged(staging_size / sector_size)) {
+        return false;
+      }
+      flushed_sectors += staging_size / sector_size;
+      staged_bytes = 0;
+    }
+  }
+  return true;
+}
+
+bool RawRecorder::sync() {
+  if (staged_bytes > 0) {
+    // 最後のセクタの余りは0で埋めて書き込む（次回以降に上書きされる）
+    size_t sectors = (staged_bytes + sector_size - 1) / sector_size;
+    memset(staging_buffer + staged_bytes, 0,
+           sectors * sector_size - staged_bytes);
+    if (!writeStaged(sectors)) {
+      return false;
+    }
+
+    // 埋まったセクタは確定させ、端数だけをバッファの先頭に残す
+    size_t full_sectors = staged_bytes / sector_size;
+    if (full_sectors > 0) {
+      size_t remain = staged_bytes - full_sectors * sector_size;
+      memmove(staging_buffer, staging_buffer + full_sectors * sector_size,
+              remain);
+      flushed_sectors += full_sectors;
+      staged_bytes = remain;
+    }
+  }
+
+  uint64_t data_bytes = flushed_sectors * sector_size + staged_bytes;
+  if (data_bytes == superblock.data_bytes) {
+    return true;
+  }
+  superblock.data_bytes = data_bytes;
+  return writeSuperblock();
+}
+
+bool RawRecorder::markExported() {
+  superblock.exported = 1;
+  return writeSuperblock();
+}
+
+bool RawRecorder::readData(uint64_t offset, void* buffer, size_t size) {
+  if (offset % sector_size != 0 || size % sector_size != 0 ||
+      offset + size > getCapacityBytes()) {
+    return false;
+  }
+  return device->readSectors(SUPERBLOCK_SECTORS + offset / sector_size,
+                             size / sector_size, buffer);
+}
+
+uint64_t RawRecorder::getCapacityBytes() const {
+  return superblock.data_sectors * sector_size;
+}
+
+bool RawRecorder::writeSuperblock() {
+  // 世代ごとにA/Bを交互に書き換え、書き込み中の電源断でも片方が残るようにする
+  superblock.generation++;
+  superblock.crc32 =
+      LogFormat::crc32(&superblock, offsetof(Superblock, crc32));
+
+  // 端数のデータを壊さないよう、ステージングバッファとは別の領域で組み立てる
+  alignas(4) uint8_t sector[512] = {};
+  if (sector_size > sizeof(sector)) {
+    return false;
+  }
+  memcpy(sector, &superblock, sizeof(superblock));
+  return device->writeSectors(superblock.generation % SUPERBLOCK_SECTORS, 1,
+                              sector);
+}
+
+bool RawRecorder::writeStaged(size_t sectors) {
+  return device->writeSectors(SUPERBLOCK_SECTORS + flushed_sectors,
+                              (uint32_t)sectors, staging_buffer);
+}
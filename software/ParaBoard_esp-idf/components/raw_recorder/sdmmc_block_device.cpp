@@ -0,0 +1,43 @@
+#include "sdmmc_block_device.hpp"
+
+#include "esp_log.h"
+
+SdmmcBlockDevice::SdmmcBlockDevice(sdmmc_card_t* card, uint64_t first_sector,
+                                   uint64_t sector_count)
+    : card(card), first_sector(first_sector), sector_count(sector_count) {}
+
+uint32_t SdmmcBlockDevice::getSectorSize() const {
+  return card->csd.sector_size;
+}
+
+bool SdmmcBlockDevice::readSectors(uint64_t sector, uint32_t count,
+                                   void* buffer) {
+  if (sector + count > sector_count) {
+    ESP_LOGE(TAG, "Read out of range (sector=%llu, count=%lu)",
+             (unsigned long long)sector, (unsigned long)count);
+    return false;
+  }
+  esp_err_t err =
+      sdmmc_read_sectors(card, buffer, first_sector + sector, count);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "sdmmc_read_sectors failed (0x%x)", err);
+    return false;
+  }
+  return true;
+}
+
+bool SdmmcBlockDevice::writeSectors(uint64_t sector, uint32_t count,
+                                    const void* buffer) {
+  if (sector + count > sector_count) {
+    ESP_LOGE(TAG, "Write out of range (sector=%llu, count=%lu)",
+             (unsigned long long)sector, (unsigned long)count);
+    return false;
+  }
+  esp_err_t err =
+      sdmmc_write_sectors(card, buffer, first_sector + sector, count);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "sdmmc_write_sectors failed (0x%x)", err);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+/**
+ * @brief 統計を取るSDカードへの操作の種類
+ */
+enum class SdOperation : uint8_t {
+  WRITE,          // ログの書き込み（writeLogBytes、ログタスクのバッファ1つ分）
+  SYNC,           // ログの同期（flush、fflush+fsync）
+  SETTINGS_SAVE,  // 設定ファイルの保存（safeWriteSettingsToFile全体）
+  COUNT,
+};
+
+/**
+ * @brief 処理時間のヒストグラム（マイクロ秒のlog2のバケット）
+ *
+ * バケット0は1us未満、バケットi(1以上)は 2^(i-1) us以上 2^i us未満を数え、
+ * 最後のバケットはそれ以上をすべて数える。あわせて回数・合計時間・最大時間・
+ * バイト数を記録する
+ * 記録はロックを使わないので、どのタスクからも待たずに呼べる
+ * 読み出しは記録と同時に行うと、回数と合計がわずかにずれることがある
+ * 32ビットのアトミック変数のみを使う（ESP32-S3では64ビットのアトミック操作はロックになるため）。
+ * 合計時間は約71分、バイト数は4GBで折り返す
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int BUCKET_COUNT = 24;  // 最後のバケットは約4.2秒以上
+
+  /**
+   * @brief 1回の処理を記録する
+   * @param elapsed_us 処理時間
+   * @param bytes 処理したバイト数
+   */
+  void record(uint32_t elapsed_us, uint32_t bytes = 0);
+
+  /**
+   * @brief 記録を0に戻す
+   */
+  void reset();
+
+  uint32_t getCount() const { return count.load(std::memory_order_relaxed); }
+  uint32_t getTotalUs() const {
+    return total_us.load(std::memory_order_relaxed);
+  }
+  uint32_t getMaxUs() const { return max_us.load(std::memory_order_relaxed); }
+  uint32_t getBytes() const { return bytes.load(std::memory_order_relaxed); }
+  uint32_t getBucket(int index) const {
+    return buckets[index].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 処理時間の百分位数を、バケットの上限で求める
+   * @param percent 百分位（0〜100）
+   * @return 処理時間の上限（us、記録がなければ0）
+   */
+  uint32_t getPercentileUs(uint32_t percent) const;
+
+  /**
+   * @brief バケットの上限を取得する
+   * @param index バケットの番号
+   * @return このバケットに入る処理時間の上限（us、これ未満）
+   */
+  static uint32_t getBucketLimitUs(int index) { return 1u << index; }
+
+  /**
+   * @brief 要約と、0でないバケットを書き出す
+   * @param out 書き出し先（stdoutまたはファイル）
+   * @param name 操作の名前
+   */
+  void print(FILE* out, const char* name) const;
+
+ private:
+  std::atomic<uint32_t> buckets[BUCKET_COUNT] = {};
+  std::atomic<uint32_t> count{0};
+  std::atomic<uint32_t> total_us{0};
+  std::atomic<uint32_t> max_us{0};
+  std::atomic<uint32_t> bytes{0};
+};
+
+/**
+ * @brief 操作の名前を取得する
+ * @param operation 操作の種類
+ * @return 名前
+ */
+const char* sdOperationName(SdOperation operation);
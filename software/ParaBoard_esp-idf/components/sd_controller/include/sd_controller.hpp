@@ -1,5 +1,6 @@
 #pragma once
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -16,17 +17,24 @@
 #include "driver/sdmmc_host.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
 #include "ff.h"
+#include "latency_histogram.hpp"
+#include "log_block.hpp"
+#include "log_codec.hpp"
+#include "log_format.hpp"
+#include "raw_recorder.hpp"
+#include "sdmmc_block_device.hpp"
+#include "settings_cache.hpp"
+#include "settings_journal.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "sdkconfig.h"
 #include "sdmmc_cmd.h"
 
-// 設定項目の型定義
-enum class SettingType { INTEGER, FLOAT, BOOLEAN, STRING };
-
 // 設定項目値のユニオン型
 union SettingValue {
   int int_value;
@@ -42,41 +50,126 @@ struct SettingItem {
   SettingValue default_value;
 };
 
+// ログ書き込みベンチマークの結果
+struct LogWriteBenchmarkResult {
+  int64_t max_us;     // writeLog()+flush()の最悪時間
+  float average_us;   // 1サンプルあたりの平均時間
+  int64_t total_ms;   // 合計時間
+};
+
 class SdController {
  private:
   static constexpr const char* TAG = "SDMMC";
   sdmmc_card_t* card = nullptr;
   FILE* log_file_pointer = nullptr;
+  BlockDevice* raw_device = nullptr;     // rawレコーダの書き込み先
+  RawRecorder* raw_recorder = nullptr;   // log_backendが"raw"の時のみ使う
   FILE* setting_file_pointer = nullptr;
   bool mounted = false;
   bool high_speed = false;
+  bool speed_fallback = false;     // 高速で使えず通常速度に戻したかどうか
+  uint32_t card_write_kbps = 0;    // 起動時の確認で計測した書き込み速度
+  sdmmc_slot_config_t slot_config = {};  // 再マウント用に保存しておく
+  bool binary_log = false;  // trueならlog-N.binにバイナリ形式で記録する
+  bool preallocated = false;  // ログファイルを事前確保したかどうか
+  uint64_t log_bytes_written = 0;  // ログファイルに書き込んだバイト数
+  uint32_t log_file_id = 0;        // バイナリ形式のブロックに書くファイルID
+  uint32_t next_block_seq = 0;     // 次に封をするブロックの通し番号
+  LogFormat::RecordEncoder log_encoder;  // バイナリ形式のレコード変換(差分圧縮)
+  // 操作ごとの処理時間（LOGGING開始時にリセットし、終了時に書き出す）
+  LatencyHistogram io_stats[static_cast<int>(SdOperation::COUNT)];
   std::string mount_point = "/sdcard";
   std::string log_file_prefix = "log-";
   std::string setting_file_name = "setting.json";
+  // 設定の正本は追記型のジャーナル、setting.json は人が編集するための写し
+  static constexpr const char* SETTINGS_JOURNAL_NAME = "settings.jnl";
+  // 最後に書き出した setting.json のCRCを記録するジャーナルのキー
+  static constexpr const char* JSON_CRC_KEY = ".json_crc";
+  SettingsJournal settings_journal;
+  uint32_t exported_json_crc = 0;
   std::string log_file_name = "";
+  std::string boot_dir_name = "";  // この起動で使うログのディレクトリ（未作成なら空）
   uint32_t freq_khz = SDMMC_FREQ_DEFAULT;
 
   static constexpr size_t LOG_BUFFER_SIZE = 4 * 1024;
+  static constexpr const char* FAT_DRIVE = "0:";
+  static constexpr const char* RAW_FILE_NAME = "flight.raw";
+  // 操作ごとの処理時間は logs/boot-N/sdstats.txt に、LOGGINGごとに追記する
+  static constexpr const char* IO_STATS_FILE_NAME = "sdstats.txt";
+  // 起動時のカードのベンチマークの書き込み先と、結果を書き出すファイル
+  static constexpr const char* CARD_BENCH_FILE_NAME = "cardbench.tmp";
+  static constexpr const char* CARD_BENCH_REPORT_NAME = "cardbench.txt";
+  static constexpr int MAX_CARD_BENCH_MB = 64;
+  // 起動時に速度を決めるための読み書きの確認
+  static constexpr const char* VERIFY_FILE_NAME = "sdverify.tmp";
+  static constexpr size_t VERIFY_SIZE = 256 * 1024;
+  // ログは logs/boot-<起動番号>/log-<通し番号>.csv(.bin) に作成する
+  static constexpr const char* LOG_DIR_NAME = "logs";
+  static constexpr const char* BOOT_DIR_PREFIX = "boot-";
+  static constexpr uint16_t LOG_SAMPLE_RATE_HZ = 1000;
+  // CSV1行あたりのバイト数の見積もり（事前確保サイズの計算用）
+  static constexpr uint64_t CSV_BYTES_PER_SAMPLE = 80;
+  // バイナリ1サンプルあたりのバイト数の見積もり
+  // (IMUレコードに、25Hzの気圧レコードと低レートの温度レコードの分を足す)
+  // 差分圧縮してもこれより大きくはならないので、圧縮時もこの値で確保する
+  static constexpr uint64_t BINARY_BYTES_PER_SAMPLE =
+      sizeof(LogFormat::ImuRecord) + 1;
+  // 修復時に1行として許容する最大長
+  static constexpr uint64_t CSV_MAX_LINE_LENGTH = 128;
+  // CSVの1行の列の数と、seqの列（0から数えた番号）
+  static constexpr int CSV_COLUMN_COUNT = 21;
+  static constexpr int CSV_SEQ_COLUMN = 18;
+  // 修復時にレコード間の時刻の空きとして許容する最大値
+  static constexpr uint64_t RECOVERY_MAX_GAP_US = 10 * 1000 * 1000;
   char* dmaBuffer = nullptr;
 
   // ファイル操作用ミューテックス
   SemaphoreHandle_t file_mutex = nullptr;
 
+  // 設定のマップ用ミューテックス（再帰的、文字列で引く設定の取得/設定と保存で使う）
+  SemaphoreHandle_t settings_mutex = nullptr;
+
   // 設定項目を格納するマップ
   std::map<std::string, SettingItem> settings;
 
   // 設定のバックアップ
   std::map<std::string, SettingItem> settings_backup;
 
+  // SettingKeyの項目の値（他のタスクからロックなしで読み出す用）
+  // settingsを変更したら、同じ値をここにも公開する
+  SettingsCache settings_cache;
+
+  // settingsの値から、SettingsCacheの全項目を公開し直す
+  void publishCachedSettings();
+
+  // SettingsCacheの項目で型が一致すれば、値を公開する
+  void publishCachedSetting(const std::string& key, SettingType type,
+                            uint32_t word);
+
   // JSONファイル読み込み処理
-  bool loadSettingsFromFile();
+  // only_if_editedなら、最後に書き出した内容から変わっている時だけ取り込む
+  bool loadSettingsFromFile(bool only_if_edited = false,
+                            bool* imported = nullptr);
 
-  // JSONファイル書き込み処理
+  // JSONファイル書き込み処理（setting.json 全体を書き直す）
   bool saveSettingsToFile();
 
+  // 起動時の設定の読み込み（ジャーナルの読み込み、setting.json の取り込みと
+  // 書き出し、ジャーナルのコンパクション）
+  bool loadSettings();
+
+  // 今の設定を、ジャーナルに記録する形に変換する
+  SettingsJournal::EntryMap collectJournalEntries();
+
+  // ジャーナルの値を設定に反映する
+  void applyJournalEntries(const SettingsJournal::EntryMap& entries);
+
   // 安全なファイル書き込み処理（一時ファイル使用）
   bool safeWriteSettingsToFile();
 
+  // 設定のバックアップを作成し、JSON文字列に変換する（free()で解放する）
+  char* serializeSettings();
+
   // ファイルシステム状態チェック
   bool checkFileSystemStatus();
 
@@ -92,11 +185,88 @@ class SdController {
   // デフォルト設定の初期化
   void initDefaultSettings();
 
+  // 設定に従ってバイナリ形式のレコード変換を初期化し、キーフレーム間隔を返す
+  uint16_t resetLogEncoder();
+
+  // 事前確保するログファイルのサイズを計算（0なら確保しない）
+  uint64_t getPreallocateSize();
+
+  // 前回切り詰められなかった事前確保済みログファイルを修復
+  void recoverPreallocatedLog();
+
+  // 事前確保済みログファイルの有効なデータの終端を探す
+  uint64_t findBinaryLogEnd(FILE* fp);
+  uint64_t findBlockLogEnd(FILE* fp);
+  uint64_t findCsvLogEnd(FILE* fp);
+
+  // 通常のファイルにログを書き込む準備をする
+  bool openLogFileStream();
+
+  // 次に使うログファイル名を決める（マウントポイントからの相対パス）
+  std::string nextLogFileName(const char* extension);
+
+  // この起動で使うログのディレクトリを作成し、起動番号を保存する
+  bool reserveBootDirectory();
+
+  // ディレクトリ内の "<prefix><番号>" で始まる名前のうち、最大の番号を探す
+  int scanMaxIndex(const std::string& dir_path, const char* prefix);
+
+  // rawレコーダ用の連続領域（flight.raw）のカード上の位置を取得
+  bool findRawExtent(uint64_t* first_sector, uint64_t* sector_count);
+
+  // rawレコーダの開始/終了
+  bool openRawRecorder();
+  void closeRawRecorder();
+
+  // 書き出されていないrawレコーダの記録を通常のファイルに書き出す
+  // （LOGGINGモード終了時には書き出さず、次の起動時にここで書き出す）
+  void recoverRawRecording();
+  bool exportRawRecording(RawRecorder* recorder);
+
+  // 指定した速度でカードをマウントする
+  bool mountCard(bool use_high_speed);
+
+  // アンマウントして、指定した速度でマウントし直す
+  // 開いている設定のジャーナルは、アンマウントの前に閉じてマウントし直した後に開き直す
+  bool remountCard(bool use_high_speed);
+
+  // 設定(sd_speed)と読み書きの確認の結果から、カードの速度を決める
+  // （マウントし直せなかった場合はfalse）
+  bool selectCardSpeed(bool allow_high_speed, std::string speed);
+
+  // 設定を読み込む前に、sd_speedだけをジャーナル（なければ setting.json）から
+  // 読み取り専用で読む（カードには書き込まない）
+  std::string peekSpeedSetting();
+
+  // テストパターンを書いて読み戻し、一致するか確認する（書き込み速度も計測する）
+  bool verifyCard(uint32_t* write_kbps);
+
+  // 位置ごとに異なるテストパターンでLOG_BUFFER_SIZEバイトを埋める
+  static void fillTestPattern(uint8_t* block, uint64_t offset);
+
+  // 操作の処理時間を記録する
+  void recordIo(SdOperation operation, int64_t start_us, size_t bytes = 0) {
+    io_stats[static_cast<int>(operation)].record(
+        esp_timer_get_time() - start_us, bytes);
+  }
+
+  // 操作ごとの処理時間を logs/boot-N/sdstats.txt に追記する
+  void saveIoStats();
+
+  // ログ書き込み時間を計測する
+  bool benchmarkLogWrite(bool use_preallocation, int samples,
+                         int flush_interval, LogWriteBenchmarkResult* result);
+
  public:
   SdController();
   ~SdController();
 
-  bool begin(bool useHighSpeed = false,
+  /**
+   * SDカードをマウントし、設定を読み込む
+   * useHighSpeedがtrueなら、まず高速(40MHz)でマウントして読み書きを確認し、
+   * 失敗したら通常速度(20MHz)に戻す（setting.jsonのsd_speedで固定もできる）
+   */
+  bool begin(bool useHighSpeed = true,
              // 追加: ピンをユーザーが指定したい場合
              int gpio_clk = GPIO_NUM_14, int gpio_cmd = GPIO_NUM_15,
              int gpio_d0 = GPIO_NUM_2, int gpio_d1 = GPIO_NUM_4,
@@ -107,9 +277,137 @@ class SdController {
    */
   void end();
 
+  /**
+   * ログファイルを開く（LOGGINGモード開始時に呼ぶ）
+   * max_flight_secondsが正なら、その時間分の連続領域を事前に確保する
+   */
+  bool openLogFile();
+
+  /**
+   * ログファイルを閉じる（事前確保した場合は実際の長さに切り詰める）
+   */
+  void closeLogFile();
+
+  /**
+   * 事前確保あり/なしでwriteLog()+flush()の最悪時間を計測して表示する
+   * ログファイルを開いていない時のみ実行できる
+   */
+  void runWriteBenchmark(int samples = 10000);
+
+  /**
+   * 既存のログが1/100/1000個ある場合に、ログファイル名を決める時間を計測して表示する
+   * (従来の連番の確認、通し番号による確認、走査によるフォールバック)
+   * ログファイルを開いていない時のみ実行できる
+   */
+  void runNamingBenchmark();
+
+  /**
+   * 飛行中と同じ書き方（事前確保した領域に4KBずつ書き、flush_max_pending_bytesごとに同期）で
+   * テストパターンを書き、持続的な書き込み速度と最悪の停止時間を表示する
+   * 読み戻してパターンも確認する。結果は logs/boot-N/cardbench.txt にも書き出す
+   * setting.json の sd_benchmark_mb が正なら起動時に実行する
+   * ログファイルを開いていない時のみ実行できる
+   * @param megabytes 書き込むサイズ（MB、最大MAX_CARD_BENCH_MB）
+   */
+  void runCardBenchmark(int megabytes);
+
+  /**
+   * @brief カードの実際のクロックを取得する
+   * @return クロック（kHz、マウントしていなければ0）
+   */
+  uint32_t getCardFreqKhz() const {
+    return mounted && card ? card->real_freq_khz : 0;
+  }
+
+  /**
+   * @brief 起動時の確認で計測した書き込み速度を取得する
+   * @return 書き込み速度（kB/s、確認に失敗していれば0）
+   */
+  uint32_t getCardWriteKbps() const { return card_write_kbps; }
+
+  /**
+   * @brief 高速で使えず通常速度に戻したかどうか
+   */
+  bool isSpeedFallback() const { return speed_fallback; }
+
+  /**
+   * @brief 操作ごとの処理時間の統計を取得する
+   * @param operation 操作の種類
+   * @return ヒストグラム
+   */
+  const LatencyHistogram& getIoStats(SdOperation operation) const {
+    return io_stats[static_cast<int>(operation)];
+  }
+
+  /**
+   * @brief 操作ごとの処理時間の統計をリセットする（ログファイルを開く時にも呼ぶ）
+   */
+  void resetIoStats();
+
+  /**
+   * @brief 操作ごとの処理時間の統計を書き出す
+   * @param out 書き出し先（stdoutまたはファイル）
+   */
+  void printIoStats(FILE* out) const;
+
+  /**
+   * この起動で使うログのディレクトリ（logs/boot-N）のパスを取得する
+   * まだ作成していなければ作成する（失敗したら空文字列を返す）
+   */
+  std::string getBootDirectoryPath();
+
+  /** encodeLog()が1サンプルあたりに必要とする最大のバイト数 */
+  static constexpr size_t MAX_ENCODED_LOG_SIZE = CSV_MAX_LINE_LENGTH;
+
   // ログ書き込み
   void writeLog(SensorData data);
 
+  /**
+   * @brief 1サンプルを現在のログ形式（CSV/バイナリ）に変換する
+   * @param data センサーデータ
+   * @param buffer 書き込み先
+   * @param size 書き込み先のサイズ
+   * @return 書き込んだバイト数（入りきらない場合は0）
+   */
+  size_t encodeLog(const SensorData& data, void* buffer, size_t size);
+
+  /**
+   * @brief 複数のサンプルを連続した領域に変換する
+   * @param data センサーデータの配列
+   * @param count サンプル数
+   * @param buffer 書き込み先
+   * @param size 書き込み先のサイズ
+   * @param encoded_count 変換できたサンプル数（入りきらなければcount未満）
+   * @return 書き込んだバイト数
+   */
+  size_t encodeLogBatch(const SensorData* data, size_t count, void* buffer,
+                        size_t size, size_t* encoded_count);
+
+  /**
+   * @brief ログタスクのバッファの先頭に空けておく、ブロックヘッダのバイト数
+   * @return バイナリ形式ならBlockHeaderのサイズ、CSVなら0
+   */
+  size_t getLogBlockHeaderSize() const {
+    return binary_log ? sizeof(LogFormat::BlockHeader) : 0;
+  }
+
+  /**
+   * @brief 変換済みのログを詰めたバッファをブロックとして封をする
+   * バイナリ形式ならヘッダとCRCを書き込んでBLOCK_SIZEまで0で埋め、
+   * CSVなら何もしない。ブロックは封をした順に書き込むこと
+   * @param buffer バッファ（先頭のgetLogBlockHeaderSize()バイトは空けておく）
+   * @param payload_size ヘッダを除いたバイト数
+   * @return 書き込むバイト数
+   */
+  size_t sealLogBlock(uint8_t* buffer, size_t payload_size);
+
+  /**
+   * @brief 変換済みのログを書き込み先（ファイル or rawレコーダ）へ渡す
+   * @param data 変換済みのログ
+   * @param size バイト数
+   */
+  void writeLogBytes(const void* data, size_t size);
+
   // fflush()のラッパ (必要に応じて呼び出し)
   void flush();
 
@@ -127,14 +425,43 @@ class SdController {
   bool getBoolSetting(const std::string& key, bool default_value = false);
   void setBoolSetting(const std::string& key, bool value);
 
+  /**
+   * @brief SettingKeyの設定値を取得する（ロック・メモリ確保なし、どのタスクからも呼べる）
+   * @param key 項目（型がINTEGERのもの）
+   * @return 設定値
+   */
+  int getIntSetting(SettingKey key) const { return settings_cache.getInt(key); }
+
+  /**
+   * @brief SettingKeyの設定値を取得する（ロック・メモリ確保なし、どのタスクからも呼べる）
+   * @param key 項目（型がFLOATのもの）
+   * @return 設定値
+   */
+  float getFloatSetting(SettingKey key) const {
+    return settings_cache.getFloat(key);
+  }
+
+  /**
+   * @brief SettingKeyの設定値を取得する（ロック・メモリ確保なし、どのタスクからも呼べる）
+   * @param key 項目（型がBOOLEANのもの）
+   * @return 設定値
+   */
+  bool getBoolSetting(SettingKey key) const {
+    return settings_cache.getBool(key);
+  }
+
   // string型の設定値取得/設定
   std::string getStringSetting(const std::string& key,
                                const std::string& default_value = "");
   void setStringSetting(const std::string& key, const std::string& value);
 
-  // 全設定の保存
+  // 全設定の保存（書き込みと同期が終わるまで待つ。通常はSettingsWriterから呼ぶ）
+  // 変わった設定だけをジャーナルに追記する
   bool saveSettings();
 
-  // 全設定の再読み込み
+  // setting.json を読み込み直し、ジャーナルにも記録する
   bool reloadSettings();
+
+  // 今の設定を setting.json に書き出す（通常は起動時に自動で行う）
+  bool exportSettings();
 };
\ No newline at end of file
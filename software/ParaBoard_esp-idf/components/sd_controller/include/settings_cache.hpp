@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+
+// 設定項目の型定義
+enum class SettingType { INTEGER, FLOAT, BOOLEAN, STRING };
+
+/**
+ * @brief 他のタスクから周期的に読み出す設定項目
+ *
+ * ここに並べた項目は、設定のマップとは別に SettingsCache にも値を持ち、
+ * 番号で直接読み出せる。項目を増やす時は settings_cache.cpp の表にも名前と型を追加する
+ */
+enum class SettingKey : uint8_t {
+  OPEN_ANGLE,   // "open-angle"（頂点検知時のサーボ角度）
+  CLOSE_ANGLE,  // "close-angle"（頂点検知を取り消した時のサーボ角度）
+  COUNT,
+};
+
+/**
+ * @brief SettingKeyの設定値を、ロックなしで読み出せるように保持する
+ *
+ * 値は32ビットの配列に入れ、シーケンスロックで更新を公開する
+ * 書き込み側は更新中にシーケンス番号を奇数にし、書き終えたら偶数に戻す
+ * 読み出し側は前後でシーケンス番号を比べ、更新と重なった時だけ読み直す
+ * そのため読み出しはメモリ確保・文字列の比較・ロックを行わず、センサータスクから呼べる
+ * 書き込みはクリティカルセクション内で行うので、同じコアの読み出しが
+ * 書きかけの状態で割り込むことはなく、他のコアの読み出しも数回の読み直しで済む
+ * 書き込みは設定の変更時のみ（コマンドタスク、起動時の読み込み）で、頻繁には行わない
+ */
+class SettingsCache {
+ public:
+  static constexpr int KEY_COUNT = static_cast<int>(SettingKey::COUNT);
+
+  /**
+   * @brief 全項目の値（型ごとに32ビットへ詰めたもの）
+   */
+  struct Snapshot {
+    uint32_t words[KEY_COUNT];
+  };
+
+  /**
+   * @brief 全項目を一度に読み出す（項目どうしの組み合わせが一貫する）
+   * @return 全項目の値
+   */
+  Snapshot read() const;
+
+  /**
+   * @brief 全項目を一度に更新する
+   * @param snapshot 全項目の値
+   */
+  void publish(const Snapshot& snapshot);
+
+  /**
+   * @brief 1項目だけ更新する
+   * @param key 項目
+   * @param word 値（toWord()で変換したもの）
+   */
+  void publish(SettingKey key, uint32_t word);
+
+  // 型ごとの読み出し（項目の型と一致するものを使う）
+  int getInt(SettingKey key) const { return static_cast<int>(readWord(key)); }
+  float getFloat(SettingKey key) const { return toFloat(readWord(key)); }
+  bool getBool(SettingKey key) const { return readWord(key) != 0; }
+
+  // 32ビットの値への変換
+  static uint32_t toWord(int value) { return static_cast<uint32_t>(value); }
+  static uint32_t toWord(float value);
+  static uint32_t toWord(bool value) { return value ? 1 : 0; }
+  static float toFloat(uint32_t word);
+
+  /**
+   * @brief 設定名から項目を探す（設定の変更時用、線形探索）
+   * @param name 設定名
+   * @param key 見つかった項目
+   * @return 見つかったかどうか
+   */
+  static bool findKey(const std::string& name, SettingKey* key);
+
+  /**
+   * @brief 項目の設定名を取得する
+   */
+  static const char* getKeyName(SettingKey key);
+
+  /**
+   * @brief 項目の型を取得する
+   */
+  static SettingType getKeyType(SettingKey key);
+
+ private:
+  // 偶数なら公開済み、奇数なら更新中
+  std::atomic<uint32_t> sequence{0};
+  std::atomic<uint32_t> words[KEY_COUNT] = {};
+  // 書き込み側どうしの排他と、書き込み中の割り込みの禁止に使う
+  portMUX_TYPE write_lock = portMUX_INITIALIZER_UNLOCKED;
+
+  uint32_t readWord(SettingKey key) const;
+};
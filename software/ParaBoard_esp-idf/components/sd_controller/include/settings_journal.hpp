@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+
+// 設定のジャーナル(settings.jnl)の定義
+// ファイルは SettingsJournalHeader 1つと、可変長のレコードの並びで構成される
+// レコードは SettingsRecordHeader、キー、値の順で、1つの設定の新しい値を表す
+// 同じキーのレコードが複数あれば、後ろのものが有効になる
+// 設定を変更した時は、変わったキーのレコードだけを追記して同期する（ファイル全体を書き直さない）
+// 電源断で書きかけになったレコードはCRCが合わないので、そこから後ろを捨てる
+// 起動時に、有効なキーごとに最新のレコードだけを残したファイルへ置き換える（コンパクション）
+// ESP-IDFに依存しないため、ホスト側ツールからもインクルードできる
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "settings_journal.hpp assumes a little-endian target"
+#endif
+
+/** ファイル先頭のマジック "PBSJ" */
+static constexpr char SETTINGS_JOURNAL_MAGIC[4] = {'P', 'B', 'S', 'J'};
+/** スキーマバージョン（レコード構造を変えたら上げる） */
+static constexpr uint16_t SETTINGS_JOURNAL_VERSION = 1;
+/** レコードの先頭の印 */
+static constexpr uint8_t SETTINGS_RECORD_MARKER = 0xA5;
+
+struct __attribute__((packed)) SettingsJournalHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t header_size;
+  uint8_t reserved[8];
+};
+
+struct __attribute__((packed)) SettingsRecordHeader {
+  uint8_t marker;        // SETTINGS_RECORD_MARKER
+  uint8_t type;          // 値の型（SettingTypeの値）
+  uint8_t key_length;    // キーのバイト数（1以上）
+  uint8_t value_length;  // 値のバイト数
+  uint32_t crc32;        // ここまでと、キー・値のCRC-32
+};
+
+static_assert(sizeof(SettingsJournalHeader) == 16,
+              "SettingsJournalHeader must be 16 bytes");
+static_assert(sizeof(SettingsRecordHeader) == 8,
+              "SettingsRecordHeader must be 8 bytes");
+
+/**
+ * @brief ジャーナルに記録する1つの設定の値
+ * 値はバイト列のまま持つ（整数・小数は4バイトのリトルエンディアン、
+ * 真偽値は1バイト、文字列は終端なしの文字列）
+ */
+struct SettingsJournalEntry {
+  uint8_t type;
+  std::string value;
+
+  bool operator==(const SettingsJournalEntry& other) const {
+    return type == other.type && value == other.value;
+  }
+  bool operator!=(const SettingsJournalEntry& other) const {
+    return !(*this == other);
+  }
+};
+
+/**
+ * @brief 設定のジャーナルファイルを読み書きする
+ * スレッドセーフではないので、呼び出し側で排他する
+ */
+class SettingsJournal {
+ public:
+  using EntryMap = std::map<std::string, SettingsJournalEntry>;
+
+  /**
+   * @brief open()で読み込んだ結果
+   */
+  struct LoadResult {
+    bool found;          // ジャーナルがあったかどうか（なければ新規に作成した）
+    uint32_t records;    // 有効なレコードの数（同じキーの重複を含む）
+    uint32_t file_bytes;   // ファイルのバイト数
+    uint32_t valid_bytes;  // 先頭から有効なレコードまでのバイト数
+  };
+
+  /** キー・値の最大のバイト数 */
+  static constexpr size_t MAX_KEY_LENGTH = 255;
+  static constexpr size_t MAX_VALUE_LENGTH = 255;
+
+  SettingsJournal() {}
+  ~SettingsJournal() { close(); }
+
+  /**
+   * @brief ジャーナルを開いて読み込み、追記できる状態にする
+   * なければ新規に作成する。コンパクションの途中で電源が切れていれば、
+   * 一時ファイル（パス+".tmp"）から復旧する
+   * 末尾の壊れたレコードは切り詰める
+   * @param path ジャーナルのパス
+   * @param result 読み込んだ結果
+   * @return 開けたかどうか
+   */
+  bool open(const std::string& path, LoadResult* result);
+
+  /**
+   * @brief ジャーナルを閉じる
+   */
+  void close();
+
+  bool isOpen() const { return file_pointer != nullptr; }
+
+  /**
+   * @brief ジャーナルに記録済みの値（キーごとの最新の値）を取得する
+   */
+  const EntryMap& getEntries() const { return entries; }
+
+  /**
+   * @brief 記録済みの値と異なるものだけを追記し、同期する
+   * @param values 記録したい値（含まれないキーはそのまま）
+   * @param appended 追記したレコードの数（nullptr可）
+   * @return 成功したかどうか（変更がなければ何もせずtrue）
+   */
+  bool put(const EntryMap& values, uint32_t* appended = nullptr);
+
+  /**
+   * @brief 記録済みの値だけを並べた新しいファイルに置き換える
+   * 一時ファイルに書いて同期してから置き換えるので、途中で電源が切れても
+   * 次のopen()で元のファイルか一時ファイルのどちらかから読める
+   * @return 成功したかどうか
+   */
+  bool compact();
+
+  /**
+   * @brief ファイルのバイト数を取得する
+   */
+  uint32_t getFileBytes() const { return file_bytes; }
+
+  /**
+   * @brief 1つのレコードを作成して末尾に追加する
+   * @param key キー
+   * @param entry 値
+   * @param out 追加先
+   * @return キー・値の長さが範囲内で追加できたかどうか
+   */
+  static bool encodeRecord(const std::string& key,
+                           const SettingsJournalEntry& entry,
+                           std::string* out);
+
+  /**
+   * @brief メモリ上のジャーナルを先頭から読み、キーごとの最新の値を求める
+   * @param data ファイルの内容
+   * @param size バイト数
+   * @param entries キーごとの最新の値
+   * @param records 有効なレコードの数
+   * @return 先頭から有効なレコードまでのバイト数（ヘッダが不正なら0）
+   */
+  static size_t replay(const uint8_t* data, size_t size, EntryMap* entries,
+                       uint32_t* records);
+
+  /**
+   * @brief ファイルヘッダを作成する
+   */
+  static SettingsJournalHeader makeHeader();
+
+ private:
+  std::string path;
+  FILE* file_pointer = nullptr;
+  EntryMap entries;
+  uint32_t file_bytes = 0;
+
+  /**
+   * @brief 記録済みの値をすべて並べたファイルを書き込んで同期する
+   * @param file_path 書き込み先
+   * @return 成功したかどうか
+   */
+  bool writeSnapshot(const std::string& file_path);
+};
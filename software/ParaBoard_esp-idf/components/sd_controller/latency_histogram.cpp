@@ -0,0 +1,92 @@
+#include "latency_histogram.hpp"
+
+void LatencyHistogram::record(uint32_t elapsed_us, uint32_t recorded_bytes) {
+  // 2^(i-1) <= elapsed_us < 2^i となるi（elapsed_usのビット長）を求める
+  int index = elapsed_us == 0 ? 0 : 32 - __builtin_clz(elapsed_us);
+  if (index >= BUCKET_COUNT) index = BUCKET_COUNT - 1;
+  buckets[index].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  total_us.fetch_add(elapsed_us, std::memory_order_relaxed);
+  bytes.fetch_add(recorded_bytes, std::memory_order_relaxed);
+
+  uint32_t current = max_us.load(std::memory_order_relaxed);
+  while (elapsed_us > current &&
+         !max_us.compare_exchange_weak(current, elapsed_us,
+                                       std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::reset() {
+  for (auto& bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count.store(0, std::memory_order_relaxed);
+  total_us.store(0, std::memory_order_relaxed);
+  max_us.store(0, std::memory_order_relaxed);
+  bytes.store(0, std::memory_order_relaxed);
+}
+
+uint32_t LatencyHistogram::getPercentileUs(uint32_t percent) const {
+  uint32_t total = getCount();
+  if (total == 0) {
+    return 0;
+  }
+  // 小さい方から数えて、全体のpercent%に達したバケットの上限を返す
+  uint64_t target = ((uint64_t)total * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKET_COUNT - 1; i++) {
+    seen += getBucket(i);
+    if (seen >= target) {
+      return getBucketLimitUs(i);
+    }
+  }
+  // 最後のバケットには上限がないので、最大値を返す
+  return getMaxUs();
+}
+
+void LatencyHistogram::print(FILE* out, const char* name) const {
+  uint32_t total = getCount();
+  if (total == 0) {
+    fprintf(out, "- %s: none\n", name);
+    return;
+  }
+  fprintf(out,
+          "- %s: %lu ops, avg %lu us, p50 < %lu us, p99 < %lu us, "
+          "max %lu us",
+          name, (unsigned long)total, (unsigned long)(getTotalUs() / total),
+          (unsigned long)getPercentileUs(50),
+          (unsigned long)getPercentileUs(99), (unsigned long)getMaxUs());
+  if (getBytes() > 0) {
+    // 処理時間だけで割った値（同期や待ち時間を含まない）
+    fprintf(out, ", %lu bytes (%.1f kB/s while busy)",
+            (unsigned long)getBytes(),
+            getTotalUs() > 0 ? getBytes() * 1000.0 / 1024 / getTotalUs() : 0.0);
+  }
+  fprintf(out, "\n");
+
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    uint32_t bucket = getBucket(i);
+    if (bucket == 0) continue;
+    if (i == BUCKET_COUNT - 1) {
+      fprintf(out, "    >= %8lu us: %lu\n",
+              (unsigned long)getBucketLimitUs(i - 1), (unsigned long)bucket);
+    } else {
+      fprintf(out, "    <  %8lu us: %lu\n", (unsigned long)getBucketLimitUs(i),
+              (unsigned long)bucket);
+    }
+  }
+}
+
+const char* sdOperationName(SdOperation operation) {
+  switch (operation) {
+    case SdOperation::WRITE:
+      return "write";
+    case SdOperation::SYNC:
+      return "sync";
+    case SdOperation::SETTINGS_SAVE:
+      return "settings save";
+    case SdOperation::COUNT:
+      break;
+  }
+  return "?";
+}
@@ -1,11 +1,34 @@
 #include "sd_controller.hpp"
 
+namespace {
+
+// スコープを抜けるまで設定のマップ用のミューテックスを保持する
+class SettingsLock {
+ public:
+  explicit SettingsLock(SemaphoreHandle_t mutex) : mutex(mutex) {
+    if (mutex) xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+  }
+  ~SettingsLock() {
+    if (mutex) xSemaphoreGiveRecursive(mutex);
+  }
+
+ private:
+  SemaphoreHandle_t mutex;
+};
+
+}  // namespace
+
 SdController::SdController() {
   // ファイル操作用ミューテックスの作成
   file_mutex = xSemaphoreCreateMutex();
   if (!file_mutex) {
     ESP_LOGE(TAG, "Failed to create file mutex");
   }
+  // 設定のマップ用ミューテックスの作成（保存タスクとコマンドタスクが同時に触るため）
+  settings_mutex = xSemaphoreCreateRecursiveMutex();
+  if (!settings_mutex) {
+    ESP_LOGE(TAG, "Failed to create settings mutex");
+  }
 
   // デフォルト設定の初期化
   initDefaultSettings();
@@ -47,6 +70,10 @@ SdController::~SdController() {
     vSemaphoreDelete(file_mutex);
     file_mutex = nullptr;
   }
+  if (settings_mutex) {
+    vSemaphoreDelete(settings_mutex);
+    settings_mutex = nullptr;
+  }
 }
 
 void SdController::initDefaultSettings() {
@@ -78,6 +105,229 @@ void SdController::initDefaultSettings() {
   comm_mode.value.string_value = strdup("can");
   comm_mode.default_value.string_value = strdup("can");
   settings["comm_mode"] = comm_mode;
+
+  // ログ形式（文字列型、"csv" または "binary"）
+  SettingItem log_format;
+  log_format.type = SettingType::STRING;
+  log_format.value.string_value = strdup("csv");
+  log_format.default_value.string_value = strdup("csv");
+  settings["log_format"] = log_format;
+
+  // ログファイルの事前確保に使う最大飛行時間（整数型、秒、0で確保しない）
+  SettingItem max_flight_seconds;
+  max_flight_seconds.type = SettingType::INTEGER;
+  max_flight_seconds.value.int_value = 1800;
+  max_flight_seconds.default_value.int_value = 1800;
+  settings["max_flight_seconds"] = max_flight_seconds;
+
+  // 切り詰めが済んでいない事前確保済みログファイル名（文字列型）
+  SettingItem pending_log;
+  pending_log.type = SettingType::STRING;
+  pending_log.value.string_value = strdup("");
+  pending_log.default_value.string_value = strdup("");
+  settings["pending_log"] = pending_log;
+
+  // ログの書き込み先（文字列型、"file" または "raw"）
+  SettingItem log_backend;
+  log_backend.type = SettingType::STRING;
+  log_backend.value.string_value = strdup("file");
+  log_backend.default_value.string_value = strdup("file");
+  settings["log_backend"] = log_backend;
+
+  // センサーデータを溜めておくリングバッファの要素数（整数型、2の累乗に切り上げ）
+  SettingItem log_ring_capacity;
+  log_ring_capacity.type = SettingType::INTEGER;
+  log_ring_capacity.value.int_value = 2048;  // 1kHzで約2秒分
+  log_ring_capacity.default_value.int_value = 2048;
+  settings["log_ring_capacity"] = log_ring_capacity;
+
+  // ログタスクが1回に取り出す最大のデータ数（整数型）
+  SettingItem log_batch_size;
+  log_batch_size.type = SettingType::INTEGER;
+  log_batch_size.value.int_value = 16;
+  log_batch_size.default_value.int_value = 16;
+  settings["log_batch_size"] = log_batch_size;
+
+  // ログタスクがデータを待つ最大時間（整数型、ミリ秒）
+  SettingItem log_batch_wait_ms;
+  log_batch_wait_ms.type = SettingType::INTEGER;
+  log_batch_wait_ms.value.int_value = 20;
+  log_batch_wait_ms.default_value.int_value = 20;
+  settings["log_batch_wait_ms"] = log_batch_wait_ms;
+
+  // 離床前のデータを溜めておく秒数（整数型、0なら常にSDカードへ記録する）
+  SettingItem pretrigger_seconds;
+  pretrigger_seconds.type = SettingType::INTEGER;
+  pretrigger_seconds.value.int_value = 0;
+  pretrigger_seconds.default_value.int_value = 0;
+  settings["pretrigger_seconds"] = pretrigger_seconds;
+
+  // 同期していないデータがこのバイト数に達したらSDカードへ同期する（整数型）
+  SettingItem flush_max_pending_bytes;
+  flush_max_pending_bytes.type = SettingType::INTEGER;
+  flush_max_pending_bytes.value.int_value = 32768;
+  flush_max_pending_bytes.default_value.int_value = 32768;
+  settings["flush_max_pending_bytes"] = flush_max_pending_bytes;
+
+  // 同期していない最も古いデータがこの時間経ったら同期する（整数型、ミリ秒）
+  SettingItem flush_max_age_ms;
+  flush_max_age_ms.type = SettingType::INTEGER;
+  flush_max_age_ms.value.int_value = 500;
+  flush_max_age_ms.default_value.int_value = 500;
+  settings["flush_max_age_ms"] = flush_max_age_ms;
+
+  // 離床・頂点・モード変更の時にすぐ同期するかどうか（真偽値型）
+  SettingItem flush_on_event;
+  flush_on_event.type = SettingType::BOOLEAN;
+  flush_on_event.value.bool_value = true;
+  flush_on_event.default_value.bool_value = true;
+  settings["flush_on_event"] = flush_on_event;
+
+  // バイナリログの圧縮方式（文字列型、"none" または "delta"）
+  SettingItem log_compression;
+  log_compression.type = SettingType::STRING;
+  log_compression.value.string_value = strdup("none");
+  log_compression.default_value.string_value = strdup("none");
+  settings["log_compression"] = log_compression;
+
+  // 差分圧縮でキーフレームを書く間隔（整数型、IMUレコード数）
+  SettingItem log_keyframe_interval;
+  log_keyframe_interval.type = SettingType::INTEGER;
+  log_keyframe_interval.value.int_value = 100;  // 1kHzで0.1秒ごと
+  log_keyframe_interval.default_value.int_value = 100;
+  settings["log_keyframe_interval"] = log_keyframe_interval;
+
+  // ログのディレクトリを作成した起動の回数（整数型、logs/boot-Nの最後のN）
+  SettingItem boot_count;
+  boot_count.type = SettingType::INTEGER;
+  boot_count.value.int_value = 0;
+  boot_count.default_value.int_value = 0;
+  settings["boot_count"] = boot_count;
+
+  // 最後に使ったログファイルの通し番号（整数型、log-Nの最後のN）
+  SettingItem log_sequence;
+  log_sequence.type = SettingType::INTEGER;
+  log_sequence.value.int_value = 0;
+  log_sequence.default_value.int_value = 0;
+  settings["log_sequence"] = log_sequence;
+
+  // 起動時にカードのベンチマークで書き込むサイズ（整数型、MB、0なら実行しない）
+  SettingItem sd_benchmark_mb;
+  sd_benchmark_mb.type = SettingType::INTEGER;
+  sd_benchmark_mb.value.int_value = 0;
+  sd_benchmark_mb.default_value.int_value = 0;
+  settings["sd_benchmark_mb"] = sd_benchmark_mb;
+
+  // SDカードの速度（文字列型、"auto"/"high"/"default"）
+  // auto: 高速(40MHz)で読み書きを確認し、失敗したら通常速度(20MHz)に戻す
+  SettingItem sd_speed;
+  sd_speed.type = SettingType::STRING;
+  sd_speed.value.string_value = strdup("auto");
+  sd_speed.default_value.string_value = strdup("auto");
+  settings["sd_speed"] = sd_speed;
+
+  // ICMの読み出し方（文字列型、"register" または "fifo"）
+  // register: 1kHzのタイマーごとにレジスタから読む
+  // fifo: ICMのFIFOに溜め、icm_fifo_period_msごとにまとめて読む
+  SettingItem icm_read_mode;
+  icm_read_mode.type = SettingType::STRING;
+  icm_read_mode.value.string_value = strdup("register");
+  icm_read_mode.default_value.string_value = strdup("register");
+  settings["icm_read_mode"] = icm_read_mode;
+
+  // FIFOを読み出す間隔（整数型、ミリ秒、5〜100）
+  SettingItem icm_fifo_period_ms;
+  icm_fifo_period_ms.type = SettingType::INTEGER;
+  icm_fifo_period_ms.value.int_value = 10;  // 100Hz
+  icm_fifo_period_ms.default_value.int_value = 10;
+  settings["icm_fifo_period_ms"] = icm_fifo_period_ms;
+
+  // 取得のきっかけ（文字列型、"interrupt" または "timer"）
+  // interrupt: ICMのINT1（データレディ・FIFOのウォーターマーク）で取得し、
+  //            タイマーは割り込みが来ない時の見張りにする（INT1が未接続ならtimer）
+  // timer: タイマーごとに取得する
+  SettingItem icm_trigger;
+  icm_trigger.type = SettingType::STRING;
+  icm_trigger.value.string_value = strdup("interrupt");
+  icm_trigger.default_value.string_value = strdup("interrupt");
+  settings["icm_trigger"] = icm_trigger;
+
+  // ICMの読み出し方（文字列型、"polling" または "queued"）
+  // polling: 転送が終わるまで待って読む
+  // queued: 読み出しをキューに入れ、転送中に前のサンプルを処理する（レジスタから読む時のみ）
+  SettingItem icm_spi_mode;
+  icm_spi_mode.type = SettingType::STRING;
+  icm_spi_mode.value.string_value = strdup("polling");
+  icm_spi_mode.default_value.string_value = strdup("polling");
+  settings["icm_spi_mode"] = icm_spi_mode;
+
+  // LPSの出力データレート（文字列型、"25"、"12.5"、"7"、"1"(Hz)）
+  SettingItem lps_odr;
+  lps_odr.type = SettingType::STRING;
+  lps_odr.value.string_value = strdup("25");
+  lps_odr.default_value.string_value = strdup("25");
+  settings["lps_odr"] = lps_odr;
+
+  // LPSが1回の出力に使う内部平均の回数（整数型、気圧: 8/32/128/512、温度: 8/16/32/64）
+  SettingItem lps_pressure_avg;
+  lps_pressure_avg.type = SettingType::INTEGER;
+  lps_pressure_avg.value.int_value = 32;  // 電源投入時と同じ
+  lps_pressure_avg.default_value.int_value = 32;
+  settings["lps_pressure_avg"] = lps_pressure_avg;
+
+  SettingItem lps_temp_avg;
+  lps_temp_avg.type = SettingType::INTEGER;
+  lps_temp_avg.value.int_value = 16;  // 電源投入時と同じ
+  lps_temp_avg.default_value.int_value = 16;
+  settings["lps_temp_avg"] = lps_temp_avg;
+
+  // LPSのFIFOの移動平均の数（整数型、0: 使わない、2/4/8/16/32）
+  SettingItem lps_fifo_mean;
+  lps_fifo_mean.type = SettingType::INTEGER;
+  lps_fifo_mean.value.int_value = 0;
+  lps_fifo_mean.default_value.int_value = 0;
+  settings["lps_fifo_mean"] = lps_fifo_mean;
+
+  publishCachedSettings();
+}
+
+void SdController::publishCachedSettings() {
+  SettingsLock lock(settings_mutex);
+  SettingsCache::Snapshot snapshot = {};
+  for (int i = 0; i < SettingsCache::KEY_COUNT; i++) {
+    SettingKey key = static_cast<SettingKey>(i);
+    auto it = settings.find(SettingsCache::getKeyName(key));
+    if (it == settings.end() ||
+        it->second.type != SettingsCache::getKeyType(key)) {
+      ESP_LOGW(TAG, "Cached setting '%s' is missing",
+               SettingsCache::getKeyName(key));
+      continue;
+    }
+    switch (it->second.type) {
+      case SettingType::INTEGER:
+        snapshot.words[i] = SettingsCache::toWord(it->second.value.int_value);
+        break;
+      case SettingType::FLOAT:
+        snapshot.words[i] =
+            SettingsCache::toWord(it->second.value.float_value);
+        break;
+      case SettingType::BOOLEAN:
+        snapshot.words[i] = SettingsCache::toWord(it->second.value.bool_value);
+        break;
+      case SettingType::STRING:
+        break;
+    }
+  }
+  settings_cache.publish(snapshot);
+}
+
+void SdController::publishCachedSetting(const std::string& key,
+                                        SettingType type, uint32_t word) {
+  SettingKey cached_key;
+  if (SettingsCache::findKey(key, &cached_key) &&
+      SettingsCache::getKeyType(cached_key) == type) {
+    settings_cache.publish(cached_key, word);
+  }
 }
 
 bool SdController::begin(bool useHighSpeed, int gpio_clk, int gpio_cmd,
@@ -87,23 +337,65 @@ bool SdController::begin(bool useHighSpeed, int gpio_clk, int gpio_cmd,
     return true;
   }
 
-  high_speed = useHighSpeed;
+  sdmmc_slot_config_t config = SDMMC_SLOT_CONFIG_DEFAULT();
+  // ユーザーが指定したピンを設定
+  config.clk = (gpio_num_t)gpio_clk;
+  config.cmd = (gpio_num_t)gpio_cmd;
+  config.d0 = (gpio_num_t)gpio_d0;
+  config.d1 = (gpio_num_t)gpio_d1;
+  config.d2 = (gpio_num_t)gpio_d2;
+  config.d3 = (gpio_num_t)gpio_d3;
+  config.width = 4;
+  config.flags = SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+  slot_config = config;
+
+  // まず高速(40MHz)でマウントを試み、失敗したら通常速度(20MHz)でやり直す
+  speed_fallback = false;
+  if (!mountCard(useHighSpeed)) {
+    if (!useHighSpeed || !mountCard(false)) {
+      return false;
+    }
+    speed_fallback = true;
+  }
+
+  // 設定はカード上にあるので、マウントした後に速度を決め直す
+  // 設定を書き込む前に、sd_speedだけを読んで速度を決め、読み書きできるか確認する
+  std::string speed = peekSpeedSetting();
+  if (!selectCardSpeed(useHighSpeed, speed)) {
+    return false;
+  }
+
+  // 設定をジャーナルから読み込み、編集された setting.json があれば取り込む
+  loadSettings();
+
+  // setting.json の編集でsd_speedが変わっていれば、速度を決め直す
+  std::string loaded_speed = getStringSetting("sd_speed", "auto");
+  if (loaded_speed != speed && !selectCardSpeed(useHighSpeed, loaded_speed)) {
+    return false;
+  }
+
+  // 前回の飛行で切り詰められなかったログファイルがあれば修復する
+  recoverPreallocatedLog();
+
+  // 書き出されていないrawレコーダの記録があればファイルに書き出す
+  recoverRawRecording();
+
+  // 設定されていれば、カードの書き込み性能を計測する
+  int benchmark_mb = getIntSetting("sd_benchmark_mb", 0);
+  if (benchmark_mb > 0) {
+    runCardBenchmark(benchmark_mb);
+  }
+
+  return true;
+}
+
+bool SdController::mountCard(bool use_high_speed) {
+  high_speed = use_high_speed;
   freq_khz = high_speed ? SDMMC_FREQ_HIGHSPEED : SDMMC_FREQ_DEFAULT;
 
   sdmmc_host_t host = SDMMC_HOST_DEFAULT();
   host.max_freq_khz = freq_khz;
 
-  sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-  // ユーザーが指定したピンを設定
-  slot_config.clk = (gpio_num_t)gpio_clk;
-  slot_config.cmd = (gpio_num_t)gpio_cmd;
-  slot_config.d0 = (gpio_num_t)gpio_d0;
-  slot_config.d1 = (gpio_num_t)gpio_d1;
-  slot_config.d2 = (gpio_num_t)gpio_d2;
-  slot_config.d3 = (gpio_num_t)gpio_d3;
-  slot_config.width = 4;
-  slot_config.flags = SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
-
   esp_vfs_fat_sdmmc_mount_config_t mount_config = {
       .format_if_mount_failed = false,
       .max_files = 10,
@@ -121,95 +413,1292 @@ bool SdController::begin(bool useHighSpeed, int gpio_clk, int gpio_cmd,
   }
   mounted = true;
   sdmmc_card_print_info(stdout, card);
+  return true;
+}
+
+std::string SdController::peekSpeedSetting() {
+  // ジャーナルはメモリ上で読むだけにする（開くと書きかけのレコードを切り詰めるため）
+  std::string journal_path = mount_point + "/" + SETTINGS_JOURNAL_NAME;
+  std::string json_path = mount_point + "/" + setting_file_name;
+  std::string speed = "auto";
+  for (const std::string& path : {journal_path, json_path}) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) continue;
+    std::string data;
+    char buffer[512];
+    size_t read_bytes;
+    while ((read_bytes = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+      data.append(buffer, read_bytes);
+    }
+    fclose(fp);
+
+    if (path == journal_path) {
+      SettingsJournal::EntryMap entries;
+      uint32_t records = 0;
+      SettingsJournal::replay(reinterpret_cast<const uint8_t*>(data.data()),
+                              data.size(), &entries, &records);
+      auto it = entries.find("sd_speed");
+      if (it != entries.end() &&
+          it->second.type == static_cast<uint8_t>(SettingType::STRING)) {
+        return it->second.value;
+      }
+    } else {
+      cJSON* root = cJSON_Parse(data.c_str());
+      cJSON* item = root ? cJSON_GetObjectItem(root, "sd_speed") : nullptr;
+      if (cJSON_IsString(item)) {
+        speed = item->valuestring;
+      }
+      cJSON_Delete(root);
+    }
+  }
+  return speed;
+}
+
+bool SdController::selectCardSpeed(bool allow_high_speed, std::string speed) {
+  // sd_speed: "auto"なら高速で確認して失敗したら通常速度に戻す
+  // "high"なら確認せずに高速、"default"なら常に通常速度にする
+  if (speed != "auto" && speed != "high" && speed != "default") {
+    ESP_LOGW(TAG, "Unknown sd_speed \"%s\", using auto", speed.c_str());
+    speed = "auto";
+  }
 
-  // 設定ファイルを確認し、存在すれば読み込む
-  if (access((mount_point + "/" + setting_file_name).c_str(), F_OK) != -1) {
-    // 設定ファイルが存在する場合、読み込み
-    if (!loadSettingsFromFile()) {
-      ESP_LOGW("SDMMC", "Failed to load settings, using defaults");
+  if (high_speed && speed == "default") {
+    ESP_LOGI(TAG, "sd_speed is \"default\", remounting at default speed");
+    if (!remountCard(false)) {
+      return false;
     }
+  }
+
+  bool verified = verifyCard(&card_write_kbps);
+  if (high_speed && speed == "auto" && !verified) {
+    ESP_LOGW(TAG, "High speed verification failed, falling back");
+    speed_fallback = true;
+    if (!remountCard(false)) {
+      return false;
+    }
+    verified = verifyCard(&card_write_kbps);
+  } else if (!high_speed && speed == "high" && allow_high_speed) {
+    ESP_LOGW(TAG, "sd_speed is \"high\" but high speed mount failed");
+  }
+
+  if (!verified) {
+    ESP_LOGE(TAG, "SD card read/write verification failed at %lu kHz",
+             (unsigned long)getCardFreqKhz());
+  }
+  ESP_LOGI(TAG, "SD card: %lu kHz%s, write %lu kB/s (sd_speed=%s)",
+           (unsigned long)getCardFreqKhz(),
+           speed_fallback ? " (fallback)" : "",
+           (unsigned long)card_write_kbps, speed.c_str());
+  return true;
+}
+
+bool SdController::remountCard(bool use_high_speed) {
+  // アンマウントするとジャーナルのFILE*が使えなくなるので、先に閉じる
+  bool reopen_journal = settings_journal.isOpen();
+  settings_journal.close();
+
+  esp_vfs_fat_sdcard_unmount(mount_point.c_str(), card);
+  mounted = false;
+  card = nullptr;
+  if (!mountCard(use_high_speed)) {
+    return false;
+  }
+
+  if (reopen_journal) {
+    std::string journal_path = mount_point + "/" + SETTINGS_JOURNAL_NAME;
+    SettingsJournal::LoadResult result;
+    if (!settings_journal.open(journal_path, &result)) {
+      // 以降の保存は setting.json 全体を書き直す
+      logFileError("reopen", journal_path.c_str());
+      settings_journal.close();
+    }
+  }
+  return true;
+}
+
+bool SdController::verifyCard(uint32_t* write_kbps) {
+  // 小さなテストパターンを書いて同期し、読み戻して一致するか確認する
+  // （クロックが速すぎるとCRCエラーやデータの化けとして現れる）
+  *write_kbps = 0;
+  if (!mounted) {
+    return false;
+  }
+  std::string verify_path = mount_point + "/" + VERIFY_FILE_NAME;
+  uint8_t* block = new uint8_t[LOG_BUFFER_SIZE];
+  uint8_t* read_block = new uint8_t[LOG_BUFFER_SIZE];
+  bool success = false;
+
+  FILE* fp = fopen(verify_path.c_str(), "w");
+  if (fp) {
+    success = true;
+    int64_t start_us = esp_timer_get_time();
+    for (size_t offset = 0; offset < VERIFY_SIZE && success;
+         offset += LOG_BUFFER_SIZE) {
+      fillTestPattern(block, offset);
+      success = fwrite(block, 1, LOG_BUFFER_SIZE, fp) == LOG_BUFFER_SIZE;
+    }
+    success = success && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    fclose(fp);
+    if (success && elapsed_us > 0) {
+      *write_kbps = (uint64_t)VERIFY_SIZE * 1000 / 1024 / elapsed_us;
+    }
+  }
+
+  fp = success ? fopen(verify_path.c_str(), "rb") : nullptr;
+  if (fp) {
+    for (size_t offset = 0; offset < VERIFY_SIZE && success;
+         offset += LOG_BUFFER_SIZE) {
+      fillTestPattern(block, offset);
+      success = fread(read_block, 1, LOG_BUFFER_SIZE, fp) == LOG_BUFFER_SIZE &&
+                memcmp(block, read_block, LOG_BUFFER_SIZE) == 0;
+    }
+    fclose(fp);
   } else {
-    // 設定ファイルが存在しない場合、デフォルト設定を保存
-    if (!saveSettingsToFile()) {
-      ESP_LOGW("SDMMC", "Failed to save default settings");
+    success = false;
+  }
+  unlink(verify_path.c_str());
+
+  delete[] read_block;
+  delete[] block;
+  return success;
+}
+
+void SdController::end() {
+  closeLogFile();
+  if (setting_file_pointer) {
+    fclose(setting_file_pointer);
+    setting_file_pointer = nullptr;
+  }
+  if (mounted) {
+    esp_vfs_fat_sdcard_unmount(mount_point.c_str(), card);
+    mounted = false;
+  }
+  ESP_LOGI("SDMMC", "Unmounted SD card");
+
+  settings_journal.close();
+
+  SettingsLock lock(settings_mutex);
+  settings.clear();
+  boot_dir_name.clear();
+}
+
+bool SdController::openLogFile() {
+  if (!mounted) {
+    ESP_LOGW(TAG, "Cannot open log file, SD card not mounted");
+    return false;
+  }
+  if (log_file_pointer || raw_recorder) {
+    ESP_LOGW(TAG, "Log file already opened");
+    return true;
+  }
+
+  // ログ形式を設定から決定する
+  binary_log = (getStringSetting("log_format", "csv") == "binary");
+  log_bytes_written = 0;
+  resetIoStats();
+
+  // DMA対応領域へ大きめのバッファを確保する
+  // ファイルの場合はsetvbuf()に、rawの場合はセクタ書き込み用に使う
+  dmaBuffer = (char*)heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_DMA);
+  if (!dmaBuffer) {
+    ESP_LOGW("SDMMC", "Failed to alloc DMA buffer. Using default buffer.");
+  }
+
+  // rawレコーダが選ばれていれば、VFS/FATFSを経由せずにセクタへ直接書き込む
+  bool opened = false;
+  if (getStringSetting("log_backend", "file") == "raw") {
+    opened = openRawRecorder();
+    if (!opened) {
+      ESP_LOGW(TAG, "Failed to start raw recorder, falling back to file");
     }
   }
+  if (!opened && !openLogFileStream()) {
+    if (dmaBuffer) {
+      heap_caps_free(dmaBuffer);
+      dmaBuffer = nullptr;
+    }
+    return false;
+  }
 
-  // ログファイルを開く
-  // ログファイルの名前は、log-1.csv, log-2.csv, ...
-  // というように連番で作成される
-  int file_count = 0;
-  while (true) {
-    log_file_name = log_file_prefix + std::to_string(file_count + 1) + ".csv";
-    if (access((mount_point + "/" + log_file_name).c_str(), F_OK) == -1) {
-      break;
+  if (binary_log) {
+    // バイナリ形式の場合はファイルヘッダだけを入れたブロック0を書いておく
+    // ブロックのファイルIDにはヘッダのboot_idと同じ値を使う
+    log_file_id = esp_random();
+    next_block_seq = 0;
+    LogFormat::FileHeader header = LogFormat::makeFileHeader(
+        log_file_id, LOG_SAMPLE_RATE_HZ, resetLogEncoder());
+    header.sd_freq_khz = getCardFreqKhz();
+    header.sd_write_kbps = card_write_kbps;
+    uint8_t* block = new uint8_t[LogFormat::BLOCK_SIZE];
+    memcpy(block + sizeof(LogFormat::BlockHeader), &header, sizeof(header));
+    writeLogBytes(block, sealLogBlock(block, sizeof(header)));
+    delete[] block;
+    // 修復時はブロック0のファイルIDを基準にするので、前のファイルのブロック0が
+    // 残ったままにならないよう、すぐに同期する
+    flush();
+    ESP_LOGI("SDMMC", "Binary log (schema v%d, boot_id=0x%08lx, keyframe=%u)",
+             header.schema_version, (unsigned long)header.boot_id,
+             header.keyframe_interval);
+  } else {
+    // CSVヘッダ等を書いておく
+    static constexpr const char CSV_HEADER[] =
+        "timestamp(us),accel-ux,accel-dx,accel-uy,accel-dy,accel-uz,accel-dz,"
+        "gyro-ux,gyro-dx,gyro-uy,gyro-dy,gyro-uz,gyro-dz,pressure-h,pressure-l,"
+        "pressure-xl,temperature-h,temperature-l,seq,icm-temp-u,icm-temp-d\n";
+    writeLogBytes(CSV_HEADER, sizeof(CSV_HEADER) - 1);
+  }
+
+  return true;
+}
+
+bool SdController::openLogFileStream() {
+  log_file_name = nextLogFileName(binary_log ? ".bin" : ".csv");
+  std::string log_file_path = mount_point + "/" + log_file_name;
+
+  // 飛行中にFATのクラスタ割り当てが走らないよう、連続領域を先に確保する
+  uint64_t preallocate_size = getPreallocateSize();
+  preallocated = false;
+  if (preallocate_size > 0) {
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = esp_vfs_fat_create_contiguous_file(
+        mount_point.c_str(), log_file_path.c_str(), preallocate_size, true);
+    if (ret == ESP_OK) {
+      preallocated = true;
+      ESP_LOGI(TAG, "Preallocated %llu bytes for %s in %lld ms",
+               (unsigned long long)preallocate_size, log_file_name.c_str(),
+               (esp_timer_get_time() - start_us) / 1000);
+    } else {
+      ESP_LOGW(TAG, "Failed to preallocate log file (0x%x), using fopen",
+               ret);
     }
-    file_count++;
   }
 
-  log_file_pointer = fopen((mount_point + "/" + log_file_name).c_str(), "w");
+  // 確保済みのファイルは先頭から上書きする
+  log_file_pointer = fopen(log_file_path.c_str(), preallocated ? "r+" : "w");
   if (!log_file_pointer) {
-    ESP_LOGE("SDMMC", "Failed to open log file: %s",
-             (mount_point + "/" + log_file_name).c_str());
+    logFileError("open log file", log_file_path.c_str());
+    preallocated = false;
     return false;
   }
-  ESP_LOGI("SDMMC", "Log file opened: %s",
-           (mount_point + "/" + log_file_name).c_str());
+  ESP_LOGI("SDMMC", "Log file opened: %s", log_file_path.c_str());
+
+  // 確保したファイルは閉じる時か次回起動時に実際の長さへ切り詰める
+  if (preallocated) {
+    setStringSetting("pending_log", log_file_name);
+  }
 
-  // DMA対応領域へ大きめのバッファを確保し、setvbuf() に設定
-  dmaBuffer = (char*)heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_DMA);
   if (dmaBuffer) {
     // _IOFBF: 完全バッファリング、LOG_BUFFER_SIZE: バッファサイズ
     setvbuf(log_file_pointer, dmaBuffer, _IOFBF, LOG_BUFFER_SIZE);
     ESP_LOGI("SDMMC", "Enabled DMA buffer for file (size=%d)", LOG_BUFFER_SIZE);
-  } else {
-    ESP_LOGW("SDMMC", "Failed to alloc DMA buffer. Using default buffer.");
+  }
+  return true;
+}
+
+std::string SdController::nextLogFileName(const char* extension) {
+  // ログファイルの名前は、logs/boot-1/log-1.csv, logs/boot-1/log-2.bin,
+  // logs/boot-2/log-3.csv, ... というように、起動ごとのディレクトリに
+  // 通し番号で作成される（形式が違っても番号は共有する）
+  // 通し番号は設定に保存しておき、既存のファイルを1つずつ確認しない
+  if (boot_dir_name.empty() && !reserveBootDirectory()) {
+    ESP_LOGW(TAG, "Failed to create log directory, using %s",
+             mount_point.c_str());
+  }
+  std::string dir_name = boot_dir_name.empty() ? "" : boot_dir_name + "/";
+
+  int sequence = getIntSetting("log_sequence", 0) + 1;
+  std::string base_path =
+      mount_point + "/" + dir_name + log_file_prefix + std::to_string(sequence);
+  if (access((base_path + ".csv").c_str(), F_OK) != -1 ||
+      access((base_path + ".bin").c_str(), F_OK) != -1) {
+    // 設定の通し番号が古い（保存前に電源が切れた、設定ファイルを戻した等）
+    // ディレクトリを走査して、既存の最大の番号の次にする
+    int max_sequence =
+        scanMaxIndex(mount_point + "/" + dir_name, log_file_prefix.c_str());
+    ESP_LOGW(TAG, "Log sequence %d already used, continuing from %d",
+             sequence, max_sequence + 1);
+    sequence = max_sequence + 1;
+  }
+  setIntSetting("log_sequence", sequence);
+  return dir_name + log_file_prefix + std::to_string(sequence) + extension;
+}
+
+bool SdController::reserveBootDirectory() {
+  std::string logs_path = mount_point + "/" + LOG_DIR_NAME;
+  if (mkdir(logs_path.c_str(), 0777) != 0 && errno != EEXIST) {
+    logFileError("mkdir", logs_path.c_str());
+    return false;
   }
 
-  // CSVヘッダ等を書いておく
-  fprintf(
-      log_file_pointer,
-      "timestamp(us),accel-ux,accel-dx,accel-uy,accel-dy,accel-uz,accel-dz,"
-      "gyro-ux,gyro-dx,gyro-uy,gyro-dy,gyro-uz,gyro-dz,pressure-h,pressure-l,"
-      "pressure-xl,temperature-h,temperature-l\n");
+  int boot_count = getIntSetting("boot_count", 0) + 1;
+  std::string dir_name =
+      std::string(LOG_DIR_NAME) + "/" + BOOT_DIR_PREFIX +
+      std::to_string(boot_count);
+  if (mkdir((mount_point + "/" + dir_name).c_str(), 0777) != 0) {
+    if (errno != EEXIST) {
+      logFileError("mkdir", dir_name.c_str());
+      return false;
+    }
+    // 設定の起動番号が古いので、既存の最大の番号の次にする
+    int max_boot_count = scanMaxIndex(logs_path, BOOT_DIR_PREFIX);
+    ESP_LOGW(TAG, "Boot directory %d already exists, continuing from %d",
+             boot_count, max_boot_count + 1);
+    boot_count = max_boot_count + 1;
+    dir_name = std::string(LOG_DIR_NAME) + "/" + BOOT_DIR_PREFIX +
+               std::to_string(boot_count);
+    if (mkdir((mount_point + "/" + dir_name).c_str(), 0777) != 0) {
+      logFileError("mkdir", dir_name.c_str());
+      return false;
+    }
+  }
+  boot_dir_name = dir_name;
+
+  // 前回の起動で通し番号を保存する前に電源が切れていると、設定の番号が古い
+  // 新しいディレクトリでは既存のファイルに気付けないので、前回のディレクトリを確認する
+  std::string previous_path = logs_path + "/" + BOOT_DIR_PREFIX +
+                              std::to_string(boot_count - 1);
+  if (boot_count > 1 && access(previous_path.c_str(), F_OK) != -1) {
+    int previous_sequence =
+        scanMaxIndex(previous_path, log_file_prefix.c_str());
+    if (previous_sequence > getIntSetting("log_sequence", 0)) {
+      ESP_LOGW(TAG, "Log sequence is behind %s, continuing from %d",
+               previous_path.c_str(), previous_sequence + 1);
+      setIntSetting("log_sequence", previous_sequence);
+    }
+  }
 
+  // 次の起動で同じディレクトリを使わないよう、すぐに保存する（通し番号も一緒に保存する）
+  // (保存前に電源が切れても、次の起動でディレクトリが既にあることに気付く)
+  setIntSetting("boot_count", boot_count);
+  if (!saveSettings()) {
+    ESP_LOGW(TAG, "Failed to save boot count");
+  }
+  ESP_LOGI(TAG, "Log directory: %s", boot_dir_name.c_str());
   return true;
 }
 
-void SdController::end() {
+std::string SdController::getBootDirectoryPath() {
+  if (!mounted) {
+    return "";
+  }
+  if (boot_dir_name.empty() && !reserveBootDirectory()) {
+    return "";
+  }
+  return mount_point + "/" + boot_dir_name;
+}
+
+int SdController::scanMaxIndex(const std::string& dir_path,
+                               const char* prefix) {
+  int max_index = 0;
+  DIR* dir = opendir(dir_path.c_str());
+  if (!dir) {
+    logFileError("opendir", dir_path.c_str());
+    return max_index;
+  }
+  size_t prefix_length = strlen(prefix);
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strncmp(entry->d_name, prefix, prefix_length) != 0) continue;
+    int index = atoi(entry->d_name + prefix_length);
+    if (index > max_index) max_index = index;
+  }
+  closedir(dir);
+  return max_index;
+}
+
+void SdController::closeLogFile() {
+  bool was_open = log_file_pointer || raw_recorder;
+  if (binary_log && log_encoder.getSampleCount() > 0) {
+    ESP_LOGI(TAG, "Encoded %lu samples (%lu keyframes), %.1f bytes/sample",
+             (unsigned long)log_encoder.getSampleCount(),
+             (unsigned long)log_encoder.getKeyframeCount(),
+             (double)log_encoder.getByteCount() /
+                 log_encoder.getSampleCount());
+  }
+  if (raw_recorder) {
+    closeRawRecorder();
+  }
   if (log_file_pointer) {
+    fflush(log_file_pointer);
+    if (preallocated) {
+      // 確保した領域のうち、書き込んだ分だけを残す
+      int fd = fileno(log_file_pointer);
+      if (fd < 0 || ftruncate(fd, (off_t)log_bytes_written) != 0) {
+        logFileError("truncate", log_file_name.c_str());
+      } else {
+        ESP_LOGI(TAG, "Log file truncated to %llu bytes",
+                 (unsigned long long)log_bytes_written);
+        setStringSetting("pending_log", "");
+      }
+      fsync(fd);
+    }
     fclose(log_file_pointer);
     log_file_pointer = nullptr;
-  }
-  if (setting_file_pointer) {
-    fclose(setting_file_pointer);
-    setting_file_pointer = nullptr;
-  }
-  if (mounted) {
-    esp_vfs_fat_sdcard_unmount(mount_point.c_str(), card);
-    mounted = false;
+    preallocated = false;
+    ESP_LOGI(TAG, "Log file closed: %s", log_file_name.c_str());
   }
   if (dmaBuffer) {
     heap_caps_free(dmaBuffer);
     dmaBuffer = nullptr;
   }
-  ESP_LOGI("SDMMC", "Unmounted SD card");
+  if (was_open) {
+    printf("SD card I/O (this log):\n");
+    printIoStats(stdout);
+    saveIoStats();
+  }
+}
 
-  settings.clear();
+void SdController::resetIoStats() {
+  for (auto& stats : io_stats) {
+    stats.reset();
+  }
+}
+
+void SdController::printIoStats(FILE* out) const {
+  uint32_t max_stall_us = 0;
+  for (int i = 0; i < static_cast<int>(SdOperation::COUNT); i++) {
+    io_stats[i].print(out, sdOperationName(static_cast<SdOperation>(i)));
+    if (io_stats[i].getMaxUs() > max_stall_us) {
+      max_stall_us = io_stats[i].getMaxUs();
+    }
+  }
+  fprintf(out, "- max stall: %lu us\n", (unsigned long)max_stall_us);
+}
+
+void SdController::saveIoStats() {
+  std::string boot_dir = getBootDirectoryPath();
+  if (boot_dir.empty()) {
+    return;
+  }
+  std::string stats_path = boot_dir + "/" + IO_STATS_FILE_NAME;
+  FILE* fp = fopen(stats_path.c_str(), "a");
+  if (!fp) {
+    logFileError("open stats file", stats_path.c_str());
+    return;
+  }
+  fprintf(fp, "log: %s (%s, %llu bytes), closed at %lld ms\n",
+          log_file_name.empty() ? "-" : log_file_name.c_str(),
+          getStringSetting("log_backend", "file").c_str(),
+          (unsigned long long)log_bytes_written,
+          esp_timer_get_time() / 1000);
+  printIoStats(fp);
+  fprintf(fp, "\n");
+  fflush(fp);
+  fsync(fileno(fp));
+  fclose(fp);
+}
+
+bool SdController::findRawExtent(uint64_t* first_sector,
+                                 uint64_t* sector_count) {
+  // FATFSから連続領域の先頭クラスタを取得し、カード上のセクタ番号に変換する
+  std::string fat_path = std::string(FAT_DRIVE) + "/" + RAW_FILE_NAME;
+  FIL file;
+  FRESULT res = f_open(&file, fat_path.c_str(), FA_READ | FA_OPEN_EXISTING);
+  if (res != FR_OK) {
+    ESP_LOGE(TAG, "Failed to open %s (error %d)", fat_path.c_str(), res);
+    return false;
+  }
+  FATFS* fs = file.obj.fs;
+  uint64_t cluster = file.obj.sclust;
+  uint64_t size = f_size(&file);
+  f_close(&file);
+
+  if (cluster < 2 || size == 0) {
+    ESP_LOGE(TAG, "%s has no allocated cluster", RAW_FILE_NAME);
+    return false;
+  }
+  *first_sector = fs->database + (cluster - 2) * fs->csize;
+  *sector_count = size / card->csd.sector_size;
+  return true;
+}
+
+bool SdController::openRawRecorder() {
+  if (!dmaBuffer) {
+    ESP_LOGE(TAG, "Raw recorder requires a DMA buffer");
+    return false;
+  }
+  uint64_t data_size = getPreallocateSize();
+  if (data_size == 0) {
+    ESP_LOGE(TAG, "Raw recorder requires max_flight_seconds > 0");
+    return false;
+  }
+  uint64_t sector_size = card->csd.sector_size;
+  uint64_t raw_size =
+      (data_size + sector_size - 1) / sector_size * sector_size +
+      RawRecorder::SUPERBLOCK_SECTORS * sector_size;
+
+  // 十分な大きさの連続領域が既にあれば使い回し、なければ作り直す
+  std::string raw_path = mount_point + "/" + RAW_FILE_NAME;
+  struct stat st;
+  bool is_contiguous = false;
+  if (stat(raw_path.c_str(), &st) != 0 || (uint64_t)st.st_size < raw_size ||
+      esp_vfs_fat_test_contiguous_file(mount_point.c_str(), raw_path.c_str(),
+                                       &is_contiguous) != ESP_OK ||
+      !is_contiguous) {
+    unlink(raw_path.c_str());
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = esp_vfs_fat_create_contiguous_file(
+        mount_point.c_str(), raw_path.c_str(), raw_size, true);
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to reserve %s (0x%x)", RAW_FILE_NAME, ret);
+      return false;
+    }
+    ESP_LOGI(TAG, "Reserved %llu bytes for %s in %lld ms",
+             (unsigned long long)raw_size, RAW_FILE_NAME,
+             (esp_timer_get_time() - start_us) / 1000);
+  }
+
+  uint64_t first_sector = 0;
+  uint64_t sector_count = 0;
+  if (!findRawExtent(&first_sector, &sector_count)) {
+    return false;
+  }
+
+  raw_device = new SdmmcBlockDevice(card, first_sector, sector_count);
+  raw_recorder = new RawRecorder(raw_device, (uint8_t*)dmaBuffer,
+                                 LOG_BUFFER_SIZE);
+  RawRecorder::DataFormat format = binary_log
+                                       ? RawRecorder::DataFormat::BINARY
+                                       : RawRecorder::DataFormat::CSV;
+  // 書き出していない記録（この起動で終えた記録は次の起動で書き出す）は上書きしない
+  bool unexported = raw_recorder->load() && !raw_recorder->isExported() &&
+                    raw_recorder->getDataBytes() > 0;
+  if (unexported) {
+    ESP_LOGW(TAG, "Previous raw recording (%llu bytes) is not exported yet",
+             (unsigned long long)raw_recorder->getDataBytes());
+  }
+  if (unexported || !raw_recorder->create(esp_random(), format)) {
+    if (!unexported) {
+      ESP_LOGE(TAG, "Failed to initialize raw recorder superblock");
+    }
+    delete raw_recorder;
+    raw_recorder = nullptr;
+    delete raw_device;
+    raw_device = nullptr;
+    return false;
+  }
+  ESP_LOGI(TAG, "Raw recorder started at sector %llu (%llu sectors)",
+           (unsigned long long)first_sector, (unsigned long long)sector_count);
+  return true;
+}
+
+void SdController::closeRawRecorder() {
+  if (!raw_recorder->sync()) {
+    ESP_LOGE(TAG, "Failed to sync raw recorder");
+  }
+  // 書き出しは数十秒かかることがあり、モード変更（コマンドタスク）を止めてしまうので、
+  // 次の起動時にrecoverRawRecording()で行う
+  ESP_LOGI(TAG, "Raw recorder stopped (%llu bytes), exported on next boot",
+           (unsigned long long)raw_recorder->getDataBytes());
+
+  delete raw_recorder;
+  raw_recorder = nullptr;
+  delete raw_device;
+  raw_device = nullptr;
+}
+
+void SdController::recoverRawRecording() {
+  std::string raw_path = mount_point + "/" + RAW_FILE_NAME;
+  if (access(raw_path.c_str(), F_OK) == -1) {
+    return;
+  }
+
+  uint64_t first_sector = 0;
+  uint64_t sector_count = 0;
+  if (!findRawExtent(&first_sector, &sector_count)) {
+    return;
+  }
+
+  char* buffer = (char*)heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_DMA);
+  if (!buffer) {
+    ESP_LOGE(TAG, "Failed to allocate buffer for raw recovery");
+    return;
+  }
+  SdmmcBlockDevice device(card, first_sector, sector_count);
+  RawRecorder recorder(&device, (uint8_t*)buffer, LOG_BUFFER_SIZE);
+  if (recorder.load() && !recorder.isExported() &&
+      recorder.getDataBytes() > 0) {
+    // 前回の起動の記録（LOGGINGモードを終えた記録、または電源断で途中の記録）
+    ESP_LOGI(TAG, "Found unexported raw recording (%llu bytes)",
+             (unsigned long long)recorder.getDataBytes());
+    exportRawRecording(&recorder);
+  }
+  heap_caps_free(buffer);
+}
+
+bool SdController::exportRawRecording(RawRecorder* recorder) {
+  const char* extension =
+      recorder->getDataFormat() == RawRecorder::DataFormat::BINARY ? ".bin"
+                                                                   : ".csv";
+  std::string export_name = nextLogFileName(extension);
+  std::string export_path = mount_point + "/" + export_name;
+  FILE* fp = fopen(export_path.c_str(), "w");
+  if (!fp) {
+    logFileError("open export file", export_path.c_str());
+    return false;
+  }
+
+  // セクタ単位で読み出し、記録された長さだけを書き出す
+  // (読み出しにはレコーダのステージングバッファを使うので、以後の追記はできない)
+  int64_t start_us = esp_timer_get_time();
+  uint64_t total = recorder->getDataBytes();
+  uint64_t offset = 0;
+  uint8_t* buffer = (uint8_t*)dmaBuffer;
+  bool own_buffer = false;
+  if (!buffer) {
+    buffer = (uint8_t*)heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_DMA);
+    own_buffer = true;
+  }
+  bool success = buffer != nullptr;
+  // 大きな記録は時間がかかるので、進み具合を10%ごとに表示する
+  uint64_t next_report = total / 10;
+  while (success && offset < total) {
+    size_t chunk = LOG_BUFFER_SIZE;
+    if (!recorder->readData(offset, buffer, chunk)) {
+      // 領域の末尾では1セクタずつ読む
+      chunk = card->csd.sector_size;
+      if (!recorder->readData(offset, buffer, chunk)) {
+        ESP_LOGE(TAG, "Failed to read raw data at %llu",
+                 (unsigned long long)offset);
+        success = false;
+        break;
+      }
+    }
+    size_t length = total - offset < chunk ? (size_t)(total - offset) : chunk;
+    if (fwrite(buffer, 1, length, fp) != length) {
+      logFileError("write export file", export_path.c_str());
+      success = false;
+      break;
+    }
+    offset += chunk;
+    if (offset >= next_report && offset < total) {
+      ESP_LOGI(TAG, "Exporting raw recording: %llu%% (%llu / %llu bytes)",
+               (unsigned long long)(offset * 100 / total),
+               (unsigned long long)offset, (unsigned long long)total);
+      next_report += total / 10;
+    }
+  }
+  if (own_buffer && buffer) heap_caps_free(buffer);
+
+  fflush(fp);
+  fsync(fileno(fp));
+  fclose(fp);
+
+  if (!success) {
+    return false;
+  }
+  if (!recorder->markExported()) {
+    ESP_LOGW(TAG, "Failed to mark raw recording as exported");
+  }
+  ESP_LOGI(TAG, "Exported raw recording to %s (%llu bytes, %lld ms)",
+           export_name.c_str(), (unsigned long long)total,
+           (esp_timer_get_time() - start_us) / 1000);
+  return true;
+}
+
+uint16_t SdController::resetLogEncoder() {
+  int keyframe_interval = 0;
+  if (getStringSetting("log_compression", "none") == "delta") {
+    keyframe_interval = getIntSetting("log_keyframe_interval", 100);
+    if (keyframe_interval < 1) keyframe_interval = 1;
+    if (keyframe_interval > UINT16_MAX) keyframe_interval = UINT16_MAX;
+  }
+  log_encoder.reset(keyframe_interval);
+  return keyframe_interval;
+}
+
+uint64_t SdController::getPreallocateSize() {
+  int max_flight_seconds = getIntSetting("max_flight_seconds", 0);
+  if (max_flight_seconds <= 0) {
+    return 0;
+  }
+  uint64_t bytes_per_sample =
+      binary_log ? BINARY_BYTES_PER_SAMPLE : CSV_BYTES_PER_SAMPLE;
+  uint64_t data_size =
+      (uint64_t)max_flight_seconds * LOG_SAMPLE_RATE_HZ * bytes_per_sample;
+  if (!binary_log) {
+    return data_size;
+  }
+
+  // バイナリ形式はブロックに分けるので、ブロックヘッダと、レコードが
+  // 入りきらずに空いた末尾の分を足す。さらに、経過時間で同期した時に
+  // 埋まりきらずに書いたブロックの分（最大でflush_max_age_msごとに1つ）と、
+  // ファイルヘッダだけのブロック0の分を足す
+  uint64_t payload_per_block =
+      LogFormat::BLOCK_PAYLOAD_SIZE - LogFormat::MAX_SAMPLE_SIZE;
+  uint64_t blocks = (data_size + payload_per_block - 1) / payload_per_block;
+  int max_age_ms = getIntSetting("flush_max_age_ms", 500);
+  if (max_age_ms < 1) max_age_ms = 1;
+  blocks += (uint64_t)max_flight_seconds * (1000 / max_age_ms + 1);
+  return (blocks + 1) * LogFormat::BLOCK_SIZE;
+}
+
+void SdController::recoverPreallocatedLog() {
+  std::string pending_log = getStringSetting("pending_log", "");
+  if (pending_log.empty()) {
+    return;
+  }
+
+  std::string file_path = mount_point + "/" + pending_log;
+  FILE* fp = fopen(file_path.c_str(), "r+");
+  if (!fp) {
+    // ファイルが消えている場合は何もしない
+    logFileError("open pending log", file_path.c_str());
+  } else {
+    // レコードを1つずつ読む形式（v4以前のバイナリ）も、カードからはブロック単位で読む
+    setvbuf(fp, nullptr, _IOFBF, LogFormat::BLOCK_SIZE);
+    int64_t start_us = esp_timer_get_time();
+    bool is_binary = pending_log.size() > 4 &&
+                     pending_log.compare(pending_log.size() - 4, 4, ".bin") == 0;
+    uint64_t valid_size =
+        is_binary ? findBinaryLogEnd(fp) : findCsvLogEnd(fp);
+
+    int fd = fileno(fp);
+    if (fd >= 0 && ftruncate(fd, (off_t)valid_size) == 0) {
+      fsync(fd);
+      ESP_LOGW(TAG, "Recovered %s: truncated to %llu bytes (%lld ms)",
+               pending_log.c_str(), (unsigned long long)valid_size,
+               (esp_timer_get_time() - start_us) / 1000);
+    } else {
+      logFileError("truncate pending log", file_path.c_str());
+    }
+    fclose(fp);
+  }
+
+  setStringSetting("pending_log", "");
+  if (!saveSettings()) {
+    ESP_LOGW(TAG, "Failed to save settings after log recovery");
+  }
+}
+
+uint64_t SdController::findBinaryLogEnd(FILE* fp) {
+  fseek(fp, 0, SEEK_SET);
+  uint8_t magic[sizeof(LogFormat::BLOCK_MAGIC)];
+  size_t magic_size = fread(magic, 1, sizeof(magic), fp);
+  if (LogFormat::isBlockFile(magic, magic_size)) {
+    return findBlockLogEnd(fp);
+  }
+
+  // ブロック形式より前（スキーマv4以前）のファイルは、レコードを先頭から順に確認する
+  fseek(fp, 0, SEEK_SET);
+  LogFormat::FileHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      !LogFormat::isValidFileHeader(header)) {
+    return 0;
+  }
+
+  // 既知のタグで始まり、時刻が単調増加し、間隔が不自然に空いていない
+  // レコードまでを有効とみなす
+  // 確保した領域の残りには過去のファイルのデータが残っている可能性がある
+  uint64_t valid_size = sizeof(header);
+  uint64_t last_timestamp_us = 0;
+  LogFormat::RecordReader reader;
+  LogFormat::Record record;
+  while (reader.read(fp, &record)) {
+    uint64_t timestamp_us = record.timestamp_us;
+    if (timestamp_us == 0 || timestamp_us < last_timestamp_us ||
+        (last_timestamp_us != 0 &&
+         timestamp_us - last_timestamp_us > RECOVERY_MAX_GAP_US)) {
+      break;
+    }
+    last_timestamp_us = timestamp_us;
+    valid_size += record.size;
+  }
+  return valid_size;
+}
+
+uint64_t SdController::findBlockLogEnd(FILE* fp) {
+  // 確保した領域の全体を読まずに、二分探索で有効なブロックの終わりを探す
+  // (有効なブロックは先頭から連続し、その後ろは書きかけか古いデータ)
+  fseek(fp, 0, SEEK_END);
+  long file_size = ftell(fp);
+  if (file_size <= 0) {
+    return 0;
+  }
+  uint32_t block_count = (uint64_t)file_size / LogFormat::BLOCK_SIZE;
+
+  uint8_t* buffer = new uint8_t[LogFormat::BLOCK_SIZE];
+  auto read_block = [fp](uint32_t index, uint8_t* block) {
+    return fseek(fp, (long)index * LogFormat::BLOCK_SIZE, SEEK_SET) == 0 &&
+           fread(block, LogFormat::BLOCK_SIZE, 1, fp) == 1;
+  };
+  LogFormat::BlockScanResult result =
+      LogFormat::findLastValidBlock(read_block, block_count, buffer);
+  delete[] buffer;
+
+  ESP_LOGI(TAG,
+           "Block scan: %lu of %lu blocks valid (file_id=0x%08lx, %lu reads)",
+           (unsigned long)result.valid_blocks, (unsigned long)block_count,
+           (unsigned long)result.file_id, (unsigned long)result.reads);
+  return (uint64_t)result.valid_blocks * LogFormat::BLOCK_SIZE;
+}
+
+uint64_t SdController::findCsvLogEnd(FILE* fp) {
+  fseek(fp, 0, SEEK_SET);
+
+  // 数字とカンマのみで構成され、列の数が合い、改行で終わる行までを有効とみなす
+  // (先頭のヘッダ行は列名を含むので無条件に有効とする)
+  // 確保した領域の残りには過去のファイルの行が残っている可能性があるので、
+  // 各行の時刻とseqが前の行から続いていること（時刻が戻らず間隔が空きすぎない、
+  // seqが増えている）も確かめ、続いていない行で止める
+  uint64_t valid_size = 0;
+  char line[CSV_MAX_LINE_LENGTH + 1];
+  size_t line_size = 0;
+  bool is_header = true;
+  bool has_previous = false;
+  uint64_t last_timestamp_us = 0;
+  uint64_t last_seq = 0;
+
+  uint8_t* buffer = new uint8_t[LogFormat::BLOCK_SIZE];
+  bool done = false;
+  size_t read_bytes;
+  while (!done &&
+         (read_bytes = fread(buffer, 1, LogFormat::BLOCK_SIZE, fp)) > 0) {
+    for (size_t i = 0; i < read_bytes; i++) {
+      char c = buffer[i];
+      if (c != '\n') {
+        // ヘッダ行は列名が長いので、長さを確かめずに読み飛ばす
+        if (is_header) {
+          line_size++;
+          continue;
+        }
+        if (line_size >= CSV_MAX_LINE_LENGTH ||
+            (c != ',' && (c < '0' || c > '9'))) {
+          done = true;
+          break;
+        }
+        line[line_size++] = c;
+        continue;
+      }
+
+      if (line_size == 0) {
+        done = true;
+        break;
+      }
+      if (!is_header) {
+        line[line_size] = '\0';
+        // 先頭が時刻、CSV_SEQ_COLUMN列目がseq
+        uint64_t timestamp_us = strtoull(line, nullptr, 10);
+        int commas = 0;
+        uint64_t seq = 0;
+        for (size_t j = 0; j < line_size; j++) {
+          if (line[j] != ',') continue;
+          commas++;
+          if (commas == CSV_SEQ_COLUMN) seq = strtoull(line + j + 1, nullptr, 10);
+        }
+        if (commas != CSV_COLUMN_COUNT - 1 ||
+            (has_previous &&
+             (timestamp_us < last_timestamp_us ||
+              timestamp_us - last_timestamp_us > RECOVERY_MAX_GAP_US ||
+              seq <= last_seq))) {
+          done = true;
+          break;
+        }
+        has_previous = true;
+        last_timestamp_us = timestamp_us;
+        last_seq = seq;
+      }
+      valid_size += line_size + 1;
+      line_size = 0;
+      is_header = false;
+    }
+  }
+  delete[] buffer;
+  return valid_size;
+}
+
+bool SdController::benchmarkLogWrite(bool use_preallocation, int samples,
+                                     int flush_interval,
+                                     LogWriteBenchmarkResult* result) {
+  std::string bench_path = mount_point + "/bench.tmp";
+  unlink(bench_path.c_str());
+
+  binary_log = (getStringSetting("log_format", "csv") == "binary");
+  resetLogEncoder();
+  uint64_t bytes_per_sample =
+      binary_log ? BINARY_BYTES_PER_SAMPLE : CSV_BYTES_PER_SAMPLE;
+  bool use_r_plus = false;
+  if (use_preallocation) {
+    esp_err_t ret = esp_vfs_fat_create_contiguous_file(
+        mount_point.c_str(), bench_path.c_str(), samples * bytes_per_sample,
+        true);
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to preallocate benchmark file (0x%x)", ret);
+      return false;
+    }
+    use_r_plus = true;
+  }
+
+  log_file_pointer = fopen(bench_path.c_str(), use_r_plus ? "r+" : "w");
+  if (!log_file_pointer) {
+    logFileError("open benchmark file", bench_path.c_str());
+    return false;
+  }
+  char* buffer = (char*)heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_DMA);
+  if (buffer) {
+    setvbuf(log_file_pointer, buffer, _IOFBF, LOG_BUFFER_SIZE);
+  }
+
+  // ログタスクと同じく、writeLog()を繰り返しflush_interval回ごとにflush()する
+  SensorData data = {};
+  int64_t total_us = 0;
+  int64_t max_us = 0;
+  for (int i = 0; i < samples; i++) {
+    data.timestamp_us = esp_timer_get_time();
+    data.seq = i;
+    data.accel.d_x = (uint8_t)i;
+    int64_t start_us = esp_timer_get_time();
+    writeLog(data);
+    if ((i + 1) % flush_interval == 0) {
+      flush();
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    total_us += elapsed_us;
+    if (elapsed_us > max_us) max_us = elapsed_us;
+  }
+
+  fclose(log_file_pointer);
+  log_file_pointer = nullptr;
+  if (buffer) heap_caps_free(buffer);
+  unlink(bench_path.c_str());
+
+  result->max_us = max_us;
+  result->average_us = samples > 0 ? (float)total_us / samples : 0.0f;
+  result->total_ms = total_us / 1000;
+  return true;
+}
+
+void SdController::runWriteBenchmark(int samples) {
+  if (!mounted || log_file_pointer) {
+    ESP_LOGW(TAG, "Benchmark requires a mounted card and no open log file");
+    return;
+  }
+
+  const int flush_interval = 40;
+  printf("SD write benchmark: %d samples, flush every %d (%s)\n", samples,
+         flush_interval,
+         getStringSetting("log_format", "csv") == "binary" ? "binary" : "csv");
+  for (bool use_preallocation : {false, true}) {
+    LogWriteBenchmarkResult result;
+    if (!benchmarkLogWrite(use_preallocation, samples, flush_interval,
+                           &result)) {
+      printf("- %s: failed\n",
+             use_preallocation ? "preallocated" : "fopen(w)");
+      continue;
+    }
+    printf("- %-12s: worst %lld us, average %.1f us, total %lld ms\n",
+           use_preallocation ? "preallocated" : "fopen(w)", result.max_us,
+           result.average_us, result.total_ms);
+  }
+}
+
+void SdController::runNamingBenchmark() {
+  if (!mounted || log_file_pointer) {
+    ESP_LOGW(TAG, "Benchmark requires a mounted card and no open log file");
+    return;
+  }
+
+  std::string bench_dir = mount_point + "/nbench";
+  if (mkdir(bench_dir.c_str(), 0777) != 0 && errno != EEXIST) {
+    logFileError("mkdir", bench_dir.c_str());
+    return;
+  }
+
+  printf("Log naming benchmark (%s)\n", bench_dir.c_str());
+  int created = 0;
+  for (int existing : {1, 100, 1000}) {
+    // 空のログファイルを必要な数だけ作っておく
+    for (; created < existing; created++) {
+      std::string path = bench_dir + "/" + log_file_prefix +
+                         std::to_string(created + 1) + ".csv";
+      FILE* fp = fopen(path.c_str(), "w");
+      if (!fp) {
+        logFileError("create benchmark file", path.c_str());
+        break;
+      }
+      fclose(fp);
+    }
+    if (created < existing) break;
+
+    // 従来の方法: log-1から順に空いている番号を探す
+    int64_t start_us = esp_timer_get_time();
+    int probe = 1;
+    while (true) {
+      std::string base_path =
+          bench_dir + "/" + log_file_prefix + std::to_string(probe);
+      if (access((base_path + ".csv").c_str(), F_OK) == -1 &&
+          access((base_path + ".bin").c_str(), F_OK) == -1) {
+        break;
+      }
+      probe++;
+    }
+    int64_t probe_us = esp_timer_get_time() - start_us;
+
+    // 通し番号: 次の番号が空いていることだけを確認する
+    start_us = esp_timer_get_time();
+    std::string base_path =
+        bench_dir + "/" + log_file_prefix + std::to_string(existing + 1);
+    bool is_free = access((base_path + ".csv").c_str(), F_OK) == -1 &&
+                   access((base_path + ".bin").c_str(), F_OK) == -1;
+    int64_t sequence_us = esp_timer_get_time() - start_us;
+
+    // 通し番号が古かった場合のフォールバック: ディレクトリを1回走査する
+    start_us = esp_timer_get_time();
+    int max_index = scanMaxIndex(bench_dir, log_file_prefix.c_str());
+    int64_t scan_us = esp_timer_get_time() - start_us;
+
+    printf("- %4d logs: probe %8lld us (log-%d), sequence %6lld us (%s), "
+           "scan %7lld us (max %d)\n",
+           existing, probe_us, probe, sequence_us, is_free ? "free" : "used",
+           scan_us, max_index);
+  }
+
+  for (int i = 1; i <= created; i++) {
+    std::string path =
+        bench_dir + "/" + log_file_prefix + std::to_string(i) + ".csv";
+    unlink(path.c_str());
+  }
+  rmdir(bench_dir.c_str());
+}
+
+void SdController::fillTestPattern(uint8_t* block, uint64_t offset) {
+  // 位置ごとに異なる値のパターン（読み戻した時に、ずれや欠けが分かる）
+  uint32_t* words = reinterpret_cast<uint32_t*>(block);
+  for (size_t i = 0; i < LOG_BUFFER_SIZE / sizeof(uint32_t); i++) {
+    words[i] = (uint32_t)(offset / sizeof(uint32_t) + i) * 2654435761u;
+  }
+}
+
+void SdController::runCardBenchmark(int megabytes) {
+  if (!mounted || log_file_pointer || raw_recorder) {
+    ESP_LOGW(TAG, "Benchmark requires a mounted card and no open log file");
+    return;
+  }
+  if (megabytes > MAX_CARD_BENCH_MB) megabytes = MAX_CARD_BENCH_MB;
+  uint64_t total_bytes = (uint64_t)megabytes * 1024 * 1024;
+  int sync_bytes = getIntSetting("flush_max_pending_bytes", 32768);
+  if (sync_bytes < (int)LOG_BUFFER_SIZE) sync_bytes = LOG_BUFFER_SIZE;
+
+  // 飛行中と同じく、事前確保した連続領域に上書きする
+  std::string bench_path = mount_point + "/" + CARD_BENCH_FILE_NAME;
+  unlink(bench_path.c_str());
+  bool contiguous = esp_vfs_fat_create_contiguous_file(
+                        mount_point.c_str(), bench_path.c_str(), total_bytes,
+                        true) == ESP_OK;
+  FILE* fp = fopen(bench_path.c_str(), contiguous ? "r+" : "w");
+  uint8_t* buffer =
+      (uint8_t*)heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_DMA);
+  uint8_t* block = new uint8_t[LOG_BUFFER_SIZE];
+  if (!fp || !buffer) {
+    logFileError("open card benchmark file", bench_path.c_str());
+    if (fp) fclose(fp);
+    if (buffer) heap_caps_free(buffer);
+    delete[] block;
+    unlink(bench_path.c_str());
+    return;
+  }
+  setvbuf(fp, (char*)buffer, _IOFBF, LOG_BUFFER_SIZE);
+
+  auto fill_pattern = [block](uint64_t offset) {
+    fillTestPattern(block, offset);
+  };
+
+  // 4KBずつ書き、sync_bytesごとに同期する。書き込みと同期を合わせた時間を
+  // 1回の停止時間とみなす（この間はログタスクのバッファが空かない）
+  LatencyHistogram write_stats;
+  LatencyHistogram sync_stats;
+  LatencyHistogram stall_stats;
+  bool success = true;
+  size_t pending = 0;
+  int64_t start_us = esp_timer_get_time();
+  for (uint64_t offset = 0; offset < total_bytes && success;
+       offset += LOG_BUFFER_SIZE) {
+    fill_pattern(offset);
+    int64_t write_start_us = esp_timer_get_time();
+    success = fwrite(block, 1, LOG_BUFFER_SIZE, fp) == LOG_BUFFER_SIZE;
+    int64_t write_end_us = esp_timer_get_time();
+    write_stats.record(write_end_us - write_start_us, LOG_BUFFER_SIZE);
+    pending += LOG_BUFFER_SIZE;
+    if (pending >= (size_t)sync_bytes ||
+        offset + LOG_BUFFER_SIZE >= total_bytes) {
+      fflush(fp);
+      fsync(fileno(fp));
+      sync_stats.record(esp_timer_get_time() - write_end_us, pending);
+      pending = 0;
+    }
+    stall_stats.record(esp_timer_get_time() - write_start_us);
+  }
+  int64_t write_total_us = esp_timer_get_time() - start_us;
+
+  // 読み戻してパターンを確認する
+  uint32_t mismatched_blocks = 0;
+  int64_t read_start_us = esp_timer_get_time();
+  fseek(fp, 0, SEEK_SET);
+  uint8_t* read_block = new uint8_t[LOG_BUFFER_SIZE];
+  for (uint64_t offset = 0; offset < total_bytes && success;
+       offset += LOG_BUFFER_SIZE) {
+    if (fread(read_block, 1, LOG_BUFFER_SIZE, fp) != LOG_BUFFER_SIZE) {
+      success = false;
+      break;
+    }
+    fill_pattern(offset);
+    if (memcmp(block, read_block, LOG_BUFFER_SIZE) != 0) {
+      mismatched_blocks++;
+    }
+  }
+  int64_t read_total_us = esp_timer_get_time() - read_start_us;
+
+  fclose(fp);
+  unlink(bench_path.c_str());
+  heap_caps_free(buffer);
+  delete[] read_block;
+  delete[] block;
+
+  // 1kHzのログに必要な速度（形式ごとの見積もり）と比べられるように表示する
+  auto print_report = [&](FILE* out) {
+    fprintf(out,
+            "SD card benchmark: %d MB, 4 KB writes, sync every %d bytes "
+            "(%s, %lu kHz)\n",
+            megabytes, sync_bytes, contiguous ? "preallocated" : "fopen(w)",
+            (unsigned long)card->real_freq_khz);
+    if (!success) {
+      fprintf(out, "- failed (I/O error)\n");
+      return;
+    }
+    fprintf(out, "- sustained write: %.1f kB/s (%lld ms)\n",
+            total_bytes * 1000.0 / 1024 / write_total_us,
+            write_total_us / 1000);
+    fprintf(out, "- read back: %.1f kB/s, %lu of %llu blocks mismatched\n",
+            total_bytes * 1000.0 / 1024 / read_total_us,
+            (unsigned long)mismatched_blocks,
+            (unsigned long long)(total_bytes / LOG_BUFFER_SIZE));
+    write_stats.print(out, "write");
+    sync_stats.print(out, "sync");
+    fprintf(out,
+            "- worst stall (write + sync): %lu us (%lu samples at 1 kHz), "
+            "p99 < %lu us\n",
+            (unsigned long)stall_stats.getMaxUs(),
+            (unsigned long)(stall_stats.getMaxUs() / 1000 + 1),
+            (unsigned long)stall_stats.getPercentileUs(99));
+    fprintf(out, "- log needs: csv %.1f kB/s, binary %.1f kB/s\n",
+            CSV_BYTES_PER_SAMPLE * LOG_SAMPLE_RATE_HZ / 1024.0,
+            BINARY_BYTES_PER_SAMPLE * LOG_SAMPLE_RATE_HZ / 1024.0);
+  };
+  print_report(stdout);
+
+  std::string boot_dir = getBootDirectoryPath();
+  if (!boot_dir.empty()) {
+    std::string report_path = boot_dir + "/" + CARD_BENCH_REPORT_NAME;
+    FILE* report = fopen(report_path.c_str(), "w");
+    if (report) {
+      print_report(report);
+      fclose(report);
+    } else {
+      logFileError("open benchmark report", report_path.c_str());
+    }
+  }
 }
 
 void SdController::writeLog(SensorData data) {
-  if (!log_file_pointer) return;
-  fprintf(log_file_pointer,
-          "%llu,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
-          (long long unsigned)data.timestamp_us, data.accel.u_x, data.accel.d_x,
-          data.accel.u_y, data.accel.d_y, data.accel.u_z, data.accel.d_z,
-          data.gyro.u_x, data.gyro.d_x, data.gyro.u_y, data.gyro.d_y,
-          data.gyro.u_z, data.gyro.d_z, data.pressure.h_p, data.pressure.l_p,
-          data.pressure.xl_p, data.temperature.h_t, data.temperature.l_t);
+  if (!log_file_pointer && !raw_recorder) return;
+  char encoded[MAX_ENCODED_LOG_SIZE];
+  size_t length = encodeLog(data, encoded, sizeof(encoded));
+  if (length > 0) {
+    writeLogBytes(encoded, length);
+  }
+}
+
+size_t SdController::encodeLog(const SensorData& data, void* buffer,
+                               size_t size) {
+  if (binary_log) {
+    // タグ付きのレコードを書き込む（設定によってはIMUを差分圧縮する）
+    return log_encoder.encode(data, static_cast<uint8_t*>(buffer), size);
+  }
+
+  // CSVは1kHzの1行に、新しい値がある時だけ気圧・温度・ICMの温度を書く
+  // (古い値を繰り返さず、空欄にする)
+  char* out = static_cast<char*>(buffer);
+  int length = snprintf(
+      out, size, "%llu,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,",
+      (long long unsigned)data.timestamp_us, data.accel.u_x, data.accel.d_x,
+      data.accel.u_y, data.accel.d_y, data.accel.u_z, data.accel.d_z,
+      data.gyro.u_x, data.gyro.d_x, data.gyro.u_y, data.gyro.d_y,
+      data.gyro.u_z, data.gyro.d_z);
+  if (length <= 0 || length >= (int)size) return 0;
+  size_t used = length;
+
+  if (data.flags & SENSOR_DATA_HAS_BARO) {
+    length = snprintf(out + used, size - used, "%d,%d,%d,%d,%d,%lu,",
+                      data.pressure.h_p, data.pressure.l_p,
+                      data.pressure.xl_p, data.temperature.h_t,
+                      data.temperature.l_t, (unsigned long)data.seq);
+  } else {
+    length = snprintf(out + used, size - used, ",,,,,%lu,",
+                      (unsigned long)data.seq);
+  }
+  if (length <= 0 || length >= (int)(size - used)) return 0;
+  used += length;
+
+  if (data.flags & SENSOR_DATA_HAS_ICM_TEMP) {
+    length = snprintf(out + used, size - used, "%d,%d\n", data.icm_temp.u_t,
+                      data.icm_temp.d_t);
+  } else {
+    length = snprintf(out + used, size - used, ",\n");
+  }
+  // 入りきらなかった場合は書き込まない
+  if (length <= 0 || length >= (int)(size - used)) return 0;
+  return used + length;
+}
+
+size_t SdController::encodeLogBatch(const SensorData* data, size_t count,
+                                    void* buffer, size_t size,
+                                    size_t* encoded_count) {
+  uint8_t* out = static_cast<uint8_t*>(buffer);
+  size_t used = 0;
+  size_t encoded = 0;
+  while (encoded < count) {
+    size_t length = encodeLog(data[encoded], out + used, size - used);
+    if (length == 0) break;
+    used += length;
+    encoded++;
+  }
+  *encoded_count = encoded;
+  return used;
+}
+
+size_t SdController::sealLogBlock(uint8_t* buffer, size_t payload_size) {
+  if (!binary_log) {
+    return payload_size;
+  }
+  LogFormat::sealBlock(buffer, log_file_id, next_block_seq++, payload_size);
+  return LogFormat::BLOCK_SIZE;
+}
+
+void SdController::writeLogBytes(const void* data, size_t size) {
+  int64_t start_us = esp_timer_get_time();
+  if (raw_recorder) {
+    if (!raw_recorder->append(data, size)) {
+      ESP_LOGE(TAG, "Raw recorder append failed");
+      return;
+    }
+    log_bytes_written += size;
+    recordIo(SdOperation::WRITE, start_us, size);
+  } else if (log_file_pointer) {
+    size_t written = fwrite(data, 1, size, log_file_pointer);
+    log_bytes_written += written;
+    recordIo(SdOperation::WRITE, start_us, written);
+  }
 }
 
 void SdController::flush() {
+  int64_t start_us = esp_timer_get_time();
+  if (raw_recorder) {
+    // rawレコーダはバッファの残りとスーパーブロックを書き込む
+    raw_recorder->sync();
+    recordIo(SdOperation::SYNC, start_us);
+    return;
+  }
   if (!log_file_pointer) return;
 
   // 1) fflushでライブラリバッファをクリア
@@ -220,9 +1709,11 @@ void SdController::flush() {
   if (fd >= 0) {
     fsync(fd);
   }
+  recordIo(SdOperation::SYNC, start_us);
 }
 
-bool SdController::loadSettingsFromFile() {
+bool SdController::loadSettingsFromFile(bool only_if_edited, bool* imported) {
+  if (imported) *imported = false;
   if (!mounted) {
     ESP_LOGW("SDMMC", "Cannot load settings, SD card not mounted");
     return false;
@@ -284,6 +1775,15 @@ bool SdController::loadSettingsFromFile() {
 
   buffer[readSize] = '\0';  // JSON解析のために終端を追加
 
+  // 最後に書き出した内容から変わっていなければ、取り込まない
+  // （ジャーナルの方が新しい値を持っている）
+  uint32_t file_crc = LogFormat::crc32(buffer, readSize);
+  if (only_if_edited && file_crc == exported_json_crc) {
+    free(buffer);
+    ESP_LOGI(TAG, "%s is unchanged since last export", file_path.c_str());
+    return true;
+  }
+
   // JSONをパース
   cJSON* root = cJSON_Parse(buffer);
   free(buffer);
@@ -294,6 +1794,7 @@ bool SdController::loadSettingsFromFile() {
   }
 
   // 設定のバックアップを作成
+  SettingsLock lock(settings_mutex);
   backupSettings();
 
   // 各設定項目を読み込む
@@ -341,6 +1842,9 @@ bool SdController::loadSettingsFromFile() {
   }
 
   cJSON_Delete(root);
+  publishCachedSettings();
+  exported_json_crc = file_crc;
+  if (imported) *imported = true;
   ESP_LOGI(TAG, "Settings loaded successfully from %s", file_path.c_str());
   return true;
 }
@@ -352,7 +1856,10 @@ bool SdController::saveSettingsToFile() {
   }
 
   // 安全な実装を使用
-  return safeWriteSettingsToFile();
+  int64_t start_us = esp_timer_get_time();
+  bool success = safeWriteSettingsToFile();
+  recordIo(SdOperation::SETTINGS_SAVE, start_us);
+  return success;
 }
 
 // 新しいメソッド: ファイルシステム状態チェック
@@ -407,6 +1914,7 @@ void SdController::logFileError(const char* operation, const char* filename) {
 
 // 新しいメソッド: 設定のバックアップを作成
 void SdController::backupSettings() {
+  SettingsLock lock(settings_mutex);
   // 現在の設定をバックアップ
   settings_backup.clear();
 
@@ -458,6 +1966,7 @@ void SdController::backupSettings() {
 
 // 新しいメソッド: バックアップから設定を復元
 void SdController::restoreSettingsFromBackup() {
+  SettingsLock lock(settings_mutex);
   if (settings_backup.empty()) {
     ESP_LOGW(TAG, "No settings backup available to restore");
     return;
@@ -520,22 +2029,13 @@ void SdController::restoreSettingsFromBackup() {
 
     settings[key] = restored_item;
   }
+  publishCachedSettings();
 
   ESP_LOGI(TAG, "Settings restored from backup (%zu items)", settings.size());
 }
 
-// 新しいメソッド: 安全なファイル書き込み処理（一時ファイル使用）
-bool SdController::safeWriteSettingsToFile() {
-  if (!mounted) {
-    ESP_LOGW(TAG, "Cannot save settings, SD card not mounted");
-    return false;
-  }
-
-  // ファイルシステムの状態チェック
-  if (!checkFileSystemStatus()) {
-    ESP_LOGE(TAG, "File system check failed, aborting settings save");
-    return false;
-  }
+char* SdController::serializeSettings() {
+  SettingsLock lock(settings_mutex);
 
   // 設定のバックアップを作成
   backupSettings();
@@ -544,7 +2044,7 @@ bool SdController::safeWriteSettingsToFile() {
   cJSON* root = cJSON_CreateObject();
   if (!root) {
     ESP_LOGE(TAG, "Failed to create JSON object");
-    return false;
+    return nullptr;
   }
 
   // 各設定項目をJSONに追加
@@ -579,6 +2079,24 @@ bool SdController::safeWriteSettingsToFile() {
   // JSONをフォーマットされた文字列に変換
   char* json_str = cJSON_Print(root);
   cJSON_Delete(root);
+  return json_str;
+}
+
+// 新しいメソッド: 安全なファイル書き込み処理（一時ファイル使用）
+bool SdController::safeWriteSettingsToFile() {
+  if (!mounted) {
+    ESP_LOGW(TAG, "Cannot save settings, SD card not mounted");
+    return false;
+  }
+
+  // ファイルシステムの状態チェック
+  if (!checkFileSystemStatus()) {
+    ESP_LOGE(TAG, "File system check failed, aborting settings save");
+    return false;
+  }
+
+  // 設定のバックアップを作成し、JSON文字列に変換する（ここだけ設定のマップを保持する）
+  char* json_str = serializeSettings();
 
   if (!json_str) {
     ESP_LOGE(TAG, "Failed to print JSON to string");
@@ -589,8 +2107,8 @@ bool SdController::safeWriteSettingsToFile() {
   std::string temp_file = mount_point + "/setting.tmp";
   std::string target_file = mount_point + "/" + setting_file_name;
 
-  // ログバッファをフラッシュして、他のファイル操作との競合を減らす
-  flush();
+  // ログの同期はここでは行わない（保存タスクから呼ばれるので、ログタスクの
+  // 書き込みと重ならないよう、ログの同期はログタスクとモード遷移の処理に任せる）
 
   // ミューテックスで保護
   if (file_mutex && xSemaphoreTake(file_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
@@ -635,6 +2153,7 @@ bool SdController::safeWriteSettingsToFile() {
   }
 
   ESP_LOGI(TAG, "Settings saved successfully to %s", target_file.c_str());
+  exported_json_crc = LogFormat::crc32(json_str, strlen(json_str));
   success = true;
 
 cleanup:
@@ -656,6 +2175,7 @@ cleanup:
 // 各型の設定値取得・設定メソッド
 
 int SdController::getIntSetting(const std::string& key, int default_value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::INTEGER) {
     return it->second.value.int_value;
@@ -664,6 +2184,7 @@ int SdController::getIntSetting(const std::string& key, int default_value) {
 }
 
 void SdController::setIntSetting(const std::string& key, int value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::INTEGER) {
     it->second.value.int_value = value;
@@ -675,10 +2196,13 @@ void SdController::setIntSetting(const std::string& key, int value) {
     setting.default_value.int_value = value;
     settings[key] = setting;
   }
+  publishCachedSetting(key, SettingType::INTEGER,
+                       SettingsCache::toWord(value));
 }
 
 float SdController::getFloatSetting(const std::string& key,
                                     float default_value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::FLOAT) {
     return it->second.value.float_value;
@@ -687,6 +2211,7 @@ float SdController::getFloatSetting(const std::string& key,
 }
 
 void SdController::setFloatSetting(const std::string& key, float value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::FLOAT) {
     it->second.value.float_value = value;
@@ -698,9 +2223,12 @@ void SdController::setFloatSetting(const std::string& key, float value) {
     setting.default_value.float_value = value;
     settings[key] = setting;
   }
+  publishCachedSetting(key, SettingType::FLOAT,
+                       SettingsCache::toWord(value));
 }
 
 bool SdController::getBoolSetting(const std::string& key, bool default_value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::BOOLEAN) {
     return it->second.value.bool_value;
@@ -709,6 +2237,7 @@ bool SdController::getBoolSetting(const std::string& key, bool default_value) {
 }
 
 void SdController::setBoolSetting(const std::string& key, bool value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::BOOLEAN) {
     it->second.value.bool_value = value;
@@ -720,10 +2249,13 @@ void SdController::setBoolSetting(const std::string& key, bool value) {
     setting.default_value.bool_value = value;
     settings[key] = setting;
   }
+  publishCachedSetting(key, SettingType::BOOLEAN,
+                       SettingsCache::toWord(value));
 }
 
 std::string SdController::getStringSetting(const std::string& key,
                                            const std::string& default_value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::STRING &&
       it->second.value.string_value) {
@@ -734,6 +2266,7 @@ std::string SdController::getStringSetting(const std::string& key,
 
 void SdController::setStringSetting(const std::string& key,
                                     const std::string& value) {
+  SettingsLock lock(settings_mutex);
   auto it = settings.find(key);
   if (it != settings.end() && it->second.type == SettingType::STRING) {
     // 既存の文字列を解放
@@ -752,6 +2285,200 @@ void SdController::setStringSetting(const std::string& key,
   }
 }
 
-bool SdController::saveSettings() { return saveSettingsToFile(); }
+bool SdController::saveSettings() {
+  if (!settings_journal.isOpen()) {
+    // ジャーナルが使えなければ、setting.json 全体を書き直す
+    return saveSettingsToFile();
+  }
+
+  // 値を集めてから書き込むまでを file_mutex で保護し、古い値で上書きしないようにする
+  if (file_mutex && xSemaphoreTake(file_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    ESP_LOGE(TAG, "Failed to take file mutex, aborting settings save");
+    return false;
+  }
+  int64_t start_us = esp_timer_get_time();
+  uint32_t start_bytes = settings_journal.getFileBytes();
+  uint32_t appended = 0;
+  bool success = settings_journal.put(collectJournalEntries(), &appended);
+  recordIo(SdOperation::SETTINGS_SAVE, start_us,
+           settings_journal.getFileBytes() - start_bytes);
+  if (file_mutex) {
+    xSemaphoreGive(file_mutex);
+  }
+
+  if (!success) {
+    // ジャーナルに追記できなければ、setting.json 全体を書き直して設定を残す
+    logFileError("append", SETTINGS_JOURNAL_NAME);
+    return saveSettingsToFile();
+  } else if (appended > 0) {
+    ESP_LOGI(TAG, "Settings journal: appended %lu record(s)",
+             (unsigned long)appended);
+  }
+  return success;
+}
+
+bool SdController::reloadSettings() {
+  // 編集された setting.json を取り込み、ジャーナルにも記録する
+  return loadSettingsFromFile() && saveSettings();
+}
+
+bool SdController::exportSettings() {
+  if (!saveSettingsToFile()) {
+    return false;
+  }
+  // 書き出した内容のCRCをジャーナルに記録し、次の起動で編集されたか判断できるようにする
+  return saveSettings();
+}
+
+bool SdController::loadSettings() {
+  std::string journal_path = mount_point + "/" + SETTINGS_JOURNAL_NAME;
+  std::string json_path = mount_point + "/" + setting_file_name;
+  bool json_exists = (access(json_path.c_str(), F_OK) != -1);
+
+  SettingsJournal::LoadResult result;
+  if (!settings_journal.open(journal_path, &result)) {
+    // ジャーナルが使えなければ、setting.json だけで読み書きする
+    logFileError("open", journal_path.c_str());
+    settings_journal.close();
+    bool loaded = json_exists ? loadSettingsFromFile() : saveSettingsToFile();
+    if (!loaded) {
+      ESP_LOGW(TAG, "Failed to load settings, using defaults");
+    }
+    return loaded;
+  }
+  applyJournalEntries(settings_journal.getEntries());
+  ESP_LOGI(TAG, "Settings journal: %lu records, %u keys, %lu bytes",
+           (unsigned long)result.records,
+           (unsigned)settings_journal.getEntries().size(),
+           (unsigned long)result.valid_bytes);
+  if (result.valid_bytes < result.file_bytes) {
+    ESP_LOGW(TAG, "Settings journal: dropped %lu bytes of a torn record",
+             (unsigned long)(result.file_bytes - result.valid_bytes));
+  }
+
+  // setting.json は人が編集するための写し
+  // 最後に書き出した後に編集されていれば（ジャーナルがなければ常に）取り込む
+  if (json_exists) {
+    bool imported = false;
+    if (!loadSettingsFromFile(result.found, &imported)) {
+      ESP_LOGW(TAG, "Failed to import %s", json_path.c_str());
+    } else if (imported) {
+      ESP_LOGI(TAG, "Imported edited %s", json_path.c_str());
+    }
+  }
+
+  // 今の設定と setting.json の内容が違えば書き出し直す
+  char* json_str = serializeSettings();
+  bool export_needed =
+      !json_exists ||
+      (json_str && LogFormat::crc32(json_str, strlen(json_str)) !=
+                       exported_json_crc);
+  free(json_str);
+  if (export_needed && !saveSettingsToFile()) {
+    ESP_LOGW(TAG, "Failed to export %s", json_path.c_str());
+  }
+
+  // 変わった値を追記し、重複したレコードがあればキーごとに1つへ詰める
+  uint32_t appended = 0;
+  if (!settings_journal.put(collectJournalEntries(), &appended)) {
+    logFileError("append", journal_path.c_str());
+    return false;
+  }
+  if (result.records + appended > settings_journal.getEntries().size()) {
+    uint32_t before_bytes = settings_journal.getFileBytes();
+    if (settings_journal.compact()) {
+      ESP_LOGI(TAG, "Settings journal compacted: %lu -> %lu bytes",
+               (unsigned long)before_bytes,
+               (unsigned long)settings_journal.getFileBytes());
+    } else {
+      logFileError("compact", journal_path.c_str());
+    }
+  }
+  return true;
+}
 
-bool SdController::reloadSettings() { return loadSettingsFromFile(); }
\ No newline at end of file
+SettingsJournal::EntryMap SdController::collectJournalEntries() {
+  SettingsLock lock(settings_mutex);
+  SettingsJournal::EntryMap entries;
+  for (const auto& item : settings) {
+    const SettingItem& setting = item.second;
+    SettingsJournalEntry& entry = entries[item.first];
+    entry.type = static_cast<uint8_t>(setting.type);
+    switch (setting.type) {
+      case SettingType::INTEGER:
+        entry.value.assign(
+            reinterpret_cast<const char*>(&setting.value.int_value),
+            sizeof(int32_t));
+        break;
+      case SettingType::FLOAT:
+        entry.value.assign(
+            reinterpret_cast<const char*>(&setting.value.float_value),
+            sizeof(float));
+        break;
+      case SettingType::BOOLEAN:
+        entry.value.assign(1, setting.value.bool_value ? 1 : 0);
+        break;
+      case SettingType::STRING:
+        if (setting.value.string_value) {
+          entry.value = setting.value.string_value;
+        }
+        break;
+    }
+  }
+
+  SettingsJournalEntry& crc_entry = entries[JSON_CRC_KEY];
+  crc_entry.type = static_cast<uint8_t>(SettingType::INTEGER);
+  crc_entry.value.assign(reinterpret_cast<const char*>(&exported_json_crc),
+                         sizeof(exported_json_crc));
+  return entries;
+}
+
+void SdController::applyJournalEntries(
+    const SettingsJournal::EntryMap& entries) {
+  SettingsLock lock(settings_mutex);
+  for (const auto& item : entries) {
+    const SettingsJournalEntry& entry = item.second;
+    if (item.first == JSON_CRC_KEY) {
+      if (entry.value.size() == sizeof(exported_json_crc)) {
+        memcpy(&exported_json_crc, entry.value.data(),
+               sizeof(exported_json_crc));
+      }
+      continue;
+    }
+
+    // 今のファームウェアにない設定や、型が変わった設定は読み飛ばす
+    auto it = settings.find(item.first);
+    if (it == settings.end() ||
+        static_cast<uint8_t>(it->second.type) != entry.type) {
+      ESP_LOGW(TAG, "Ignoring journaled setting '%s'", item.first.c_str());
+      continue;
+    }
+    SettingItem& setting = it->second;
+    switch (setting.type) {
+      case SettingType::INTEGER:
+        if (entry.value.size() == sizeof(int32_t)) {
+          memcpy(&setting.value.int_value, entry.value.data(),
+                 sizeof(int32_t));
+        }
+        break;
+      case SettingType::FLOAT:
+        if (entry.value.size() == sizeof(float)) {
+          memcpy(&setting.value.float_value, entry.value.data(),
+                 sizeof(float));
+        }
+        break;
+      case SettingType::BOOLEAN:
+        if (entry.value.size() == 1) {
+          setting.value.bool_value = entry.value[0] != 0;
+        }
+        break;
+      case SettingType::STRING:
+        if (setting.value.string_value) {
+          free(setting.value.string_value);
+        }
+        setting.value.string_value = strdup(entry.value.c_str());
+        break;
+    }
+  }
+  publishCachedSettings();
+}
\ No newline at end of file
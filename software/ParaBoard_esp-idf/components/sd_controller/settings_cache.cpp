@@ -0,0 +1,106 @@
+#include "settings_cache.hpp"
+
+#include <string.h>
+
+namespace {
+
+struct SettingKeyInfo {
+  const char* name;
+  SettingType type;
+};
+
+// SettingKeyと同じ順に並べる
+constexpr SettingKeyInfo KEY_INFO[] = {
+    {"open-angle", SettingType::INTEGER},
+    {"close-angle", SettingType::INTEGER},
+};
+
+static_assert(sizeof(KEY_INFO) / sizeof(KEY_INFO[0]) ==
+                  SettingsCache::KEY_COUNT,
+              "KEY_INFO must list every SettingKey");
+
+}  // namespace
+
+SettingsCache::Snapshot SettingsCache::read() const {
+  Snapshot snapshot;
+  while (true) {
+    uint32_t begin = sequence.load(std::memory_order_acquire);
+    if ((begin & 1) == 0) {
+      for (int i = 0; i < KEY_COUNT; i++) {
+        snapshot.words[i] = words[i].load(std::memory_order_relaxed);
+      }
+      // 値を読み終えてから、シーケンス番号を読み直す
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == begin) {
+        return snapshot;
+      }
+    }
+  }
+}
+
+uint32_t SettingsCache::readWord(SettingKey key) const {
+  int index = static_cast<int>(key);
+  while (true) {
+    uint32_t begin = sequence.load(std::memory_order_acquire);
+    if ((begin & 1) == 0) {
+      uint32_t word = words[index].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == begin) {
+        return word;
+      }
+    }
+  }
+}
+
+void SettingsCache::publish(const Snapshot& snapshot) {
+  portENTER_CRITICAL(&write_lock);
+  uint32_t current = sequence.load(std::memory_order_relaxed);
+  sequence.store(current + 1, std::memory_order_relaxed);
+  // 奇数のシーケンス番号を、値より先に見えるようにする
+  std::atomic_thread_fence(std::memory_order_release);
+  for (int i = 0; i < KEY_COUNT; i++) {
+    words[i].store(snapshot.words[i], std::memory_order_relaxed);
+  }
+  sequence.store(current + 2, std::memory_order_release);
+  portEXIT_CRITICAL(&write_lock);
+}
+
+void SettingsCache::publish(SettingKey key, uint32_t word) {
+  portENTER_CRITICAL(&write_lock);
+  uint32_t current = sequence.load(std::memory_order_relaxed);
+  sequence.store(current + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  words[static_cast<int>(key)].store(word, std::memory_order_relaxed);
+  sequence.store(current + 2, std::memory_order_release);
+  portEXIT_CRITICAL(&write_lock);
+}
+
+uint32_t SettingsCache::toWord(float value) {
+  uint32_t word;
+  memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+float SettingsCache::toFloat(uint32_t word) {
+  float value;
+  memcpy(&value, &word, sizeof(value));
+  return value;
+}
+
+bool SettingsCache::findKey(const std::string& name, SettingKey* key) {
+  for (int i = 0; i < KEY_COUNT; i++) {
+    if (name == KEY_INFO[i].name) {
+      *key = static_cast<SettingKey>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* SettingsCache::getKeyName(SettingKey key) {
+  return KEY_INFO[static_cast<int>(key)].name;
+}
+
+SettingType SettingsCache::getKeyType(SettingKey key) {
+  return KEY_INFO[static_cast<int>(key)].type;
+}
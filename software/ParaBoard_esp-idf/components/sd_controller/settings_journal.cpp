@@ -0,0 +1,247 @@
+#include "settings_journal.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.hpp"
+
+SettingsJournalHeader SettingsJournal::makeHeader() {
+  SettingsJournalHeader header = {};
+  memcpy(header.magic, SETTINGS_JOURNAL_MAGIC, sizeof(SETTINGS_JOURNAL_MAGIC));
+  header.version = SETTINGS_JOURNAL_VERSION;
+  header.header_size = sizeof(SettingsJournalHeader);
+  return header;
+}
+
+bool SettingsJournal::encodeRecord(const std::string& key,
+                                   const SettingsJournalEntry& entry,
+                                   std::string* out) {
+  if (key.empty() || key.size() > MAX_KEY_LENGTH ||
+      entry.value.size() > MAX_VALUE_LENGTH) {
+    return false;
+  }
+  SettingsRecordHeader header = {};
+  header.marker = SETTINGS_RECORD_MARKER;
+  header.type = entry.type;
+  header.key_length = key.size();
+  header.value_length = entry.value.size();
+  uint32_t crc =
+      LogFormat::crc32(&header, offsetof(SettingsRecordHeader, crc32));
+  crc = LogFormat::crc32(key.data(), key.size(), crc);
+  header.crc32 = LogFormat::crc32(entry.value.data(), entry.value.size(), crc);
+
+  out->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  out->append(key);
+  out->append(entry.value);
+  return true;
+}
+
+size_t SettingsJournal::replay(const uint8_t* data, size_t size,
+                               EntryMap* entries, uint32_t* records) {
+  *records = 0;
+  SettingsJournalHeader header;
+  if (size < sizeof(header)) return 0;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, SETTINGS_JOURNAL_MAGIC,
+             sizeof(SETTINGS_JOURNAL_MAGIC)) != 0 ||
+      header.version != SETTINGS_JOURNAL_VERSION ||
+      header.header_size < sizeof(header) || header.header_size > size) {
+    return 0;
+  }
+
+  size_t position = header.header_size;
+  while (position + sizeof(SettingsRecordHeader) <= size) {
+    SettingsRecordHeader record;
+    memcpy(&record, data + position, sizeof(record));
+    size_t record_size =
+        sizeof(record) + record.key_length + record.value_length;
+    if (record.marker != SETTINGS_RECORD_MARKER || record.key_length == 0 ||
+        position + record_size > size) {
+      break;
+    }
+    const uint8_t* key = data + position + sizeof(record);
+    const uint8_t* value = key + record.key_length;
+    uint32_t crc =
+        LogFormat::crc32(&record, offsetof(SettingsRecordHeader, crc32));
+    crc = LogFormat::crc32(key, record.key_length, crc);
+    crc = LogFormat::crc32(value, record.value_length, crc);
+    if (crc != record.crc32) {
+      break;
+    }
+
+    SettingsJournalEntry& entry =
+        (*entries)[std::string(reinterpret_cast<const char*>(key),
+                               record.key_length)];
+    entry.type = record.type;
+    entry.value.assign(reinterpret_cast<const char*>(value),
+                       record.value_length);
+    (*records)++;
+    position += record_size;
+  }
+  return position;
+}
+
+bool SettingsJournal::open(const std::string& journal_path,
+                           LoadResult* result) {
+  close();
+  *result = {};
+  entries.clear();
+  path = journal_path;
+
+  // コンパクションの途中で電源が切れた場合の復旧
+  // 元のファイルがあれば一時ファイルは書きかけかもしれないので捨て、
+  // 元のファイルを消した後なら一時ファイルは書き終えているので使う
+  std::string temp_path = path + ".tmp";
+  struct stat st;
+  bool exists = (stat(path.c_str(), &st) == 0);
+  if (stat(temp_path.c_str(), &st) == 0) {
+    if (exists) {
+      remove(temp_path.c_str());
+    } else if (rename(temp_path.c_str(), path.c_str()) == 0) {
+      exists = true;
+    }
+  }
+  result->found = exists;
+
+  if (!exists && !writeSnapshot(path)) {
+    return false;
+  }
+  file_pointer = fopen(path.c_str(), "r+b");
+  if (!file_pointer) {
+    return false;
+  }
+
+  // ジャーナルはコンパクションで小さく保つので、まとめて読み込む
+  fseek(file_pointer, 0, SEEK_END);
+  long size = ftell(file_pointer);
+  fseek(file_pointer, 0, SEEK_SET);
+  uint8_t* data = size > 0 ? (uint8_t*)malloc(size) : nullptr;
+  if (size > 0 && (!data || fread(data, 1, size, file_pointer) !=
+                                (size_t)size)) {
+    free(data);
+    close();
+    return false;
+  }
+  result->file_bytes = size;
+  size_t valid = replay(data, size, &entries, &result->records);
+  free(data);
+
+  if (valid == 0) {
+    // ヘッダが壊れていれば、空のジャーナルを作り直す
+    fclose(file_pointer);
+    file_pointer = nullptr;
+    entries.clear();
+    result->records = 0;
+    if (!writeSnapshot(path)) {
+      return false;
+    }
+    file_pointer = fopen(path.c_str(), "r+b");
+    if (!file_pointer) {
+      return false;
+    }
+    valid = sizeof(SettingsJournalHeader);
+  } else if (valid < (size_t)size) {
+    // 書きかけのレコードを切り詰め、その後ろに追記できるようにする
+    fflush(file_pointer);
+    if (ftruncate(fileno(file_pointer), valid) == 0) {
+      fsync(fileno(file_pointer));
+    }
+  }
+  result->valid_bytes = valid;
+  file_bytes = valid;
+  return true;
+}
+
+void SettingsJournal::close() {
+  if (file_pointer) {
+    fclose(file_pointer);
+    file_pointer = nullptr;
+  }
+}
+
+bool SettingsJournal::put(const EntryMap& values, uint32_t* appended) {
+  if (appended) *appended = 0;
+  if (!file_pointer) return false;
+
+  // 変わった値だけをレコードにして、1回で書き込む
+  std::string records;
+  uint32_t count = 0;
+  for (const auto& item : values) {
+    auto it = entries.find(item.first);
+    if (it != entries.end() && it->second == item.second) continue;
+    if (!encodeRecord(item.first, item.second, &records)) {
+      return false;
+    }
+    count++;
+  }
+  if (count == 0) return true;
+
+  // 前回の書き込みに失敗していても、有効なレコードの直後から書く
+  bool success =
+      fseek(file_pointer, file_bytes, SEEK_SET) == 0 &&
+      fwrite(records.data(), 1, records.size(), file_pointer) ==
+          records.size() &&
+      fflush(file_pointer) == 0 && fsync(fileno(file_pointer)) == 0;
+  if (!success) {
+    // 書きかけのレコードを取り除いておく（できなくても次のopen()で捨てる）
+    fflush(file_pointer);
+    ftruncate(fileno(file_pointer), file_bytes);
+    return false;
+  }
+
+  for (const auto& item : values) {
+    entries[item.first] = item.second;
+  }
+  file_bytes += records.size();
+  if (appended) *appended = count;
+  return true;
+}
+
+bool SettingsJournal::writeSnapshot(const std::string& file_path) {
+  std::string data;
+  SettingsJournalHeader header = makeHeader();
+  data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const auto& item : entries) {
+    if (!encodeRecord(item.first, item.second, &data)) {
+      return false;
+    }
+  }
+
+  FILE* fp = fopen(file_path.c_str(), "wb");
+  if (!fp) {
+    return false;
+  }
+  bool success = fwrite(data.data(), 1, data.size(), fp) == data.size() &&
+                 fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  fclose(fp);
+  return success;
+}
+
+bool SettingsJournal::compact() {
+  if (!file_pointer) return false;
+
+  std::string temp_path = path + ".tmp";
+  if (!writeSnapshot(temp_path)) {
+    remove(temp_path.c_str());
+    return false;
+  }
+
+  // FATのrename()は上書きできないので、元のファイルを消してから置き換える
+  close();
+  if (remove(path.c_str()) != 0 ||
+      rename(temp_path.c_str(), path.c_str()) != 0) {
+    // どちらのファイルが残っていても、次のopen()で復旧できる
+    file_pointer = fopen(path.c_str(), "r+b");
+    return false;
+  }
+
+  file_pointer = fopen(path.c_str(), "r+b");
+  if (!file_pointer) {
+    return false;
+  }
+  fseek(file_pointer, 0, SEEK_END);
+  file_bytes = ftell(file_pointer);
+  return true;
+}
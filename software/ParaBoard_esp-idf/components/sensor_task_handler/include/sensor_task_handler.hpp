@@ -2,10 +2,14 @@
 
 #include <stdio.h>
 
+#include <atomic>
+
 #include "condition_checker.hpp"
 #include "config.hpp"
+#include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "event_journal.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "icm42688.hpp"
@@ -14,6 +18,21 @@
 #include "sd_controller.hpp"
 #include "servo_controller.hpp"
 
+/**
+ * @brief センサーからログまでの経路の統計（LOGGING開始ごとにリセット）
+ */
+struct PipelineStats {
+  uint32_t samples;          // 取得したサンプル数
+  uint32_t dropped;          // リングバッファが満杯で捨てたサンプル数
+  uint32_t late;  // 前回の取得から間隔が空きすぎたサンプル数（FIFOモードでは数えない）
+  uint32_t overrun;  // タイマー通知が重なる・FIFOが溢れるなどで、取得できなかった周期の数
+  uint32_t max_interval_us;  // 取得間隔の最大値
+  uint32_t duplicate;  // 前回と同じ（ICMが更新する前に読んだ）サンプル数
+  uint32_t skipped;    // ICMが更新したのに読まなかったサンプル数
+  uint32_t watchdog;   // 割り込みが来ず、タイマーで取得した回数
+  uint32_t baro_stale;  // LPSがまだ新しく変換しておらず、読み直した回数
+};
+
 class SensorTaskHandler {
  public:
   SensorTaskHandler();
@@ -26,10 +45,72 @@ class SensorTaskHandler {
    * @param log_handler ログタスクハンドラへのポインタ
    * @param servo サーボコントローラへのポインタ
    * @param sd_controller SDカードコントローラへのポインタ
+   * @param journal イベントジャーナルへのポインタ（nullptrなら記録しない）
    * @return 初期化が成功したかどうか
    */
   bool init(Icm::Icm42688* icm, Lps::Lps25hb* lps, LogTaskHandler* log_handler,
-            ServoController* servo, SdController* sd_controller);
+            ServoController* servo, SdController* sd_controller,
+            EventJournal* journal = nullptr);
+
+  /**
+   * @brief ICMのFIFOからまとめて読み出すモードにする（startTask()の前に呼ぶ）
+   * タイマーの周期をFIFOの読み出し間隔にし、1回の通知で溜まったサンプルをすべて処理する
+   * @param period_ms 読み出し間隔（ミリ秒）
+   * @return 成功したかどうか（失敗した場合は1kHzでレジスタから読むモードのまま）
+   */
+  bool enableFifo(uint32_t period_ms);
+
+  /**
+   * @brief FIFOから読み出すモードかどうか
+   */
+  bool isFifoMode() const { return fifo_batch != nullptr; }
+
+  /**
+   * @brief ICMのINT1の割り込みで取得するモードにする（startTask()の前、enableFifo()の後に呼ぶ）
+   * レジスタから読むモードではデータレディ、FIFOモードではウォーターマークで割り込む
+   * タイマーは割り込みが来ない時だけ取得する見張りになる
+   * @param pin INT1をつないだGPIO（GPIO_NUM_NCなら何もしない）
+   * @return 成功したかどうか（失敗した場合はタイマーで取得するモードのまま）
+   */
+  bool enableInterrupt(gpio_num_t pin);
+
+  /**
+   * @brief 割り込みで取得するモードかどうか
+   */
+  bool isInterruptMode() const { return interrupt_pin != GPIO_NUM_NC; }
+
+  /**
+   * @brief ICMの読み出しをキューに入れ、転送中に前のサンプルを処理するモードにする
+   * （startTask()の前に呼ぶ。レジスタから読むモードのみ）
+   * 各サンプルの処理（離床・頂点の判定、ログへの送信、サーボ）は1周期遅れて行う
+   * @return 成功したかどうか（FIFOモードでは使えない）
+   */
+  bool enableQueuedRead();
+
+  /**
+   * @brief ICMの読み出しをキューに入れるモードかどうか
+   */
+  bool isQueuedRead() const { return queued_read; }
+
+  /**
+   * @brief LPSの出力データレートに合わせて、気圧を読む間隔を変える（startTask()の前に呼ぶ）
+   * @param odr_mhz LPSの出力データレート(mHz)
+   */
+  void setBaroRate(uint32_t odr_mhz);
+
+  /**
+   * @brief LPSの出力データレートと平均の設定を読み、変わっていればLPSに設定し直す
+   * 気圧を読む間隔と、気圧による判定のデータの数・閾値もレートに合わせる
+   * 起動時と、LOGGINGモードを開始するたび（センサータスクの中）に呼ばれる
+   * @return 設定どおりにできたかどうか（失敗したら前の設定のまま）
+   */
+  bool applyBaroSettings();
+
+  /**
+   * @brief 取得の周期を取得する（タイマーの周期に使う）
+   * @return 周期（マイクロ秒）
+   */
+  uint32_t getPeriodUs() const { return period_us; }
 
   /**
    * @brief センサータスクを開始する
@@ -43,6 +124,7 @@ class SensorTaskHandler {
 
   /**
    * @brief タイマー割り込みからタスクに通知を送る
+   * 割り込みで取得するモードでは、直近に割り込みが来ていれば何もしない
    * @return 高優先度タスクの切り替えが必要かどうか
    */
   bool notifyFromISR();
@@ -73,14 +155,78 @@ class SensorTaskHandler {
    */
   uint32_t getLaunchTime() const { return condition_checker->getLaunchTime(); }
 
+  /**
+   * @brief センサーからログまでの経路の統計を取得する
+   * @return 統計
+   */
+  PipelineStats getPipelineStats() const;
+
+  /**
+   * @brief 統計とサンプル番号をリセットする（LOGGING開始時に呼ぶ）
+   * 実際のリセットはセンサータスクが次のサンプルを取得する時に行う
+   */
+  void resetPipelineStats() { reset_requested = true; }
+
  private:
   static constexpr const char* TAG = "SENSOR_TASK_HANDLER";
   static constexpr int TASK_STACK_SIZE = 4096;
   static constexpr int TASK_PRIORITY = 5;
   static constexpr int LPS_SAMPLE_DIVIDER =
-      40;  // LPSは25Hzでサンプリング（ICMの1kHzの1/40）
+      40;  // LPSは25Hzでサンプリング（ICMの1kHzの1/40、setBaroRate()で変更）
+  // LPSが新しく変換していなかった時に、読み直す回数の上限
+  static constexpr int LPS_STALE_RETRY_LIMIT = 10;
+  static constexpr int ICM_TEMP_SAMPLE_DIVIDER =
+      100;  // ICMの温度は10Hzで記録（ICMの1kHzの1/100）
+  // ICMの周期（レジスタから読むモードではタイマーの周期）と、遅れとみなす取得間隔
+  static constexpr uint32_t SAMPLE_PERIOD_US = 1000;
+  static constexpr uint32_t LATE_THRESHOLD_US = SAMPLE_PERIOD_US * 3 / 2;
+  // LPSを読み直すまでの間隔（タイマーの揺れで次の周期を飛ばさないよう半周期の余裕を取る）
+  static constexpr int64_t BARO_RETRY_INTERVAL_US = SAMPLE_PERIOD_US / 2;
+  // FIFOの読み出し間隔の範囲（FIFOは1kHzで約128ms分のパケットを溜められる）
+  static constexpr uint32_t MIN_FIFO_PERIOD_MS = 5;
+  static constexpr uint32_t MAX_FIFO_PERIOD_MS = 100;
+  // 割り込みが来ないとみなす時間（取得の周期の倍数）
+  static constexpr uint32_t INTERRUPT_TIMEOUT_PERIODS = 2;
   bool is_servo_open = false;
 
+  // 取得の周期（FIFOモードでは読み出し間隔）
+  uint32_t period_us = SAMPLE_PERIOD_US;
+  gpio_num_t interrupt_pin = GPIO_NUM_NC;
+  // 最後にINT1の割り込みが来た時刻（割り込みで更新し、タイマー割り込みで読む）
+  std::atomic<uint32_t> last_interrupt_us{0};
+
+  // 取得の状態（センサータスクだけが使う）
+  int32_t sample_index = 0;  // LPS・ICMの温度を読む周期を決めるサンプルの通し番号
+  int lps_sample_divider = LPS_SAMPLE_DIVIDER;
+  int baro_retries = -1;  // LPSを読み直している回数（読む予定がなければ-1）
+  int64_t baro_retry_at_us = 0;  // 次にLPSを読み直してよい時刻
+  uint32_t next_seq = 0;
+  int64_t last_timestamp_us = 0;
+  // イベントジャーナルに記録済みかどうか
+  bool launch_recorded = false;
+  bool apogee_recorded = false;
+  bool drop_recorded = false;
+  bool interrupt_missing_recorded = false;
+  // FIFOから読み出したサンプル（FIFOモードの時だけ確保する）
+  SensorData* fifo_batch = nullptr;
+  // キューに入れて読むモードで、次の周期に処理するサンプル
+  bool queued_read = false;
+  bool has_pending_sample = false;
+  SensorData pending_sample = {};
+
+  // センサータスクだけが更新し、他のタスクからは読み出すのみ
+  std::atomic<uint32_t> sample_count{0};
+  std::atomic<uint32_t> dropped_count{0};
+  std::atomic<uint32_t> late_count{0};
+  std::atomic<uint32_t> overrun_count{0};
+  std::atomic<uint32_t> max_interval_us{0};
+  std::atomic<uint32_t> duplicate_count{0};
+  std::atomic<uint32_t> skipped_count{0};
+  // タイマー割り込みでも更新する
+  std::atomic<uint32_t> watchdog_count{0};
+  std::atomic<uint32_t> baro_stale_count{0};
+  std::atomic<bool> reset_requested{true};
+
   TaskHandle_t sensor_task_handle = nullptr;
   Icm::Icm42688* icm = nullptr;
   Lps::Lps25hb* lps = nullptr;
@@ -88,10 +234,73 @@ class SensorTaskHandler {
   ServoController* servo = nullptr;
   SdController* sd_controller = nullptr;
   ConditionChecker* condition_checker = nullptr;
+  EventJournal* journal = nullptr;
 
   /**
    * @brief センサータスク関数
    * @param pvParameters タスクパラメータ
    */
   static void sensorTask(void* pvParameters);
+
+  /**
+   * @brief ICMのINT1の割り込みハンドラ
+   * @param arg SensorTaskHandlerへのポインタ
+   */
+  static void onDataReady(void* arg);
+
+  /**
+   * @brief タスクに通知を送る（割り込みから呼ぶ）
+   * @return 高優先度タスクの切り替えが必要かどうか
+   */
+  bool notifyTaskFromISR();
+
+  /**
+   * @brief サンプル番号と統計をリセットする（LOGGING開始時）
+   */
+  void resetAcquisition();
+
+  /**
+   * @brief タイマー通知1回分、レジスタから1サンプルを取得する
+   * @param notified 溜まっていた通知の数（2以上なら取得できなかった周期がある）
+   */
+  void acquireFromRegisters(uint32_t notified);
+
+  /**
+   * @brief ICMの加速度・角速度を読む（キューに入れるモードでは、転送中に前のサンプルを処理する）
+   * @param data 読んだ値と時刻を入れるサンプル
+   * @param data_ready 新しいサンプルだったかどうか
+   */
+  void readAccelAndGyro(SensorData* data, bool* data_ready);
+
+  /**
+   * @brief LPSを読む周期なら気圧・温度を読み、サンプルに入れる
+   * LPSがまだ新しく変換していなければ記録せず、ICMの約1周期後（時刻で判断する）の
+   * サンプルで読み直す
+   * @param data 気圧・温度を入れるサンプル
+   */
+  void readBaro(SensorData* data);
+
+  /**
+   * @brief タイマー通知1回分、FIFOに溜まったサンプルをすべて取得する
+   */
+  void acquireFromFifo();
+
+  /**
+   * @brief 取得した1サンプルで離床・頂点を判定し、ログへ送り、サーボを制御する
+   * @param data サンプル（seqと、あれば気圧・ICMの温度を設定済みのもの）
+   */
+  void processSample(const SensorData& data);
+
+  /**
+   * @brief イベントジャーナルに記録する（ジャーナルがなければ何もしない）
+   */
+  void recordEvent(LogFormat::EventType type, uint8_t detail = 0,
+                   int32_t value0 = 0, int32_t value1 = 0);
+
+  /**
+   * @brief 離床・頂点を検知した条件と値をイベントジャーナルに記録する
+   * @param type LAUNCHまたはAPOGEE
+   * @param info 検知した条件と値
+   */
+  void recordDetection(LogFormat::EventType type, const DetectionInfo& info);
 };
@@ -1,6 +1,10 @@
 #include "sensor_task_handler.hpp"
 
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
 
 SensorTaskHandler::SensorTaskHandler()
     : sensor_task_handle(nullptr),
@@ -13,12 +17,14 @@ SensorTaskHandler::SensorTaskHandler()
 SensorTaskHandler::~SensorTaskHandler() {
   // タスクの停止
   stopTask();
+  delete[] fifo_batch;
 }
 
 bool SensorTaskHandler::init(Icm::Icm42688* icm_ptr, Lps::Lps25hb* lps_ptr,
                              LogTaskHandler* log_handler_ptr,
                              ServoController* servo_ptr,
-                             SdController* sd_controller_ptr) {
+                             SdController* sd_controller_ptr,
+                             EventJournal* journal_ptr) {
   if (icm_ptr == nullptr) {
     ESP_LOGE(TAG, "ICM pointer is null");
     return false;
@@ -49,6 +55,7 @@ bool SensorTaskHandler::init(Icm::Icm42688* icm_ptr, Lps::Lps25hb* lps_ptr,
   log_handler = log_handler_ptr;
   servo = servo_ptr;
   sd_controller = sd_controller_ptr;
+  journal = journal_ptr;
 
   // ConditionCheckerの初期化
   condition_checker = new ConditionChecker();
@@ -60,6 +67,144 @@ bool SensorTaskHandler::init(Icm::Icm42688* icm_ptr, Lps::Lps25hb* lps_ptr,
   return true;
 }
 
+bool SensorTaskHandler::enableFifo(uint32_t period_ms) {
+  if (icm == nullptr) {
+    ESP_LOGE(TAG, "Not initialized");
+    return false;
+  }
+  if (period_ms < MIN_FIFO_PERIOD_MS || period_ms > MAX_FIFO_PERIOD_MS) {
+    ESP_LOGE(TAG, "Invalid FIFO period: %lu ms", (unsigned long)period_ms);
+    return false;
+  }
+  if (!icm->beginFifo()) {
+    return false;
+  }
+  // FIFOに入りうる最大の数を受け取れるようにする
+  fifo_batch = new SensorData[Icm::Icm42688Config::Fifo::MAX_PACKETS];
+  period_us = period_ms * 1000;
+  ESP_LOGI(TAG, "FIFO mode enabled (read every %lu ms)",
+           (unsigned long)period_ms);
+  return true;
+}
+
+bool SensorTaskHandler::enableQueuedRead() {
+  if (icm == nullptr) {
+    ESP_LOGE(TAG, "Not initialized");
+    return false;
+  }
+  if (isFifoMode()) {
+    // FIFOはまとめて1回で読むので、キューに入れても重ねられる処理がない
+    ESP_LOGW(TAG, "Queued read is not used in FIFO mode");
+    return false;
+  }
+  queued_read = true;
+  ESP_LOGI(TAG, "Queued read enabled (samples are processed one period late)");
+  return true;
+}
+
+void SensorTaskHandler::setBaroRate(uint32_t odr_mhz) {
+  if (odr_mhz == 0) {
+    return;
+  }
+  // ODRの周期ごと（ICMのサンプル数）に読む。新しい変換が遅れた分は読み直しで拾う
+  // 周期がICMの周期で割り切れない時は切り上げる（切り捨てると変換より先に読み続ける）
+  uint64_t odr_period_us = 1000000000ULL / odr_mhz;
+  lps_sample_divider = std::max<int>(
+      1, (odr_period_us + SAMPLE_PERIOD_US - 1) / SAMPLE_PERIOD_US);
+  ESP_LOGI(TAG, "Reading LPS every %d samples", lps_sample_divider);
+}
+
+bool SensorTaskHandler::applyBaroSettings() {
+  if (lps == nullptr || sd_controller == nullptr) {
+    return false;
+  }
+  Lps::Lps25hbSettings current = lps->getSettings();
+  Lps::Lps25hbSettings next = current;
+  next.odr_mhz = lroundf(
+      strtof(sd_controller->getStringSetting("lps_odr", "25").c_str(),
+             nullptr) *
+      1000);
+  next.pressure_avg = sd_controller->getIntSetting("lps_pressure_avg", 32);
+  next.temp_avg = sd_controller->getIntSetting("lps_temp_avg", 16);
+  next.fifo_mean = sd_controller->getIntSetting("lps_fifo_mean", 0);
+
+  // 変わっていなければLPSには書き込まない
+  bool success = true;
+  if (next.odr_mhz != current.odr_mhz ||
+      next.pressure_avg != current.pressure_avg ||
+      next.temp_avg != current.temp_avg ||
+      next.fifo_mean != current.fifo_mean) {
+    success = lps->configure(next);
+    if (!success) {
+      ESP_LOGW(TAG, "Failed to configure LPS25HB, keeping previous settings");
+    }
+  }
+
+  const Lps::Lps25hbSettings& applied = lps->getSettings();
+  setBaroRate(applied.odr_mhz);
+  condition_checker->setPressureRate(applied.odr_mhz);
+
+  // 判定にかかる時間（最初の平均+回数分の平均）と、FIFOの移動平均による遅れを表示する
+  ConditionConfig::PressureDetection detection =
+      condition_checker->getPressureDetection();
+  uint32_t detect_ms = detection.window_ms * (detection.launch_count + 1);
+  uint32_t mean_lag_ms =
+      applied.fifo_mean > 1
+          ? (uint64_t)(applied.fifo_mean - 1) * 500000 / applied.odr_mhz
+          : 0;
+  ESP_LOGI(TAG, "Pressure detection takes about %lu ms (+%lu ms FIFO mean lag)",
+           (unsigned long)detect_ms, (unsigned long)mean_lag_ms);
+  if (detect_ms + mean_lag_ms >=
+      ConditionConfig::TIME_THRESHOLD_FOR_APOGEE_FROM_LAUNCH) {
+    ESP_LOGW(TAG, "Pressure apogee detection is slower than the %lu ms timer",
+             (unsigned long)ConditionConfig::TIME_THRESHOLD_FOR_APOGEE_FROM_LAUNCH);
+  }
+  return success;
+}
+
+bool SensorTaskHandler::enableInterrupt(gpio_num_t pin) {
+  if (icm == nullptr) {
+    ESP_LOGE(TAG, "Not initialized");
+    return false;
+  }
+  if (pin == GPIO_NUM_NC) {
+    ESP_LOGW(TAG, "ICM INT1 is not connected, acquiring by timer");
+    return false;
+  }
+
+  // FIFOモードでは読み出し間隔分のパケットが溜まったら割り込む
+  uint16_t watermark = period_us / Icm::Icm42688Config::ODR_PERIOD_US;
+  if (!icm->enableInterrupt(watermark)) {
+    return false;
+  }
+
+  gpio_config_t io_conf = {};
+  io_conf.pin_bit_mask = 1ULL << pin;
+  io_conf.mode = GPIO_MODE_INPUT;
+  io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+  io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;  // ICMがプッシュプルで駆動する
+  io_conf.intr_type = GPIO_INTR_POSEDGE;
+  if (gpio_config(&io_conf) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to configure INT1 pin");
+    return false;
+  }
+  // 他のコンポーネントが既にインストールしていればそれを使う
+  esp_err_t err = gpio_install_isr_service(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(TAG, "Failed to install GPIO ISR service");
+    return false;
+  }
+  if (gpio_isr_handler_add(pin, onDataReady, this) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to add INT1 handler");
+    return false;
+  }
+
+  last_interrupt_us = (uint32_t)esp_timer_get_time();
+  interrupt_pin = pin;
+  ESP_LOGI(TAG, "Interrupt mode enabled (INT1 on GPIO %d)", (int)pin);
+  return true;
+}
+
 void SensorTaskHandler::startTask() {
   // タスクが既に存在する場合は、状態をチェックして適切に処理
   if (sensor_task_handle != nullptr) {
@@ -118,7 +263,69 @@ void SensorTaskHandler::stopTask() {
   ESP_LOGI(TAG, "Sensor task stopped");
 }
 
-bool SensorTaskHandler::notifyFromISR() {
+PipelineStats SensorTaskHandler::getPipelineStats() const {
+  PipelineStats stats;
+  stats.samples = sample_count;
+  stats.dropped = dropped_count;
+  stats.late = late_count;
+  stats.overrun = overrun_count;
+  stats.max_interval_us = max_interval_us;
+  stats.duplicate = duplicate_count;
+  stats.skipped = skipped_count;
+  stats.watchdog = watchdog_count;
+  stats.baro_stale = baro_stale_count;
+  return stats;
+}
+
+void SensorTaskHandler::recordEvent(LogFormat::EventType type, uint8_t detail,
+                                    int32_t value0, int32_t value1) {
+  if (journal != nullptr) {
+    journal->record(type, detail, value0, value1);
+  }
+}
+
+void SensorTaskHandler::recordDetection(LogFormat::EventType type,
+                                        const DetectionInfo& info) {
+  int32_t value0 = 0;
+  int32_t value1 = 0;
+  switch (info.source) {
+    case LogFormat::EventSource::ACCEL:
+      value0 = lroundf(info.value * LogFormat::EVENT_ACCEL_SQUARE_SCALE);
+      break;
+    case LogFormat::EventSource::PRESSURE:
+      value0 = lroundf(info.value * LogFormat::EVENT_PRESSURE_SCALE);
+      value1 = lroundf(info.delta * LogFormat::EVENT_PRESSURE_SCALE);
+      break;
+    default:
+      value0 = lroundf(info.value);
+      break;
+  }
+  recordEvent(type, static_cast<uint8_t>(info.source), value0, value1);
+}
+
+bool IRAM_ATTR SensorTaskHandler::notifyFromISR() {
+  if (isInterruptMode()) {
+    // 割り込みが来ていれば、タイマーでは取得しない
+    uint32_t elapsed_us = (uint32_t)esp_timer_get_time() -
+                          last_interrupt_us.load(std::memory_order_relaxed);
+    if (elapsed_us < period_us * INTERRUPT_TIMEOUT_PERIODS) {
+      return false;
+    }
+    watchdog_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  return notifyTaskFromISR();
+}
+
+void IRAM_ATTR SensorTaskHandler::onDataReady(void* arg) {
+  SensorTaskHandler* self = static_cast<SensorTaskHandler*>(arg);
+  self->last_interrupt_us.store((uint32_t)esp_timer_get_time(),
+                                std::memory_order_relaxed);
+  if (self->notifyTaskFromISR()) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+bool IRAM_ATTR SensorTaskHandler::notifyTaskFromISR() {
   if (sensor_task_handle == nullptr) {
     return false;
   }
@@ -146,63 +353,293 @@ void SensorTaskHandler::sensorTask(void* pvParameters) {
     return;
   }
 
-  int32_t count = 0;
-  AccelData accel;
-  GyroData gyro;
-  PressureData pressure;
-  TempData temperature;
-
   while (true) {
-    // タイマー割り込みからの通知を待つ
-    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-
-    // センサーからデータを取得する
-    // ICMは1kHz（タイマーも1kHz）でデータを取得する
-    self->icm->getAccelAndGyro(&accel, &gyro);
-
-    // 加速度データを使用して離床検知
-    float accel_x = (int16_t)(accel.u_x << 8 | accel.d_x) / 32768.0f *
-                    16.0f;  // ±16gレンジを仮定
-    float accel_y = (int16_t)(accel.u_y << 8 | accel.d_y) / 32768.0f * 16.0f;
-    float accel_z = (int16_t)(accel.u_z << 8 | accel.d_z) / 32768.0f * 16.0f;
-    self->condition_checker->checkLaunchByAccel(accel_x, accel_y, accel_z);
-
-    // タイマーによる頂点検知
-    self->condition_checker->checkApogeeByTimer();
-
-    // LPSは25Hzでデータを取得する（40回に1回）
-    if (count % SensorTaskHandler::LPS_SAMPLE_DIVIDER == 0) {
-      self->lps->getPressureAndTemp(&pressure, &temperature);
-
-      // 気圧データを使用して離床検知と頂点検知
-      float pressure_value =
-          (pressure.h_p << 16) | (pressure.l_p << 8) | pressure.xl_p;
-      self->condition_checker->checkLaunchByPressure(pressure_value / 4096.0f);
-      self->condition_checker->checkApogeeByPressure(pressure_value / 4096.0f);
+    // INT1またはタイマー割り込みからの通知を待つ
+    uint32_t notified = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (self->reset_requested.exchange(false)) {
+      // 停止中に溜まった通知は数えない
+      self->resetAcquisition();
+      notified = 1;
     }
 
-    // ログタスクにデータを送信する
-    SensorData data;
-    data.timestamp_us = esp_timer_get_time();
-    data.accel = accel;
-    data.gyro = gyro;
-    data.pressure = pressure;
-    data.temperature = temperature;
-    self->log_handler->sendToQueue(data);
-
-    count++;
-
-    // サーボの制御
-    if (self->is_servo_open == false &&
-        self->condition_checker->getHasReachedApogee()) {
-      int open_angle = self->sd_controller->getIntSetting("open-angle", 10);
-      self->servo->openServo(open_angle);
-      self->is_servo_open = true;
-    } else if (self->is_servo_open == true &&
-               !self->condition_checker->getHasReachedApogee()) {
-      int close_angle = self->sd_controller->getIntSetting("close-angle", 10);
-      self->servo->closeServo(close_angle);
-      self->is_servo_open = false;
+    if (self->isFifoMode()) {
+      self->acquireFromFifo();
+    } else {
+      self->acquireFromRegisters(notified);
     }
+
+    // 割り込みが来なくなったことを1回だけ記録する
+    if (self->isInterruptMode() && !self->interrupt_missing_recorded &&
+        self->watchdog_count > 0) {
+      self->recordEvent(
+          LogFormat::EventType::ERROR,
+          static_cast<uint8_t>(LogFormat::EventError::SENSOR_INTERRUPT_MISSING),
+          self->next_seq);
+      self->interrupt_missing_recorded = true;
+    }
+  }
+}
+
+void SensorTaskHandler::resetAcquisition() {
+  next_seq = 0;
+  last_timestamp_us = 0;
+  sample_count = 0;
+  dropped_count = 0;
+  late_count = 0;
+  overrun_count = 0;
+  max_interval_us = 0;
+  duplicate_count = 0;
+  skipped_count = 0;
+  watchdog_count = 0;
+  baro_stale_count = 0;
+  drop_recorded = false;
+  interrupt_missing_recorded = false;
+  // 新しいログにも離床・頂点の検知を記録し直す（検知済みなら最初のサンプルで記録される）
+  launch_recorded = false;
+  apogee_recorded = false;
+  // 設定が変わっていれば、LPSの出力データレートと平均を設定し直す
+  // （センサータスクの中で行うので、LPSの読み出しと重ならない）
+  applyBaroSettings();
+  // 停止前に読んだサンプルは前回のロギングのものなので捨てる
+  has_pending_sample = false;
+  // 停止中に溜まった（溢れた）FIFOの中身は捨てる
+  if (isFifoMode()) {
+    icm->flushFifo();
+  }
+}
+
+void SensorTaskHandler::acquireFromRegisters(uint32_t notified) {
+  if (notified > 1) {
+    // 処理が間に合わず、取得できなかった周期がある
+    overrun_count += notified - 1;
+    next_seq += notified - 1;
+    // データレディの割り込み1回がICMの1サンプルなので、その分を読まずに上書きされた
+    if (isInterruptMode()) {
+      skipped_count += notified - 1;
+    }
+  }
+
+  // センサーからデータを取得する
+  // ICMは1kHz（タイマーも1kHz）でデータを取得する
+  // 各値の時刻は、それぞれのセンサーを読んだ直後に記録する
+  SensorData data = {};
+  data.seq = next_seq++;
+  bool data_ready = true;
+  readAccelAndGyro(&data, &data_ready);
+  // 前回読んだ後にICMが更新していなければ、同じサンプルを二重に読んでいる
+  // （タイマーとICMのクロックがずれると起きる）
+  if (!data_ready) {
+    duplicate_count++;
+  }
+
+  // LPSは25Hzでデータを取得する（40回に1回）
+  // 取得した周期だけ気圧レコードを記録する（1kHzの各行に複製しない）
+  readBaro(&data);
+
+  // ICMの温度は変化が遅いので10Hzで記録する
+  if (sample_index % ICM_TEMP_SAMPLE_DIVIDER == 0 &&
+      icm->getTemp(&data.icm_temp)) {
+    data.icm_temp_timestamp_us = esp_timer_get_time();
+    data.flags |= SENSOR_DATA_HAS_ICM_TEMP;
+  }
+
+  if (queued_read) {
+    // 次の周期でICMを読んでいる間に処理する
+    pending_sample = data;
+    has_pending_sample = true;
+  } else {
+    processSample(data);
+  }
+}
+
+void SensorTaskHandler::readAccelAndGyro(SensorData* data, bool* data_ready) {
+  if (!queued_read || !icm->startAccelAndGyro()) {
+    icm->getAccelAndGyro(&data->accel, &data->gyro, data_ready);
+    data->timestamp_us = esp_timer_get_time();
+    if (has_pending_sample) {
+      processSample(pending_sample);
+      has_pending_sample = false;
+    }
+    return;
+  }
+
+  // 転送中に前の周期のサンプルを処理する（判定・ログへの送信・サーボはSPIを使わない）
+  if (has_pending_sample) {
+    processSample(pending_sample);
+    has_pending_sample = false;
+  }
+  // 時刻は転送が終わった時（SPIの割り込み）のもの
+  int64_t done_us = 0;
+  if (icm->finishAccelAndGyro(&data->accel, &data->gyro, data_ready,
+                              &done_us)) {
+    data->timestamp_us = done_us;
+  } else {
+    data->timestamp_us = esp_timer_get_time();
+  }
+}
+
+void SensorTaskHandler::readBaro(SensorData* data) {
+  if (sample_index % lps_sample_divider == 0) {
+    baro_retries = 0;
+  }
+  if (baro_retries < 0) {
+    return;
+  }
+  // 読み直しは前に読んでから実際に時間が経ってから行う
+  // （FIFOモードでは1バッチのサンプルを続けて処理するので、同じバッチでは読み直さない）
+  int64_t now_us = esp_timer_get_time();
+  if (baro_retries > 0 && now_us < baro_retry_at_us) {
+    return;
+  }
+
+  bool fresh = false;
+  if (!lps->getPressureAndTemp(&data->pressure, &data->temperature, &fresh)) {
+    baro_retries = -1;
+    return;
+  }
+  if (!fresh) {
+    // 前回と同じ変換の値なので記録しない（LPSの25HzとICMのクロックのずれで起きる）
+    baro_stale_count++;
+    if (++baro_retries > LPS_STALE_RETRY_LIMIT) {
+      baro_retries = -1;
+    } else {
+      baro_retry_at_us = now_us + BARO_RETRY_INTERVAL_US;
+    }
+    return;
+  }
+  data->baro_timestamp_us = esp_timer_get_time();
+  data->flags |= SENSOR_DATA_HAS_BARO;
+  baro_retries = -1;
+}
+
+void SensorTaskHandler::acquireFromFifo() {
+  Icm::FifoReadResult result;
+  int count = icm->readFifo(fifo_batch, Icm::Icm42688Config::Fifo::MAX_PACKETS,
+                            &result);
+  if (count <= 0) {
+    return;
+  }
+  // ICMが付けた時刻の間隔から、同じ・抜けたサンプルを数える
+  duplicate_count += result.duplicate;
+  skipped_count += result.skipped;
+
+  for (int i = 0; i < count; i++) {
+    SensorData& data = fifo_batch[i];
+
+    // FIFOのサンプルはセンサーの時刻を持つので、間隔が空いていれば
+    // その分のサンプルが失われている。seqはその分だけ進める
+    // 抜けた数はドライバーがskippedとして数えるが、溢れた直後のパケットの
+    // 前の間隔（時刻の対応付けをやり直した所）だけは数えないので、overrunとする
+    if (last_timestamp_us != 0) {
+      int64_t interval_us = (int64_t)data.timestamp_us - last_timestamp_us;
+      if (interval_us > (int64_t)LATE_THRESHOLD_US) {
+        uint32_t missing =
+            (interval_us + SAMPLE_PERIOD_US / 2) / SAMPLE_PERIOD_US - 1;
+        if (result.overflowed && i == 0) {
+          overrun_count += missing;
+        }
+        next_seq += missing;
+      }
+    }
+    data.seq = next_seq++;
+
+    // LPSはこのサンプルを処理する時に読む（FIFOに溜まるのはICMのデータだけ）
+    readBaro(&data);
+
+    // ICMの温度はFIFOのパケットに含まれている
+    if (sample_index % ICM_TEMP_SAMPLE_DIVIDER == 0) {
+      data.icm_temp_timestamp_us = data.timestamp_us;
+      data.flags |= SENSOR_DATA_HAS_ICM_TEMP;
+    }
+
+    processSample(data);
+  }
+}
+
+void SensorTaskHandler::processSample(const SensorData& data) {
+  // 加速度データを使用して離床検知
+  const AccelData& accel = data.accel;
+  float accel_x = (int16_t)(accel.u_x << 8 | accel.d_x) / 32768.0f *
+                  16.0f;  // ±16gレンジを仮定
+  float accel_y = (int16_t)(accel.u_y << 8 | accel.d_y) / 32768.0f * 16.0f;
+  float accel_z = (int16_t)(accel.u_z << 8 | accel.d_z) / 32768.0f * 16.0f;
+  condition_checker->checkLaunchByAccel(accel_x, accel_y, accel_z);
+
+  // タイマーによる頂点検知
+  condition_checker->checkApogeeByTimer();
+
+  // 気圧データを使用して離床検知と頂点検知
+  if (data.flags & SENSOR_DATA_HAS_BARO) {
+    const PressureData& pressure = data.pressure;
+    float pressure_value =
+        (pressure.h_p << 16) | (pressure.l_p << 8) | pressure.xl_p;
+    condition_checker->checkLaunchByPressure(pressure_value / 4096.0f);
+    condition_checker->checkApogeeByPressure(pressure_value / 4096.0f);
+  }
+
+  // 離床を検知したらログタスクに知らせる（プリトリガモードの記録開始）
+  if (condition_checker->getIsLaunched()) {
+    log_handler->trigger();
+    if (!launch_recorded) {
+      recordDetection(LogFormat::EventType::LAUNCH,
+                      condition_checker->getLaunchInfo());
+      launch_recorded = true;
+    }
+  }
+
+  // ログタスクにデータを送信する
+  if (!log_handler->sendToQueue(data)) {
+    // リングバッファが満杯（SDカードへの書き込みが追いついていない）
+    dropped_count++;
+    if (!drop_recorded) {
+      recordEvent(
+          LogFormat::EventType::ERROR,
+          static_cast<uint8_t>(LogFormat::EventError::SAMPLES_DROPPED),
+          data.seq);
+      drop_recorded = true;
+    }
+  }
+  sample_count++;
+
+  // 前回の取得からの間隔を確認する
+  // （FIFOモードの間隔はICMの時刻なので、空いた分はskipped・overrunに数える）
+  if (last_timestamp_us != 0) {
+    uint32_t interval_us = data.timestamp_us - last_timestamp_us;
+    if (interval_us > LATE_THRESHOLD_US && !isFifoMode()) {
+      late_count++;
+    }
+    if (interval_us > max_interval_us) {
+      max_interval_us = interval_us;
+    }
+  }
+  last_timestamp_us = data.timestamp_us;
+
+  sample_index++;
+
+  // サーボの制御
+  if (!apogee_recorded && condition_checker->getHasReachedApogee()) {
+    recordDetection(LogFormat::EventType::APOGEE,
+                    condition_checker->getApogeeInfo());
+    apogee_recorded = true;
+  }
+  if (is_servo_open == false && condition_checker->getHasReachedApogee()) {
+    // 設定は番号で読み出す（文字列の比較やロックをしない）
+    int open_angle = sd_controller->getIntSetting(SettingKey::OPEN_ANGLE);
+    servo->openServo(open_angle);
+    is_servo_open = true;
+    recordEvent(LogFormat::EventType::SERVO,
+                static_cast<uint8_t>(LogFormat::ServoAction::OPEN),
+                open_angle);
+    // 頂点までのデータをSDカードへ同期させる
+    log_handler->requestSync();
+  } else if (is_servo_open == true &&
+             !condition_checker->getHasReachedApogee()) {
+    int close_angle = sd_controller->getIntSetting(SettingKey::CLOSE_ANGLE);
+    servo->closeServo(close_angle);
+    is_servo_open = false;
+    recordEvent(LogFormat::EventType::SERVO,
+                static_cast<uint8_t>(LogFormat::ServoAction::CLOSE),
+                close_angle);
   }
 }
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sd_controller.hpp"
+
+/**
+ * @brief 設定の保存1回分の結果
+ */
+struct SettingsSaveResult {
+  uint32_t generation;  // 保存した（または保存できなかった）要求の番号
+  bool durable;         // 設定ファイルへの書き込みと同期まで完了したかどうか
+  uint8_t attempts;     // 書き込みを試みた回数
+  uint32_t elapsed_ms;  // 最初の試行から完了（または断念）までの時間
+};
+
+/**
+ * @brief 設定の保存をバックグラウンドで行う
+ *
+ * requestSave()は要求の番号を進めてタスクに通知するだけなので、コマンドタスクや
+ * モード遷移の処理を止めない。保存タスクは少し待ってから、その時点の設定を
+ * まとめて1回だけ書き込む（待つ間に来た要求は同じ書き込みに含める）
+ * 書き込みは SdController::saveSettings()（変わった設定をジャーナルに追記して同期する）で行い、
+ * 失敗した場合は間隔を空けて再試行する
+ * 完了すると、含めた要求のうち最新の番号をdurable（保存済み）とし、コールバックで知らせる
+ */
+class SettingsWriter {
+ public:
+  using DoneCallback = std::function<void(const SettingsSaveResult& result)>;
+
+  SettingsWriter();
+  ~SettingsWriter();
+
+  /**
+   * @brief 保存タスクを開始する
+   * @param sd_controller SDカードコントローラへのポインタ
+   * @return 初期化が成功したかどうか
+   */
+  bool init(SdController* sd_controller);
+
+  /**
+   * @brief 保存が終わった時（失敗して断念した時も）に呼ぶ関数を設定する
+   * 保存タスクから呼ばれるので、待つ処理は行わないこと
+   * @param callback 関数
+   */
+  void setDoneCallback(DoneCallback callback) { done_callback = callback; }
+
+  /**
+   * @brief 現在の設定の保存を要求する（どのタスクからも呼べる、待たない）
+   * 設定を変更してから呼ぶ
+   * @return 要求の番号（getDurableGeneration()がこれ以上になれば保存済み）
+   */
+  uint32_t requestSave();
+
+  /**
+   * @brief 要求した最新の番号を取得する
+   */
+  uint32_t getRequestedGeneration() const {
+    return requested_generation.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief 保存済みの最新の番号を取得する
+   */
+  uint32_t getDurableGeneration() const {
+    return durable_generation.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief まだ保存していない要求があるかどうか
+   */
+  bool isPending() const {
+    return getDurableGeneration() != getRequestedGeneration();
+  }
+
+ private:
+  static constexpr const char* TAG = "SETTINGS_WRITER";
+  static constexpr int TASK_STACK_SIZE = 6144;  // cJSONの生成とファイル操作を行う
+  // ログの書き込み・イベントジャーナルより低くし、飛行中のデータを優先する
+  static constexpr int TASK_PRIORITY = 2;
+  // 要求を受けてから書き込むまで待つ時間（続けて来る要求をまとめる）
+  static constexpr int COALESCE_MS = 50;
+  // 書き込みの試行回数と、再試行までの時間（回数ごとに増やす）
+  static constexpr int MAX_ATTEMPTS = 3;
+  static constexpr int RETRY_DELAY_MS = 500;
+
+  SdController* sd_controller = nullptr;
+  TaskHandle_t task_handle = nullptr;
+  DoneCallback done_callback;
+  std::atomic<uint32_t> requested_generation{0};
+  std::atomic<uint32_t> durable_generation{0};
+
+  /**
+   * @brief 保存タスク関数
+   * @param pvParameters タスクパラメータ
+   */
+  static void writerTask(void* pvParameters);
+
+  /**
+   * @brief 要求をまとめて1回保存する（再試行を含む）
+   * @param generation 含める要求のうち最新の番号
+   * @return 結果
+   */
+  SettingsSaveResult save(uint32_t generation);
+};
@@ -0,0 +1,103 @@
+#include "settings_writer.hpp"
+
+SettingsWriter::SettingsWriter() {}
+
+SettingsWriter::~SettingsWriter() {
+  if (task_handle != nullptr) {
+    vTaskDelete(task_handle);
+    task_handle = nullptr;
+  }
+}
+
+bool SettingsWriter::init(SdController* sd_controller) {
+  if (sd_controller == nullptr) {
+    ESP_LOGE(TAG, "SD controller pointer is null");
+    return false;
+  }
+  if (task_handle != nullptr) {
+    ESP_LOGW(TAG, "Settings writer already started");
+    return true;
+  }
+  this->sd_controller = sd_controller;
+
+  BaseType_t result =
+      xTaskCreate(writerTask, "settings_writer_task", TASK_STACK_SIZE, this,
+                  TASK_PRIORITY, &task_handle);
+  if (result != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create settings writer task");
+    task_handle = nullptr;
+    return false;
+  }
+  return true;
+}
+
+uint32_t SettingsWriter::requestSave() {
+  uint32_t generation =
+      requested_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+  if (task_handle != nullptr) {
+    xTaskNotifyGive(task_handle);
+  } else {
+    ESP_LOGW(TAG, "Settings writer not started, save request %lu is pending",
+             (unsigned long)generation);
+  }
+  return generation;
+}
+
+void SettingsWriter::writerTask(void* pvParameters) {
+  SettingsWriter* self = static_cast<SettingsWriter*>(pvParameters);
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // 保存中に来た要求は、次の周回でまとめて保存する
+    while (self->isPending()) {
+      vTaskDelay(pdMS_TO_TICKS(COALESCE_MS));
+      // 待つ間に来た通知はこの書き込みに含まれるので消しておく
+      ulTaskNotifyTake(pdTRUE, 0);
+      uint32_t generation = self->getRequestedGeneration();
+
+      SettingsSaveResult result = self->save(generation);
+      if (result.durable) {
+        self->durable_generation.store(generation, std::memory_order_release);
+      }
+      if (self->done_callback) {
+        self->done_callback(result);
+      }
+      if (!result.durable) {
+        // 断念した要求は、次の要求が来た時にまとめて保存し直す
+        break;
+      }
+    }
+  }
+}
+
+SettingsSaveResult SettingsWriter::save(uint32_t generation) {
+  SettingsSaveResult result = {};
+  result.generation = generation;
+  int64_t start_us = esp_timer_get_time();
+
+  while (result.attempts < MAX_ATTEMPTS && !result.durable) {
+    if (result.attempts > 0) {
+      ESP_LOGI(TAG, "Retrying settings save (attempt %d/%d)...",
+               result.attempts + 1, MAX_ATTEMPTS);
+      // 待機時間を徐々に増やす
+      vTaskDelay(pdMS_TO_TICKS(RETRY_DELAY_MS * result.attempts));
+    }
+    result.attempts++;
+    result.durable = sd_controller->saveSettings();
+    if (!result.durable) {
+      ESP_LOGW(TAG, "Failed to save settings (attempt %d/%d)",
+               result.attempts, MAX_ATTEMPTS);
+    }
+  }
+
+  result.elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+  if (result.durable) {
+    ESP_LOGI(TAG, "Settings durable (request %lu, %lu ms)",
+             (unsigned long)generation, (unsigned long)result.elapsed_ms);
+  } else {
+    ESP_LOGE(TAG, "Failed to save settings after %d attempts (request %lu)",
+             MAX_ATTEMPTS, (unsigned long)generation);
+  }
+  return result;
+}
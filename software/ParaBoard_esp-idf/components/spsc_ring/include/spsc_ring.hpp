@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+/**
+ * @brief 1対1(書き込み1タスク、読み出し1タスク)専用のロックフリーなリングバッファ
+ *
+ * 書き込み側はpush()、読み出し側はpop()だけを呼ぶ。
+ * カーネルのクリティカルセクションを通らないため、1kHzで呼んでも負荷が小さい。
+ * 読み出し側を起こす仕組みは持たないので、呼び出し側でタスク通知などを使う。
+ * ESP-IDF以外ではmalloc()で確保するため、ホストでも同じコードを動かせる
+ *
+ * @tparam T 格納する型（memcpyでコピーできる型）
+ */
+template <typename T>
+class SpscRing {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SpscRing requires a trivially copyable type");
+
+ public:
+  /** 書き込み位置と読み出し位置を別のキャッシュラインに置く */
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  SpscRing() {}
+  ~SpscRing() { release(); }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  /**
+   * @brief バッファを確保する
+   * @param requested_capacity 格納できる要素数（2の累乗に切り上げる）
+   * @param prefer_psram PSRAMを優先して確保するか（確保できなければ内部RAM）
+   * @return 確保に成功したかどうか
+   */
+  bool init(size_t requested_capacity, bool prefer_psram = true) {
+    release();
+    if (requested_capacity < 2) {
+      requested_capacity = 2;
+    }
+    size_t new_capacity = 1;
+    while (new_capacity < requested_capacity) {
+      new_capacity <<= 1;
+    }
+
+    buffer = allocate(new_capacity * sizeof(T), prefer_psram);
+    if (buffer == nullptr) {
+      return false;
+    }
+    capacity_mask = new_capacity - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief 要素を追加する（書き込み側のみ）
+   * @return 追加できたかどうか（満杯ならfalse）
+   */
+  bool push(const T& item) {
+    size_t current_head = head.load(std::memory_order_relaxed);
+    if (current_head - tail.load(std::memory_order_acquire) > capacity_mask) {
+      return false;
+    }
+    buffer[current_head & capacity_mask] = item;
+    head.store(current_head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief 要素を取り出す（読み出し側のみ）
+   * @return 取り出せたかどうか（空ならfalse）
+   */
+  bool pop(T* item) {
+    size_t current_tail = tail.load(std::memory_order_relaxed);
+    if (current_tail == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = buffer[current_tail & capacity_mask];
+    tail.store(current_tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief 溜まっている要素をまとめて取り出す（読み出し側のみ）
+   * @param items 取り出し先（max_count個分の領域）
+   * @param max_count 取り出す最大数
+   * @return 取り出した数
+   */
+  size_t popBatch(T* items, size_t max_count) {
+    size_t current_tail = tail.load(std::memory_order_relaxed);
+    size_t available = head.load(std::memory_order_acquire) - current_tail;
+    size_t count = available < max_count ? available : max_count;
+    if (count == 0) {
+      return 0;
+    }
+
+    // 末尾で折り返す場合は2回に分けてコピーする
+    size_t first = current_tail & capacity_mask;
+    size_t first_count = capacity_mask + 1 - first;
+    if (first_count > count) first_count = count;
+    memcpy(items, buffer + first, first_count * sizeof(T));
+    memcpy(items + first_count, buffer, (count - first_count) * sizeof(T));
+    tail.store(current_tail + count, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * @brief 溜まっている要素を全て捨てる（読み出し側のみ）
+   */
+  void clear() {
+    tail.store(head.load(std::memory_order_acquire),
+               std::memory_order_release);
+  }
+
+  /**
+   * @brief 溜まっている要素数を取得する（どちらからでも呼べるが目安の値）
+   */
+  size_t size() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return buffer ? capacity_mask + 1 : 0; }
+  bool isPsram() const { return in_psram; }
+
+ private:
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};  // 書き込み側が更新
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};  // 読み出し側が更新
+  alignas(CACHE_LINE_SIZE) T* buffer = nullptr;
+  size_t capacity_mask = 0;
+  bool in_psram = false;
+
+  T* allocate(size_t size, bool prefer_psram) {
+#ifdef ESP_PLATFORM
+    void* memory = nullptr;
+    if (prefer_psram) {
+      memory = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      in_psram = memory != nullptr;
+    }
+    if (memory == nullptr) {
+      memory = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return static_cast<T*>(memory);
+#else
+    (void)prefer_psram;
+    in_psram = false;
+    return static_cast<T*>(malloc(size));
+#endif
+  }
+
+  void release() {
+    if (buffer == nullptr) return;
+#ifdef ESP_PLATFORM
+    heap_caps_free(buffer);
+#else
+    free(buffer);
+#endif
+    buffer = nullptr;
+    capacity_mask = 0;
+    in_psram = false;
+  }
+};
@@ -1,15 +1,19 @@
 #include <fcntl.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "CanComm.hpp"
 #include "command_handler.hpp"
 #include "config.hpp"
 #include "create_spi.hpp"
 #include "driver/usb_serial_jtag.h"
+#include "esp_system.h"
 #include "esp_timer.h"
 #include "esp_vfs_dev.h"
 #include "esp_vfs_usb_serial_jtag.h"
+#include "event_journal.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
@@ -21,6 +25,7 @@
 #include "sd_controller.hpp"
 #include "sensor_task_handler.hpp"
 #include "servo_controller.hpp"
+#include "settings_writer.hpp"
 
 TaskHandle_t process_task_handle;
 QueueHandle_t process_queue;
@@ -30,6 +35,8 @@ Icm::Icm42688 *icm = nullptr;
 Lps::Lps25hb *lps = nullptr;
 GPTimer *gptimer = nullptr;
 SdController *logger = nullptr;
+EventJournal *event_journal = nullptr;
+SettingsWriter *settings_writer = nullptr;
 CanComm *can_comm = nullptr;
 LogTaskHandler *log_task_handler = nullptr;
 SensorTaskHandler *sensor_task_handler = nullptr;
@@ -84,12 +91,14 @@ extern "C" void app_main(void) {
   spi->begin(SPI2_HOST, config::pins.SCK, config::pins.MISO, config::pins.MOSI);
 
   icm = new Icm::Icm42688();
-  if (!icm->begin(spi, config::pins.ICMCS)) {
+  bool icm_ok = icm->begin(spi, config::pins.ICMCS);
+  if (!icm_ok) {
     ESP_LOGE(TAG, "Failed to initialize ICM42688");
   }
 
   lps = new Lps::Lps25hb();
-  if (!lps->begin(spi, config::pins.LPSCS)) {
+  bool lps_ok = lps->begin(spi, config::pins.LPSCS);
+  if (!lps_ok) {
     ESP_LOGE(TAG, "Failed to initialize LPS25HB");
   }
 
@@ -99,6 +108,37 @@ extern "C" void app_main(void) {
     ESP_LOGE(TAG, "Failed to initialize SDMMC");
   }
 
+  // イベントジャーナルの初期化（この起動のログのディレクトリに作成する）
+  event_journal = new EventJournal();
+  if (event_journal->init(logger)) {
+    event_journal->record(LogFormat::EventType::BOOT, 0,
+                          logger->getIntSetting("boot_count", 0),
+                          esp_reset_reason());
+    // 起動時に決めたSDカードの速度と、その時の書き込み速度
+    LogFormat::SdSpeed sd_speed =
+        logger->isSpeedFallback()            ? LogFormat::SdSpeed::FALLBACK
+        : logger->getCardFreqKhz() > SDMMC_FREQ_DEFAULT
+            ? LogFormat::SdSpeed::HIGH_SPEED
+            : LogFormat::SdSpeed::DEFAULT_SPEED;
+    event_journal->record(LogFormat::EventType::SD_CARD,
+                          static_cast<uint8_t>(sd_speed),
+                          logger->getCardFreqKhz(),
+                          logger->getCardWriteKbps());
+    // SDカードより先に初期化したセンサーの失敗もここで記録する
+    if (!icm_ok) {
+      event_journal->record(
+          LogFormat::EventType::ERROR,
+          static_cast<uint8_t>(LogFormat::EventError::SENSOR_INIT_FAILED), 0);
+    }
+    if (!lps_ok) {
+      event_journal->record(
+          LogFormat::EventType::ERROR,
+          static_cast<uint8_t>(LogFormat::EventError::SENSOR_INIT_FAILED), 1);
+    }
+  } else {
+    ESP_LOGE(TAG, "Failed to initialize EventJournal");
+  }
+
   // 通信モードの設定を読み込む
   std::string comm_mode_str = logger->getStringSetting("comm_mode", "can");
   bool use_can = (comm_mode_str != "uart");
@@ -124,14 +164,6 @@ extern "C" void app_main(void) {
     ESP_LOGI(TAG, "UART initialized");
   }
 
-  // タイマーの初期化
-  gptimer = new GPTimer();
-  if (!gptimer->init(40000000, 40000)) {
-    ESP_LOGE(TAG, "Failed to initialize GPTimer");
-  }
-  gptimer->registerCallback(onTimer);
-  gptimer->start();
-
   // LogTaskHandlerの初期化
   log_task_handler = new LogTaskHandler();
   if (!log_task_handler->init(logger)) {
@@ -151,13 +183,50 @@ extern "C" void app_main(void) {
   // SensorTaskHandlerの初期化
   sensor_task_handler = new SensorTaskHandler();
   if (!sensor_task_handler->init(icm, lps, log_task_handler, servo_controller,
-                                 logger)) {
+                                 logger, event_journal)) {
     ESP_LOGE(TAG, "Failed to initialize SensorTaskHandler");
     return;
   }
   ESP_LOGI(TAG, "SensorTaskHandler initialized");
+
+  // LPSの出力データレートと平均の設定を読み込む（失敗したら電源投入時の設定のまま）
+  // LOGGINGモードを開始するたびにも読み直し、変わっていれば設定し直す
+  if (lps_ok) {
+    sensor_task_handler->applyBaroSettings();
+  }
+
+  // ICMの読み出し方の設定を読み込む（FIFOならタイマーの周期を読み出し間隔にする）
+  std::string icm_read_mode =
+      logger->getStringSetting("icm_read_mode", "register");
+  if (icm_read_mode == "fifo" && icm_ok) {
+    int fifo_period_ms = logger->getIntSetting("icm_fifo_period_ms", 10);
+    if (!sensor_task_handler->enableFifo(fifo_period_ms)) {
+      ESP_LOGW(TAG, "Failed to enable ICM FIFO, reading registers at 1kHz");
+    }
+  }
+  // 転送中に前のサンプルを処理する（レジスタから読む時のみ）
+  if (logger->getStringSetting("icm_spi_mode", "polling") == "queued" &&
+      icm_ok && !sensor_task_handler->enableQueuedRead()) {
+    ESP_LOGW(TAG, "Failed to enable queued ICM read, polling");
+  }
+  // INT1が配線されていれば、ICMの割り込みで取得する（タイマーは見張りになる）
+  std::string icm_trigger = logger->getStringSetting("icm_trigger", "interrupt");
+  if (icm_trigger == "interrupt" && icm_ok &&
+      config::pins.ICM_INT1 != GPIO_NUM_NC &&
+      !sensor_task_handler->enableInterrupt(config::pins.ICM_INT1)) {
+    ESP_LOGW(TAG, "Failed to enable ICM interrupt, acquiring by timer");
+  }
+  uint64_t timer_period_us = sensor_task_handler->getPeriodUs();
   sensor_task_handler->startTask();
 
+  // タイマーの初期化（40MHzでカウント）
+  gptimer = new GPTimer();
+  if (!gptimer->init(40000000, timer_period_us * 40)) {
+    ESP_LOGE(TAG, "Failed to initialize GPTimer");
+  }
+  gptimer->registerCallback(onTimer);
+  gptimer->start();
+
   // LEDコントローラーの初期化
   led_controller = new LedController();
   if (!led_controller->init(config::pins.LED)) {
@@ -166,11 +235,19 @@ extern "C" void app_main(void) {
   }
   ESP_LOGI(TAG, "LEDController initialized");
 
+  // 設定の保存タスクの初期化（モード遷移等で設定の保存を待たないようにする）
+  settings_writer = new SettingsWriter();
+  if (!settings_writer->init(logger)) {
+    ESP_LOGE(TAG, "Failed to initialize SettingsWriter");
+    delete settings_writer;
+    settings_writer = nullptr;
+  }
+
   // CommandHandlerの初期化
   command_handler = new CommandHandler();
   if (!command_handler->init(can_comm, logger, sensor_task_handler,
                              log_task_handler, servo_controller,
-                             led_controller)) {
+                             led_controller, event_journal, settings_writer)) {
     ESP_LOGE(TAG, "Failed to initialize CommandHandler");
     return;
   }
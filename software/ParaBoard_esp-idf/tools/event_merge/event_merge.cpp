@@ -0,0 +1,285 @@
+// イベントジャーナル(events.bin)を表示し、センサーログのCSVと時刻順に結合するホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -I../../components/log_format/include
+//       event_merge.cpp -o event_merge
+// 使い方:
+//   ./event_merge events.bin
+//   イベントの一覧をCSVで標準出力に書き出す
+//   ./event_merge events.bin log-1.csv [merged.csv]
+//   センサーログのCSV（基板のCSV出力、またはlog_decoderの出力）の各行の後ろに
+//   イベントの列を足し、イベントは時刻順の位置に1行として挿入する
+//   センサーログに "-" を指定すると標準入力から読む
+//   （例）./log_decoder log-1.bin | ./event_merge events.bin - merged.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "event_format.hpp"
+
+// 基板・log_decoderのCSVの列数（イベント行ではタイムスタンプ以外を空欄にする）
+static constexpr int SENSOR_COLUMNS = 21;
+static const char EVENT_COLUMNS[] = "event,detail,value0,value1,description";
+
+/**
+ * @brief ジャーナルを読み込む（CRCが合わないレコードは捨てる）
+ * @param path ファイル名
+ * @param events 読み込んだイベント
+ * @return 読み込めたかどうか
+ */
+static bool readJournal(const char* path,
+                        std::vector<LogFormat::EventRecord>* events) {
+  FILE* in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+  LogFormat::EventFileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      !LogFormat::isValidEventFileHeader(header)) {
+    fprintf(stderr, "%s is not an event journal (schema v%u expected)\n",
+            path, LogFormat::EVENT_SCHEMA_VERSION);
+    fclose(in);
+    return false;
+  }
+  fprintf(stderr, "event journal schema v%u, boot %u\n", header.schema_version,
+          header.boot_count);
+
+  LogFormat::EventRecord record;
+  size_t broken = 0;
+  size_t missing = 0;
+  bool has_previous = false;
+  uint16_t next_seq = 0;
+  while (fread(&record, sizeof(record), 1, in) == 1) {
+    if (!LogFormat::isValidEventRecord(record)) {
+      broken++;
+      continue;
+    }
+    if (has_previous && record.seq != next_seq) {
+      missing += (uint16_t)(record.seq - next_seq);
+    }
+    next_seq = record.seq + 1;
+    has_previous = true;
+    events->push_back(record);
+  }
+  fclose(in);
+  // 別々のタスクから記録したイベントは、書き込み順と時刻順が前後することがある
+  std::stable_sort(events->begin(), events->end(),
+                   [](const LogFormat::EventRecord& a,
+                      const LogFormat::EventRecord& b) {
+                     return a.timestamp_us < b.timestamp_us;
+                   });
+  fprintf(stderr, "%zu events", events->size());
+  if (broken > 0) fprintf(stderr, ", %zu broken records skipped", broken);
+  if (missing > 0) fprintf(stderr, ", %zu events missing (queue full)", missing);
+  fprintf(stderr, "\n");
+  return true;
+}
+
+/**
+ * @brief イベントの詳細の名前を取得する
+ */
+static const char* detailName(const LogFormat::EventRecord& event) {
+  switch (static_cast<LogFormat::EventType>(event.type)) {
+    case LogFormat::EventType::MODE_CHANGE:
+      return event.detail == 's' ? "START"
+             : event.detail == 'l' ? "LOGGING"
+                                   : "UNKNOWN";
+    case LogFormat::EventType::LAUNCH:
+    case LogFormat::EventType::APOGEE:
+      switch (static_cast<LogFormat::EventSource>(event.detail)) {
+        case LogFormat::EventSource::ACCEL:
+          return "ACCEL";
+        case LogFormat::EventSource::PRESSURE:
+          return "PRESSURE";
+        case LogFormat::EventSource::TIMER:
+          return "TIMER";
+        default:
+          return "NONE";
+      }
+    case LogFormat::EventType::SERVO:
+      return event.detail == (uint8_t)LogFormat::ServoAction::OPEN ? "OPEN"
+                                                                   : "CLOSE";
+    case LogFormat::EventType::ERROR:
+      switch (static_cast<LogFormat::EventError>(event.detail)) {
+        case LogFormat::EventError::LOG_OPEN_FAILED:
+          return "LOG_OPEN_FAILED";
+        case LogFormat::EventError::SETTINGS_SAVE_FAILED:
+          return "SETTINGS_SAVE_FAILED";
+        case LogFormat::EventError::SAMPLES_DROPPED:
+          return "SAMPLES_DROPPED";
+        case LogFormat::EventError::SENSOR_INIT_FAILED:
+          return "SENSOR_INIT_FAILED";
+        case LogFormat::EventError::SENSOR_INTERRUPT_MISSING:
+          return "SENSOR_INTERRUPT_MISSING";
+      }
+      return "UNKNOWN";
+    case LogFormat::EventType::SD_CARD:
+      switch (static_cast<LogFormat::SdSpeed>(event.detail)) {
+        case LogFormat::SdSpeed::DEFAULT_SPEED:
+          return "DEFAULT_SPEED";
+        case LogFormat::SdSpeed::HIGH_SPEED:
+          return "HIGH_SPEED";
+        case LogFormat::SdSpeed::FALLBACK:
+          return "FALLBACK";
+      }
+      return "UNKNOWN";
+    default:
+      return "";
+  }
+}
+
+/**
+ * @brief 値を人が読める形にする（気圧等の倍率を戻す）
+ */
+static std::string describe(const LogFormat::EventRecord& event) {
+  char text[96] = "";
+  auto type = static_cast<LogFormat::EventType>(event.type);
+  auto source = static_cast<LogFormat::EventSource>(event.detail);
+  if ((type == LogFormat::EventType::LAUNCH ||
+       type == LogFormat::EventType::APOGEE) &&
+      source == LogFormat::EventSource::PRESSURE) {
+    snprintf(text, sizeof(text), "pressure %.2f hPa / delta %.4f hPa",
+             (double)event.value0 / LogFormat::EVENT_PRESSURE_SCALE,
+             (double)event.value1 / LogFormat::EVENT_PRESSURE_SCALE);
+  } else if (type == LogFormat::EventType::LAUNCH &&
+             source == LogFormat::EventSource::ACCEL) {
+    snprintf(text, sizeof(text), "accel square sum %.3f g^2",
+             (double)event.value0 / LogFormat::EVENT_ACCEL_SQUARE_SCALE);
+  } else if (type == LogFormat::EventType::APOGEE &&
+             source == LogFormat::EventSource::TIMER) {
+    snprintf(text, sizeof(text), "%ld ms after launch", (long)event.value0);
+  } else if (type == LogFormat::EventType::SERVO) {
+    snprintf(text, sizeof(text), "angle %ld (%s)", (long)event.value0,
+             event.value1 ? "command" : "auto");
+  } else if (type == LogFormat::EventType::MODE_CHANGE) {
+    snprintf(text, sizeof(text), "from %s",
+             event.value0 == 's'   ? "START"
+             : event.value0 == 'l' ? "LOGGING"
+                                   : "UNKNOWN");
+  } else if (type == LogFormat::EventType::LOG_OPENED) {
+    snprintf(text, sizeof(text), "log-%ld", (long)event.value0);
+  } else if (type == LogFormat::EventType::LOG_CLOSED) {
+    snprintf(text, sizeof(text), "%ld samples / %ld dropped",
+             (long)event.value0, (long)event.value1);
+  } else if (type == LogFormat::EventType::SD_CARD) {
+    snprintf(text, sizeof(text), "%ld kHz / write %ld kB/s",
+             (long)event.value0, (long)event.value1);
+  } else if (type == LogFormat::EventType::SETTINGS_SAVED) {
+    snprintf(text, sizeof(text), "request %ld durable after %ld ms",
+             (long)event.value0, (long)event.value1);
+  } else if (type == LogFormat::EventType::BOOT) {
+    snprintf(text, sizeof(text), "boot %ld / reset reason %ld",
+             (long)event.value0, (long)event.value1);
+  }
+  return text;
+}
+
+/**
+ * @brief イベントの列を書き出す（改行まで）
+ */
+static void writeEventColumns(FILE* out, const LogFormat::EventRecord& event) {
+  fprintf(out, "%s,%s,%ld,%ld,%s\n", LogFormat::eventTypeName(event.type),
+          detailName(event), (long)event.value0, (long)event.value1,
+          describe(event).c_str());
+}
+
+/**
+ * @brief イベントを1行として書き出す（センサーの列は空欄）
+ */
+static void writeEventRow(FILE* out, const LogFormat::EventRecord& event) {
+  fprintf(out, "%llu", (unsigned long long)event.timestamp_us);
+  for (int i = 1; i < SENSOR_COLUMNS; i++) fputc(',', out);
+  fputc(',', out);
+  writeEventColumns(out, event);
+}
+
+/**
+ * @brief センサーログのCSVにイベントを時刻順に挿入する
+ * @param events 時刻順のイベント
+ * @param in センサーログのCSV（1行目はヘッダ）
+ * @param out 出力先
+ */
+static bool mergeCsv(const std::vector<LogFormat::EventRecord>& events,
+                     FILE* in, FILE* out) {
+  char line[1024];
+  if (!fgets(line, sizeof(line), in)) {
+    fprintf(stderr, "Empty sensor log\n");
+    return false;
+  }
+  line[strcspn(line, "\r\n")] = '\0';
+  if (strncmp(line, "timestamp", 9) != 0) {
+    fprintf(stderr, "Sensor log has no CSV header\n");
+    return false;
+  }
+  fprintf(out, "%s,%s\n", line, EVENT_COLUMNS);
+
+  size_t next = 0;
+  size_t rows = 0;
+  while (fgets(line, sizeof(line), in)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0') continue;
+    unsigned long long timestamp_us = strtoull(line, nullptr, 10);
+    // この行より前に起きたイベントを先に書く
+    while (next < events.size() && events[next].timestamp_us <= timestamp_us) {
+      writeEventRow(out, events[next++]);
+    }
+    fprintf(out, "%s,,,,,\n", line);
+    rows++;
+  }
+  // ログファイルを閉じた後のイベント
+  while (next < events.size()) {
+    writeEventRow(out, events[next++]);
+  }
+  fprintf(stderr, "%zu sensor rows merged with %zu events\n", rows,
+          events.size());
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr,
+            "usage: %s <events.bin>\n"
+            "       %s <events.bin> <log-N.csv|-> [merged.csv]\n",
+            argv[0], argv[0]);
+    return 2;
+  }
+
+  std::vector<LogFormat::EventRecord> events;
+  if (!readJournal(argv[1], &events)) return 1;
+
+  if (argc == 2) {
+    printf("timestamp(us),seq,%s\n", EVENT_COLUMNS);
+    for (const LogFormat::EventRecord& event : events) {
+      printf("%llu,%u,", (unsigned long long)event.timestamp_us, event.seq);
+      writeEventColumns(stdout, event);
+    }
+    return 0;
+  }
+
+  FILE* in = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+  if (!in) {
+    perror(argv[2]);
+    return 1;
+  }
+  FILE* out = stdout;
+  if (argc == 4) {
+    out = fopen(argv[3], "w");
+    if (!out) {
+      perror(argv[3]);
+      if (in != stdin) fclose(in);
+      return 1;
+    }
+  }
+
+  bool ok = mergeCsv(events, in, out);
+
+  if (in != stdin) fclose(in);
+  if (out != stdout) fclose(out);
+  return ok ? 0 : 1;
+}
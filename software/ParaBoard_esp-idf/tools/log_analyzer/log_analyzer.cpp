@@ -0,0 +1,947 @@
+// ログ(log-N.csv / log-N.bin)を物理量(g, dps, hPa, ℃)に変換し、
+// 飛行ごとの概要（最大加速度、離床・頂点の時刻、サンプルの欠け、離床前の気圧のノイズ）を
+// 表示するホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -pthread -I../../components/config/include
+//       -I../../components/log_format/include log_analyzer.cpp -o log_analyzer
+// 使い方:
+//   ./log_analyzer [-j スレッド数] [-f csv|columnar|none] [-o 出力] log-1.csv ...
+//   出力を省略した場合は log-1-phys.csv（columnarなら log-1-phys.<列名>.<型>）に書き出す
+//   -o は入力が1つの時だけ指定できる。-f none は概要だけを表示する
+//   CSVはメモリにマップして行の境界で分割し、すべてのコアで変換する
+//   バイナリは差分圧縮を先頭から順に復元し、変換と書式化をすべてのコアで行う
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "condition_config.hpp"
+#include "log_block.hpp"
+#include "log_codec.hpp"
+#include "log_format.hpp"
+#include "sensor_data.hpp"
+
+/** 1つのスレッドに渡すCSVのバイト数（行の境界に合わせる） */
+static constexpr size_t CSV_CHUNK_BYTES = 8 * 1024 * 1024;
+/** 1つのスレッドに渡すバイナリのサンプル数 */
+static constexpr size_t BIN_CHUNK_SAMPLES = 100000;
+/** ICM-42688の温度の分解能(LSB/℃)とオフセット(℃) */
+static constexpr float ICM_TEMP_LSB_PER_DEGC = 132.48f;
+static constexpr float ICM_TEMP_OFFSET_DEGC = 25.0f;
+/** CSVには標本化周波数が書かれていないので、基板の既定値を使う */
+static constexpr uint16_t DEFAULT_SAMPLE_RATE_HZ = 1000;
+
+static const char CSV_HEADER[] =
+    "timestamp(us),seq,accel-x(g),accel-y(g),accel-z(g),gyro-x(dps),"
+    "gyro-y(dps),gyro-z(dps),pressure(hPa),temperature(degC),"
+    "icm-temp(degC)\n";
+
+enum class OutputFormat { CSV, COLUMNAR, NONE };
+
+/**
+ * @brief 生データから物理量への換算係数
+ * バイナリログはファイルヘッダの値を、CSVは log_format.hpp の値を使う
+ */
+struct Scale {
+  float accel_g_per_lsb = LogFormat::ACCEL_RANGE_G / 32768.0f;
+  float gyro_dps_per_lsb = LogFormat::GYRO_RANGE_DPS / 32768.0f;
+  float pressure_lsb_per_hpa = LogFormat::PRESSURE_LSB_PER_HPA;
+  float temp_lsb_per_degc = LogFormat::TEMP_LSB_PER_DEGC;
+  float temp_offset_degc = LogFormat::TEMP_OFFSET_DECI_DEGC / 10.0f;
+  uint16_t sample_rate_hz = DEFAULT_SAMPLE_RATE_HZ;
+};
+
+/**
+ * @brief 物理量に変換した1サンプル
+ */
+struct Sample {
+  uint64_t timestamp_us;
+  uint32_t seq;
+  uint8_t flags;  // SENSOR_DATA_HAS_BARO / SENSOR_DATA_HAS_ICM_TEMP
+  float accel[3];  // g
+  float gyro[3];   // dps
+  uint64_t baro_timestamp_us;
+  float pressure_hpa;
+  float temp_degc;
+  uint64_t icm_temp_timestamp_us;
+  float icm_temp_degc;
+};
+
+/**
+ * @brief 1つのスレッドが処理する範囲と、その結果
+ */
+struct Chunk {
+  // 入力（CSVならtext、バイナリならraw）
+  const char* text = nullptr;
+  const char* text_end = nullptr;
+  const SensorData* raw = nullptr;
+  size_t raw_count = 0;
+  // 結果
+  std::vector<Sample> samples;
+  std::string csv;
+  size_t bad_lines = 0;
+};
+
+static int16_t toInt16(uint8_t high, uint8_t low) {
+  return (int16_t)(high << 8 | low);
+}
+
+static void convertSample(const SensorData& data, const Scale& scale,
+                          Sample* sample) {
+  sample->timestamp_us = data.timestamp_us;
+  sample->seq = data.seq;
+  sample->flags = data.flags;
+  const AccelData& a = data.accel;
+  sample->accel[0] = toInt16(a.u_x, a.d_x) * scale.accel_g_per_lsb;
+  sample->accel[1] = toInt16(a.u_y, a.d_y) * scale.accel_g_per_lsb;
+  sample->accel[2] = toInt16(a.u_z, a.d_z) * scale.accel_g_per_lsb;
+  const GyroData& g = data.gyro;
+  sample->gyro[0] = toInt16(g.u_x, g.d_x) * scale.gyro_dps_per_lsb;
+  sample->gyro[1] = toInt16(g.u_y, g.d_y) * scale.gyro_dps_per_lsb;
+  sample->gyro[2] = toInt16(g.u_z, g.d_z) * scale.gyro_dps_per_lsb;
+
+  sample->baro_timestamp_us = data.baro_timestamp_us;
+  const PressureData& p = data.pressure;
+  uint32_t pressure = (uint32_t)p.h_p << 16 | p.l_p << 8 | p.xl_p;
+  sample->pressure_hpa = pressure / scale.pressure_lsb_per_hpa;
+  sample->temp_degc =
+      scale.temp_offset_degc +
+      toInt16(data.temperature.h_t, data.temperature.l_t) /
+          scale.temp_lsb_per_degc;
+
+  sample->icm_temp_timestamp_us = data.icm_temp_timestamp_us;
+  sample->icm_temp_degc =
+      toInt16(data.icm_temp.u_t, data.icm_temp.d_t) / ICM_TEMP_LSB_PER_DEGC +
+      ICM_TEMP_OFFSET_DEGC;
+}
+
+/**
+ * @brief CSVの1つの欄を10進数として読む
+ * @param p 欄の先頭（読んだ後は区切りの次を指す）
+ * @param end 行末
+ * @param value 読んだ値
+ * @return 値があればtrue（空欄ならfalse）
+ */
+static bool parseField(const char** p, const char* end, uint64_t* value) {
+  const char* c = *p;
+  uint64_t result = 0;
+  bool present = false;
+  while (c < end && *c >= '0' && *c <= '9') {
+    result = result * 10 + (*c - '0');
+    present = true;
+    c++;
+  }
+  // 区切りまで読み飛ばす（数字以外が混ざっていれば空欄と同じに扱う）
+  bool clean = (c == end || *c == ',' || *c == '\r');
+  while (c < end && *c != ',') c++;
+  if (c < end) c++;
+  *p = c;
+  *value = result;
+  return present && clean;
+}
+
+/**
+ * @brief 基板のCSV出力（log_decoderの出力と同じ列構成）の1行を読む
+ * @return 読めたかどうか（ヘッダ行や壊れた行はfalse）
+ */
+static bool parseCsvLine(const char* line, const char* end, SensorData* data) {
+  // timestamp, accel×6, gyro×6, pressure×3, temperature×2, seq, icm-temp×2
+  static constexpr int FIELD_COUNT = 21;
+  uint64_t values[FIELD_COUNT];
+  bool present[FIELD_COUNT];
+  const char* p = line;
+  int fields = 0;
+  while (fields < FIELD_COUNT && p < end) {
+    present[fields] = parseField(&p, end, &values[fields]);
+    fields++;
+  }
+  // seqより前の列は必須（seqはスキーマv2以降）
+  if (fields < 19) return false;
+  for (int i = 0; i < 13; i++) {
+    if (!present[i]) return false;
+  }
+  if (!present[18]) return false;
+  for (int i = fields; i < FIELD_COUNT; i++) present[i] = false;
+
+  *data = {};
+  data->timestamp_us = values[0];
+  uint8_t* imu = &data->accel.u_x;
+  for (int i = 0; i < 6; i++) imu[i] = values[1 + i];
+  uint8_t* gyro = &data->gyro.u_x;
+  for (int i = 0; i < 6; i++) gyro[i] = values[7 + i];
+  if (present[13] && present[14] && present[15] && present[16] &&
+      present[17]) {
+    data->pressure.h_p = values[13];
+    data->pressure.l_p = values[14];
+    data->pressure.xl_p = values[15];
+    data->temperature.h_t = values[16];
+    data->temperature.l_t = values[17];
+    data->baro_timestamp_us = data->timestamp_us;
+    data->flags |= SENSOR_DATA_HAS_BARO;
+  }
+  data->seq = values[18];
+  if (present[19] && present[20]) {
+    data->icm_temp.u_t = values[19];
+    data->icm_temp.d_t = values[20];
+    data->icm_temp_timestamp_us = data->timestamp_us;
+    data->flags |= SENSOR_DATA_HAS_ICM_TEMP;
+  }
+  return true;
+}
+
+static void appendCsvRow(const Sample& s, std::string* out) {
+  char line[256];
+  int length = snprintf(
+      line, sizeof(line), "%llu,%u,%.5f,%.5f,%.5f,%.3f,%.3f,%.3f,",
+      (unsigned long long)s.timestamp_us, s.seq, s.accel[0], s.accel[1],
+      s.accel[2], s.gyro[0], s.gyro[1], s.gyro[2]);
+  if (s.flags & SENSOR_DATA_HAS_BARO) {
+    length += snprintf(line + length, sizeof(line) - length, "%.4f,%.3f,",
+                       s.pressure_hpa, s.temp_degc);
+  } else {
+    length += snprintf(line + length, sizeof(line) - length, ",,");
+  }
+  if (s.flags & SENSOR_DATA_HAS_ICM_TEMP) {
+    length += snprintf(line + length, sizeof(line) - length, "%.3f\n",
+                       s.icm_temp_degc);
+  } else {
+    length += snprintf(line + length, sizeof(line) - length, "\n");
+  }
+  out->append(line, length);
+}
+
+/**
+ * @brief 1つの範囲を変換する（スレッドごとに呼ぶ）
+ */
+static void processChunk(Chunk* chunk, const Scale* scale,
+                         OutputFormat format) {
+  SensorData data;
+  Sample sample;
+  if (chunk->raw) {
+    chunk->samples.reserve(chunk->raw_count);
+    for (size_t i = 0; i < chunk->raw_count; i++) {
+      convertSample(chunk->raw[i], *scale, &sample);
+      chunk->samples.push_back(sample);
+    }
+  } else {
+    const char* p = chunk->text;
+    while (p < chunk->text_end) {
+      const char* line_end = (const char*)memchr(p, '\n', chunk->text_end - p);
+      if (!line_end) line_end = chunk->text_end;
+      if (parseCsvLine(p, line_end, &data)) {
+        convertSample(data, *scale, &sample);
+        chunk->samples.push_back(sample);
+      } else if (line_end - p > 1 && strncmp(p, "timestamp", 9) != 0) {
+        chunk->bad_lines++;
+      }
+      p = line_end + 1;
+    }
+  }
+
+  if (format == OutputFormat::CSV) {
+    chunk->csv.reserve(chunk->samples.size() * 80);
+    for (const Sample& s : chunk->samples) appendCsvRow(s, &chunk->csv);
+  }
+}
+
+/**
+ * @brief 複数の範囲をスレッドに分けて変換する
+ */
+static void processChunks(std::vector<Chunk>* chunks, const Scale& scale,
+                          OutputFormat format) {
+  std::vector<std::thread> threads;
+  threads.reserve(chunks->size());
+  for (Chunk& chunk : *chunks) {
+    threads.emplace_back(processChunk, &chunk, &scale, format);
+  }
+  for (std::thread& thread : threads) thread.join();
+}
+
+/**
+ * @brief 列ごとのファイル（リトルエンディアンの配列）に書き出す
+ */
+class ColumnWriter {
+ public:
+  ~ColumnWriter() { close(); }
+
+  bool open(const std::string& prefix) {
+    for (int i = 0; i < COLUMN_COUNT; i++) {
+      std::string path = prefix + "." + COLUMNS[i];
+      files[i] = fopen(path.c_str(), "wb");
+      if (!files[i]) {
+        perror(path.c_str());
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void write(const std::vector<Sample>& samples) {
+    for (const Sample& s : samples) {
+      put(0, &s.timestamp_us, sizeof(s.timestamp_us));
+      put(1, &s.seq, sizeof(s.seq));
+      for (int i = 0; i < 3; i++) put(2 + i, &s.accel[i], sizeof(float));
+      for (int i = 0; i < 3; i++) put(5 + i, &s.gyro[i], sizeof(float));
+      if (s.flags & SENSOR_DATA_HAS_BARO) {
+        put(8, &s.baro_timestamp_us, sizeof(s.baro_timestamp_us));
+        put(9, &s.pressure_hpa, sizeof(float));
+        put(10, &s.temp_degc, sizeof(float));
+      }
+      if (s.flags & SENSOR_DATA_HAS_ICM_TEMP) {
+        put(11, &s.icm_temp_timestamp_us, sizeof(s.icm_temp_timestamp_us));
+        put(12, &s.icm_temp_degc, sizeof(float));
+      }
+    }
+  }
+
+  void close() {
+    for (FILE*& file : files) {
+      if (file) fclose(file);
+      file = nullptr;
+    }
+  }
+
+ private:
+  static constexpr int COLUMN_COUNT = 13;
+  // 気圧・ICMの温度の列は、取得したサンプルの分だけの長さになる
+  static constexpr const char* COLUMNS[COLUMN_COUNT] = {
+      "timestamp_us.u64",      "seq.u32",
+      "accel_x_g.f32",         "accel_y_g.f32",
+      "accel_z_g.f32",         "gyro_x_dps.f32",
+      "gyro_y_dps.f32",        "gyro_z_dps.f32",
+      "baro_timestamp_us.u64", "pressure_hpa.f32",
+      "temperature_degc.f32",  "icm_temp_timestamp_us.u64",
+      "icm_temp_degc.f32",
+  };
+  FILE* files[COLUMN_COUNT] = {};
+
+  void put(int column, const void* value, size_t size) {
+    fwrite(value, size, 1, files[column]);
+  }
+};
+
+/**
+ * @brief 変換したサンプルを先頭から順に見て、飛行ごとの概要を求める
+ * 離床・頂点の判定は ConditionChecker と同じ閾値・手順で行う
+ * （タイマーによる頂点は、どちらの方法で離床を検知しても離床の時刻から数える）
+ * サンプル番号が戻った所（LOGGINGモードのやり直し）から次の飛行とする
+ */
+class FlightAnalyzer {
+ public:
+  /**
+   * @brief 標本化周波数を設定する（間隔が周期の1.5倍を超えたら遅れとして数える）
+   */
+  void setSampleRate(uint16_t sample_rate_hz) {
+    late_threshold_us = 1000000u / sample_rate_hz * 3 / 2;
+  }
+
+  /**
+   * @brief 記録した時のLPSの出力データレートを設定する
+   * 気圧による判定のデータの数・回数・閾値を、基板と同じように換算する
+   */
+  void setPressureRate(uint32_t odr_mhz) {
+    detection = ConditionConfig::pressureDetectionFor(odr_mhz);
+  }
+
+  void add(const Sample& s) {
+    if (flights.empty() || s.seq < flights.back().last_seq) {
+      startFlight(s);
+    }
+    Flight& f = flights.back();
+    if (f.samples > 0) {
+      uint32_t missing = s.seq - f.last_seq - 1;
+      if (s.seq > f.last_seq + 1) {
+        f.seq_gaps++;
+        f.missing_samples += missing;
+      }
+      uint64_t interval_us = s.timestamp_us - f.last_timestamp_us;
+      f.interval_sum_us += interval_us;
+      if (interval_us > late_threshold_us) f.late_intervals++;
+      if (interval_us > f.max_interval_us) {
+        f.max_interval_us = interval_us;
+        f.max_interval_at_us = f.last_timestamp_us;
+      }
+    }
+    f.samples++;
+    f.last_seq = s.seq;
+    f.last_timestamp_us = s.timestamp_us;
+
+    float magnitude = sqrtf(s.accel[0] * s.accel[0] + s.accel[1] * s.accel[1] +
+                            s.accel[2] * s.accel[2]);
+    if (magnitude > f.peak_accel_g) {
+      f.peak_accel_g = magnitude;
+      f.peak_accel_at_us = s.timestamp_us;
+    }
+
+    checkLaunchByAccel(f, s);
+    checkApogeeByTimer(f, s);
+    if (s.flags & SENSOR_DATA_HAS_BARO) {
+      if (f.baro_samples == 0) f.ground_pressure_hpa = s.pressure_hpa;
+      f.baro_samples++;
+      if (s.pressure_hpa < f.min_pressure_hpa || f.baro_samples == 1) {
+        f.min_pressure_hpa = s.pressure_hpa;
+        f.min_pressure_at_us = s.timestamp_us;
+      }
+      if (!f.launch_at_us) addBaroNoise(f, s);
+      checkLaunchByPressure(f, s);
+      checkApogeeByPressure(f, s);
+    }
+  }
+
+  void print(const char* name) const {
+    for (size_t i = 0; i < flights.size(); i++) {
+      const Flight& f = flights[i];
+      printf("%s flight %zu: %llu samples, %.3f s\n", name, i + 1,
+             (unsigned long long)f.samples, seconds(f, f.last_timestamp_us));
+      printf("  peak accel   %.2f g at %.3f s\n", f.peak_accel_g,
+             seconds(f, f.peak_accel_at_us));
+      if (f.launch_at_us) {
+        printf("  launch       %.3f s (%s)\n", seconds(f, f.launch_at_us),
+               f.launch_source);
+      } else {
+        printf("  launch       not detected\n");
+      }
+      if (f.apogee_at_us) {
+        printf("  apogee       %.3f s (%s)\n", seconds(f, f.apogee_at_us),
+               f.apogee_source);
+      } else {
+        printf("  apogee       not detected\n");
+      }
+      if (f.baro_samples > 0) {
+        // 国際標準大気で、最初の気圧からの高さに換算する
+        double altitude_m =
+            44330.0 * (1.0 - pow(f.min_pressure_hpa / f.ground_pressure_hpa,
+                                 1.0 / 5.255));
+        printf("  min pressure %.2f hPa at %.3f s (%.1f m above start)\n",
+               f.min_pressure_hpa, seconds(f, f.min_pressure_at_us),
+               altitude_m);
+      }
+      if (f.noise_diffs > 0 && f.noise_block_diffs > 0) {
+        // 隣り合うサンプルの差の分散はノイズの分散の2倍になる
+        // （ゆっくりした気圧の変化は差を取ると打ち消される）
+        double noise_pa =
+            sqrt(f.noise_diff_square_sum / f.noise_diffs / 2.0) * 100.0;
+        double block_pa =
+            sqrt(f.noise_block_diff_square_sum / f.noise_block_diffs) * 100.0;
+        // 国際標準大気で、最初の気圧での1Paあたりの高さに換算する
+        double meters_per_pa = 44330.0 / 5.255 / f.ground_pressure_hpa / 100.0;
+        printf("  baro noise   %.2f Pa rms (%.2f m), %d-sample mean diff "
+               "%.2f Pa rms, %llu samples before launch\n",
+               noise_pa, noise_pa * meters_per_pa,
+               (int)detection.data_count, block_pa,
+               (unsigned long long)f.noise_diffs + 1);
+      }
+      double mean_us =
+          f.samples > 1 ? (double)f.interval_sum_us / (f.samples - 1) : 0.0;
+      printf(
+          "  gaps         %u seq gaps, %llu missing samples, %u intervals "
+          "> %u us\n",
+          f.seq_gaps, (unsigned long long)f.missing_samples, f.late_intervals,
+          late_threshold_us);
+      printf("  interval     mean %.1f us, max %llu us at %.3f s\n", mean_us,
+             (unsigned long long)f.max_interval_us,
+             seconds(f, f.max_interval_at_us));
+    }
+  }
+
+ private:
+  struct Flight {
+    uint64_t first_timestamp_us = 0;
+    uint64_t samples = 0;
+    uint32_t last_seq = 0;
+    uint64_t last_timestamp_us = 0;
+    // サンプルの欠け
+    uint32_t seq_gaps = 0;
+    uint64_t missing_samples = 0;
+    uint32_t late_intervals = 0;
+    uint64_t interval_sum_us = 0;
+    uint64_t max_interval_us = 0;
+    uint64_t max_interval_at_us = 0;
+    // 最大値
+    float peak_accel_g = 0;
+    uint64_t peak_accel_at_us = 0;
+    uint64_t baro_samples = 0;
+    float ground_pressure_hpa = 0;
+    float min_pressure_hpa = 0;
+    uint64_t min_pressure_at_us = 0;
+    // 離床前（静止中）の気圧のノイズ
+    float last_noise_pressure_hpa = 0;
+    double noise_diff_square_sum = 0;
+    uint64_t noise_diffs = 0;
+    float noise_block_sum = 0;
+    int noise_block_count = 0;
+    float last_noise_block_av = 0;
+    bool has_noise_block = false;
+    double noise_block_diff_square_sum = 0;
+    uint64_t noise_block_diffs = 0;
+    // 離床・頂点（0なら未検知）
+    uint64_t launch_at_us = 0;
+    const char* launch_source = "";
+    uint64_t apogee_at_us = 0;
+    const char* apogee_source = "";
+    // ConditionCheckerと同じ判定の途中経過
+    float accel_sum[3] = {};
+    int accel_count = 0;
+    int accel_increase_count = 0;
+    float launch_pressure_sum = 0;
+    uint32_t launch_pressure_count = 0;
+    float last_launch_pressure_av = 0;
+    int launch_pressure_decrease_count = 0;
+    float apogee_pressure_sum = 0;
+    int apogee_pressure_count = 0;
+    float last_apogee_pressure_av = 0;
+    int apogee_pressure_increase_count = 0;
+  };
+
+  uint32_t late_threshold_us = 1000000u / DEFAULT_SAMPLE_RATE_HZ * 3 / 2;
+  ConditionConfig::PressureDetection detection =
+      ConditionConfig::pressureDetectionFor(
+          ConditionConfig::PRESSURE_TUNED_ODR_MHZ);
+  std::vector<Flight> flights;
+
+  void startFlight(const Sample& s) {
+    flights.emplace_back();
+    flights.back().first_timestamp_us = s.timestamp_us;
+  }
+
+  static double seconds(const Flight& f, uint64_t timestamp_us) {
+    return (double)(timestamp_us - f.first_timestamp_us) / 1e6;
+  }
+
+  static void launch(Flight& f, const Sample& s, const char* source) {
+    f.launch_at_us = s.timestamp_us;
+    f.launch_source = source;
+  }
+
+  /**
+   * @brief 離床前の気圧のノイズを積算する
+   * 隣り合うサンプルの差と、頂点の判定と同じ数の平均どうしの差の二乗を足す
+   */
+  void addBaroNoise(Flight& f, const Sample& s) const {
+    if (f.baro_samples > 1) {
+      double diff = s.pressure_hpa - f.last_noise_pressure_hpa;
+      f.noise_diff_square_sum += diff * diff;
+      f.noise_diffs++;
+    }
+    f.last_noise_pressure_hpa = s.pressure_hpa;
+
+    f.noise_block_sum += s.pressure_hpa;
+    if (++f.noise_block_count < (int)detection.data_count) {
+      return;
+    }
+    float av = f.noise_block_sum / detection.data_count;
+    f.noise_block_sum = 0;
+    f.noise_block_count = 0;
+    if (f.has_noise_block) {
+      double diff = av - f.last_noise_block_av;
+      f.noise_block_diff_square_sum += diff * diff;
+      f.noise_block_diffs++;
+    }
+    f.last_noise_block_av = av;
+    f.has_noise_block = true;
+  }
+
+  static void checkLaunchByAccel(Flight& f, const Sample& s) {
+    if (f.launch_at_us) return;
+    for (int i = 0; i < 3; i++) f.accel_sum[i] += s.accel[i];
+    if (++f.accel_count < ConditionConfig::NUMBER_OF_ACCEL_DATA_FOR_LAUNCH) {
+      return;
+    }
+    float square_sum = 0;
+    for (int i = 0; i < 3; i++) {
+      float av = f.accel_sum[i] / ConditionConfig::NUMBER_OF_ACCEL_DATA_FOR_LAUNCH;
+      square_sum += av * av;
+      f.accel_sum[i] = 0;
+    }
+    f.accel_count = 0;
+    if (square_sum >= ConditionConfig::ACCEL_SQUARE_SUM_THRESHOLD) {
+      f.accel_increase_count++;
+    } else {
+      f.accel_increase_count = 0;
+    }
+    if (f.accel_increase_count >
+        ConditionConfig::ACCEL_INCREASE_COUNT_THRESHOLD_FOR_LAUNCH) {
+      launch(f, s, "accel");
+    }
+  }
+
+  void checkLaunchByPressure(Flight& f, const Sample& s) const {
+    if (f.launch_at_us) return;
+    f.launch_pressure_sum += s.pressure_hpa;
+    if (++f.launch_pressure_count < detection.data_count) {
+      return;
+    }
+    float av = f.launch_pressure_sum / detection.data_count;
+    f.launch_pressure_sum = 0;
+    f.launch_pressure_count = 0;
+    if (f.last_launch_pressure_av == 0) {
+      f.last_launch_pressure_av = av;
+      return;
+    }
+    float diff = f.last_launch_pressure_av - av;
+    if (diff > 0 && diff > detection.launch_threshold) {
+      f.launch_pressure_decrease_count++;
+    } else {
+      f.launch_pressure_decrease_count = 0;
+    }
+    f.last_launch_pressure_av = av;
+    if (f.launch_pressure_decrease_count >= (int)detection.launch_count) {
+      launch(f, s, "pressure");
+    }
+  }
+
+  void checkApogeeByPressure(Flight& f, const Sample& s) const {
+    if (!f.launch_at_us || f.apogee_at_us) return;
+    f.apogee_pressure_sum += s.pressure_hpa;
+    if (++f.apogee_pressure_count < (int)detection.data_count) {
+      return;
+    }
+    float av = f.apogee_pressure_sum / detection.data_count;
+    f.apogee_pressure_sum = 0;
+    f.apogee_pressure_count = 0;
+    if (f.last_apogee_pressure_av == 0) {
+      f.last_apogee_pressure_av = av;
+      return;
+    }
+    float diff = av - f.last_apogee_pressure_av;
+    if (diff > 0 && diff > detection.apogee_threshold) {
+      f.apogee_pressure_increase_count++;
+    } else {
+      f.apogee_pressure_increase_count = 0;
+    }
+    f.last_apogee_pressure_av = av;
+    if (f.apogee_pressure_increase_count >= (int)detection.apogee_count) {
+      f.apogee_at_us = s.timestamp_us;
+      f.apogee_source = "pressure";
+    }
+  }
+
+  static void checkApogeeByTimer(Flight& f, const Sample& s) {
+    if (!f.launch_at_us || f.apogee_at_us) return;
+    if (s.timestamp_us - f.launch_at_us >=
+        (uint64_t)ConditionConfig::TIME_THRESHOLD_FOR_APOGEE_FROM_LAUNCH *
+            1000) {
+      f.apogee_at_us = s.timestamp_us;
+      f.apogee_source = "timer";
+    }
+  }
+};
+
+/**
+ * @brief 変換の出力先（CSVまたは列ごとのファイル）
+ */
+class Output {
+ public:
+  ~Output() {
+    if (csv_file) fclose(csv_file);
+  }
+
+  OutputFormat getFormat() const { return format; }
+
+  bool open(OutputFormat output_format, const std::string& path) {
+    format = output_format;
+    if (format == OutputFormat::CSV) {
+      csv_file = fopen(path.c_str(), "w");
+      if (!csv_file) {
+        perror(path.c_str());
+        return false;
+      }
+      fputs(CSV_HEADER, csv_file);
+    } else if (format == OutputFormat::COLUMNAR) {
+      return columns.open(path);
+    }
+    return true;
+  }
+
+  /**
+   * @brief 変換した範囲を先頭から順に書き出し、概要に加える
+   */
+  void write(const std::vector<Chunk>& chunks, FlightAnalyzer* analyzer,
+             size_t* samples, size_t* bad_lines) {
+    for (const Chunk& chunk : chunks) {
+      for (const Sample& s : chunk.samples) analyzer->add(s);
+      if (format == OutputFormat::CSV) {
+        fwrite(chunk.csv.data(), 1, chunk.csv.size(), csv_file);
+      } else if (format == OutputFormat::COLUMNAR) {
+        columns.write(chunk.samples);
+      }
+      *samples += chunk.samples.size();
+      *bad_lines += chunk.bad_lines;
+    }
+  }
+
+ private:
+  OutputFormat format = OutputFormat::NONE;
+  FILE* csv_file = nullptr;
+  ColumnWriter columns;
+};
+
+/**
+ * @brief CSVのログを変換する
+ * ファイルをメモリにマップし、行の境界で区切った範囲をスレッドの数ずつ並列に変換して、
+ * 先頭から順に書き出す
+ */
+static bool analyzeCsv(const char* path, unsigned threads, Output* output,
+                       FlightAnalyzer* analyzer) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    fprintf(stderr, "%s is empty\n", path);
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  const char* data =
+      (const char*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return false;
+  }
+  madvise((void*)data, size, MADV_SEQUENTIAL);
+
+  Scale scale;
+  analyzer->setSampleRate(scale.sample_rate_hz);
+  size_t samples = 0;
+  size_t bad_lines = 0;
+  const char* end = data + size;
+  const char* position = data;
+  while (position < end) {
+    std::vector<Chunk> chunks;
+    while (chunks.size() < threads && position < end) {
+      const char* chunk_end =
+          position + std::min(CSV_CHUNK_BYTES, (size_t)(end - position));
+      if (chunk_end < end) {
+        const char* newline =
+            (const char*)memchr(chunk_end, '\n', end - chunk_end);
+        chunk_end = newline ? newline + 1 : end;
+      }
+      chunks.emplace_back();
+      chunks.back().text = position;
+      chunks.back().text_end = chunk_end;
+      position = chunk_end;
+    }
+    processChunks(&chunks, scale, output->getFormat());
+    output->write(chunks, analyzer, &samples, &bad_lines);
+  }
+  munmap((void*)data, size);
+
+  fprintf(stderr, "%s: %zu samples converted", path, samples);
+  if (bad_lines > 0) {
+    fprintf(stderr, ", %zu unreadable lines skipped", bad_lines);
+  }
+  fprintf(stderr, "\n");
+  return true;
+}
+
+/**
+ * @brief バイナリのログを変換する
+ * 差分圧縮は前のサンプルに依存するので先頭から順に復元し、
+ * 復元したサンプルをスレッドの数ずつ並列に変換して書き出す
+ */
+static bool analyzeBin(const char* path, unsigned threads, Output* output,
+                       FlightAnalyzer* analyzer) {
+  FILE* in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+  uint32_t block_count = 0;
+  bool blocks_complete = true;
+  in = LogFormat::unwrapBlockFile(in, &block_count, &blocks_complete);
+  if (!in) {
+    perror("tmpfile");
+    return false;
+  }
+  if (block_count > 0 && !blocks_complete) {
+    fprintf(stderr, "%s: %u blocks, stopped at broken block\n", path,
+            block_count);
+  }
+
+  LogFormat::FileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      !LogFormat::isValidFileHeader(header)) {
+    fprintf(stderr, "%s: unsupported log file\n", path);
+    fclose(in);
+    return false;
+  }
+  fseek(in, header.header_size, SEEK_SET);
+  Scale scale;
+  scale.accel_g_per_lsb = header.accel_range_g / 32768.0f;
+  scale.gyro_dps_per_lsb = header.gyro_range_dps / 32768.0f;
+  scale.pressure_lsb_per_hpa = header.pressure_lsb_per_hpa;
+  scale.temp_lsb_per_degc = header.temp_lsb_per_degc;
+  scale.temp_offset_degc = header.temp_offset_deci_degc / 10.0f;
+  if (header.sample_rate_hz > 0) scale.sample_rate_hz = header.sample_rate_hz;
+  analyzer->setSampleRate(scale.sample_rate_hz);
+
+  LogFormat::RecordReader reader;
+  LogFormat::Record record;
+  std::vector<SensorData> raw;
+  raw.reserve(threads * BIN_CHUNK_SAMPLES);
+  SensorData data = {};
+  bool has_row = false;
+  bool more = true;
+  size_t samples = 0;
+  size_t bad_lines = 0;
+  while (more) {
+    // 気圧・ICMの温度のレコードは、直前のIMUレコードのサンプルに含める
+    raw.clear();
+    while (raw.size() < threads * BIN_CHUNK_SAMPLES) {
+      if (!reader.read(in, &record)) {
+        more = false;
+        break;
+      }
+      switch (record.tag) {
+        case LogFormat::RecordTag::IMU:
+          if (has_row) raw.push_back(data);
+          data = {};
+          data.timestamp_us = record.timestamp_us;
+          data.seq = record.seq;
+          data.accel = record.accel;
+          data.gyro = record.gyro;
+          has_row = true;
+          break;
+        case LogFormat::RecordTag::BARO:
+          data.pressure = record.pressure;
+          data.temperature = record.temperature;
+          data.baro_timestamp_us = record.timestamp_us;
+          data.flags |= SENSOR_DATA_HAS_BARO;
+          break;
+        case LogFormat::RecordTag::ICM_TEMP:
+          data.icm_temp = record.icm_temp;
+          data.icm_temp_timestamp_us = record.timestamp_us;
+          data.flags |= SENSOR_DATA_HAS_ICM_TEMP;
+          break;
+        default:
+          break;
+      }
+    }
+    if (!more && has_row) raw.push_back(data);
+
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < raw.size(); i += BIN_CHUNK_SAMPLES) {
+      chunks.emplace_back();
+      chunks.back().raw = raw.data() + i;
+      chunks.back().raw_count = std::min(BIN_CHUNK_SAMPLES, raw.size() - i);
+    }
+    processChunks(&chunks, scale, output->getFormat());
+    output->write(chunks, analyzer, &samples, &bad_lines);
+  }
+  fclose(in);
+
+  fprintf(stderr, "%s: %zu samples converted\n", path, samples);
+  return true;
+}
+
+static bool endsWith(const std::string& text, const char* suffix) {
+  size_t length = strlen(suffix);
+  return text.size() >= length &&
+         text.compare(text.size() - length, length, suffix) == 0;
+}
+
+/**
+ * @brief 入力ファイル名から出力先を決める（log-1.csv → log-1-phys.csv）
+ */
+static std::string defaultOutputPath(const std::string& input,
+                                     OutputFormat format) {
+  std::string base = input;
+  size_t dot = base.find_last_of('.');
+  size_t slash = base.find_last_of('/');
+  if (dot != std::string::npos &&
+      (slash == std::string::npos || dot > slash)) {
+    base.erase(dot);
+  }
+  base += "-phys";
+  return format == OutputFormat::CSV ? base + ".csv" : base;
+}
+
+int main(int argc, char** argv) {
+  const char* program = argv[0];
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  OutputFormat format = OutputFormat::CSV;
+  const char* output_path = nullptr;
+  uint32_t lps_odr_mhz = ConditionConfig::PRESSURE_TUNED_ODR_MHZ;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:f:o:r:")) != -1) {
+    switch (opt) {
+      case 'j':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'f':
+        if (strcmp(optarg, "csv") == 0) {
+          format = OutputFormat::CSV;
+        } else if (strcmp(optarg, "columnar") == 0) {
+          format = OutputFormat::COLUMNAR;
+        } else if (strcmp(optarg, "none") == 0) {
+          format = OutputFormat::NONE;
+        } else {
+          fprintf(stderr, "Unknown format: %s\n", optarg);
+          return 2;
+        }
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'r':
+        // 記録した時の lps_odr（Hz）
+        lps_odr_mhz = lroundf(strtof(optarg, nullptr) * 1000);
+        if (lps_odr_mhz == 0) {
+          fprintf(stderr, "Invalid LPS rate: %s\n", optarg);
+          return 2;
+        }
+        break;
+      default:
+        optind = argc + 1;
+        break;
+    }
+  }
+  int inputs = argc - optind;
+  if (inputs < 1 || (output_path && inputs != 1)) {
+    fprintf(stderr,
+            "usage: %s [-j threads] [-f csv|columnar|none] [-o output] "
+            "[-r lps_odr_hz] "
+            "<log-N.csv|log-N.bin>...\n",
+            program);
+    return 2;
+  }
+
+  bool ok = true;
+  for (int i = optind; i < argc; i++) {
+    std::string input = argv[i];
+    Output output;
+    if (format != OutputFormat::NONE &&
+        !output.open(format, output_path ? output_path
+                                         : defaultOutputPath(input, format))) {
+      ok = false;
+      continue;
+    }
+    FlightAnalyzer analyzer;
+    analyzer.setPressureRate(lps_odr_mhz);
+    bool analyzed = endsWith(input, ".bin")
+                        ? analyzeBin(argv[i], threads, &output, &analyzer)
+                        : analyzeCsv(argv[i], threads, &output, &analyzer);
+    if (!analyzed) {
+      ok = false;
+      continue;
+    }
+    analyzer.print(argv[i]);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,339 @@
+// バイナリログのブロック形式(log_block.hpp)と、起動時の修復で使う
+// 二分探索(findLastValidBlock)を、壊れたイメージで確認するホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -I../../components/config/include
+//       -I../../components/log_format/include log_block_check.cpp
+//       -o log_block_check
+// 使い方:
+//   ./log_block_check [log-N.bin]
+//   ファイルを指定すると、基板の修復と同じ方法で有効なブロックの終わりを探し、
+//   先頭から順に確認した結果と比べる（ファイルは変更しない）
+//   動作確認に失敗した場合は終了コード1を返す
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "log_block.hpp"
+#include "log_format.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      fprintf(stderr, "FAILED: %s (line %d)\n", #condition, __LINE__); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+static constexpr uint32_t FILE_ID = 0x1234abcd;
+static constexpr uint32_t OLD_FILE_ID = 0x0badf00d;
+
+/**
+ * @brief 電源断の後に、書き込んだブロックの後ろに残っているもの
+ */
+enum class Tail {
+  ZERO,       // 事前確保したばかりの領域（0埋め）
+  OLD_FILE,   // 前のファイルのブロック（別のファイルIDで、通し番号は位置と一致）
+  TORN,       // 書きかけのブロック（ペイロードが途中まで）の後ろが0
+  REORDERED,  // 同期前の区間で1ブロックだけ抜け、後ろのブロックは書けている
+  GARBAGE,    // 以前の使い方による任意のデータ
+};
+
+static const char* tailName(Tail tail) {
+  switch (tail) {
+    case Tail::ZERO:
+      return "zero";
+    case Tail::OLD_FILE:
+      return "old file";
+    case Tail::TORN:
+      return "torn block";
+    case Tail::REORDERED:
+      return "reordered";
+    case Tail::GARBAGE:
+      return "garbage";
+  }
+  return "?";
+}
+
+/**
+ * @brief 有効なブロックを作る（ペイロードは番号から決まる内容）
+ */
+static void makeBlock(uint8_t* block, uint32_t file_id, uint32_t index) {
+  size_t payload_size = LogFormat::BLOCK_PAYLOAD_SIZE - (index * 7) % 64;
+  uint8_t* payload = block + sizeof(LogFormat::BlockHeader);
+  if (index == 0) {
+    LogFormat::FileHeader header = LogFormat::makeFileHeader(file_id, 1000, 0);
+    memcpy(payload, &header, sizeof(header));
+    payload_size = sizeof(header);
+  } else {
+    for (size_t i = 0; i < payload_size; i++) {
+      payload[i] = (uint8_t)(index * 31 + i);
+    }
+  }
+  LogFormat::sealBlock(block, file_id, index, payload_size);
+}
+
+/**
+ * @brief 電源断の後のイメージ（必要なブロックだけをその場で作る）
+ * valid_blocks個の有効なブロックの後ろに、tailのデータが続く
+ */
+struct Image {
+  uint32_t valid_blocks;
+  Tail tail;
+
+  bool read(uint32_t index, uint8_t* block) const {
+    if (index < valid_blocks) {
+      makeBlock(block, FILE_ID, index);
+      return true;
+    }
+    memset(block, 0, LogFormat::BLOCK_SIZE);
+    switch (tail) {
+      case Tail::ZERO:
+        break;
+      case Tail::OLD_FILE:
+        makeBlock(block, OLD_FILE_ID, index);
+        break;
+      case Tail::TORN:
+        if (index == valid_blocks) {
+          makeBlock(block, FILE_ID, index);
+          block[sizeof(LogFormat::BlockHeader) + 10] ^= 0xff;
+        }
+        break;
+      case Tail::REORDERED:
+        if (index > valid_blocks && index <= valid_blocks + 3) {
+          makeBlock(block, FILE_ID, index);
+        }
+        break;
+      case Tail::GARBAGE:
+        srand(index);
+        for (size_t i = 0; i < LogFormat::BLOCK_SIZE; i++) {
+          block[i] = rand() & 0xff;
+        }
+        break;
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief 先頭から順に確認して、有効なブロックの数を求める（比較用）
+ */
+template <typename ReadBlock>
+static uint32_t scanLinear(ReadBlock read_block, uint32_t block_count,
+                           uint8_t* buffer) {
+  LogFormat::BlockHeader header;
+  uint32_t file_id = 0;
+  for (uint32_t index = 0; index < block_count; index++) {
+    if (!read_block(index, buffer) ||
+        !LogFormat::readBlockHeader(buffer, &header) || header.seq != index ||
+        (index > 0 && header.file_id != file_id)) {
+      return index;
+    }
+    if (index == 0) file_id = header.file_id;
+  }
+  return block_count;
+}
+
+static void checkBlock() {
+  std::vector<uint8_t> block(LogFormat::BLOCK_SIZE, 0xff);
+  LogFormat::BlockHeader header;
+
+  // 封をしたブロックは読め、ペイロードの後ろは0で埋まる
+  memset(block.data() + sizeof(header), 0x5a, 100);
+  LogFormat::sealBlock(block.data(), FILE_ID, 7, 100);
+  CHECK(LogFormat::readBlockHeader(block.data(), &header));
+  CHECK(header.file_id == FILE_ID && header.seq == 7);
+  CHECK(header.payload_size == 100);
+  CHECK(block[sizeof(header) + 100] == 0);
+  CHECK(block[LogFormat::BLOCK_SIZE - 1] == 0);
+  CHECK(LogFormat::isBlockFile(block.data(), block.size()));
+
+  // どのバイトが壊れても検出できる（ペイロードの後ろの0埋めはCRCの対象外）
+  bool detected = true;
+  for (size_t i = 0; i < sizeof(header) + 100; i++) {
+    block[i] ^= 0x01;
+    if (LogFormat::readBlockHeader(block.data(), &header)) detected = false;
+    block[i] ^= 0x01;
+  }
+  CHECK(detected);
+
+  // ペイロード長が範囲外なら無効
+  LogFormat::sealBlock(block.data(), FILE_ID, 0,
+                       LogFormat::BLOCK_PAYLOAD_SIZE);
+  CHECK(LogFormat::readBlockHeader(block.data(), &header));
+  uint16_t too_large = LogFormat::BLOCK_PAYLOAD_SIZE + 1;
+  memcpy(block.data() + offsetof(LogFormat::BlockHeader, payload_size),
+         &too_large, sizeof(too_large));
+  CHECK(!LogFormat::readBlockHeader(block.data(), &header));
+}
+
+static void checkUnwrap() {
+  // ブロックのペイロードをつなげるとFileHeaderとレコードの並びに戻り、
+  // 壊れたブロックの手前で止まる
+  FILE* fp = tmpfile();
+  CHECK(fp != nullptr);
+  if (!fp) return;
+  Image image = {5, Tail::TORN};
+  std::vector<uint8_t> block(LogFormat::BLOCK_SIZE);
+  size_t expected_size = 0;
+  for (uint32_t index = 0; index < 8; index++) {
+    image.read(index, block.data());
+    fwrite(block.data(), 1, block.size(), fp);
+    LogFormat::BlockHeader header;
+    if (index < image.valid_blocks &&
+        LogFormat::readBlockHeader(block.data(), &header)) {
+      expected_size += header.payload_size;
+    }
+  }
+  rewind(fp);
+
+  uint32_t block_count = 0;
+  bool complete = true;
+  fp = LogFormat::unwrapBlockFile(fp, &block_count, &complete);
+  CHECK(fp != nullptr);
+  if (!fp) return;
+  CHECK(block_count == image.valid_blocks);
+  CHECK(!complete);
+  LogFormat::FileHeader header;
+  CHECK(fread(&header, sizeof(header), 1, fp) == 1);
+  CHECK(LogFormat::isValidFileHeader(header));
+  CHECK(header.boot_id == FILE_ID);
+  fseek(fp, 0, SEEK_END);
+  CHECK((size_t)ftell(fp) == expected_size);
+  fclose(fp);
+}
+
+/**
+ * @brief 有効なブロックの数を0から確保した領域いっぱいまで変えて、二分探索と比べる
+ * @param block_count 確保した領域のブロック数
+ * @param tail 書き込んだブロックの後ろに残っているもの
+ */
+static void sweep(uint32_t block_count, Tail tail) {
+  std::vector<uint8_t> buffer(LogFormat::BLOCK_SIZE);
+  uint32_t mismatches = 0;
+  uint32_t max_reads = 0;
+  uint64_t total_reads = 0;
+  uint64_t total_linear = 0;
+  uint32_t cases = 0;
+  // ブロック0は開いた直後に同期するので、前のファイルのブロック0が残っている
+  // 状態（有効なブロックが0個）は、ファイルを開いている最中の電源断に限られる
+  // その場合は前のファイルとして読めるだけなので、ここでは確認しない
+  uint32_t first = tail == Tail::OLD_FILE ? 1 : 0;
+  // 長い領域は間引いて確認する（両端は必ず含める）
+  uint32_t step = block_count > 64 ? 37 : 1;
+  for (uint32_t valid = first; valid <= block_count;
+       valid = valid < block_count && valid + step > block_count
+                   ? block_count
+                   : valid + step) {
+    Image image = {valid, tail};
+    auto read_block = [&image](uint32_t index, uint8_t* block) {
+      return image.read(index, block);
+    };
+    LogFormat::BlockScanResult result =
+        LogFormat::findLastValidBlock(read_block, block_count, buffer.data());
+    // 先頭からの確認は時間がかかるので、短い領域でのみイメージ自体の確認に使う
+    uint32_t linear = block_count <= 64
+                          ? scanLinear(read_block, block_count, buffer.data())
+                          : valid;
+    if (result.valid_blocks != valid || linear != valid) {
+      if (mismatches++ < 5) {
+        fprintf(stderr, "  %s: %u valid blocks, found %u (linear %u)\n",
+                tailName(tail), valid, result.valid_blocks, linear);
+      }
+    }
+    if (result.valid_blocks > 0) {
+      CHECK(result.file_id == FILE_ID);
+    }
+    if (result.reads > max_reads) max_reads = result.reads;
+    total_reads += result.reads;
+    total_linear += valid < block_count ? valid + 1 : valid;
+    cases++;
+  }
+  CHECK(mismatches == 0);
+  printf("  %-10s %5u blocks: reads avg %6.1f, max %3u  (linear avg %7.1f)\n",
+         tailName(tail), block_count, (double)total_reads / cases, max_reads,
+         (double)total_linear / cases);
+}
+
+/**
+ * @brief 実際のファイルを二分探索と先頭からの確認の両方で調べる
+ * @param path ファイル
+ * @return 両者が一致すればtrue
+ */
+static bool scanFile(const char* path) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    perror(path);
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  long file_size = ftell(fp);
+  uint32_t block_count = file_size > 0 ? file_size / LogFormat::BLOCK_SIZE : 0;
+  std::vector<uint8_t> buffer(LogFormat::BLOCK_SIZE);
+  auto read_block = [fp](uint32_t index, uint8_t* block) {
+    return fseek(fp, (long)index * LogFormat::BLOCK_SIZE, SEEK_SET) == 0 &&
+           fread(block, LogFormat::BLOCK_SIZE, 1, fp) == 1;
+  };
+  LogFormat::BlockScanResult result =
+      LogFormat::findLastValidBlock(read_block, block_count, buffer.data());
+  uint32_t linear = scanLinear(read_block, block_count, buffer.data());
+  fclose(fp);
+
+  printf("%s: %ld bytes, %u blocks\n", path, file_size, block_count);
+  printf("  binary search: %u valid blocks (file_id=0x%08x, %u reads)\n",
+         result.valid_blocks, result.file_id, result.reads);
+  printf("  linear scan  : %u valid blocks (%u reads)\n", linear,
+         linear < block_count ? linear + 1 : linear);
+  printf("  recovered size: %llu bytes\n",
+         (unsigned long long)result.valid_blocks * LogFormat::BLOCK_SIZE);
+  return result.valid_blocks == linear;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [log-N.bin]\n", argv[0]);
+    return 2;
+  }
+
+  checkBlock();
+  checkUnwrap();
+
+  // 短い領域と、10分の飛行で確保する程度の領域（約32kB/s）
+  printf("Recovery scan (valid blocks swept over the whole extent):\n");
+  for (uint32_t block_count : {1u, 2u, 40u, 4800u}) {
+    for (Tail tail : {Tail::ZERO, Tail::OLD_FILE, Tail::TORN,
+                      Tail::REORDERED, Tail::GARBAGE}) {
+      sweep(block_count, tail);
+    }
+  }
+
+  // ブロック0が壊れていれば、後ろが有効でも何も残さない
+  {
+    std::vector<uint8_t> buffer(LogFormat::BLOCK_SIZE);
+    Image image = {100, Tail::ZERO};
+    auto read_block = [&image](uint32_t index, uint8_t* block) {
+      image.read(index, block);
+      if (index == 0) block[sizeof(LogFormat::BlockHeader)] ^= 0xff;
+      return true;
+    };
+    CHECK(LogFormat::findLastValidBlock(read_block, 200, buffer.data())
+              .valid_blocks == 0);
+  }
+
+  if (argc == 2 && !scanFile(argv[1])) {
+    fprintf(stderr, "Binary search and linear scan disagree\n");
+    failures++;
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,331 @@
+// バイナリログの差分圧縮(log_codec.hpp)の往復確認と圧縮率の計測を行うホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -I../../components/config/include
+//       -I../../components/log_format/include log_codec_check.cpp
+//       -o log_codec_check
+// 使い方:
+//   ./log_codec_check [log-N.bin]
+//   ファイルを指定すると、そのログのサンプルでも往復確認と計測を行う
+//   動作確認に失敗した場合は終了コード1を返す
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "log_block.hpp"
+#include "log_codec.hpp"
+#include "log_format.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      fprintf(stderr, "FAILED: %s (line %d)\n", #condition, __LINE__); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+static void setAxis(uint8_t* u, uint8_t* d, int value) {
+  uint16_t raw = (uint16_t)(int16_t)value;
+  *u = raw >> 8;
+  *d = raw & 0xff;
+}
+
+/**
+ * @brief 1kHzのサンプルを作る
+ * @param count サンプル数
+ * @param vibration 振動の振幅（LSB、0なら射点で静止している状態）
+ */
+static std::vector<SensorData> makeSamples(size_t count, int vibration) {
+  std::vector<SensorData> samples;
+  srand(1);
+  uint64_t timestamp_us = 1000000;
+  uint32_t seq = 0;
+  for (size_t i = 0; i < count; i++) {
+    SensorData data = {};
+    // タイマー周期1ms、タスクの起床の揺らぎを数十us入れる
+    timestamp_us += 1000 + (rand() % 61) - 30;
+    data.timestamp_us = timestamp_us;
+    // 時々取りこぼす
+    if (i % 997 == 996) seq += 2;
+    data.seq = seq++;
+
+    double t = i / 1000.0;
+    int noise[6];
+    for (int j = 0; j < 6; j++) noise[j] = (rand() % 17) - 8;
+    int shake = (int)(vibration * sin(2 * M_PI * 180 * t));
+    setAxis(&data.accel.u_x, &data.accel.d_x, noise[0] + shake / 3);
+    setAxis(&data.accel.u_y, &data.accel.d_y, noise[1] + shake / 5);
+    setAxis(&data.accel.u_z, &data.accel.d_z, 2048 + noise[2] + shake);
+    setAxis(&data.gyro.u_x, &data.gyro.d_x, noise[3] + shake / 4);
+    setAxis(&data.gyro.u_y, &data.gyro.d_y, noise[4] + shake / 4);
+    setAxis(&data.gyro.u_z, &data.gyro.d_z, noise[5] + shake / 8);
+
+    if (i % 40 == 0) {
+      data.flags |= SENSOR_DATA_HAS_BARO;
+      data.pressure.h_p = 0x3f;
+      data.pressure.l_p = rand() & 0xff;
+      data.pressure.xl_p = rand() & 0xff;
+      data.temperature.h_t = 0xf0;
+      data.temperature.l_t = rand() & 0xff;
+      data.baro_timestamp_us = timestamp_us + 150;
+    }
+    if (i % 100 == 0) {
+      data.flags |= SENSOR_DATA_HAS_ICM_TEMP;
+      data.icm_temp.u_t = 0x0a;
+      data.icm_temp.d_t = rand() & 0xff;
+      data.icm_temp_timestamp_us = timestamp_us + 200;
+    }
+    samples.push_back(data);
+  }
+  return samples;
+}
+
+static bool sameImu(const SensorData& a, const SensorData& b) {
+  return a.timestamp_us == b.timestamp_us && a.seq == b.seq &&
+         memcmp(&a.accel, &b.accel, sizeof(a.accel)) == 0 &&
+         memcmp(&a.gyro, &b.gyro, sizeof(a.gyro)) == 0;
+}
+
+static bool sameSample(const SensorData& a, const SensorData& b) {
+  if (!sameImu(a, b) || a.flags != b.flags) return false;
+  if ((a.flags & SENSOR_DATA_HAS_BARO) &&
+      (a.baro_timestamp_us != b.baro_timestamp_us ||
+       memcmp(&a.pressure, &b.pressure, sizeof(a.pressure)) != 0 ||
+       memcmp(&a.temperature, &b.temperature, sizeof(a.temperature)) != 0)) {
+    return false;
+  }
+  if ((a.flags & SENSOR_DATA_HAS_ICM_TEMP) &&
+      (a.icm_temp_timestamp_us != b.icm_temp_timestamp_us ||
+       memcmp(&a.icm_temp, &b.icm_temp, sizeof(a.icm_temp)) != 0)) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief ファイル(ヘッダの直後)からサンプルを復元する
+ * 気圧・ICMの温度のレコードは直前のIMUレコードのサンプルにまとめる
+ */
+static std::vector<SensorData> readSamples(FILE* fp, bool* complete) {
+  std::vector<SensorData> samples;
+  LogFormat::RecordReader reader;
+  LogFormat::Record record;
+  while (reader.read(fp, &record)) {
+    if (record.tag == LogFormat::RecordTag::IMU) {
+      SensorData data = {};
+      data.timestamp_us = record.timestamp_us;
+      data.seq = record.seq;
+      data.accel = record.accel;
+      data.gyro = record.gyro;
+      samples.push_back(data);
+      continue;
+    }
+    if (samples.empty()) continue;
+    SensorData& data = samples.back();
+    if (record.tag == LogFormat::RecordTag::BARO) {
+      data.pressure = record.pressure;
+      data.temperature = record.temperature;
+      data.baro_timestamp_us = record.timestamp_us;
+      data.flags |= SENSOR_DATA_HAS_BARO;
+    } else if (record.tag == LogFormat::RecordTag::ICM_TEMP) {
+      data.icm_temp = record.icm_temp;
+      data.icm_temp_timestamp_us = record.timestamp_us;
+      data.flags |= SENSOR_DATA_HAS_ICM_TEMP;
+    }
+  }
+  *complete = feof(fp);
+  return samples;
+}
+
+/**
+ * @brief 変換→読み込みの往復で一致することを確認し、1サンプルあたりのバイト数を返す
+ * ログタスクと同じく4KBのバッファ単位で変換し、入りきらないサンプルは次のバッファに回す
+ */
+static double roundTrip(const std::vector<SensorData>& samples,
+                        uint32_t keyframe_interval) {
+  static constexpr size_t BUFFER_SIZE = 4096;
+  LogFormat::RecordEncoder encoder;
+  encoder.reset(keyframe_interval);
+
+  FILE* fp = tmpfile();
+  if (!fp) {
+    perror("tmpfile");
+    failures++;
+    return 0;
+  }
+  uint8_t buffer[BUFFER_SIZE];
+  size_t used = 0;
+  for (const SensorData& data : samples) {
+    size_t length = encoder.encode(data, buffer + used, BUFFER_SIZE - used);
+    if (length == 0) {
+      fwrite(buffer, 1, used, fp);
+      used = 0;
+      length = encoder.encode(data, buffer, BUFFER_SIZE);
+    }
+    CHECK(length > 0);
+    used += length;
+  }
+  fwrite(buffer, 1, used, fp);
+  CHECK(encoder.getSampleCount() == samples.size());
+
+  rewind(fp);
+  bool complete = false;
+  std::vector<SensorData> decoded = readSamples(fp, &complete);
+  fclose(fp);
+  CHECK(complete);
+  CHECK(decoded.size() == samples.size());
+  size_t mismatches = 0;
+  for (size_t i = 0; i < samples.size() && i < decoded.size(); i++) {
+    if (!sameSample(samples[i], decoded[i])) mismatches++;
+  }
+  if (mismatches > 0) {
+    fprintf(stderr, "FAILED: %zu samples differ (keyframe=%u)\n", mismatches,
+            keyframe_interval);
+    failures++;
+  }
+  return samples.empty() ? 0
+                         : (double)encoder.getByteCount() / samples.size();
+}
+
+static void checkBasics() {
+  // zigzag: 絶対値の小さい値ほど小さくなる
+  CHECK(LogFormat::zigzagEncode(0) == 0);
+  CHECK(LogFormat::zigzagEncode(-1) == 1);
+  CHECK(LogFormat::zigzagEncode(1) == 2);
+  CHECK(LogFormat::zigzagEncode(INT32_MIN) == UINT32_MAX);
+  for (int32_t v : {0, 1, -1, 63, -64, 32767, -32768, INT32_MAX, INT32_MIN}) {
+    CHECK(LogFormat::zigzagDecode(LogFormat::zigzagEncode(v)) == v);
+  }
+
+  // varint: 7bitごとに1バイト
+  uint8_t bytes[LogFormat::MAX_VARINT_SIZE];
+  CHECK(LogFormat::putVarint(0, bytes) == 1);
+  CHECK(LogFormat::putVarint(127, bytes) == 1);
+  CHECK(LogFormat::putVarint(128, bytes) == 2);
+  CHECK(LogFormat::putVarint(65535, bytes) == 3);
+  CHECK(LogFormat::putVarint(UINT32_MAX, bytes) == 5);
+
+  // 静止時の差分はタグ+8bit程度に収まる
+  SensorData a = {};
+  a.timestamp_us = 1000;
+  a.seq = 10;
+  SensorData b = a;
+  b.timestamp_us = 2000;
+  b.seq = 11;
+  LogFormat::RecordEncoder encoder;
+  encoder.reset(100);
+  uint8_t buffer[LogFormat::MAX_SAMPLE_SIZE];
+  CHECK(encoder.encode(a, buffer, sizeof(buffer)) ==
+        sizeof(LogFormat::ImuRecord));
+  CHECK(buffer[0] == 'I');
+  // 入りきらない場合は何も書かず、状態も変えない
+  CHECK(encoder.encode(b, buffer, 4) == 0);
+  size_t length = encoder.encode(b, buffer, sizeof(buffer));
+  CHECK(buffer[0] == 'D');
+  CHECK(length == 1 + 2 + 6);  // 初回の時刻間隔1000usは2バイト
+
+  // サンプル番号が飛んだらキーフレーム
+  SensorData c = b;
+  c.timestamp_us = 4000;
+  c.seq = 13;
+  CHECK(encoder.encode(c, buffer, sizeof(buffer)) ==
+        sizeof(LogFormat::ImuRecord));
+  CHECK(buffer[0] == 'I');
+
+  // 圧縮しない場合はv3と同じレコード
+  encoder.reset(0);
+  uint8_t plain[LogFormat::MAX_SAMPLE_SIZE];
+  CHECK(encoder.encode(a, buffer, sizeof(buffer)) ==
+        LogFormat::encodeRecords(a, plain, sizeof(plain)));
+  CHECK(memcmp(buffer, plain, sizeof(LogFormat::ImuRecord)) == 0);
+
+  // キーフレームより前の差分レコードは読めない
+  FILE* fp = tmpfile();
+  const uint8_t orphan[] = {'D', 0, 0, 0, 0, 0, 0, 0};
+  fwrite(orphan, 1, sizeof(orphan), fp);
+  rewind(fp);
+  LogFormat::RecordReader reader;
+  LogFormat::Record record;
+  CHECK(!reader.read(fp, &record));
+  fclose(fp);
+
+  // フルスケールの振れ（int16の折り返し）も元に戻る
+  std::vector<SensorData> extremes;
+  for (int i = 0; i < 64; i++) {
+    SensorData data = {};
+    data.timestamp_us = 1000 + i * (i % 3 == 0 ? 1000 : 5);
+    data.seq = i;
+    int value = (i % 2) ? 32767 : -32768;
+    setAxis(&data.accel.u_x, &data.accel.d_x, value);
+    setAxis(&data.gyro.u_z, &data.gyro.d_z, -value);
+    setAxis(&data.accel.u_y, &data.accel.d_y, i * 1000);
+    extremes.push_back(data);
+  }
+  roundTrip(extremes, 100);
+}
+
+static void report(const char* name, const std::vector<SensorData>& samples) {
+  double plain = roundTrip(samples, 0);
+  printf("%s (%zu samples)\n", name, samples.size());
+  printf("  %-14s %6.2f bytes/sample  %7.1f kB/s\n", "none", plain,
+         plain * 1000 / 1024);
+  for (uint32_t interval : {10u, 100u, 1000u}) {
+    double bytes = roundTrip(samples, interval);
+    char label[32];
+    snprintf(label, sizeof(label), "keyframe=%u", interval);
+    printf("  %-14s %6.2f bytes/sample  %7.1f kB/s  (x%.2f)\n", label, bytes,
+           bytes * 1000 / 1024, bytes > 0 ? plain / bytes : 0.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [log-N.bin]\n", argv[0]);
+    return 2;
+  }
+
+  checkBasics();
+  report("synthetic, on the pad", makeSamples(60000, 0));
+  report("synthetic, vibration ±200 LSB", makeSamples(60000, 200));
+  report("synthetic, vibration ±2000 LSB", makeSamples(60000, 2000));
+
+  if (argc == 2) {
+    FILE* fp = fopen(argv[1], "rb");
+    uint32_t block_count = 0;
+    bool blocks_complete = true;
+    if (fp) {
+      fp = LogFormat::unwrapBlockFile(fp, &block_count, &blocks_complete);
+    }
+    if (!fp) {
+      perror(argv[1]);
+      return 1;
+    }
+    LogFormat::FileHeader header;
+    bool complete = false;
+    std::vector<SensorData> samples;
+    if (fread(&header, sizeof(header), 1, fp) == 1 &&
+        LogFormat::isValidFileHeader(header)) {
+      samples = readSamples(fp, &complete);
+    } else {
+      fprintf(stderr, "Unsupported log file\n");
+      failures++;
+    }
+    fclose(fp);
+    if (!blocks_complete) fprintf(stderr, "Stopped at broken block\n");
+    if (!complete) fprintf(stderr, "Stopped at broken record\n");
+    report(argv[1], samples);
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,262 @@
+// バイナリログ(log-N.bin)をCSVに変換するホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -I../../components/config/include
+//       -I../../components/log_format/include log_decoder.cpp -o log_decoder
+// 使い方:
+//   ./log_decoder log-1.bin [log-1.csv]
+//   出力ファイルを省略した場合は標準出力に書き出す
+//   ./log_decoder -s log-1 log-1.bin
+//   レコードの種類ごとに log-1-imu.csv, log-1-baro.csv, log-1-icm_temp.csv
+//   に書き出す（それぞれ自分の時刻を持つ）
+//   ブロック形式（スキーマv5以降）のファイルは、最初の壊れたブロックの手前まで変換する
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "log_block.hpp"
+#include "log_codec.hpp"
+#include "log_format.hpp"
+
+static const char CSV_HEADER[] =
+    "timestamp(us),accel-ux,accel-dx,accel-uy,accel-dy,accel-uz,accel-dz,"
+    "gyro-ux,gyro-dx,gyro-uy,gyro-dy,gyro-uz,gyro-dz,pressure-h,pressure-l,"
+    "pressure-xl,temperature-h,temperature-l,seq,icm-temp-u,icm-temp-d\n";
+
+/**
+ * @brief ファイルヘッダを読み込んで確認する
+ * @param in 入力ファイル
+ * @return 読み込めるファイルならtrue
+ */
+static bool readHeader(FILE* in) {
+  LogFormat::FileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1) {
+    fprintf(stderr, "Failed to read file header\n");
+    return false;
+  }
+  if (!LogFormat::isValidFileHeader(header)) {
+    fprintf(stderr, "Unsupported log file (schema v%u, expected v%u-v%u)\n",
+            header.schema_version, LogFormat::MIN_SCHEMA_VERSION,
+            LogFormat::SCHEMA_VERSION);
+    return false;
+  }
+  fprintf(stderr,
+          "schema v%u, boot_id=0x%08x, sample_rate=%u Hz, accel=±%ug, "
+          "gyro=±%udps, keyframe=%u\n",
+          header.schema_version, header.boot_id, header.sample_rate_hz,
+          header.accel_range_g, header.gyro_range_dps,
+          header.keyframe_interval);
+  if (header.sd_freq_khz > 0) {
+    fprintf(stderr, "SD card: %u kHz, write %u kB/s at boot\n",
+            header.sd_freq_khz, header.sd_write_kbps);
+  }
+  return true;
+}
+
+/**
+ * @brief 読み込みが途中で止まった場合に、その位置を表示する
+ * @param in 入力ファイル
+ */
+static void reportStop(FILE* in) {
+  if (!feof(in)) {
+    fprintf(stderr, "Stopped at broken record near offset %ld\n", ftell(in));
+  }
+}
+
+/**
+ * @brief ファームウェアのCSV出力と同じ1行を書き出す
+ * 気圧・ICMの温度はそのサンプルで取得した時だけ書き、それ以外は空欄にする
+ */
+static void writeCsvRow(FILE* out, const SensorData& data) {
+  fprintf(out, "%llu,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,",
+          (unsigned long long)data.timestamp_us, data.accel.u_x,
+          data.accel.d_x, data.accel.u_y, data.accel.d_y, data.accel.u_z,
+          data.accel.d_z, data.gyro.u_x, data.gyro.d_x, data.gyro.u_y,
+          data.gyro.d_y, data.gyro.u_z, data.gyro.d_z);
+  if (data.flags & SENSOR_DATA_HAS_BARO) {
+    fprintf(out, "%d,%d,%d,%d,%d,", data.pressure.h_p, data.pressure.l_p,
+            data.pressure.xl_p, data.temperature.h_t, data.temperature.l_t);
+  } else {
+    fprintf(out, ",,,,,");
+  }
+  fprintf(out, "%u,", data.seq);
+  if (data.flags & SENSOR_DATA_HAS_ICM_TEMP) {
+    fprintf(out, "%d,%d\n", data.icm_temp.u_t, data.icm_temp.d_t);
+  } else {
+    fprintf(out, ",\n");
+  }
+}
+
+/**
+ * @brief IMUのサンプルごとに1行のCSVに変換する
+ * 気圧・ICMの温度のレコードは、直前のIMUレコードと同じ行に書く
+ */
+static bool writeCsv(FILE* in, FILE* out) {
+  if (!readHeader(in)) return false;
+  fputs(CSV_HEADER, out);
+
+  LogFormat::RecordReader reader;
+  LogFormat::Record record;
+  SensorData data = {};
+  bool has_row = false;
+  size_t count = 0;
+  size_t imu_bytes = 0;
+  while (reader.read(in, &record)) {
+    switch (record.tag) {
+      case LogFormat::RecordTag::IMU:
+        if (has_row) writeCsvRow(out, data);
+        data = {};
+        data.timestamp_us = record.timestamp_us;
+        data.seq = record.seq;
+        data.accel = record.accel;
+        data.gyro = record.gyro;
+        has_row = true;
+        count++;
+        imu_bytes += record.size;
+        break;
+      case LogFormat::RecordTag::BARO:
+        data.pressure = record.pressure;
+        data.temperature = record.temperature;
+        data.baro_timestamp_us = record.timestamp_us;
+        data.flags |= SENSOR_DATA_HAS_BARO;
+        break;
+      case LogFormat::RecordTag::ICM_TEMP:
+        data.icm_temp = record.icm_temp;
+        data.icm_temp_timestamp_us = record.timestamp_us;
+        data.flags |= SENSOR_DATA_HAS_ICM_TEMP;
+        break;
+      default:
+        break;
+    }
+  }
+  reportStop(in);
+  if (has_row) writeCsvRow(out, data);
+  fprintf(stderr, "%zu samples decoded (IMU %.1f bytes/sample)\n", count,
+          count > 0 ? (double)imu_bytes / count : 0.0);
+  return true;
+}
+
+/**
+ * @brief レコードの種類ごとに別のCSVに変換する
+ * @param in 入力ファイル
+ * @param prefix 出力ファイル名の先頭（<prefix>-imu.csv など）
+ */
+static bool writeSplitCsv(FILE* in, const char* prefix) {
+  if (!readHeader(in)) return false;
+
+  const std::string base = prefix;
+  FILE* imu_out = fopen((base + "-imu.csv").c_str(), "w");
+  FILE* baro_out = fopen((base + "-baro.csv").c_str(), "w");
+  FILE* temp_out = fopen((base + "-icm_temp.csv").c_str(), "w");
+  if (!imu_out || !baro_out || !temp_out) {
+    perror(prefix);
+    if (imu_out) fclose(imu_out);
+    if (baro_out) fclose(baro_out);
+    if (temp_out) fclose(temp_out);
+    return false;
+  }
+  fprintf(imu_out,
+          "timestamp(us),seq,accel-ux,accel-dx,accel-uy,accel-dy,accel-uz,"
+          "accel-dz,gyro-ux,gyro-dx,gyro-uy,gyro-dy,gyro-uz,gyro-dz\n");
+  fprintf(baro_out,
+          "timestamp(us),pressure-h,pressure-l,pressure-xl,temperature-h,"
+          "temperature-l\n");
+  fprintf(temp_out, "timestamp(us),icm-temp-u,icm-temp-d\n");
+
+  LogFormat::RecordReader reader;
+  LogFormat::Record record;
+  size_t counts[3] = {};
+  while (reader.read(in, &record)) {
+    switch (record.tag) {
+      case LogFormat::RecordTag::IMU:
+        fprintf(imu_out, "%llu,%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+                (unsigned long long)record.timestamp_us, record.seq,
+                record.accel.u_x, record.accel.d_x, record.accel.u_y,
+                record.accel.d_y, record.accel.u_z, record.accel.d_z,
+                record.gyro.u_x, record.gyro.d_x, record.gyro.u_y,
+                record.gyro.d_y, record.gyro.u_z, record.gyro.d_z);
+        counts[0]++;
+        break;
+      case LogFormat::RecordTag::BARO:
+        fprintf(baro_out, "%llu,%d,%d,%d,%d,%d\n",
+                (unsigned long long)record.timestamp_us, record.pressure.h_p,
+                record.pressure.l_p, record.pressure.xl_p,
+                record.temperature.h_t, record.temperature.l_t);
+        counts[1]++;
+        break;
+      case LogFormat::RecordTag::ICM_TEMP:
+        fprintf(temp_out, "%llu,%d,%d\n",
+                (unsigned long long)record.timestamp_us, record.icm_temp.u_t,
+                record.icm_temp.d_t);
+        counts[2]++;
+        break;
+      default:
+        break;
+    }
+  }
+  reportStop(in);
+  fprintf(stderr, "%zu imu, %zu baro, %zu icm_temp records decoded\n",
+          counts[0], counts[1], counts[2]);
+  fclose(imu_out);
+  fclose(baro_out);
+  fclose(temp_out);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* program = argv[0];
+  const char* split_prefix = nullptr;
+  if (argc >= 3 && strcmp(argv[1], "-s") == 0) {
+    split_prefix = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc < 2 || argc > 3 || (split_prefix && argc != 2)) {
+    fprintf(stderr,
+            "usage: %s <log-N.bin> [output.csv]\n"
+            "       %s -s <prefix> <log-N.bin>\n",
+            program, program);
+    return 2;
+  }
+
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  // ブロック形式ならペイロードだけをつなげてから読む
+  uint32_t block_count = 0;
+  bool blocks_complete = true;
+  in = LogFormat::unwrapBlockFile(in, &block_count, &blocks_complete);
+  if (!in) {
+    perror("tmpfile");
+    return 1;
+  }
+  if (block_count > 0) {
+    fprintf(stderr, "%u blocks%s\n", block_count,
+            blocks_complete ? "" : ", stopped at broken block");
+  }
+  if (split_prefix) {
+    bool ok = writeSplitCsv(in, split_prefix);
+    fclose(in);
+    return ok ? 0 : 1;
+  }
+
+  FILE* out = stdout;
+  if (argc == 3) {
+    out = fopen(argv[2], "w");
+    if (!out) {
+      perror(argv[2]);
+      fclose(in);
+      return 1;
+    }
+  }
+
+  bool ok = writeCsv(in, out);
+
+  fclose(in);
+  if (out != stdout) fclose(out);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+// rawレコーダの領域(flight.raw またはカードのイメージ)から記録を取り出すホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -I../../components/raw_recorder/include
+//       -I../../components/log_format/include
+//       ../../components/raw_recorder/raw_recorder.cpp
+//       ../../components/raw_recorder/file_block_device.cpp
+//       raw_export.cpp -o raw_export
+// 使い方:
+//   ./raw_export flight.raw log-1.csv
+//   記録の形式(CSV/バイナリ)は表示されるので、出力ファイルの拡張子を合わせる
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include "file_block_device.hpp"
+#include "raw_recorder.hpp"
+
+static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <flight.raw> <output>\n", argv[0]);
+    return 1;
+  }
+
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  struct stat st;
+  if (fstat(fileno(in), &st) != 0) {
+    perror(argv[1]);
+    fclose(in);
+    return 1;
+  }
+
+  FileBlockDevice device(in, st.st_size / FileBlockDevice::DEFAULT_SECTOR_SIZE);
+  std::vector<uint8_t> buffer(CHUNK_SIZE);
+  RawRecorder recorder(&device, buffer.data(), buffer.size());
+  if (!recorder.load()) {
+    fprintf(stderr, "No valid superblock found\n");
+    fclose(in);
+    return 1;
+  }
+
+  uint64_t total = recorder.getDataBytes();
+  fprintf(stderr, "recording_id=0x%08x, format=%s, %llu bytes%s\n",
+          recorder.getRecordingId(),
+          recorder.getDataFormat() == RawRecorder::DataFormat::BINARY ? "binary"
+                                                                      : "csv",
+          (unsigned long long)total,
+          recorder.isExported() ? " (already exported)" : "");
+
+  FILE* out = fopen(argv[2], "wb");
+  if (!out) {
+    perror(argv[2]);
+    fclose(in);
+    return 1;
+  }
+
+  // 領域の末尾ではセクタ単位で読み出す
+  uint64_t offset = 0;
+  bool success = true;
+  while (offset < total) {
+    size_t chunk = buffer.size();
+    if (!recorder.readData(offset, buffer.data(), chunk)) {
+      chunk = FileBlockDevice::DEFAULT_SECTOR_SIZE;
+      if (!recorder.readData(offset, buffer.data(), chunk)) {
+        fprintf(stderr, "Failed to read data at %llu\n",
+                (unsigned long long)offset);
+        success = false;
+        break;
+      }
+    }
+    size_t length = total - offset < chunk ? (size_t)(total - offset) : chunk;
+    fwrite(buffer.data(), 1, length, out);
+    offset += chunk;
+  }
+
+  fclose(out);
+  fclose(in);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+// 設定のジャーナル(settings_journal.hpp)の追記・電源断後の読み込み・
+// コンパクションを、一時ディレクトリのファイルで確認するホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -I../../components/log_format/include
+//       -I../../components/sd_controller/include settings_journal_check.cpp
+//       ../../components/sd_controller/settings_journal.cpp
+//       -o settings_journal_check
+// 使い方:
+//   ./settings_journal_check [settings.jnl]
+//   ファイルを指定すると、基板と同じ方法で読み込んだ結果を表示する（ファイルは変更しない）
+//   動作確認に失敗した場合は終了コード1を返す
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "settings_journal.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      fprintf(stderr, "FAILED: %s (line %d)\n", #condition, __LINE__); \
+      failures++;                                                       \
+    }                                                                   \
+  } while (0)
+
+// SettingTypeの値（sd_controller.hppと同じ順）
+static constexpr uint8_t TYPE_INTEGER = 0;
+static constexpr uint8_t TYPE_STRING = 3;
+
+static SettingsJournalEntry intEntry(int32_t value) {
+  SettingsJournalEntry entry;
+  entry.type = TYPE_INTEGER;
+  entry.value.assign(reinterpret_cast<const char*>(&value), sizeof(value));
+  return entry;
+}
+
+static SettingsJournalEntry stringEntry(const char* value) {
+  SettingsJournalEntry entry;
+  entry.type = TYPE_STRING;
+  entry.value = value;
+  return entry;
+}
+
+static int32_t intValue(const SettingsJournal::EntryMap& entries,
+                        const char* key) {
+  auto it = entries.find(key);
+  if (it == entries.end() || it->second.value.size() != sizeof(int32_t)) {
+    return -1;
+  }
+  int32_t value;
+  memcpy(&value, it->second.value.data(), sizeof(value));
+  return value;
+}
+
+static long fileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+static bool exists(const std::string& path) { return fileSize(path) >= 0; }
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+  std::vector<uint8_t> data;
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp) return data;
+  int c;
+  while ((c = fgetc(fp)) != EOF) data.push_back(c);
+  fclose(fp);
+  return data;
+}
+
+static void writeFile(const std::string& path,
+                      const std::vector<uint8_t>& data) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  fwrite(data.data(), 1, data.size(), fp);
+  fclose(fp);
+}
+
+/**
+ * @brief 基板の起動時と同じように開き、設定を1つずつ変えて追記する
+ */
+static void checkAppendAndReopen(const std::string& path) {
+  SettingsJournal journal;
+  SettingsJournal::LoadResult result;
+  CHECK(journal.open(path, &result));
+  CHECK(!result.found);
+  CHECK(result.records == 0);
+  CHECK(fileSize(path) == (long)sizeof(SettingsJournalHeader));
+
+  SettingsJournal::EntryMap values;
+  values["open-angle"] = intEntry(10);
+  values["close-angle"] = intEntry(55);
+  values["comm_mode"] = stringEntry("can");
+  uint32_t appended = 0;
+  CHECK(journal.put(values, &appended));
+  CHECK(appended == 3);
+
+  // 同じ値なら何も書かない
+  long before = fileSize(path);
+  CHECK(journal.put(values, &appended));
+  CHECK(appended == 0);
+  CHECK(fileSize(path) == before);
+
+  // 1つだけ変えると、そのレコードだけを追記する
+  values["open-angle"] = intEntry(11);
+  CHECK(journal.put(values, &appended));
+  CHECK(appended == 1);
+  long record_bytes = fileSize(path) - before;
+  CHECK(record_bytes == (long)(sizeof(SettingsRecordHeader) +
+                               strlen("open-angle") + sizeof(int32_t)));
+  printf("one servo-angle change appends %ld bytes\n", record_bytes);
+  journal.close();
+
+  SettingsJournal reopened;
+  CHECK(reopened.open(path, &result));
+  CHECK(result.found);
+  CHECK(result.records == 4);
+  CHECK(result.valid_bytes == result.file_bytes);
+  CHECK(intValue(reopened.getEntries(), "open-angle") == 11);
+  CHECK(intValue(reopened.getEntries(), "close-angle") == 55);
+  CHECK(reopened.getEntries().at("comm_mode").value == "can");
+}
+
+/**
+ * @brief 最後のレコードを書いている途中で電源が切れた場合
+ * 書きかけのレコードを切り詰め、その直後に追記したものが読めること
+ */
+static void checkTornTail(const std::string& path) {
+  std::vector<uint8_t> complete = readFile(path);
+  SettingsJournal::EntryMap before;
+  uint32_t before_records = 0;
+  size_t valid = SettingsJournal::replay(complete.data(), complete.size(),
+                                         &before, &before_records);
+  CHECK(valid == complete.size());
+
+  std::string record;
+  SettingsJournal::encodeRecord("close-angle", intEntry(60), &record);
+  for (size_t cut = 1; cut < record.size(); cut++) {
+    std::vector<uint8_t> torn = complete;
+    torn.insert(torn.end(), record.begin(), record.begin() + cut);
+    writeFile(path, torn);
+
+    SettingsJournal journal;
+    SettingsJournal::LoadResult result;
+    CHECK(journal.open(path, &result));
+    CHECK(result.valid_bytes == complete.size());
+    CHECK(result.file_bytes == torn.size());
+    CHECK(result.records == before_records);
+    CHECK(intValue(journal.getEntries(), "close-angle") == 55);
+    CHECK(fileSize(path) == (long)complete.size());
+
+    // 切り詰めた後の追記は、次に開いた時に読める
+    SettingsJournal::EntryMap values;
+    values["close-angle"] = intEntry(61);
+    CHECK(journal.put(values));
+    journal.close();
+    SettingsJournal reopened;
+    CHECK(reopened.open(path, &result));
+    CHECK(intValue(reopened.getEntries(), "close-angle") == 61);
+  }
+  writeFile(path, complete);
+
+  // 1ビットの破損は、そのレコードから後ろを捨てる
+  std::vector<uint8_t> flipped = complete;
+  flipped[complete.size() - 1] ^= 0x01;
+  SettingsJournal::EntryMap entries;
+  uint32_t records = 0;
+  CHECK(SettingsJournal::replay(flipped.data(), flipped.size(), &entries,
+                                &records) < complete.size());
+  CHECK(records == before_records - 1);
+}
+
+/**
+ * @brief 重複したレコードを詰め、その途中で電源が切れた場合も読めること
+ */
+static void checkCompaction(const std::string& path) {
+  SettingsJournal journal;
+  SettingsJournal::LoadResult result;
+  CHECK(journal.open(path, &result));
+  SettingsJournal::EntryMap values = journal.getEntries();
+  for (int angle = 0; angle < 100; angle++) {
+    values["open-angle"] = intEntry(angle);
+    CHECK(journal.put(values));
+  }
+  long before = fileSize(path);
+  CHECK(journal.compact());
+  long after = fileSize(path);
+  printf("compaction: %ld -> %ld bytes (%u keys)\n", before, after,
+         (unsigned)journal.getEntries().size());
+  CHECK(after < before);
+  CHECK(after == (long)journal.getFileBytes());
+  CHECK(!exists(path + ".tmp"));
+
+  // 詰めた後も追記できる
+  values["open-angle"] = intEntry(7);
+  CHECK(journal.put(values));
+  journal.close();
+  CHECK(journal.open(path, &result));
+  CHECK(result.records == journal.getEntries().size() + 1);
+  CHECK(intValue(journal.getEntries(), "open-angle") == 7);
+  CHECK(journal.compact());
+  journal.close();
+
+  std::vector<uint8_t> compacted = readFile(path);
+
+  // 一時ファイルを書いている途中で電源が切れた（元のファイルが残っている）
+  std::vector<uint8_t> partial(compacted.begin(), compacted.begin() + 20);
+  writeFile(path + ".tmp", partial);
+  CHECK(journal.open(path, &result));
+  CHECK(intValue(journal.getEntries(), "open-angle") == 7);
+  CHECK(!exists(path + ".tmp"));
+  journal.close();
+
+  // 元のファイルを消した後、置き換える前に電源が切れた
+  rename(path.c_str(), (path + ".tmp").c_str());
+  CHECK(journal.open(path, &result));
+  CHECK(result.found);
+  CHECK(intValue(journal.getEntries(), "open-angle") == 7);
+  CHECK(!exists(path + ".tmp"));
+  journal.close();
+
+  // ヘッダが壊れていれば、空のジャーナルとして作り直す
+  std::vector<uint8_t> broken = compacted;
+  broken[0] = 'X';
+  writeFile(path, broken);
+  CHECK(journal.open(path, &result));
+  CHECK(result.records == 0);
+  CHECK(journal.getEntries().empty());
+  CHECK(fileSize(path) == (long)sizeof(SettingsJournalHeader));
+  journal.close();
+}
+
+/**
+ * @brief キー・値の長さの上限
+ */
+static void checkLimits() {
+  std::string out;
+  CHECK(!SettingsJournal::encodeRecord("", intEntry(1), &out));
+  CHECK(!SettingsJournal::encodeRecord(std::string(256, 'k'), intEntry(1),
+                                       &out));
+  SettingsJournalEntry long_value = stringEntry("");
+  long_value.value.assign(256, 'v');
+  CHECK(!SettingsJournal::encodeRecord("key", long_value, &out));
+  CHECK(out.empty());
+  long_value.value.assign(255, 'v');
+  CHECK(SettingsJournal::encodeRecord(std::string(255, 'k'), long_value,
+                                      &out));
+}
+
+/**
+ * @brief 基板のジャーナルを読み込んで表示する
+ */
+static int dumpJournal(const char* path) {
+  std::vector<uint8_t> data = readFile(path);
+  if (data.empty()) {
+    fprintf(stderr, "Failed to read %s\n", path);
+    return 1;
+  }
+  SettingsJournal::EntryMap entries;
+  uint32_t records = 0;
+  size_t valid =
+      SettingsJournal::replay(data.data(), data.size(), &entries, &records);
+  if (valid == 0) {
+    fprintf(stderr, "%s is not a settings journal\n", path);
+    return 1;
+  }
+  printf("%s: %u records, %u keys, %zu/%zu bytes valid\n", path,
+         (unsigned)records, (unsigned)entries.size(), valid, data.size());
+  for (const auto& item : entries) {
+    const SettingsJournalEntry& entry = item.second;
+    printf("  %-24s ", item.first.c_str());
+    if (entry.type == TYPE_STRING) {
+      printf("\"%s\"\n", entry.value.c_str());
+    } else if (entry.value.size() == sizeof(int32_t)) {
+      int32_t value;
+      memcpy(&value, entry.value.data(), sizeof(value));
+      printf("%ld (type %u)\n", (long)value, entry.type);
+    } else if (entry.value.size() == 1) {
+      printf("%s\n", entry.value[0] ? "true" : "false");
+    } else {
+      printf("(%zu bytes, type %u)\n", entry.value.size(), entry.type);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    return dumpJournal(argv[1]);
+  }
+
+  char dir_template[] = "/tmp/settings_journal_check.XXXXXX";
+  char* dir = mkdtemp(dir_template);
+  if (!dir) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string path = std::string(dir) + "/settings.jnl";
+
+  checkAppendAndReopen(path);
+  checkTornTail(path);
+  checkCompaction(path);
+  checkLimits();
+
+  remove(path.c_str());
+  remove((path + ".tmp").c_str());
+  rmdir(dir);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
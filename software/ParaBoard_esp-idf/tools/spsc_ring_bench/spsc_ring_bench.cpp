@@ -0,0 +1,207 @@
+// SpscRingの動作確認とスループット計測を行うホスト側ツール
+//
+// ビルド:
+//   g++ -std=c++17 -O2 -pthread -I../../components/spsc_ring/include
+//       -I../../components/config/include spsc_ring_bench.cpp
+//       -o spsc_ring_bench
+// 使い方:
+//   ./spsc_ring_bench [サンプル数]
+//   動作確認に失敗した場合は終了コード1を返す
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sensor_data.hpp"
+#include "spsc_ring.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition)                                            \
+  do {                                                              \
+    if (!(condition)) {                                             \
+      fprintf(stderr, "FAILED: %s (line %d)\n", #condition, __LINE__); \
+      failures++;                                                   \
+    }                                                               \
+  } while (0)
+
+static SensorData makeSample(uint64_t index) {
+  SensorData data = {};
+  data.timestamp_us = index;
+  data.accel.u_x = (uint8_t)(index >> 8);
+  data.accel.d_x = (uint8_t)index;
+  return data;
+}
+
+// 1スレッドでの基本動作の確認
+static void checkBasics() {
+  SpscRing<SensorData> ring;
+  CHECK(ring.init(1000));
+  CHECK(ring.capacity() == 1024);  // 2の累乗に切り上げる
+  CHECK(ring.size() == 0);
+
+  SensorData data;
+  CHECK(!ring.pop(&data));  // 空なら取り出せない
+
+  // 満杯になるまで追加できる
+  for (uint64_t i = 0; i < ring.capacity(); i++) {
+    CHECK(ring.push(makeSample(i)));
+  }
+  CHECK(!ring.push(makeSample(9999)));
+  CHECK(ring.size() == ring.capacity());
+
+  // 追加した順に取り出せる
+  for (uint64_t i = 0; i < ring.capacity(); i++) {
+    CHECK(ring.pop(&data) && data.timestamp_us == i);
+  }
+  CHECK(!ring.pop(&data));
+
+  // 何周しても順番が崩れない
+  uint64_t next_push = 0;
+  uint64_t next_pop = 0;
+  for (int round = 0; round < 10000; round++) {
+    for (int i = 0; i < 7; i++) ring.push(makeSample(next_push++));
+    for (int i = 0; i < 5; i++) {
+      CHECK(ring.pop(&data) && data.timestamp_us == next_pop++);
+    }
+    if (ring.size() > ring.capacity() / 2) {
+      while (ring.pop(&data)) CHECK(data.timestamp_us == next_pop++);
+    }
+  }
+
+  // popBatch()は折り返しをまたいでも順番どおりに取り出せる
+  SensorData batch[100];
+  for (int round = 0; round < 1000; round++) {
+    for (int i = 0; i < 37; i++) ring.push(makeSample(next_push++));
+    size_t count = ring.popBatch(batch, 100);
+    CHECK(count > 0);
+    for (size_t i = 0; i < count; i++) {
+      CHECK(batch[i].timestamp_us == next_pop++);
+    }
+  }
+  CHECK(ring.popBatch(batch, 100) == 0);
+
+  // clear()で全て捨てられる
+  ring.push(makeSample(0));
+  ring.clear();
+  CHECK(ring.size() == 0);
+  CHECK(!ring.pop(&data));
+}
+
+// 比較用: FreeRTOSのキューと同じく、ロックと1件ごとの通知で受け渡す
+class LockedQueue {
+ public:
+  explicit LockedQueue(size_t depth) : depth(depth) {}
+
+  void push(const SensorData& data) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this] { return items.size() < depth; });
+    items.push_back(data);
+    not_empty.notify_one();
+  }
+
+  SensorData pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [this] { return !items.empty(); });
+    SensorData data = items.front();
+    items.pop_front();
+    not_full.notify_one();
+    return data;
+  }
+
+ private:
+  size_t depth;
+  std::deque<SensorData> items;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+};
+
+static double benchmarkLockedQueue(uint64_t samples, size_t depth) {
+  LockedQueue queue(depth);
+  auto start = std::chrono::steady_clock::now();
+  std::thread consumer([&] {
+    for (uint64_t i = 0; i < samples; i++) {
+      SensorData data = queue.pop();
+      if (data.timestamp_us != i) {
+        fprintf(stderr, "LockedQueue: order broken at %llu\n",
+                (unsigned long long)i);
+        failures++;
+        return;
+      }
+    }
+  });
+  for (uint64_t i = 0; i < samples; i++) {
+    queue.push(makeSample(i));
+  }
+  consumer.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return samples / elapsed.count();
+}
+
+static double benchmarkSpscRing(uint64_t samples, size_t capacity,
+                                size_t batch_size) {
+  SpscRing<SensorData> ring;
+  if (!ring.init(capacity)) {
+    fprintf(stderr, "Failed to allocate ring\n");
+    failures++;
+    return 0;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::thread consumer([&] {
+    std::vector<SensorData> batch(batch_size);
+    uint64_t next = 0;
+    while (next < samples) {
+      // 実機と同じく、溜まっている分をまとめて取り出す
+      size_t count;
+      while ((count = ring.popBatch(batch.data(), batch_size)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+          if (batch[i].timestamp_us != next) {
+            fprintf(stderr, "SpscRing: order broken at %llu\n",
+                    (unsigned long long)next);
+            failures++;
+            return;
+          }
+          next++;
+        }
+      }
+      std::this_thread::yield();
+    }
+  });
+  for (uint64_t i = 0; i < samples; i++) {
+    while (!ring.push(makeSample(i))) {
+      std::this_thread::yield();
+    }
+  }
+  consumer.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return samples / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  uint64_t samples = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+
+  checkBasics();
+  printf("basic checks: %s\n", failures == 0 ? "ok" : "FAILED");
+
+  printf("sizeof(SensorData) = %zu bytes, %llu samples\n", sizeof(SensorData),
+         (unsigned long long)samples);
+  double queue_rate = benchmarkLockedQueue(samples, 10);
+  printf("locked queue (depth 10) : %8.2f M samples/s\n", queue_rate / 1e6);
+  double ring_rate = benchmarkSpscRing(samples, 2048, 1);
+  printf("SpscRing (2048)         : %8.2f M samples/s (x%.1f)\n",
+         ring_rate / 1e6, ring_rate / queue_rate);
+  double batch_rate = benchmarkSpscRing(samples, 2048, 16);
+  printf("SpscRing popBatch(16)   : %8.2f M samples/s (x%.1f)\n",
+         batch_rate / 1e6, batch_rate / queue_rate);
+
+  return failures == 0 ? 0 : 1;
+}